@@ -0,0 +1,82 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+#include "type_checker.h"
+
+#include <string>
+
+namespace {
+
+constexpr int kElements = 10000;
+constexpr int kRounds = 100;
+
+/**
+ * @brief Two arrays of `kElements` numbers, then `kRounds` times
+ *        `a * b + 1` through `combine`, and the sum of the last elements.
+ */
+std::string script(char const *combine) {
+  return std::string(combine) +
+         "var n = " + std::to_string(kElements) +
+         ";\n"
+         "var a = [];\n"
+         "var b = [];\n"
+         "for (var i = 0; i < n; i = i + 1) {\n"
+         "  a[i] = i;\n"
+         "  b[i] = n - i;\n"
+         "}\n"
+         "var total = 0;\n"
+         "for (var round = 0; round < " +
+         std::to_string(kRounds) +
+         "; round = round + 1) {\n"
+         "  total = total + combine(a, b)[n - 1];\n"
+         "}\n"
+         "total\n";
+}
+
+/**
+ * An interpreted loop over the elements, one operator at a time.
+ */
+char const *const kLoop = "fun combine(a, b) {\n"
+                          "  var c = [];\n"
+                          "  for (var i = 0; i < len(a); i = i + 1) {\n"
+                          "    c[i] = a[i] * b[i] + 1;\n"
+                          "  }\n"
+                          "  return c;\n"
+                          "}\n";
+
+/**
+ * Whole arrays, through the SIMD kernels.
+ */
+char const *const kVectorized = "fun combine(a, b) { return a * b + 1; }\n";
+
+double run(std::string const &source, double &sink) {
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+  Lox::Interpreter interpreter;
+  Lox::Program program = Lox::Parser(tokens).parse_program();
+  Lox::Resolver(interpreter.natives()).resolve(program);
+  Lox::Optimizer().optimize(program);
+  Lox::TypeChecker().check(program);
+  return Lox::Bench::measure_ms([&] {
+    interpreter.interpret(program);
+    sink += interpreter.result().number();
+  });
+}
+
+} // namespace
+
+int main() {
+  double sink = 0;
+  double const loop_ms = run(script(kLoop), sink);
+  Lox::Bench::report("a * b + 1, element by element", loop_ms, loop_ms);
+  double const vectorized_ms = run(script(kVectorized), sink);
+  Lox::Bench::report("a * b + 1, on whole arrays", vectorized_ms, loop_ms);
+  // What both pay: building the arrays, element by element
+  double const build_ms =
+      run(script("fun combine(a, b) { return a; }\n"), sink);
+  Lox::Bench::report("building a and b alone", build_ms, loop_ms);
+  return sink != 0 ? 0 : 1;
+}
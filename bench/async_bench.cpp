@@ -0,0 +1,221 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kPrograms = 10000;
+
+/**
+ * How long the cache takes to answer a lookup, in the tables with latency.
+ * Blocking on it is slow, so fewer programs run then.
+ */
+constexpr auto kLatency = std::chrono::microseconds(100);
+constexpr int kLatencyPrograms = 1000;
+
+/**
+ * Each program makes 16 lookups, in a loop of a function: the calls between
+ * the program and the native are suspended along with it.
+ */
+char const *const kSource = R"(
+fun score(key, count) {
+  var total = 0;
+  for (var i = 0; i < count; i = i + 1) {
+    total = total + lookup(key + i) * 0.5 + i * i;
+  }
+  return total;
+}
+score(1, 8) + score(100, 8)
+)";
+
+/**
+ * @brief Wait until `ready`, which is the epoch for no latency. Spin rather
+ *        than sleep: sleeping overshoots by tens of microseconds, which
+ *        would add up over the blocking lookups.
+ */
+void wait_until(Clock::time_point ready) {
+  if (ready == Clock::time_point()) {
+    return;
+  }
+  while (Clock::now() < ready) {
+  }
+}
+
+/**
+ * A fake cache, whose lookups are answered `latency` after they were made,
+ * in that order, as a local sidecar would. Asynchronous lookups are answered
+ * by its event loop, blocking ones wait for their answer.
+ */
+class FakeCache {
+public:
+  explicit FakeCache(Clock::duration latency) : m_latency(latency) {}
+
+  Lox::Deferred lookup(double key) {
+    Lox::Deferred deferred;
+    m_pending.emplace_back(deferred, key * 2, ready_at());
+    m_peak = std::max(m_peak, m_pending.size());
+    return deferred;
+  }
+
+  double blocking_lookup(double key) const {
+    wait_until(ready_at());
+    return key * 2;
+  }
+
+  /**
+   * @brief Answer the lookups until there are none left, resuming the
+   *        programs which made them, and waiting for the answers which are
+   *        not ready yet.
+   */
+  void run() {
+    while (!m_pending.empty()) {
+      auto [deferred, value, ready] = std::move(m_pending.front());
+      m_pending.pop_front();
+      wait_until(ready);
+      deferred.resolve(value);
+    }
+  }
+
+  [[nodiscard]] std::size_t peak() const noexcept { return m_peak; }
+
+private:
+  [[nodiscard]] Clock::time_point ready_at() const {
+    return m_latency == Clock::duration::zero() ? Clock::time_point()
+                                                : Clock::now() + m_latency;
+  }
+
+private:
+  Clock::duration m_latency;
+  std::deque<std::tuple<Lox::Deferred, double, Clock::time_point>> m_pending;
+  std::size_t m_peak = 0;
+};
+
+/**
+ * @brief Interpreters for `count` programs, with a `lookup()` native to
+ *        `cache` which is asynchronous if `async` is set, and blocking
+ *        otherwise.
+ */
+std::vector<std::unique_ptr<Lox::Interpreter>>
+interpreters(int count, FakeCache &cache, bool async) {
+  std::vector<std::unique_ptr<Lox::Interpreter>> result;
+  for (int i = 0; i < count; ++i) {
+    auto &interpreter =
+        result.emplace_back(std::make_unique<Lox::Interpreter>());
+    interpreter->set_stack_size(256);
+    if (async) {
+      interpreter->natives().define(
+          "lookup", [&cache](double key) { return cache.lookup(key); });
+    } else {
+      interpreter->natives().define("lookup", [&cache](double key) {
+        return cache.blocking_lookup(key);
+      });
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief Run `program` on each of `interpreters`, one after the other,
+ *        adding up their results into `sink`.
+ */
+void run_blocking(
+    std::vector<std::unique_ptr<Lox::Interpreter>> const &interpreters,
+    Lox::Program &program, double &sink) {
+  for (auto const &interpreter : interpreters) {
+    interpreter->interpret(program);
+    sink += interpreter->result().number();
+  }
+}
+
+/**
+ * @brief Start `program` on all of `interpreters` at once, then run the
+ *        event loop of `cache` until they are all done, on this thread.
+ */
+void run_in_flight(
+    std::vector<std::unique_ptr<Lox::Interpreter>> const &interpreters,
+    Lox::Program &program, FakeCache &cache, double &sink) {
+  std::vector<Lox::Evaluation<Lox::Expected<Lox::Value>>> evaluations;
+  evaluations.reserve(interpreters.size());
+  for (auto const &interpreter : interpreters) {
+    evaluations.push_back(interpreter->start(program));
+  }
+  cache.run();
+  for (auto &evaluation : evaluations) {
+    sink += evaluation.result().value().number();
+  }
+}
+
+void report_throughput(char const *name, int programs, double ms) {
+  std::printf("%-40s %10.0f programs/s\n", name, programs * 1000 / ms);
+}
+
+} // namespace
+
+int main() {
+  std::string const source(kSource);
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+  FakeCache cache(Clock::duration::zero());
+  auto blocking = interpreters(kPrograms, cache, false);
+  auto async = interpreters(kPrograms, cache, true);
+  // The natives of all the interpreters have the same indexes
+  Lox::Program program = Lox::Parser(tokens).parse_program();
+  Lox::Resolver(blocking.front()->natives()).resolve(program);
+
+  // Without latency: the cost of suspending
+  double sink = 0;
+  double const blocking_ms = Lox::Bench::measure_ms(
+      [&] { run_blocking(blocking, program, sink); });
+  Lox::Bench::report("blocking lookups, one at a time", blocking_ms,
+                     blocking_ms);
+  double const async_ms = Lox::Bench::measure_ms(
+      [&] { run_in_flight(async, program, cache, sink); });
+  Lox::Bench::report("asynchronous lookups, all in flight", async_ms,
+                     blocking_ms);
+  std::printf("%zu lookups in flight at most, on one thread\n", cache.peak());
+
+  // The cost of suspending alone, without the working set of all the
+  // programs in flight
+  double const one_ms = Lox::Bench::measure_ms([&] {
+    for (auto &interpreter : async) {
+      auto evaluation = interpreter->start(program);
+      cache.run();
+      sink += evaluation.result().value().number();
+    }
+  });
+  Lox::Bench::report("asynchronous lookups, one at a time", one_ms,
+                     blocking_ms);
+
+  // With latency: while a blocking lookup waits, the thread is idle, while
+  // asynchronous ones wait together and the thread runs the other programs
+  std::printf("\nlookups answered in %lld us\n",
+              static_cast<long long>(kLatency.count()));
+  FakeCache slow_cache(kLatency);
+  auto slow_blocking = interpreters(kLatencyPrograms, slow_cache, false);
+  auto slow_async = interpreters(kLatencyPrograms, slow_cache, true);
+  double const slow_blocking_ms = Lox::Bench::measure_ms(
+      [&] { run_blocking(slow_blocking, program, sink); }, 1);
+  Lox::Bench::report("blocking lookups, one at a time", slow_blocking_ms,
+                     slow_blocking_ms);
+  double const slow_async_ms = Lox::Bench::measure_ms(
+      [&] { run_in_flight(slow_async, program, slow_cache, sink); });
+  Lox::Bench::report("asynchronous lookups, all in flight", slow_async_ms,
+                     slow_blocking_ms);
+  report_throughput("blocking lookups, one at a time", kLatencyPrograms,
+                    slow_blocking_ms);
+  report_throughput("asynchronous lookups, all in flight", kLatencyPrograms,
+                    slow_async_ms);
+  return sink != 0 ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+
+namespace Lox::Bench {
+
+/**
+ * @brief Run `fn` `repeat` times and return the fastest run in milliseconds.
+ */
+template <typename F> double measure_ms(F &&fn, int repeat = 5) {
+  double best = std::numeric_limits<double>::max();
+  for (int i = 0; i < repeat; ++i) {
+    auto const start = std::chrono::steady_clock::now();
+    fn();
+    auto const stop = std::chrono::steady_clock::now();
+    best = std::min(
+        best,
+        std::chrono::duration<double, std::milli>(stop - start).count());
+  }
+  return best;
+}
+
+/**
+ * @brief Print one row of a benchmark table.
+ */
+inline void report(char const *name, double ms, double baseline_ms) {
+  std::printf("%-40s %10.3f ms %8.2fx\n", name, ms, baseline_ms / ms);
+}
+
+} // namespace Lox::Bench
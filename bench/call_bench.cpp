@@ -0,0 +1,103 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief A script counting a linked list of `length` nodes `runs` times,
+ *        recursively. There are no loops nor conditions yet: the list is
+ *        built by unrolled statements, and dynamic dispatch ends the
+ *        recursion.
+ */
+std::string script(bool tail, int length, int runs) {
+  std::string source =
+      "class Nil { count(acc) { return acc; } }\n"
+      "class Node {\n"
+      "  init(next) { this.next = next; }\n";
+  source += tail ? "  count(acc) { return this.next.count(acc + 1); }\n"
+                 : "  count(acc) { var n = this.next.count(acc + 1); "
+                   "return n; }\n";
+  source += "}\nvar list = Nil();\n";
+  for (int i = 0; i < length; ++i) {
+    source += "list = Node(list);\n";
+  }
+  source += "var sum = 0;\n";
+  for (int i = 0; i < runs; ++i) {
+    source += "sum = sum + list.count(0);\n";
+  }
+  source += "sum\n";
+  return source;
+}
+
+/**
+ * @brief A script making `calls` calls of a function whose locals are all in
+ *        its frame, or one of them `captured` by a closure.
+ */
+std::string locals_script(bool captured, int calls) {
+  std::string source = "fun f(x) {\n"
+                       "  var a = x + 1;\n"
+                       "  var b = a * 2;\n";
+  source += captured ? "  fun g() { return a; }\n" : "";
+  source += "  return a + b;\n}\nvar sum = 0;\n";
+  for (int i = 0; i < calls / 8; ++i) {
+    source += "sum = sum + f(1) + f(2) + f(3) + f(4) + f(5) + f(6) + f(7) + "
+              "f(8);\n";
+  }
+  source += "sum\n";
+  return source;
+}
+
+double run(std::string const &source, double &sink) {
+  constexpr int kRepeat = 5;
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+
+  // Inline caches stay filled after a run, every run gets a fresh AST
+  std::vector<Lox::Program> programs(kRepeat);
+  for (auto &program : programs) {
+    program = Lox::Parser(tokens).parse_program();
+    Lox::Resolver(Lox::NativeRegistry()).resolve(program);
+  }
+
+  std::size_t i = 0;
+  return Lox::Bench::measure_ms(
+      [&] {
+        Lox::Interpreter interpreter;
+        interpreter.interpret(programs[i++]);
+        sink += interpreter.result().number();
+      },
+      kRepeat);
+}
+
+} // namespace
+
+int main() {
+  double sink = 0;
+  double const call_ms = run(script(false, 1000, 200), sink);
+  Lox::Bench::report("recursion, depth 1000", call_ms, call_ms);
+  double const tail_ms = run(script(true, 1000, 200), sink);
+  Lox::Bench::report("tail recursion, depth 1000", tail_ms, call_ms);
+
+  double const frame_ms = run(locals_script(false, 160000), sink);
+  Lox::Bench::report("calls, locals in the frame", frame_ms, frame_ms);
+  double const boxed_ms = run(locals_script(true, 160000), sink);
+  Lox::Bench::report("calls, a local captured", boxed_ms, frame_ms);
+
+  // Far deeper than any call stack would allow
+  Lox::runtime_errors.clear();
+  double const deep_ms = run(script(true, 1000000, 1), sink);
+  Lox::Bench::report("tail recursion, depth 1000000", deep_ms, deep_ms);
+  if (!Lox::runtime_errors.empty()) {
+    std::printf("deep tail recursion failed\n");
+    return 1;
+  }
+
+  return sink != 0 ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#include "bench.h"
+#include "closure_compiler.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "scanner.h"
+
+#include <string>
+
+namespace {
+
+/**
+ * @brief A balanced expression of depth `depth` using every arithmetic
+ *        operator, with the leaves numbered from `leaf`.
+ */
+std::string balanced(int depth, int &leaf) {
+  if (depth == 0) {
+    return std::to_string(++leaf % 97 + 1);
+  }
+  static constexpr char const *kOps[] = {" + ", " - ", " * ", " / "};
+  auto left = balanced(depth - 1, leaf);
+  auto const *op = kOps[leaf % 4];
+  return "(" + left + op + balanced(depth - 1, leaf) + ")";
+}
+
+} // namespace
+
+int main() {
+  // Evaluated many times, so that the one-off compilation is not what gets
+  // measured
+  int leaf = 0;
+  std::string const source =
+      "!(" + balanced(12, leaf) + " < 0) == !(1 <= 2) != nil";
+  constexpr int kRuns = 200;
+
+  Lox::Scanner scanner(source);
+  Lox::Parser parser(scanner.scan_tokens());
+  auto expr = parser.parse();
+
+  double sink = 0;
+  double const tree_ms = Lox::Bench::measure_ms([&] {
+    Lox::Interpreter interpreter;
+    for (int i = 0; i < kRuns; ++i) {
+      interpreter.interpret(expr.get());
+      sink += interpreter.result().is_truthy();
+    }
+  });
+  double const closure_ms = Lox::Bench::measure_ms([&] {
+    auto const compiled = Lox::ClosureCompiler().compile(*expr);
+    for (int i = 0; i < kRuns; ++i) {
+      auto result = compiled.evaluate();
+      sink += result.value().is_truthy();
+    }
+  });
+  Lox::Bench::report("Interpreter", tree_ms, tree_ms);
+  Lox::Bench::report("ClosureCompiler (incl. compile)", closure_ms, tree_ms);
+
+  return sink > 0 ? 0 : 1;
+}
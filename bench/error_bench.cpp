@@ -0,0 +1,56 @@
+#include "bench.h"
+#include "error.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "runtime_error.h"
+#include "scanner.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Scan, parse and evaluate every source once, dropping the errors
+ *        without formatting them.
+ */
+void run_all(std::vector<std::string> const &sources) {
+  for (auto const &source : sources) {
+    Lox::Scanner scanner(source);
+    Lox::Parser parser(scanner.scan_tokens());
+    auto expr = parser.parse();
+    if (expr) {
+      Lox::Interpreter interpreter;
+      interpreter.interpret(expr.get());
+    }
+    Lox::syntax_errors.clear();
+    Lox::runtime_errors.clear();
+  }
+}
+
+std::vector<std::string> repeat(std::string const &source, int n) {
+  return std::vector<std::string>(n, source);
+}
+
+} // namespace
+
+int main() {
+  constexpr int kSources = 20000;
+  auto const valid =
+      repeat("(1 + 2) * 3 - 4 / (5 - 6) == 7 != !true", kSources);
+  auto const syntax =
+      repeat("(1 + 2) * 3 - 4 / (5 - ) == 7 != !true", kSources);
+  auto const runtime =
+      repeat("(1 + 2) * 3 - 4 / (5 - \"6\") == 7 != !true", kSources);
+
+  double const valid_ms = Lox::Bench::measure_ms([&] { run_all(valid); });
+  Lox::Bench::report("valid", valid_ms, valid_ms);
+  Lox::Bench::report("syntax error",
+                     Lox::Bench::measure_ms([&] { run_all(syntax); }),
+                     valid_ms);
+  Lox::Bench::report("runtime error",
+                     Lox::Bench::measure_ms([&] { run_all(runtime); }),
+                     valid_ms);
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "ast_printer.h"
+#include "bench.h"
+#include "error.h"
+#include "parallel_parser.h"
+#include "parallel_scanner.h"
+#include "parser.h"
+#include "scanner.h"
+
+#include <limits>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Generate a source of about `n_bytes` bytes of statements which
+ *        contain comments with quotes and multi-line string literals.
+ */
+std::string generate_source(std::size_t n_bytes) {
+  std::string source;
+  source.reserve(n_bytes + 128);
+  for (int i = 0; source.size() < n_bytes; ++i) {
+    source += "print (12.5 + " + std::to_string(i) +
+              ") * 3 - 4 / 2 >= 7 == true\n";
+    source += "// a comment with a \" quote\n";
+    source += "+ \"a string\n  spanning two lines // not a comment\" != nil;\n";
+    source += "fun f" + std::to_string(i) + "(a) { return {\"a\": [a]}; }\n";
+  }
+  return source;
+}
+
+bool same_tokens(Lox::TokenList const &lhs,
+                 Lox::TokenList const &rhs) {
+  if (lhs.size() != rhs.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < lhs.size(); ++i) {
+    if (lhs[i].offset() != rhs[i].offset() || lhs[i].type() != rhs[i].type() ||
+        lhs[i].lexeme() != rhs[i].lexeme()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string print(Lox::Program const &program) {
+  std::ostringstream out;
+  Lox::AstPrinter printer(out);
+  for (auto const &stmt : program.statements) {
+    dispatch(*stmt, printer);
+    out << '\n';
+  }
+  return out.str();
+}
+
+} // namespace
+
+int main() {
+  auto const source = generate_source(4 << 20);
+  std::printf("scanning %zu bytes\n", source.size());
+
+  Lox::TokenList serial_tokens;
+  double const serial_ms = Lox::Bench::measure_ms([&] {
+    Lox::Scanner scanner(source);
+    serial_tokens = scanner.scan_tokens();
+  });
+  Lox::Bench::report("Scanner", serial_ms, serial_ms);
+
+  unsigned const max_jobs = std::max(4u, std::thread::hardware_concurrency());
+  for (unsigned n_jobs = 1; n_jobs <= max_jobs; n_jobs *= 2) {
+    bool same = true;
+    double const ms = Lox::Bench::measure_ms([&] {
+      Lox::ParallelScanner scanner(source, n_jobs);
+      same = same && same_tokens(serial_tokens, scanner.scan_tokens());
+    });
+    std::string const name =
+        "ParallelScanner jobs=" + std::to_string(n_jobs);
+    Lox::Bench::report(name.c_str(), ms, serial_ms);
+    if (!same || !Lox::syntax_errors.empty()) {
+      std::fprintf(stderr, "token streams differ\n");
+      return 1;
+    }
+  }
+
+  // Serial and parallel runs alternate, so that both see the heap in the
+  // same state, and their programs are destroyed after all of them
+  constexpr int kRepeat = 5;
+  std::printf("parsing %zu tokens\n", serial_tokens.size());
+  for (unsigned n_jobs = 1; n_jobs <= max_jobs; n_jobs *= 2) {
+    Lox::ParallelScanner scanner(source, n_jobs);
+    auto const &tokens = scanner.scan_tokens();
+    std::vector<Lox::Program> serial(kRepeat);
+    std::vector<Lox::Program> parallel(kRepeat);
+    double serial_ms = std::numeric_limits<double>::max();
+    double ms = std::numeric_limits<double>::max();
+    for (int run = 0; run < kRepeat; ++run) {
+      auto const parse_serial = [&] {
+        serial[run] = Lox::Parser(tokens).parse_program();
+      };
+      auto const parse_parallel = [&] {
+        parallel[run] = Lox::ParallelParser(tokens, scanner.splits(), n_jobs)
+                            .parse_program();
+      };
+      serial_ms = std::min(serial_ms, Lox::Bench::measure_ms(parse_serial, 1));
+      ms = std::min(ms, Lox::Bench::measure_ms(parse_parallel, 1));
+    }
+    std::string const name = "ParallelParser jobs=" + std::to_string(n_jobs);
+    Lox::Bench::report(name.c_str(), ms, serial_ms);
+    if (print(parallel.back()) != print(serial.back()) ||
+        !Lox::syntax_errors.empty()) {
+      std::fprintf(stderr, "programs differ\n");
+      return 1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "scanner.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <string>
+
+namespace {
+
+std::size_t live_bytes = 0;
+
+/**
+ * @brief An expression of `levels` levels, each of them using the previous
+ *        one twice, as machine-generated code often does.
+ */
+std::string redundant(int levels) {
+  std::string expr = "(1 + 2)";
+  for (int i = 0; i < levels; ++i) {
+    expr = "(" + expr + " * 2 - " + expr + " / 3)";
+  }
+  return expr;
+}
+
+} // namespace
+
+void *operator new(std::size_t size) {
+  if (void *ptr = std::malloc(size)) {
+    live_bytes += malloc_usable_size(ptr);
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+  live_bytes -= malloc_usable_size(ptr);
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept { operator delete(ptr); }
+
+int main() {
+  std::string const source = redundant(14);
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+
+  double sink = 0;
+  for (bool hash_cons : {false, true}) {
+    double const parse_ms = Lox::Bench::measure_ms(
+        [&] { sink += Lox::Parser(tokens, hash_cons).parse() != nullptr; });
+    static double tree_parse_ms = parse_ms;
+    Lox::Bench::report(hash_cons ? "parse, hash-consed" : "parse, tree",
+                       parse_ms, tree_parse_ms);
+
+    auto const before = live_bytes;
+    auto expr = Lox::Parser(tokens, hash_cons).parse();
+    auto const ast_bytes = live_bytes - before;
+
+    double const ms = Lox::Bench::measure_ms([&] {
+      Lox::Interpreter interpreter;
+      interpreter.interpret(expr.get());
+      sink += interpreter.result().number();
+    });
+    static double tree_ms = ms;
+    Lox::Bench::report(hash_cons ? "evaluate, hash-consed" : "evaluate, tree",
+                       ms, tree_ms);
+    std::printf("%-40s %10zu KiB\n", "  AST size",
+                ast_bytes / 1024);
+  }
+
+  return sink != 0 ? 0 : 1;
+}
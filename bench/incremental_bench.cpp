@@ -0,0 +1,79 @@
+#include "bench.h"
+#include "error.h"
+#include "incremental_scanner.h"
+#include "scanner.h"
+
+#include <cstdint>
+#include <string>
+
+namespace {
+
+std::string generate_source(std::size_t n_bytes) {
+  std::string source;
+  source.reserve(n_bytes + 128);
+  for (int i = 0; source.size() < n_bytes; ++i) {
+    source += "(1.5 + " + std::to_string(i) + ") * 3 >= 7 == true // \"\n";
+    source += "+ \"multi\nline\" != nil\n";
+  }
+  return source;
+}
+
+bool same_tokens(Lox::TokenList const &lhs,
+                 Lox::TokenList const &rhs) {
+  if (lhs.size() != rhs.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < lhs.size(); ++i) {
+    if (lhs[i].offset() != rhs[i].offset() || lhs[i].type() != rhs[i].type() ||
+        lhs[i].lexeme() != rhs[i].lexeme()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main() {
+  // Edits which merge, split and re-type tokens, open and close comments and
+  // string literals
+  char const *const insertions[] = {"1", ".5", "=", "//", "\"", "\n", "x"};
+  constexpr int kEdits = 200;
+
+  for (std::size_t n_bytes = 64 << 10; n_bytes <= 4 << 20; n_bytes *= 4) {
+    auto const source = generate_source(n_bytes);
+    double const full_ms = Lox::Bench::measure_ms([&] {
+      Lox::Scanner scanner(source);
+      scanner.scan_tokens();
+    });
+
+    Lox::IncrementalScanner scanner(source);
+    uint64_t seed = 42;
+    double const edits_ms = Lox::Bench::measure_ms(
+        [&] {
+          for (int i = 0; i < kEdits; ++i) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            auto const offset = (seed >> 33) % scanner.size();
+            std::string_view const text = insertions[i % std::size(insertions)];
+            scanner.edit(offset, 0, text);
+            scanner.edit(offset, text.size(), "");
+          }
+        },
+        1);
+    double const edit_ms = edits_ms / (2 * kEdits);
+
+    std::string const name = "source " + std::to_string(n_bytes >> 10) + " KiB";
+    std::printf("%-20s full scan %10.3f ms, edit %8.4f ms\n", name.c_str(),
+                full_ms, edit_ms);
+
+    scanner.edit(source.size() / 2, 0, "\"");
+    Lox::Scanner fresh(scanner.source());
+    if (!same_tokens(scanner.tokens(), fresh.scan_tokens())) {
+      std::fprintf(stderr, "token streams differ\n");
+      return 1;
+    }
+    Lox::syntax_errors.clear();
+  }
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief A generated loop recomputing the same subexpressions of its
+ *        parameters and of constants on every iteration.
+ */
+std::string script(int iterations) {
+  return "var scale = 1000;\n"
+         "fun price(base, rate, n) {\n"
+         "  var total = 0;\n"
+         "  for (var i = 0; i < n; i = i + 1) {\n"
+         "    total = total + i * (base * (1 + rate / 100) - base / scale) +\n"
+         "            (rate * rate - base) / (scale * 2 + 1);\n"
+         "  }\n"
+         "  return total;\n"
+         "}\n"
+         "price(250, 7, " +
+         std::to_string(iterations) + ")\n";
+}
+
+double run(std::string const &source, bool optimize, double &sink) {
+  constexpr int kRepeat = 5;
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+
+  std::vector<Lox::Program> programs(kRepeat);
+  for (auto &program : programs) {
+    program = Lox::Parser(tokens).parse_program();
+    Lox::Resolver(Lox::NativeRegistry()).resolve(program);
+    if (optimize) {
+      Lox::Optimizer().optimize(program);
+    }
+  }
+
+  std::size_t i = 0;
+  return Lox::Bench::measure_ms(
+      [&] {
+        Lox::Interpreter interpreter;
+        interpreter.interpret(programs[i++]);
+        sink += interpreter.result().number();
+      },
+      kRepeat);
+}
+
+} // namespace
+
+int main() {
+  double sink = 0;
+  std::string const source = script(200000);
+  double const plain_ms = run(source, false, sink);
+  Lox::Bench::report("loop, not optimized", plain_ms, plain_ms);
+  double const optimized_ms = run(source, true, sink);
+  Lox::Bench::report("loop, optimized", optimized_ms, plain_ms);
+  return sink != 0 ? 0 : 1;
+}
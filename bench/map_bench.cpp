@@ -0,0 +1,111 @@
+#include "bench.h"
+#include "object.h"
+#include "value.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr int kKeys = 100000;
+constexpr int kLookupRounds = 10;
+
+using StdMap = std::unordered_map<Lox::Value, Lox::Value, Lox::KeyHash,
+                                  Lox::KeyEqual>;
+
+/**
+ * @brief `kKeys` distinct keys: short strings, as field names or words
+ *        would be, or integral numbers.
+ */
+std::vector<Lox::Value> keys(bool strings) {
+  std::vector<Lox::Value> result;
+  result.reserve(kKeys);
+  for (int i = 0; i < kKeys; ++i) {
+    if (strings) {
+      result.emplace_back("key" + std::to_string(i));
+    } else {
+      result.emplace_back(static_cast<double>(i));
+    }
+  }
+  return result;
+}
+
+template <typename Map, typename Insert>
+double insert_ms(std::vector<Lox::Value> const &keys, Insert insert,
+                 double &sink) {
+  return Lox::Bench::measure_ms([&] {
+    Map map;
+    for (auto const &key : keys) {
+      insert(map, key);
+    }
+    sink += static_cast<double>(map.size());
+  });
+}
+
+/**
+ * @brief Look every key up `kLookupRounds` times, in the order they were
+ *        added, summing their values.
+ */
+template <typename Map, typename Find>
+double lookup_ms(Map const &map, std::vector<Lox::Value> const &keys,
+                 Find find, double &sink) {
+  return Lox::Bench::measure_ms([&] {
+    double total = 0;
+    for (int round = 0; round < kLookupRounds; ++round) {
+      for (auto const &key : keys) {
+        total += find(map, key).number();
+      }
+    }
+    sink += total;
+  });
+}
+
+void compare(char const *label, bool strings, double &sink) {
+  auto const all = keys(strings);
+  auto const std_insert = [](StdMap &map, Lox::Value const &key) {
+    map.emplace(key, 1.0);
+  };
+  auto const lox_insert = [](Lox::LoxMap &map, Lox::Value const &key) {
+    map.set(key, 1.0);
+  };
+
+  double const std_insert_ms = insert_ms<StdMap>(all, std_insert, sink);
+  std::string name = std::string(label) + ", unordered_map insert";
+  Lox::Bench::report(name.c_str(), std_insert_ms, std_insert_ms);
+  double const lox_insert_ms = insert_ms<Lox::LoxMap>(all, lox_insert, sink);
+  name = std::string(label) + ", LoxMap insert";
+  Lox::Bench::report(name.c_str(), lox_insert_ms, std_insert_ms);
+
+  StdMap std_map;
+  Lox::LoxMap lox_map;
+  for (auto const &key : all) {
+    std_insert(std_map, key);
+    lox_insert(lox_map, key);
+  }
+  double const std_lookup_ms = lookup_ms(
+      std_map, all,
+      [](StdMap const &map, Lox::Value const &key) -> Lox::Value const & {
+        return map.find(key)->second;
+      },
+      sink);
+  name = std::string(label) + ", unordered_map lookup";
+  Lox::Bench::report(name.c_str(), std_lookup_ms, std_lookup_ms);
+  double const lox_lookup_ms = lookup_ms(
+      lox_map, all,
+      [](Lox::LoxMap const &map, Lox::Value const &key) -> Lox::Value const & {
+        return *map.find(key);
+      },
+      sink);
+  name = std::string(label) + ", LoxMap lookup";
+  Lox::Bench::report(name.c_str(), lox_lookup_ms, std_lookup_ms);
+}
+
+} // namespace
+
+int main() {
+  double sink = 0;
+  compare("string keys", true, sink);
+  compare("number keys", false, sink);
+  return sink != 0 ? 0 : 1;
+}
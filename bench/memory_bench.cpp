@@ -0,0 +1,69 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "memory_account.h"
+#include "output_sink.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+/**
+ * @brief A generated script building linked lists of instances, closures,
+ *        and long strings.
+ */
+std::string script(int iterations) {
+  return "class Node { init(next) { this.next = next; this.value = 1; } }\n"
+         "fun counter() { var n = 0; fun next() { n = n + 1; return n; } "
+         "return next; }\n"
+         "var s = \"\";\n"
+         "for (var i = 0; i < " +
+         std::to_string(iterations) +
+         "; i = i + 1) {\n"
+         "  var list = nil;\n"
+         "  for (var j = 0; j < 100; j = j + 1) { list = Node(list); }\n"
+         "  var next = counter();\n"
+         "  next();\n"
+         "  s = s + \"a string long enough to be a rope\";\n"
+         "}\n";
+}
+
+/**
+ * @brief Scan, parse and run `source`, with its memory accounted in
+ *        `memory` if any.
+ */
+void run(std::string const &source, Lox::MemoryAccount *memory) {
+  Lox::NullSink sink;
+  Lox::Scanner scanner(source, memory != nullptr
+                                   ? memory
+                                   : std::pmr::get_default_resource());
+  auto const &tokens = scanner.scan_tokens();
+  Lox::Program program = Lox::Parser(tokens, false, memory).parse_program();
+  Lox::Resolver(Lox::NativeRegistry()).resolve(program);
+  Lox::Interpreter interpreter;
+  interpreter.set_output(sink);
+  if (memory != nullptr) {
+    interpreter.set_memory(*memory);
+  }
+  interpreter.interpret(program);
+}
+
+} // namespace
+
+int main() {
+  std::string const source = script(20000);
+
+  double const plain_ms = Lox::Bench::measure_ms([&] { run(source, nullptr); });
+  Lox::Bench::report("heap, global allocator", plain_ms, plain_ms);
+
+  Lox::MemoryAccount memory;
+  Lox::Bench::report("heap, accounted",
+                     Lox::Bench::measure_ms([&] { run(source, &memory); }),
+                     plain_ms);
+  std::printf("peak %zu bytes, %zu left allocated\n", memory.peak(),
+              memory.used());
+  return memory.used() == 0 ? 0 : 1;
+}
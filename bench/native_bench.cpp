@@ -0,0 +1,63 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief A script making `calls` calls of `mix()`, which is a native, or a
+ *        Lox function computing the same if `lox` is set.
+ */
+std::string script(bool lox, int calls) {
+  std::string source =
+      lox ? "fun mix(a, b) { return a * 0.25 + b * 0.75; }\n" : "";
+  source += "var sum = 0;\n";
+  for (int i = 0; i < calls / 8; ++i) {
+    source += "sum = sum + mix(1, 2) + mix(3, 4) + mix(5, 6) + mix(7, 8) + "
+              "mix(9, 10) + mix(11, 12) + mix(13, 14) + mix(15, 16);\n";
+  }
+  source += "sum\n";
+  return source;
+}
+
+double run(std::string const &source, double &sink) {
+  constexpr int kRepeat = 5;
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+
+  std::vector<std::unique_ptr<Lox::Interpreter>> interpreters;
+  std::vector<Lox::Program> programs(kRepeat);
+  for (auto &program : programs) {
+    auto &interpreter =
+        interpreters.emplace_back(std::make_unique<Lox::Interpreter>());
+    interpreter->natives().define(
+        "mix", [](double a, double b) { return a * 0.25 + b * 0.75; });
+    program = Lox::Parser(tokens).parse_program();
+    Lox::Resolver(interpreter->natives()).resolve(program);
+  }
+
+  std::size_t i = 0;
+  return Lox::Bench::measure_ms(
+      [&] {
+        interpreters[i]->interpret(programs[i]);
+        sink += interpreters[i++]->result().number();
+      },
+      kRepeat);
+}
+
+} // namespace
+
+int main() {
+  double sink = 0;
+  double const lox_ms = run(script(true, 160000), sink);
+  Lox::Bench::report("calls of a Lox function", lox_ms, lox_ms);
+  double const native_ms = run(script(false, 160000), sink);
+  Lox::Bench::report("calls of a native", native_ms, lox_ms);
+  return sink != 0 ? 0 : 1;
+}
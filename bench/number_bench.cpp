@@ -0,0 +1,51 @@
+#include "bench.h"
+#include "number.h"
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main() {
+  std::vector<std::string> literals;
+  for (int i = 0; i < 200000; ++i) {
+    literals.push_back(std::to_string(i * 7919 % 100003) + "." +
+                       std::to_string(i % 997));
+  }
+  std::vector<double> numbers(literals.size());
+
+  double sink = 0;
+  double const stod_ms = Lox::Bench::measure_ms([&] {
+    for (std::size_t i = 0; i < literals.size(); ++i) {
+      numbers[i] = std::stod(literals[i]);
+    }
+  });
+  double const parse_ms = Lox::Bench::measure_ms([&] {
+    for (std::size_t i = 0; i < literals.size(); ++i) {
+      auto const &literal = literals[i];
+      numbers[i] = Lox::parse_number(literal.data(),
+                                     literal.data() + literal.size());
+    }
+  });
+  Lox::Bench::report("std::stod", stod_ms, stod_ms);
+  Lox::Bench::report("parse_number", parse_ms, stod_ms);
+
+  double const ostream_ms = Lox::Bench::measure_ms([&] {
+    std::ostringstream out;
+    for (double number : numbers) {
+      out << number << '\n';
+    }
+    sink += out.str().size();
+  });
+  double const format_ms = Lox::Bench::measure_ms([&] {
+    std::ostringstream out;
+    Lox::NumberBuffer buffer;
+    for (double number : numbers) {
+      out << Lox::format_number(number, buffer) << '\n';
+    }
+    sink += out.str().size();
+  });
+  Lox::Bench::report("std::ostream << double", ostream_ms, ostream_ms);
+  Lox::Bench::report("format_number", format_ms, ostream_ms);
+
+  return sink > 0 ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kInstances = 32;
+
+/**
+ * @brief A script whose hot property reads, in the loop, see instances of
+ *        `n_shapes` shapes. `v` is the first of 66 fields, so that a miss
+ *        walks the whole shape to find it: with short shapes, the caches
+ *        gain nothing measurable.
+ */
+std::string script(int n_shapes, int rounds) {
+  std::string source = "class A {}\nvar objects = [];\n";
+  for (int i = 0; i < kInstances; ++i) {
+    source += "{ var a = A();\n";
+    source += "a.v = " + std::to_string(i) + ";\n";
+    source += "a.s" + std::to_string(i % n_shapes) + " = 0;\n";
+    for (int field = 0; field < 64; ++field) {
+      source += "a.f" + std::to_string(field) + " = 0;\n";
+    }
+    source += "objects[" + std::to_string(i) + "] = a; }\n";
+  }
+  source += "var sum = 0;\n"
+            "for (var round = 0; round < " +
+            std::to_string(rounds) +
+            "; round = round + 1) {\n"
+            "  for (var i = 0; i < " +
+            std::to_string(kInstances) +
+            "; i = i + 1) {\n"
+            "    var o = objects[i];\n"
+            "    sum = sum + o.v + o.v + o.v + o.v + o.v + o.v + o.v + o.v;\n"
+            "  }\n"
+            "}\n"
+            "sum\n";
+  return source;
+}
+
+} // namespace
+
+int main() {
+  constexpr int kRepeat = 5;
+  double sink = 0;
+  double baseline_ms = 0;
+  for (int n_shapes : {kInstances, 4, 1}) {
+    std::string const source = script(n_shapes, 5000);
+    Lox::Scanner scanner(source);
+    auto const &tokens = scanner.scan_tokens();
+
+    // Inline caches stay filled after a run, every run gets a fresh AST
+    std::vector<Lox::Program> programs(kRepeat);
+    for (auto &program : programs) {
+      program = Lox::Parser(tokens).parse_program();
+      Lox::Resolver(Lox::NativeRegistry()).resolve(program);
+    }
+
+    std::size_t run = 0;
+    double const ms = Lox::Bench::measure_ms(
+        [&] {
+          Lox::Interpreter interpreter;
+          interpreter.interpret(programs[run++]);
+          sink += interpreter.result().number();
+        },
+        kRepeat);
+    if (baseline_ms == 0) {
+      baseline_ms = ms;
+    }
+    char const *name = n_shapes == kInstances ? "megamorphic site, 32 shapes"
+                       : n_shapes > 1         ? "polymorphic site, 4 shapes"
+                                              : "monomorphic site";
+    Lox::Bench::report(name, ms, baseline_ms);
+  }
+
+  return sink != 0 ? 0 : 1;
+}
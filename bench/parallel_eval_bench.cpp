@@ -0,0 +1,64 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "parallel_evaluator.h"
+#include "parser.h"
+#include "scanner.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief A balanced expression of depth `depth`, see closure_bench.
+ */
+std::string balanced(int depth, int &leaf) {
+  if (depth == 0) {
+    return std::to_string(++leaf % 97 + 1);
+  }
+  static constexpr char const *kOps[] = {" + ", " - ", " * ", " / "};
+  auto left = balanced(depth - 1, leaf);
+  auto const *op = kOps[leaf % 4];
+  return "(" + left + op + balanced(depth - 1, leaf) + ")";
+}
+
+} // namespace
+
+int main() {
+  int leaf = 0;
+  std::string const source = balanced(20, leaf);
+  Lox::Scanner scanner(source);
+  Lox::Parser parser(scanner.scan_tokens());
+  auto expr = parser.parse();
+
+  double sink = 0;
+  double const serial_ms = Lox::Bench::measure_ms([&] {
+    Lox::Interpreter interpreter;
+    interpreter.interpret(expr.get());
+    sink += interpreter.result().number();
+  });
+  Lox::Bench::report("Interpreter", serial_ms, serial_ms);
+
+  // Powers of two up to the number of cores, and all of them
+  unsigned const n_cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<unsigned> jobs;
+  for (unsigned n_jobs = 1; n_jobs < n_cores; n_jobs *= 2) {
+    jobs.push_back(n_jobs);
+  }
+  jobs.push_back(n_cores);
+
+  for (unsigned n_jobs : jobs) {
+    Lox::ParallelEvaluator evaluator(n_jobs);
+    double const ms = Lox::Bench::measure_ms([&] {
+      evaluator.interpret(expr.get());
+      sink += evaluator.result().number();
+    });
+    auto const name = "ParallelEvaluator, " + std::to_string(n_jobs) +
+                      (n_jobs == n_cores ? " jobs (all cores)" : " jobs");
+    Lox::Bench::report(name.c_str(), ms, serial_ms);
+  }
+
+  return sink != 0 ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "output_sink.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+/**
+ * Write every line through an `std::ostream`, flushed at its end as with
+ * `std::endl`: what a line-oriented host would do.
+ */
+class StreamSink final : public Lox::OutputSink {
+public:
+  explicit StreamSink(std::ostream &out) : m_out(out) {}
+
+  void write(std::string_view bytes) override {
+    m_out << bytes;
+    if (bytes == "\n") {
+      m_out.flush();
+    }
+  }
+
+private:
+  std::ostream &m_out;
+};
+
+/**
+ * @brief A generated script printing a number and a string per iteration.
+ */
+std::string script(int iterations) {
+  return "for (var i = 0; i < " + std::to_string(iterations) +
+         "; i = i + 1) {\n"
+         "  print i;\n"
+         "  print \"line\";\n"
+         "}\n";
+}
+
+double run(std::string const &source, Lox::OutputSink &sink) {
+  constexpr int kRepeat = 5;
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+
+  std::vector<Lox::Program> programs(kRepeat);
+  for (auto &program : programs) {
+    program = Lox::Parser(tokens).parse_program();
+    Lox::Resolver(Lox::NativeRegistry()).resolve(program);
+  }
+
+  std::size_t i = 0;
+  return Lox::Bench::measure_ms(
+      [&] {
+        Lox::Interpreter interpreter;
+        interpreter.set_output(sink);
+        interpreter.interpret(programs[i++]);
+        sink.flush();
+      },
+      kRepeat);
+}
+
+} // namespace
+
+int main() {
+  std::string const source = script(100000);
+
+  std::ofstream dev_null_stream("/dev/null");
+  StreamSink stream_sink(dev_null_stream);
+  double const stream_ms = run(source, stream_sink);
+  Lox::Bench::report("print, ostream flushed per line", stream_ms, stream_ms);
+
+  int const fd = ::open("/dev/null", O_WRONLY);
+  {
+    Lox::FdSink fd_sink(fd);
+    Lox::Bench::report("print, buffered write(2)", run(source, fd_sink),
+                       stream_ms);
+  }
+  ::close(fd);
+
+  Lox::StringSink string_sink;
+  Lox::Bench::report("print, in memory", run(source, string_sink), stream_ms);
+
+  Lox::NullSink null_sink;
+  Lox::Bench::report("print, discarded", run(source, null_sink), stream_ms);
+  return string_sink.str().empty() ? 1 : 0;
+}
@@ -0,0 +1,49 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "scanner.h"
+
+#include <cstdio>
+#include <string>
+
+int main() {
+  std::string const piece = "<td>cell</td>";
+  double sink = 0;
+
+  for (int n : {2000, 4000, 8000, 16000}) {
+    // "..." + "..." + ... as a templating script would build a page
+    std::string source = '"' + piece + '"';
+    for (int i = 1; i < n; ++i) {
+      source += " + \"" + piece + '"';
+    }
+    Lox::Scanner scanner(source);
+    Lox::Parser parser(scanner.scan_tokens());
+    auto expr = parser.parse();
+
+    // What `+` did before ropes: copy both operands every time
+    double const flat_ms = Lox::Bench::measure_ms(
+        [&] {
+          std::string str;
+          for (int i = 0; i < n; ++i) {
+            str = str + piece;
+          }
+          sink += str.size();
+        },
+        1);
+    double const rope_ms = Lox::Bench::measure_ms(
+        [&] {
+          Lox::Interpreter interpreter;
+          interpreter.interpret(expr.get());
+          // Printing observes the string, which flattens it
+          sink += interpreter.result().str().size();
+        },
+        1);
+
+    std::printf("%d concatenations\n", n);
+    Lox::Bench::report("  flat strings", flat_ms, flat_ms);
+    Lox::Bench::report("  Interpreter with ropes (and flattening)", rope_ms,
+                       flat_ms);
+  }
+
+  return sink > 0 ? 0 : 1;
+}
@@ -0,0 +1,153 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+#include "snapshot.h"
+#include "type_checker.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <memory_resource>
+#include <string>
+
+namespace {
+
+constexpr int kStartups = 100;
+constexpr int kFunctions = 300;
+constexpr int kClasses = 60;
+
+/**
+ * @brief A generated standard library: functions, classes inheriting from
+ *        one another, and a list of instances built when it runs.
+ */
+std::string prelude() {
+  std::string source;
+  for (int i = 0; i < kFunctions; ++i) {
+    auto const n = std::to_string(i);
+    source += "fun f" + n + "(x) {\n  var a = x * " + n +
+              ";\n  if (a > 10) return a - " + n + ";\n  return a + " + n +
+              ";\n}\n";
+  }
+  for (int i = 0; i < kClasses; ++i) {
+    auto const n = std::to_string(i);
+    source += "class C" + n;
+    if (i > 0) {
+      source += " < C" + std::to_string(i - 1);
+    }
+    source += " {\n  init(x) { this.x = x; }\n";
+    for (int m = 0; m < 4; ++m) {
+      auto const method = "m" + n + "_" + std::to_string(m);
+      source += "  " + method + "(y) { return this.x * y + " +
+                std::to_string(m) + "; }\n";
+    }
+    source += "}\n";
+  }
+  source += "class Node {\n"
+            "  init(value, next) { this.value = value; this.next = next; }\n"
+            "}\n"
+            "fun build(n) {\n"
+            "  var list = nil;\n"
+            "  for (var i = 0; i < n; i = i + 1) list = Node(i, list);\n"
+            "  return list;\n"
+            "}\n"
+            "fun sum(list) {\n"
+            "  var total = 0;\n"
+            "  while (list != nil) {\n"
+            "    total = total + list.value;\n"
+            "    list = list.next;\n"
+            "  }\n"
+            "  return total;\n"
+            "}\n"
+            "var numbers = build(1000);\n";
+  return source;
+}
+
+/**
+ * A short script, as most of those a host runs are: starting it costs more
+ * than running it.
+ */
+char const *const kScript = "f10(3) + C59(2).m0_1(5) + sum(numbers)\n";
+
+/**
+ * @brief Scan, parse, resolve, optimize, check and run `source`, against
+ *        `snapshot` if set.
+ */
+double start(std::string const &source, Lox::Snapshot const *snapshot) {
+  Lox::Interpreter interpreter;
+  interpreter.set_snapshot(snapshot);
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+  Lox::Program program = Lox::Parser(tokens).parse_program();
+  Lox::Resolver(interpreter.natives(), snapshot).resolve(program);
+  Lox::Optimizer().optimize(program);
+  Lox::TypeChecker().check(program);
+  interpreter.interpret(program);
+  return interpreter.result().number();
+}
+
+} // namespace
+
+int main() {
+  std::string const library = prelude();
+  std::string const script(kScript);
+  auto const path =
+      std::filesystem::temp_directory_path() / "lox_snapshot_bench.snap";
+
+  {
+    Lox::Interpreter interpreter;
+    Lox::Scanner scanner(library);
+    auto const &tokens = scanner.scan_tokens();
+    Lox::Program program = Lox::Parser(tokens).parse_program();
+    Lox::Resolver(interpreter.natives()).resolve(program);
+    Lox::Optimizer().optimize(program);
+    Lox::TypeChecker().check(program);
+    auto const globals = interpreter.run_prelude(program);
+    Lox::Snapshot::write(path.c_str(), program, Lox::SourceMap(library),
+                         *globals, interpreter.natives());
+  }
+  std::printf("%d functions, %d classes, a snapshot of %ju bytes\n",
+              kFunctions, kClasses,
+              static_cast<uintmax_t>(std::filesystem::file_size(path)));
+
+  double sink = 0;
+  std::string const whole = library + script;
+  double const source_ms = Lox::Bench::measure_ms([&] {
+    for (int i = 0; i < kStartups; ++i) {
+      sink += start(whole, nullptr);
+    }
+  });
+  Lox::Bench::report("100 startups, prelude from source", source_ms,
+                     source_ms);
+
+  Lox::Snapshot const snapshot(path.c_str());
+  double const snapshot_ms = Lox::Bench::measure_ms([&] {
+    for (int i = 0; i < kStartups; ++i) {
+      sink += start(script, &snapshot);
+    }
+  });
+  Lox::Bench::report("100 startups, prelude from a snapshot", snapshot_ms,
+                     source_ms);
+
+  // What remains of the prelude in each startup: mapping the snapshot once,
+  // and copying its objects for every run
+  double const map_ms = Lox::Bench::measure_ms([&] {
+    Lox::Snapshot const mapped(path.c_str());
+    sink += mapped.global_count();
+  });
+  Lox::Bench::report("mapping the snapshot, once", map_ms, source_ms);
+  Lox::Interpreter interpreter;
+  double const copy_ms = Lox::Bench::measure_ms([&] {
+    for (int i = 0; i < kStartups; ++i) {
+      sink += snapshot
+                  .instantiate(interpreter.natives(),
+                               std::pmr::get_default_resource())
+                  .size();
+    }
+  });
+  Lox::Bench::report("100 copies of its objects", copy_ms, source_ms);
+
+  std::filesystem::remove(path);
+  return sink != 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#include "bench.h"
+#include "interpreter.h"
+#include "parser.h"
+#include "resolver.h"
+#include "scanner.h"
+#include "type_checker.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief A generated numeric loop over locals only, whose operand types can
+ *        all be proven but for the bound `n`, a parameter.
+ */
+std::string script(int iterations) {
+  return "fun mix(n) {\n"
+         "  var a = 1;\n"
+         "  var b = 2;\n"
+         "  var acc = 0;\n"
+         "  for (var i = 0; i < n; i = i + 1) {\n"
+         "    var t = a * 3 - b / 2 + i;\n"
+         "    a = b - t / 7;\n"
+         "    b = -t + a * 0.5;\n"
+         "    if (a > b) acc = acc + 1; else acc = acc - a / 1000;\n"
+         "  }\n"
+         "  return acc;\n"
+         "}\n"
+         "mix(" +
+         std::to_string(iterations) + ")\n";
+}
+
+double run(std::string const &source, bool check, double &sink) {
+  constexpr int kRepeat = 5;
+  Lox::Scanner scanner(source);
+  auto const &tokens = scanner.scan_tokens();
+
+  std::vector<Lox::Program> programs(kRepeat);
+  for (auto &program : programs) {
+    program = Lox::Parser(tokens).parse_program();
+    Lox::Resolver(Lox::NativeRegistry()).resolve(program);
+    if (check) {
+      Lox::TypeChecker().check(program);
+    }
+  }
+
+  std::size_t i = 0;
+  return Lox::Bench::measure_ms(
+      [&] {
+        Lox::Interpreter interpreter;
+        interpreter.interpret(programs[i++]);
+        sink += interpreter.result().number();
+      },
+      kRepeat);
+}
+
+} // namespace
+
+int main() {
+  double sink = 0;
+  std::string const source = script(200000);
+  double const checked_ms = run(source, false, sink);
+  Lox::Bench::report("operators, all checked", checked_ms, checked_ms);
+  double const proven_ms = run(source, true, sink);
+  Lox::Bench::report("operators, proven types unchecked", proven_ms,
+                     checked_ms);
+  return sink != 0 ? 0 : 1;
+}
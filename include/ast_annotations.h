@@ -0,0 +1,170 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Lox {
+
+class LoxClass;
+class LoxFunction;
+class Shape;
+
+/**
+ * Where a variable lives, filled by `Resolver`.
+ *
+ * A local captured by a closure is `BOXED`: its slot holds a `Cell` shared
+ * with the closures, which reach it as an `UPVALUE`. The other locals stay in
+ * the frame.
+ */
+struct VariableSlot {
+  enum class Kind : uint8_t { UNRESOLVED, GLOBAL, LOCAL, BOXED, UPVALUE };
+
+  Kind kind = Kind::UNRESOLVED;
+  /**
+   * The index in the globals, in the frame of the enclosing function, or in
+   * the captures of the closure being run.
+   */
+  uint32_t index = 0;
+};
+
+/**
+ * The types an expression may evaluate to, as a set of bits, proven by
+ * `TypeChecker`. An expression never checked may have any type.
+ */
+struct TypeSet {
+  static constexpr uint8_t kNumber = 1 << 0;
+  static constexpr uint8_t kString = 1 << 1;
+  static constexpr uint8_t kBoolean = 1 << 2;
+  static constexpr uint8_t kNil = 1 << 3;
+  /**
+   * Any object but an array.
+   */
+  static constexpr uint8_t kObject = 1 << 4;
+  static constexpr uint8_t kArray = 1 << 5;
+  static constexpr uint8_t kAny =
+      kNumber | kString | kBoolean | kNil | kObject | kArray;
+
+  /**
+   * @brief Whether the expression always has one of `types`.
+   */
+  [[nodiscard]] constexpr bool only(uint8_t types) const noexcept {
+    return bits != 0 && (bits & ~types) == 0;
+  }
+
+  /**
+   * @brief Whether the expression never has any of `types`.
+   */
+  [[nodiscard]] constexpr bool never(uint8_t types) const noexcept {
+    return (bits & types) == 0;
+  }
+
+  constexpr TypeSet operator|(TypeSet other) const noexcept {
+    return {static_cast<uint8_t>(bits | other.bits)};
+  }
+
+  bool operator==(TypeSet const &) const = default;
+
+  uint8_t bits = kAny;
+};
+
+/**
+ * How a closure captures a variable when it is created, filled by `Resolver`.
+ */
+struct Capture {
+  enum class Kind : uint8_t {
+    /**
+     * The cell of a boxed local of the enclosing function.
+     */
+    CELL,
+    /**
+     * A copy of a local which never changes, `this`.
+     */
+    VALUE,
+    /**
+     * A capture of the enclosing closure.
+     */
+    UPVALUE,
+  };
+
+  Kind kind;
+  uint32_t index;
+
+  bool operator==(Capture const &) const = default;
+};
+
+/**
+ * A polymorphic inline cache: the result of the last property lookups at one
+ * site, keyed by the shape of the instance. Once it is full, the site is
+ * megamorphic and further shapes are looked up every time.
+ *
+ * Every entry keeps the class owning its shape alive, so that the address of
+ * a cached shape is never reused by another one.
+ */
+template <typename Entry> struct InlineCache {
+  static constexpr uint8_t kMaxEntries = 4;
+
+  [[nodiscard]] Entry const *find(Shape const *shape) const noexcept {
+    for (uint8_t i = 0; i < size; ++i) {
+      if (entries[i].shape == shape) {
+        return &entries[i];
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Whether the site is megamorphic: a miss is not cached any more.
+   */
+  [[nodiscard]] bool full() const noexcept { return size == kMaxEntries; }
+
+  void insert(Entry entry) {
+    if (size < kMaxEntries) {
+      entries[size++] = std::move(entry);
+    }
+  }
+
+  std::array<Entry, kMaxEntries> entries{};
+  uint8_t size = 0;
+};
+
+/**
+ * A cached property read: a field at `slot`, or `method` if not null.
+ */
+struct PropertyCacheEntry {
+  Shape const *shape = nullptr;
+  LoxFunction const *method = nullptr;
+  uint32_t slot = 0;
+  std::shared_ptr<LoxClass const> owner;
+};
+
+/**
+ * A cached field write: a shape `shape` becomes `target`, equal to it if the
+ * field already exists, with the field at `slot`.
+ */
+struct TransitionCacheEntry {
+  Shape const *shape = nullptr;
+  Shape const *target = nullptr;
+  uint32_t slot = 0;
+  std::shared_ptr<LoxClass const> owner;
+};
+
+using PropertyCache = InlineCache<PropertyCacheEntry>;
+
+using TransitionCache = InlineCache<TransitionCacheEntry>;
+
+/**
+ * The hash of the key of an element access, see `hash_key()`, computed on
+ * the first access to a map. It is kept if the key is a constant, a literal
+ * or folded by `Optimizer`, so that the key is never hashed again.
+ */
+struct KeyHashCache {
+  enum class State : uint8_t { UNKNOWN, CONSTANT, VARIABLE };
+
+  State state = State::UNKNOWN;
+  std::size_t hash = 0;
+};
+
+} // namespace Lox
@@ -26,7 +26,59 @@ public:
 
   void visit(Literal &node) override;
 
+  void visit(Logical &node) override;
+
+  void visit(Constant &node) override;
+
+  void visit(Hoisted &node) override;
+
+  void visit(Shared &node) override;
+
+  void visit(Variable &node) override;
+
+  void visit(Assign &node) override;
+
+  void visit(Call &node) override;
+
+  void visit(Get &node) override;
+
+  void visit(Set &node) override;
+
+  void visit(Invoke &node) override;
+
+  void visit(Array &node) override;
+
+  void visit(Map &node) override;
+
+  void visit(Index &node) override;
+
+  void visit(SetIndex &node) override;
+
+  void visit(This &node) override;
+
+  void visit(Super &node) override;
+
+  void visit(Expression &node) override;
+
+  void visit(Print &node) override;
+
+  void visit(Var &node) override;
+
+  void visit(Block &node) override;
+
+  void visit(If &node) override;
+
+  void visit(While &node) override;
+
+  void visit(Function &node) override;
+
+  void visit(Class &node) override;
+
+  void visit(Return &node) override;
+
 private:
+  void print_arguments(ExprList const &arguments);
+
   std::ostream &m_out;
 };
 
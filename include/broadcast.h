@@ -0,0 +1,46 @@
+#pragma once
+
+#include "diagnostic.h"
+#include "expected.h"
+#include "scanner.h"
+#include "value.h"
+
+#include <memory_resource>
+
+namespace Lox {
+
+/**
+ * @brief Apply the arithmetic or comparison operator `op` element-wise: to
+ *        an array and a number, a number and an array, or two arrays of the
+ *        same length. The array built is allocated from `memory`.
+ *
+ * The elements must all be numbers. They run through SIMD kernels, four at
+ * a time: arithmetic gives an array of numbers, unboxed, a comparison an
+ * array of booleans. The kernels are compiled for AVX2 and for the baseline
+ * instruction set, the one the CPU runs being picked when the program is
+ * loaded, where the platform supports it.
+ */
+[[nodiscard]] Expected<Value, ErrorCode>
+broadcast(TokenType op, Value const &left, Value const &right,
+          std::pmr::memory_resource *memory);
+
+/**
+ * @brief Whether `op` is an operator which `broadcast()` applies.
+ */
+[[nodiscard]] constexpr bool broadcasts(TokenType op) noexcept {
+  switch (op) {
+  case TokenType::PLUS:
+  case TokenType::MINUS:
+  case TokenType::STAR:
+  case TokenType::SLASH:
+  case TokenType::GREATER:
+  case TokenType::GREATER_EQUAL:
+  case TokenType::LESS:
+  case TokenType::LESS_EQUAL:
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // namespace Lox
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "expected.h"
+#include "value.h"
+
+#include <deque>
+#include <unordered_map>
+
+namespace Lox {
+
+/**
+ * A pre-bound evaluation step. Every node of the compiled tree calls the
+ * function specialised for its operator, which calls its children's thunks
+ * directly: there is no visitor dispatch and no switch on the operator at
+ * evaluation time.
+ */
+struct Thunk {
+  using Fn = bool (*)(Thunk const &self, Value &out, Diagnostic &error);
+
+  /**
+   * @brief Evaluate into `out`, or return `false` and fill `error`.
+   */
+  [[nodiscard]] bool operator()(Value &out, Diagnostic &error) const {
+    return fn(*this, out, error);
+  }
+
+  Fn fn;
+  Thunk const *left = nullptr;
+  Thunk const *right = nullptr;
+  /**
+   * The token of the operator or literal, kept for diagnostics and debugging.
+   */
+  Token const *token = nullptr;
+  /**
+   * The value of a literal, converted once at compile time. Numbers are kept
+   * unboxed in `number`.
+   */
+  Value constant{};
+  double number = 0;
+};
+
+/**
+ * An expression compiled by `ClosureCompiler`. It refers to the tokens of
+ * the expression, which must outlive it.
+ */
+class CompiledExpr {
+  friend class ClosureCompiler;
+
+public:
+  [[nodiscard]] Expected<Value> evaluate() const {
+    Value result;
+    Diagnostic error{};
+    if (!(*m_root)(result, error)) {
+      return Unexpected{error};
+    }
+    return result;
+  }
+
+private:
+  std::deque<Thunk> m_thunks;
+  Thunk const *m_root = nullptr;
+};
+
+/**
+ * Translate an expression once into a tree of thunks, an alternative to the
+ * tree-walking `Interpreter`.
+ */
+class ClosureCompiler final : public AstNodeVisitor {
+public:
+  [[nodiscard]] CompiledExpr compile(Expr &expr);
+
+  void visit(Literal &) override;
+
+  void visit(Binary &) override;
+
+  void visit(Unary &) override;
+
+  void visit(Grouping &) override;
+
+  void visit(Logical &) override;
+
+  void visit(Constant &) override;
+
+  void visit(Hoisted &) override;
+
+  void visit(Shared &) override;
+
+  void visit(Variable &) override;
+
+  void visit(Assign &) override;
+
+  void visit(Call &) override;
+
+  void visit(Get &) override;
+
+  void visit(Set &) override;
+
+  void visit(Invoke &) override;
+
+  void visit(Array &) override;
+
+  void visit(Map &) override;
+
+  void visit(Index &) override;
+
+  void visit(SetIndex &) override;
+
+  void visit(This &) override;
+
+  void visit(Super &) override;
+
+  void visit(Expression &) override;
+
+  void visit(Print &) override;
+
+  void visit(Var &) override;
+
+  void visit(Block &) override;
+
+  void visit(If &) override;
+
+  void visit(While &) override;
+
+  void visit(Function &) override;
+
+  void visit(Class &) override;
+
+  void visit(Return &) override;
+
+  ~ClosureCompiler() noexcept override = default;
+
+private:
+  /**
+   * @brief Reject a node the thunks do not cover: only expressions of
+   *        literals and operators are compiled so far.
+   */
+  [[noreturn]] static void unsupported(Token const &token);
+
+  [[noreturn]] static void unsupported();
+
+  Thunk const *compile_child(Expr &expr) {
+    dispatch(expr, *this);
+    return m_thunk;
+  }
+
+  Thunk const *emit(Thunk thunk) {
+    return &m_compiled.m_thunks.emplace_back(std::move(thunk));
+  }
+
+private:
+  CompiledExpr m_compiled;
+  /**
+   * The thunks of the shared subexpressions, compiled only once.
+   */
+  std::unordered_map<Expr const *, Thunk const *> m_shared_thunks;
+  Thunk const *m_thunk = nullptr;
+};
+
+} // namespace Lox
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace Lox {
+
+class Snapshot;
+class SourceMap;
+class Token;
+
+enum class ErrorCode : uint8_t {
+  // syntax errors
+  INVALID_CHARACTER,
+  UNTERMINATED_STRING,
+  INVALID_LITERAL,
+  EXPECT_EXPRESSION,
+  EXPECT_RIGHT_PAREN,
+  EXPECT_SEMICOLON,
+  EXPECT_VARIABLE_NAME,
+  EXPECT_CLASS_NAME,
+  EXPECT_SUPERCLASS_NAME,
+  EXPECT_LEFT_BRACE_BEFORE_CLASS_BODY,
+  EXPECT_RIGHT_BRACE_AFTER_CLASS_BODY,
+  EXPECT_FUNCTION_NAME,
+  EXPECT_METHOD_NAME,
+  EXPECT_LEFT_PAREN_AFTER_NAME,
+  EXPECT_PARAMETER_NAME,
+  EXPECT_RIGHT_PAREN_AFTER_PARAMETERS,
+  EXPECT_LEFT_BRACE_BEFORE_BODY,
+  EXPECT_RIGHT_BRACE_AFTER_BLOCK,
+  EXPECT_RIGHT_PAREN_AFTER_ARGUMENTS,
+  EXPECT_PROPERTY_NAME,
+  EXPECT_DOT_AFTER_SUPER,
+  EXPECT_LEFT_PAREN_AFTER_IF,
+  EXPECT_LEFT_PAREN_AFTER_WHILE,
+  EXPECT_LEFT_PAREN_AFTER_FOR,
+  EXPECT_RIGHT_PAREN_AFTER_CONDITION,
+  EXPECT_SEMICOLON_AFTER_LOOP_CONDITION,
+  EXPECT_RIGHT_PAREN_AFTER_FOR_CLAUSES,
+  EXPECT_RIGHT_BRACKET_AFTER_ELEMENTS,
+  EXPECT_RIGHT_BRACKET_AFTER_INDEX,
+  EXPECT_COLON_AFTER_KEY,
+  EXPECT_RIGHT_BRACE_AFTER_ENTRIES,
+  INVALID_ASSIGNMENT_TARGET,
+  ALREADY_DECLARED,
+  READ_IN_OWN_INITIALIZER,
+  RETURN_FROM_TOP_LEVEL,
+  RETURN_VALUE_FROM_INITIALIZER,
+  THIS_OUTSIDE_CLASS,
+  SUPER_OUTSIDE_CLASS,
+  SUPER_WITHOUT_SUPERCLASS,
+  INHERIT_FROM_ITSELF,
+  NATIVE_WRONG_ARITY,
+  TYPE_OPERAND_MUST_BE_NUMBER,
+  TYPE_OPERANDS_MUST_BE_NUMBERS,
+  TYPE_OPERANDS_MUST_BE_NUMBERS_OR_STRINGS,
+
+  // runtime errors
+  OPERAND_MUST_BE_NUMBER,
+  OPERANDS_MUST_BE_NUMBERS,
+  OPERANDS_MUST_BE_NUMBERS_OR_STRINGS,
+  STRING_TOO_LONG,
+  OPERANDS_MUST_BE_NUMBERS_OR_ARRAYS,
+  ARRAY_LENGTHS_DIFFER,
+  UNDEFINED_VARIABLE,
+  UNDEFINED_PROPERTY,
+  ONLY_INSTANCES_HAVE_PROPERTIES,
+  ONLY_INSTANCES_HAVE_FIELDS,
+  ONLY_ARRAYS_AND_MAPS_HAVE_ELEMENTS,
+  INDEX_MUST_BE_INTEGER,
+  INDEX_OUT_OF_RANGE,
+  UNDEFINED_KEY,
+  NOT_CALLABLE,
+  WRONG_ARITY,
+  SUPERCLASS_MUST_BE_CLASS,
+  STACK_OVERFLOW,
+  ARGUMENT_MUST_BE_NUMBER,
+  ARGUMENT_MUST_BE_STRING,
+  ARGUMENT_MUST_BE_BOOLEAN,
+  ARGUMENT_MUST_BE_ARRAY,
+  ARGUMENT_MUST_BE_MAP,
+  ARGUMENT_MUST_BE_ARRAY_OR_MAP,
+  OUT_OF_MEMORY,
+  STEP_BUDGET_EXHAUSTED,
+  INTERRUPTED,
+  NATIVE_IS_ASYNC,
+  NATIVE_FAILED,
+};
+
+char const *to_message(ErrorCode code);
+
+inline bool is_runtime_error(ErrorCode code) {
+  return code >= ErrorCode::OPERAND_MUST_BE_NUMBER;
+}
+
+/**
+ * A Lox error, which only keeps structured data. It is formatted by
+ * `to_string()` when it is reported, so the token it refers to must be alive
+ * until then.
+ */
+struct Diagnostic {
+  ErrorCode code;
+  uint32_t offset;
+  Token const *token;
+};
+
+/**
+ * @brief Format `diagnostic`, its line and column are looked up in
+ *        `source_map`, or in the source map of `prelude` for an error in
+ *        the code of the prelude.
+ */
+std::string to_string(Diagnostic const &diagnostic,
+                      SourceMap const &source_map,
+                      Snapshot const *prelude = nullptr);
+
+} // namespace Lox
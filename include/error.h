@@ -1,5 +1,7 @@
 #pragma once
 
+#include "diagnostic.h"
+
 #include <cstdio>
 #include <cstring>
 #include <exception>
@@ -10,32 +12,22 @@
 
 namespace Lox {
 
-extern std::vector<std::string> syntax_error_msgs;
+extern std::vector<Diagnostic> syntax_errors;
 
 /**
- * @brief Insert an error message into `syntax_error_msgs`, which can be dumped
- * later.
+ * @brief Insert an error into `syntax_errors`, which can be dumped later.
  */
-inline void syntax_error(int lineno, char const *msg) {
-  std::ostringstream oss;
-  if (!syntax_error_msgs.empty()) {
-    oss << '\n';
-  }
-  oss << "error: " << lineno << ": " << msg;
-  syntax_error_msgs.emplace_back(std::move(oss).str());
+inline void syntax_error(Diagnostic const &diagnostic) {
+  syntax_errors.push_back(diagnostic);
 }
 
 /**
- * @brief Dump all messages from `msgs`. After this, `msgs` is empty.
+ * @brief Format and dump all errors from `errors`, one per line, see
+ * `to_string()`. After this, `errors` is empty.
  */
-inline std::string dump_error_msgs(std::vector<std::string> &msgs) {
-  std::ostringstream oss;
-  for (auto &&msg : msgs) {
-    oss << std::move(msg);
-  }
-  msgs.clear();
-  return std::move(oss).str();
-}
+std::string dump_errors(std::vector<Diagnostic> &errors,
+                        SourceMap const &source_map,
+                        Snapshot const *prelude = nullptr);
 
 class Exception : public std::exception {
 public:
@@ -63,7 +55,7 @@ protected:
 
 #define THROW_ASSERT(pred, msg)                                                \
   do {                                                                         \
-    if (!pred) {                                                               \
+    if (!(pred)) {                                                             \
       throw Lox::Exception(msg);                                               \
     }                                                                          \
   } while (false);
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "diagnostic.h"
+
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace Lox {
+
+/**
+ * The error alternative of `Expected`, see `std::unexpected`.
+ */
+template <typename E> struct Unexpected {
+  E error;
+};
+
+template <typename E> Unexpected(E) -> Unexpected<E>;
+
+/**
+ * Either a value or an error, a subset of C++23 `std::expected`. Lox errors
+ * are propagated by returning it instead of throwing.
+ */
+template <typename T, typename E = Diagnostic> class [[nodiscard]] Expected {
+public:
+  template <typename U = T>
+    requires std::is_constructible_v<T, U &&>
+  Expected(U &&value)
+      : m_data(std::in_place_index<0>, std::forward<U>(value)) {}
+
+  Expected(Unexpected<E> error)
+      : m_data(std::in_place_index<1>, std::move(error.error)) {}
+
+  [[nodiscard]] bool has_value() const noexcept { return m_data.index() == 0; }
+
+  explicit operator bool() const noexcept { return has_value(); }
+
+  [[nodiscard]] T &value() & { return *std::get_if<0>(&m_data); }
+
+  [[nodiscard]] T &&value() && { return std::move(*std::get_if<0>(&m_data)); }
+
+  [[nodiscard]] E const &error() const & { return *std::get_if<1>(&m_data); }
+
+  [[nodiscard]] E &&error() && { return std::move(*std::get_if<1>(&m_data)); }
+
+private:
+  std::variant<T, E> m_data;
+};
+
+template <typename E> class [[nodiscard]] Expected<void, E> {
+public:
+  Expected() = default;
+
+  Expected(Unexpected<E> error) : m_error(std::move(error.error)) {}
+
+  [[nodiscard]] bool has_value() const noexcept { return !m_error; }
+
+  explicit operator bool() const noexcept { return has_value(); }
+
+  [[nodiscard]] E const &error() const & { return *m_error; }
+
+  [[nodiscard]] E &&error() && { return std::move(*m_error); }
+
+private:
+  std::optional<E> m_error;
+};
+
+#define LOX_CONCAT_IMPL(a, b) a##b
+#define LOX_CONCAT(a, b) LOX_CONCAT_IMPL(a, b)
+
+/**
+ * Evaluate `rexpr` of type `Expected`, return its error from the current
+ * function, or otherwise assign its value to `lhs`.
+ */
+#define TRY_ASSIGN(lhs, rexpr)                                                 \
+  auto &&LOX_CONCAT(expected_, __LINE__) = (rexpr);                            \
+  if (!LOX_CONCAT(expected_, __LINE__)) {                                      \
+    return Unexpected{std::move(LOX_CONCAT(expected_, __LINE__)).error()};     \
+  }                                                                            \
+  lhs = std::move(LOX_CONCAT(expected_, __LINE__)).value();
+
+/**
+ * Evaluate `rexpr` of type `Expected<void>`, return its error from the
+ * current function.
+ */
+#define TRY(rexpr)                                                             \
+  do {                                                                         \
+    auto &&expected = (rexpr);                                                 \
+    if (!expected) {                                                           \
+      return Unexpected{std::move(expected).error()};                          \
+    }                                                                          \
+  } while (false)
+
+} // namespace Lox
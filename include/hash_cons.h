@@ -0,0 +1,113 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "program.h"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Lox {
+
+/**
+ * Share structurally identical subexpressions while an expression is being
+ * built, turning the tree into a DAG.
+ *
+ * Every node is given the id of its structure: literals by value, the other
+ * nodes by their operator and the ids of their children. A node whose
+ * structure was already seen is replaced by a `Shared` node referring to the
+ * first one, which is kept as the canonical node. Literals are never
+ * replaced, a `Shared` node would not be any smaller. Only nodes without side
+ * effects, whose value only depends on their structure, are shared: any
+ * other node gets a structure of its own.
+ */
+class HashConsTable {
+public:
+  HashConsTable() = default;
+
+  HashConsTable(HashConsTable const &) = delete;
+
+  HashConsTable &operator=(HashConsTable const &) = delete;
+
+  ~HashConsTable() noexcept = default;
+
+  /**
+   * @brief Return `expr`, or a `Shared` node referring to the canonical node
+   *        with the same structure. The children of `expr` must have been
+   *        interned already.
+   */
+  ExprPtr intern(std::unique_ptr<Literal> expr);
+
+  ExprPtr intern(std::unique_ptr<Unary> expr);
+
+  ExprPtr intern(std::unique_ptr<Binary> expr);
+
+  ExprPtr intern(std::unique_ptr<Grouping> expr);
+
+  /**
+   * @brief Give a node which must not be shared a structure of its own.
+   */
+  ExprPtr intern(ExprPtr expr);
+
+  /**
+   * @brief Once `root` is complete, wrap every canonical node which is
+   *        referred to in an owning `Shared` node, so that all occurrences
+   *        of a shared subexpression are `Shared` nodes.
+   */
+  void wrap_shared(ExprPtr &root);
+
+  void wrap_shared(Program &program);
+
+private:
+  enum class Kind : uint8_t { LITERAL, UNARY, BINARY, GROUPING };
+
+  struct Key {
+    bool operator==(Key const &) const = default;
+
+    Kind kind;
+    TokenType type;
+    /**
+     * The value of a STRING literal.
+     */
+    std::string_view text;
+    /**
+     * The value of a NUMBER literal.
+     */
+    double number;
+    uint32_t left;
+    uint32_t right;
+  };
+
+  struct KeyHash {
+    std::size_t operator()(Key const &key) const noexcept;
+  };
+
+  struct Entry {
+    uint32_t id;
+    Expr *canonical;
+  };
+
+  /**
+   * @brief The structure id of `expr`, which must have been interned.
+   */
+  uint32_t id_of(ExprPtr const &expr) const { return m_ids.at(expr.get()); }
+
+  ExprPtr intern(ExprPtr expr, Key const &key);
+
+private:
+  std::unordered_map<Key, Entry, KeyHash> m_entries;
+  uint32_t m_next_id = 0;
+  /**
+   * The structure id of every interned node. Nodes dropped by `intern()` may
+   * leave stale entries, they are overwritten when their address is reused,
+   * since every node is interned right after it is built.
+   */
+  std::unordered_map<Expr const *, uint32_t> m_ids;
+  /**
+   * The canonical nodes referred to by at least one `Shared` node.
+   */
+  std::unordered_set<Expr const *> m_targets;
+};
+
+} // namespace Lox
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "scanner.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Lox {
+
+/**
+ * Own a source together with its tokens, and keep the tokens up to date when
+ * the source is edited.
+ *
+ * The source is split into chunks of about `kChunkSize` bytes, always at the
+ * start of a token, each holding its tokens and errors at offsets relative to
+ * the chunk. The sizes of the chunks are summed by a Fenwick tree, so an edit
+ * finds its chunk in logarithmic time and only rewrites the chunks it
+ * touches: it re-scans them from the start of the chunk holding the last
+ * character a changed token may look at, up to the first old token which
+ * starts after the edited text at the same scanner state. The tokens and the
+ * errors are always identical to those of a scan from scratch.
+ *
+ * Parsing is not incremental: the nodes of the AST refer to their tokens, so
+ * a program is parsed again from `tokens()`.
+ */
+class IncrementalScanner {
+public:
+  /**
+   * @brief The size in bytes beyond which a re-scanned chunk is split.
+   */
+  static constexpr std::size_t kChunkSize = 4096;
+
+  explicit IncrementalScanner(std::string const &source);
+
+  IncrementalScanner(IncrementalScanner const &) = delete;
+
+  IncrementalScanner &operator=(IncrementalScanner const &) = delete;
+
+  ~IncrementalScanner() noexcept = default;
+
+  /**
+   * @brief The size in bytes of the source.
+   */
+  [[nodiscard]] uint64_t size() const noexcept { return m_size; }
+
+  /**
+   * @brief The whole source, joined from the chunks when it was edited since
+   *        the last call.
+   */
+  [[nodiscard]] std::string const &source() const;
+
+  /**
+   * @brief The tokens of the whole source, ended by `END`, joined from the
+   *        chunks when it was edited since the last call. Their lexemes refer
+   *        to `source()`.
+   */
+  [[nodiscard]] TokenList const &tokens() const;
+
+  /**
+   * @brief Replace `removed` bytes at `offset` of the source by `inserted`,
+   *        and update the tokens.
+   *
+   * @return The number of tokens which were re-scanned.
+   */
+  std::size_t edit(uint64_t offset, uint64_t removed,
+                   std::string_view inserted);
+
+  /**
+   * @brief Insert the errors of the current source into `syntax_errors`.
+   */
+  void report_errors() const;
+
+private:
+  struct Chunk {
+    std::string text;
+    TokenList tokens;
+    std::vector<ScanError> errors;
+  };
+
+  /**
+   * @brief Split `text`, scanned into `tokens` and `errors`, into chunks of
+   *        about `kChunkSize` bytes.
+   */
+  static std::vector<std::unique_ptr<Chunk>>
+  split(std::string text, TokenList tokens, std::vector<ScanError> errors);
+
+  /**
+   * @brief The offset in the source of the first byte of chunk `index`.
+   */
+  [[nodiscard]] uint64_t chunk_start(std::size_t index) const noexcept;
+
+  /**
+   * @brief The index of the chunk holding the byte at `offset`, the last
+   *        chunk for the end of the source.
+   */
+  [[nodiscard]] std::size_t chunk_at(uint64_t offset) const noexcept;
+
+  void build_tree();
+
+  /**
+   * @brief Join the chunks into `m_source` and `m_tokens`.
+   */
+  void join() const;
+
+  std::vector<std::unique_ptr<Chunk>> m_chunks;
+  /**
+   * @brief Fenwick tree of the sizes of the chunks, indexed from 1.
+   */
+  std::vector<uint64_t> m_tree;
+  uint64_t m_size = 0;
+
+  mutable std::string m_source;
+  mutable TokenList m_tokens;
+  mutable bool m_joined = false;
+};
+
+} // namespace Lox
@@ -1,17 +1,198 @@
 #pragma once
 
 #include "ast_defines.inc"
+#include "expected.h"
+#include "memory_account.h"
+#include "native.h"
+#include "object.h"
+#include "output_sink.h"
+#include "profiler.h"
+#include "program.h"
 #include "runtime_error.h"
+#include "snapshot.h"
+#include "task.h"
 #include "value.h"
 
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 namespace Lox {
 
 class Interpreter final : public AstNodeVisitor {
 public:
+  /**
+   * The default number of slots of the stack of frames, shared by all calls,
+   * see `set_stack_size()`.
+   */
+  static constexpr uint32_t kStackSize = 1 << 16;
+
+  /**
+   * The default maximum depth of calls, see `set_max_call_depth()`.
+   */
+  static constexpr uint32_t kMaxCallDepth = 4096;
+
+  /**
+   * No step budget, see `set_step_budget()`.
+   */
+  static constexpr uint64_t kUnlimitedSteps =
+      std::numeric_limits<uint64_t>::max();
+
+  /**
+   * How far the last run went, for a host which stopped it.
+   */
+  struct ExecutionReport {
+    /**
+     * The steps run, see `set_step_budget()`.
+     */
+    uint64_t steps = 0;
+    /**
+     * The depth of the calls in progress when the run was stopped by its
+     * budget or an interrupt, 0 otherwise.
+     */
+    uint32_t depth = 0;
+  };
+
+  /**
+   * @brief Run `program`, resolved by `Resolver`, and keep the value of its
+   *        result expression, if any, in `result()`. On a runtime error,
+   *        insert it into `runtime_errors`.
+   */
+  void interpret(Program &program);
+
+  /**
+   * @brief Run the prelude `program` like `interpret()`, and return the
+   *        values its globals are left with, to write a `Snapshot` of. On a
+   *        runtime error, insert it into `runtime_errors` and return
+   *        nothing.
+   */
+  [[nodiscard]] std::optional<Snapshot::Globals>
+  run_prelude(Program &program);
+
+  /**
+   * @brief Start running `program`, resolved by `Resolver`, as a coroutine
+   *        which suspends whenever it awaits an asynchronous native, instead
+   *        of blocking the thread, see `Deferred`. The result is the value
+   *        of the result expression of the program, if any, or its runtime
+   *        error, which is not inserted into `runtime_errors`.
+   *
+   * The program runs until its end or its first suspension before
+   * `start()` returns, then it is resumed by the natives it awaits. The
+   * subexpressions and the functions which call no asynchronous natives
+   * run as fast as `interpret()` runs them. An interpreter runs one program
+   * at a time, so hosts multiplexing many programs on one thread use one
+   * interpreter per program in progress, with a small stack.
+   */
+  [[nodiscard]] Evaluation<Expected<Value>> start(Program &program);
+
+  /**
+   * @brief Evaluate `expr`. On a runtime error, insert it into
+   *        `runtime_errors`.
+   */
   void interpret(Expr *expr);
 
+  /**
+   * @brief Evaluate `expr`, and return its value or its runtime error
+   *        instead of inserting it into `runtime_errors`.
+   */
+  [[nodiscard]] Expected<Value> try_interpret(Expr *expr);
+
+  /**
+   * @brief Apply the operator of `expr` to operands which are already
+   *        evaluated, used to combine subexpressions evaluated separately.
+   */
+  [[nodiscard]] Expected<Value> apply(Unary &expr, Value operand);
+
+  [[nodiscard]] Expected<Value> apply(Binary &expr, Value left, Value right);
+
   [[nodiscard]] Value result() const { return m_result; }
 
+  /**
+   * @brief Report every evaluation to `profiler`, or stop reporting if it is
+   *        `nullptr`.
+   */
+  void set_profiler(Profiler *profiler) noexcept { m_profiler = profiler; }
+
+  /**
+   * @brief Write the `print` statements to `output`, which must outlive the
+   *        runs, instead of the standard output. Nothing is flushed before
+   *        `output->flush()`.
+   */
+  void set_output(OutputSink &output) noexcept { m_output = &output; }
+
+  [[nodiscard]] OutputSink &output() const noexcept { return *m_output; }
+
+  /**
+   * @brief Allocate the objects, the strings and the closures the scripts
+   *        create from `memory`, which must outlive them, for instance a
+   *        `MemoryAccount`. A `MemoryLimitError` it throws is an
+   *        `OUT_OF_MEMORY` error at the expression which allocated.
+   */
+  void set_memory(std::pmr::memory_resource &memory) noexcept {
+    m_memory = &memory;
+    m_string_memory = true;
+  }
+
+  /**
+   * @brief Start every run of a program from a copy of the globals of
+   *        `snapshot`, which must outlive the runs, or from the natives
+   *        alone if it is `nullptr`. The programs must be resolved against
+   *        it, see `Resolver`.
+   */
+  void set_snapshot(Snapshot const *snapshot) noexcept {
+    m_snapshot = snapshot;
+  }
+
+  /**
+   * @brief Give the stack of frames `slots` slots, allocated on first use,
+   *        instead of `kStackSize`. Calls which need more raise a stack
+   *        overflow. Only between runs.
+   */
+  void set_stack_size(uint32_t slots) {
+    m_stack_size = slots;
+    m_stack = {};
+  }
+
+  /**
+   * @brief Raise a stack overflow on calls deeper than `depth`. Tail calls
+   *        reuse the frame of their caller, they do not count. Whatever the
+   *        depth, a stack overflow is also raised before the native stack
+   *        runs out.
+   */
+  void set_max_call_depth(uint32_t depth) noexcept { m_max_call_depth = depth; }
+
+  /**
+   * @brief Stop each run after `steps` steps, with a `STEP_BUDGET_EXHAUSTED`
+   *        error. A step is an iteration of a loop or a call, the points
+   *        where a run is checked as without them it cannot run for long.
+   */
+  void set_step_budget(uint64_t steps) noexcept { m_step_budget = steps; }
+
+  /**
+   * @brief Stop the current run at its next step, with an `INTERRUPTED`
+   *        error. Safe to call from any thread. If no run is in progress,
+   *        the next one stops at its first step.
+   */
+  void interrupt() noexcept {
+    m_interrupt.store(true, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] ExecutionReport report() const noexcept {
+    return {m_step_budget - m_fuel, m_stopped_depth};
+  }
+
+  /**
+   * @brief The natives defined in the programs this interpreter runs, which
+   *        must be resolved against them.
+   */
+  [[nodiscard]] NativeRegistry &natives() noexcept { return m_natives; }
+
   void visit(Literal &) override;
 
   void visit(Binary &) override;
@@ -20,29 +201,681 @@ public:
 
   void visit(Grouping &) override;
 
+  void visit(Logical &) override;
+
+  void visit(Constant &) override;
+
+  void visit(Hoisted &) override;
+
+  void visit(Shared &) override;
+
+  void visit(Variable &) override;
+
+  void visit(Assign &) override;
+
+  void visit(Call &) override;
+
+  void visit(Get &) override;
+
+  void visit(Set &) override;
+
+  void visit(Invoke &) override;
+
+  void visit(Array &) override;
+
+  void visit(Map &) override;
+
+  void visit(Index &) override;
+
+  void visit(SetIndex &) override;
+
+  void visit(This &) override;
+
+  void visit(Super &) override;
+
+  void visit(Expression &) override;
+
+  void visit(Print &) override;
+
+  void visit(Var &) override;
+
+  void visit(Block &) override;
+
+  void visit(If &) override;
+
+  void visit(While &) override;
+
+  void visit(Function &) override;
+
+  void visit(Class &) override;
+
+  void visit(Return &) override;
+
   ~Interpreter() noexcept override = default;
 
 private:
   /**
    * @brief Evaluate the value of `expr`, and get the value using `result()`.
+   *
+   * @return `false` if a runtime error occurred, which is kept in `m_error`.
+   */
+  [[nodiscard]] bool evaluate(Expr *expr) {
+    if (m_profiler != nullptr) [[unlikely]] {
+      m_profiler->enter(expr);
+      dispatch(*expr, *this);
+      m_profiler->leave();
+    } else {
+      dispatch(*expr, *this);
+    }
+    return !m_error;
+  }
+
+  /**
+   * @brief Run `stmts` until the end, a `return` or a runtime error.
+   *
+   * @return `false` if a runtime error occurred, which is kept in `m_error`.
+   */
+  [[nodiscard]] bool execute(StmtList const &stmts) {
+    for (auto const &stmt : stmts) {
+      dispatch(*stmt, *this);
+      if (m_error) {
+        return false;
+      } else if (m_returning) {
+        break;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Whether running `expr` may await an asynchronous native, that is
+   *        whether it calls anything but a synchronous native bound by
+   *        `Resolver`. Cached per node for the current run.
+   */
+  [[nodiscard]] bool may_suspend(Expr &expr);
+
+  [[nodiscard]] bool may_suspend(Stmt &stmt);
+
+  [[nodiscard]] bool may_suspend(StmtList const &stmts);
+
+  /**
+   * @brief `evaluate()` as a coroutine, which suspends while it awaits an
+   *        asynchronous native. What cannot suspend runs through
+   *        `evaluate()`, without a coroutine of its own.
+   */
+  [[nodiscard]] Task<bool> evaluate_async(Expr &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Binary &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Unary &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Grouping &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Logical &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Assign &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Call &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Get &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Set &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Invoke &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Array &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Map &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(Index &expr);
+
+  [[nodiscard]] Task<bool> evaluate_async(SetIndex &expr);
+
+  /**
+   * @brief `execute()` as a coroutine, see `evaluate_async()`.
+   */
+  [[nodiscard]] Task<bool> execute_async(StmtList const &stmts);
+
+  [[nodiscard]] Task<bool> execute_async(Stmt &stmt);
+
+  [[nodiscard]] Task<bool> execute_async(Expression &stmt);
+
+  [[nodiscard]] Task<bool> execute_async(Print &stmt);
+
+  [[nodiscard]] Task<bool> execute_async(Var &stmt);
+
+  [[nodiscard]] Task<bool> execute_async(If &stmt);
+
+  [[nodiscard]] Task<bool> execute_async(While &stmt);
+
+  [[nodiscard]] Task<bool> execute_async(Return &stmt);
+
+  [[nodiscard]] Value &local(VariableSlot slot) {
+    return m_stack[m_frame_base + slot.index];
+  }
+
+  [[nodiscard]] static Cell &cell(Value const &boxed) {
+    return static_cast<Cell &>(*boxed.object());
+  }
+
+  /**
+   * @brief The variables captured by a closure of `declaration` created
+   *        now, in the frame of the current call.
+   */
+  [[nodiscard]] Captures capture(Function const &declaration);
+
+  /**
+   * @brief Start a run with the whole step budget.
+   */
+  void start_run() noexcept {
+    m_fuel = m_step_budget;
+    m_stopped_depth = 0;
+  }
+
+  /**
+   * @brief Take a step at `where`: return `false` with an error if the
+   *        budget is exhausted or an interrupt was requested.
+   */
+  [[nodiscard]] bool step(Token const &where) {
+    if (m_fuel == 0 || m_interrupt.load(std::memory_order_relaxed))
+        [[unlikely]] {
+      return stop(where);
+    }
+    --m_fuel;
+    return true;
+  }
+
+  [[nodiscard]] bool stop(Token const &where);
+
+  /**
+   * @brief Build an object from the memory resource, for the expression at
+   *        `where`.
+   */
+  template <typename T, typename... Args>
+  [[nodiscard]] std::shared_ptr<T> make(Token const &where, Args &&...args) {
+    m_allocating = &where;
+    return std::allocate_shared<T>(
+        std::pmr::polymorphic_allocator<>(m_memory),
+        std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Concatenate `left` and `m_result` into `m_result`, for `op`, or
+   *        record an error if the result would be too long.
+   */
+  void concat(Token const &op, Value const &left) {
+    if (concat_too_long(left, m_result)) [[unlikely]] {
+      error(op, ErrorCode::STRING_TOO_LONG);
+      return;
+    }
+    m_allocating = &op;
+    m_result = Lox::concat(left, m_result, m_memory);
+    if (m_string_memory && m_result.str_size() < kRopeMinBytes) {
+      m_result = make_string(op, m_result.str());
+    }
+  }
+
+  /**
+   * @brief The string `str`, for the expression at `where`. After
+   *        `set_memory()`, a string too long to be stored inline is a rope
+   *        allocated from the memory resource instead of a `std::string`
+   *        from the global heap: it is accounted, and the values it is
+   *        copied to share it.
+   */
+  [[nodiscard]] Value make_string(Token const &where, std::string_view str) {
+    if (m_string_memory && str.size() > kInlineStringBytes) {
+      return make<Rope const>(where, str, m_memory);
+    }
+    return std::string(str);
+  }
+
+  /**
+   * @brief Run `evaluate`, turning a `MemoryLimitError` into an
+   *        `OUT_OF_MEMORY` error. The calls it interrupted are unwound back
+   *        to where `evaluate` started.
+   */
+  template <typename F> [[nodiscard]] bool out_of_memory_guard(F &&evaluate) {
+    uint32_t const frame_base = m_frame_base;
+    uint32_t const frame_top = m_frame_top;
+    uint32_t const depth = m_depth;
+    LoxFunction const *const function = m_function;
+    try {
+      return evaluate();
+    } catch (MemoryLimitError const &) {
+      if (m_frame_top > frame_top) {
+        unwind(frame_top);
+      }
+      m_frame_top = frame_top;
+      m_frame_base = frame_base;
+      m_depth = depth;
+      m_function = function;
+      out_of_memory();
+      return false;
+    }
+  }
+
+  /**
+   * @brief Report an `OUT_OF_MEMORY` error at the expression which
+   *        allocated last.
+   */
+  void out_of_memory() {
+    m_returning = false;
+    m_tail_call.reset();
+    Token const *const where = std::exchange(m_allocating, nullptr);
+    m_error = Diagnostic{ErrorCode::OUT_OF_MEMORY,
+                         where != nullptr ? where->offset() : 0, where};
+  }
+
+  /**
+   * @brief Run `program` for `interpret()`, up to its end or its first
+   *        runtime error, which is kept in `m_error`.
+   */
+  [[nodiscard]] bool run_program(Program &program);
+
+  /**
+   * @brief Run `program` for `start()`, once it is set up, unless `begun`
+   *        is `false`.
+   */
+  [[nodiscard]] Evaluation<Expected<Value>> run_async(Program &program,
+                                                      bool begun);
+
+  /**
+   * @brief Set up the globals and the top-level frame of `program`.
+   *
+   * @return `false` if copying the globals of the snapshot ran out of
+   *         memory, which is kept in `m_error`.
+   */
+  [[nodiscard]] bool begin(Program &program);
+
+  /**
+   * @brief Release what the run of a program left behind.
+   */
+  void end() noexcept;
+
+  /**
+   * @brief Load the variable at `slot` into `m_result`.
    */
-  void evaluate(Expr *expr) { expr->accept(*this); }
+  void load(Token const &name, VariableSlot slot);
 
-  void check_number_operands(Token const &op, Value const &operand) {
+  /**
+   * @brief Store `m_result` into the variable at `slot`, which must be
+   *        defined unless it is being `declared`.
+   */
+  void store(Token const &name, VariableSlot slot, bool declared);
+
+  /**
+   * @brief Push `m_result` on top of the stack.
+   */
+  [[nodiscard]] bool push(Token const &token);
+
+  /**
+   * @brief Pop the slots above `base`.
+   */
+  void unwind(uint32_t base);
+
+  /**
+   * @brief Push the callee of `expr` and its arguments on top of the stack.
+   *        On failure, the caller pops what was pushed.
+   */
+  [[nodiscard]] bool push_call(Call &expr, uint32_t &argc);
+
+  /**
+   * @brief Push the receiver of `expr` and its arguments on top of the
+   *        stack. `method` is set to the method to call on the receiver, or
+   *        to `nullptr` if the property is a field, which is pushed as the
+   *        callee instead. On failure, the caller pops what was pushed.
+   */
+  [[nodiscard]] bool push_invoke(Invoke &expr, LoxFunction const *&method,
+                                 uint32_t &argc);
+
+  /**
+   * @brief Push the receiver of `expr`, in `m_result`, and set `method` as
+   *        `push_invoke()` does.
+   */
+  [[nodiscard]] bool push_receiver(Invoke &expr, LoxFunction const *&method);
+
+  [[nodiscard]] bool push_arguments(Token const &paren,
+                                    ExprList const &arguments, uint32_t &argc);
+
+  [[nodiscard]] Task<bool> push_call_async(Call &expr, uint32_t &argc);
+
+  [[nodiscard]] Task<bool> push_invoke_async(Invoke &expr,
+                                             LoxFunction const *&method,
+                                             uint32_t &argc);
+
+  [[nodiscard]] Task<bool> push_arguments_async(Token const &paren,
+                                                ExprList const &arguments,
+                                                uint32_t &argc);
+
+  /**
+   * @brief Replace the frame of the current call by the frame of the call
+   *        `expr`, a `Call` or an `Invoke`, which `call_function()` runs
+   *        once the current call returned.
+   */
+  void tail_call(Expr &expr);
+
+  [[nodiscard]] Task<bool> tail_call_async(Expr &expr);
+
+  /**
+   * @brief Move the callee and the arguments of a tail call, pushed from
+   *        slot `base`, over the frame of the current call.
+   */
+  void replace_frame(Token const &paren, LoxFunction const *method,
+                     uint32_t base, uint32_t argc);
+
+  /**
+   * What calling a value takes: running a function, or calling a native.
+   * Neither, if it was done already or failed.
+   */
+  struct Callee {
+    LoxFunction const *function = nullptr;
+    NativeFunction const *native = nullptr;
+  };
+
+  /**
+   * @brief Prepare the call of the callee in slot `base` with the `argc`
+   *        arguments above it. A bound method or a class is replaced by the
+   *        receiver of the function to run. A class without an initializer
+   *        is instantiated into `m_result` right away.
+   */
+  [[nodiscard]] Callee prepare_call(Token const &paren, uint32_t base,
+                                    uint32_t argc);
+
+  /**
+   * @brief Call the callee in slot `base` with the `argc` arguments above it.
+   */
+  void call_value(Token const &paren, uint32_t base, uint32_t argc);
+
+  [[nodiscard]] Task<bool> call_value_async(Token const &paren, uint32_t base,
+                                            uint32_t argc);
+
+  /**
+   * @brief Call `native` on its arguments, pushed from slot `base`.
+   */
+  void call_native(Token const &paren, NativeFunction const &native,
+                   uint32_t base);
+
+  /**
+   * @brief `call_native()`, awaiting the result of an asynchronous native.
+   */
+  [[nodiscard]] Task<bool> call_native_async(Token const &paren,
+                                             NativeFunction const &native,
+                                             uint32_t base);
+
+  /**
+   * @brief Start the call of the asynchronous `native`, and await it.
+   */
+  [[nodiscard]] Task<bool> await_native(Token const &paren,
+                                        NativeFunction const &native,
+                                        uint32_t base);
+
+  /**
+   * @brief Call `function` on the frame starting at `base`, whose slot 0
+   *        holds the receiver, then the tail calls it makes, if any.
+   */
+  void call_function(Token const &paren, LoxFunction const &function,
+                     uint32_t base, uint32_t argc);
+
+  [[nodiscard]] Task<bool> call_function_async(Token const &paren,
+                                               LoxFunction const &function,
+                                               uint32_t base, uint32_t argc);
+
+  /**
+   * @brief Run the body of `function` on the frame starting at `base`.
+   *
+   * @return `false` if a runtime error occurred, which is kept in `m_error`.
+   */
+  [[nodiscard]] bool run(Token const &paren, LoxFunction const &function,
+                         uint32_t base, uint32_t argc);
+
+  /**
+   * @brief Set up the frame starting at `base` for the body of `function`.
+   */
+  [[nodiscard]] bool enter(Token const &paren, LoxFunction const &function,
+                           uint32_t base, uint32_t argc);
+
+  /**
+   * @brief Set the result of the call of `function` which ran to its end,
+   *        once its body was executed.
+   */
+  void leave(LoxFunction const &function, uint32_t base, bool ok);
+
+  /**
+   * @brief What to do for the pending tail call, whose callee is in slot
+   *        `base`.
+   */
+  [[nodiscard]] Callee next_tail_call(uint32_t base);
+
+  /**
+   * @brief How far calls may grow the native stack: half of its limit, so
+   *        that the frames of the evaluation itself always fit.
+   */
+  [[nodiscard]] static uintptr_t native_stack_budget();
+
+  /**
+   * @brief Measure the native stack from here. An asynchronous run calls it
+   *        whenever it is resumed, maybe on the stack of another thread.
+   */
+  void mark_native_stack() noexcept {
+    char const marker = 0;
+    m_native_stack_base = reinterpret_cast<uintptr_t>(&marker);
+  }
+
+  [[nodiscard]] bool native_stack_exhausted() const noexcept {
+    char const marker = 0;
+    auto const here = reinterpret_cast<uintptr_t>(&marker);
+    return m_native_stack_base != 0 &&
+           m_native_stack_base - here > m_native_stack_budget;
+  }
+
+  struct Property {
+    LoxFunction const *method;
+    uint32_t slot;
+  };
+
+  /**
+   * @brief Find the property `name` of `instance`: a field at `slot`, or a
+   *        method of its class. The result is cached per shape in `cache`.
+   */
+  [[nodiscard]] static std::optional<Property>
+  find_property(PropertyCache &cache, LoxInstance const &instance,
+                std::string_view name);
+
+  /**
+   * @brief Read the property of `expr` of the object in `m_result`.
+   */
+  void get_property(Get &expr);
+
+  /**
+   * @brief Write `m_result` to the field of `expr` of `instance`.
+   */
+  void set_field(Set &expr, LoxInstance &instance);
+
+  /**
+   * @brief Read the element of `array` at the index in `m_result`.
+   */
+  void get_element(Index &expr, LoxArray const &array);
+
+  /**
+   * @brief Write `m_result` to the element of `array` at `index`, which may
+   *        be its size, to append it.
+   */
+  void set_element(SetIndex &expr, LoxArray &array, Value const &index);
+
+  /**
+   * @brief Read the value of the key in `m_result` from `map`.
+   */
+  void get_entry(Index &expr, LoxMap const &map);
+
+  /**
+   * @brief Write `m_result` as the value of `key` in `map`.
+   */
+  void set_entry(SetIndex &expr, LoxMap &map, Value key);
+
+  /**
+   * @brief The hash of `key`, the value of the key expression `index`,
+   *        kept by `cache` if `index` is a constant.
+   */
+  [[nodiscard]] std::size_t key_hash(KeyHashCache &cache, Expr const &index,
+                                     Value const &key);
+
+  /**
+   * @brief Whether `m_result` is an array or a map, recording the error at
+   *        `bracket` if not.
+   */
+  [[nodiscard]] bool check_container(Token const &bracket);
+
+  /**
+   * @brief `index` as an index below `limit`, or nothing after recording the
+   *        error at `bracket`.
+   */
+  [[nodiscard]] std::optional<std::size_t>
+  element_index(Token const &bracket, Value const &index, std::size_t limit);
+
+  /**
+   * @brief Apply the operator of `expr` to `m_result`.
+   */
+  void apply_unary(Unary &expr);
+
+  /**
+   * @brief Apply the unary operator `op` to `m_result`.
+   */
+  void apply_unary(Token const &op);
+
+  /**
+   * @brief Apply the operator of `expr` to `left` and `m_result`.
+   */
+  void apply_binary(Binary &expr, Value const &left);
+
+  /**
+   * @brief Apply the binary operator `op` to `left` and `m_result`.
+   */
+  void apply_binary(Token const &op, Value const &left);
+
+  /**
+   * @brief Apply the binary operator `op` to `left` and `m_result`, which
+   *        `TypeChecker` proved to be numbers, or strings for a `+`.
+   */
+  void apply_unchecked(Token const &op, Value const &left);
+
+  /**
+   * @brief Apply the binary operator `op` element-wise to `left` and
+   *        `m_result` if either is an array, see `broadcast()`, or record
+   *        the error `code`.
+   */
+  void apply_element_wise(Token const &op, Value const &left, ErrorCode code);
+
+  /**
+   * @brief Record the runtime error `code` found at `token`.
+   */
+  void error(Token const &token, ErrorCode code) {
+    m_error = Diagnostic{code, token.offset(), &token};
+  }
+
+  [[nodiscard]] bool check_number_operands(Token const &op,
+                                           Value const &operand) {
     if (!operand.is_number()) {
-      throw RuntimeError(op, "Operand must be a number.");
+      error(op, ErrorCode::OPERAND_MUST_BE_NUMBER);
+      return false;
     }
+    return true;
   }
 
-  void check_number_operands(Token const &op, Value const &left,
-                             Value const &right) {
-    if (!left.is_number() || !right.is_number()) {
-      throw RuntimeError(op, "Operands must be numbers.");
+  /**
+   * @brief Whether `left` and `m_result` are numbers, which the binary
+   *        operator `op` applies to. If not, `op` is applied element-wise
+   *        if either is an array, or the error is recorded.
+   */
+  [[nodiscard]] bool number_operands(Token const &op, Value const &left) {
+    if (left.is_number() && m_result.is_number()) [[likely]] {
+      return true;
     }
+    apply_element_wise(op, left, ErrorCode::OPERANDS_MUST_BE_NUMBERS);
+    return false;
   }
 
 private:
   Value m_result;
+  std::optional<Diagnostic> m_error;
+  /**
+   * The values of the shared subexpressions evaluated by the current
+   * `interpret()` call. Only expressions without side effects are shared,
+   * so a shared subexpression always has the same value.
+   */
+  std::unordered_map<Expr const *, Value> m_shared_values;
+  /**
+   * The answers of `may_suspend()` in the current run of `start()`.
+   */
+  std::unordered_map<void const *, bool> m_suspends;
+  /**
+   * Whether a run of `start()` is in progress.
+   */
+  bool m_started = false;
+  Profiler *m_profiler = nullptr;
+  OutputSink *m_output = &stdout_sink();
+  std::pmr::memory_resource *m_memory = std::pmr::new_delete_resource();
+  /**
+   * Whether the strings are allocated from `m_memory`, see `make_string()`.
+   */
+  bool m_string_memory = false;
+  /**
+   * The expression which allocated last, where running out of memory is
+   * reported.
+   */
+  Token const *m_allocating = nullptr;
+
+  struct Global {
+    Value value;
+    bool defined = false;
+  };
+
+  NativeRegistry m_natives;
+  Snapshot const *m_snapshot = nullptr;
+  std::vector<Global> m_globals;
+  /**
+   * The frames of the calls in progress: a frame holds the receiver, the
+   * arguments and the locals of a call, and starts at `m_frame_base`. The
+   * slots from `m_frame_top` on are free. Allocated on first use.
+   */
+  std::vector<Value> m_stack;
+  uint32_t m_stack_size = kStackSize;
+  uint32_t m_frame_base = 0;
+  uint32_t m_frame_top = 0;
+  uint32_t m_depth = 0;
+  uint32_t m_max_call_depth = kMaxCallDepth;
+  uint64_t m_step_budget = kUnlimitedSteps;
+  /**
+   * The steps left to the current run.
+   */
+  uint64_t m_fuel = kUnlimitedSteps;
+  uint32_t m_stopped_depth = 0;
+  std::atomic<bool> m_interrupt{false};
+  /**
+   * The address of the native stack when `interpret()` started, and how far
+   * calls may grow it.
+   */
+  uintptr_t m_native_stack_base = 0;
+  uintptr_t m_native_stack_budget = 0;
+  /**
+   * The function being run, `nullptr` at the top level.
+   */
+  LoxFunction const *m_function = nullptr;
+  /**
+   * Whether a `return` is unwinding the statements of the current call.
+   */
+  bool m_returning = false;
+
+  struct TailCall {
+    Token const *paren;
+    LoxFunction const *method;
+    uint32_t argc;
+  };
+
+  /**
+   * The call a `return` left in the frame of the current call, to be run by
+   * `call_function()` instead of recursing.
+   */
+  std::optional<TailCall> m_tail_call;
 };
 
 } // namespace Lox
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "error.h"
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <utility>
+
+namespace Lox {
+
+/**
+ * Thrown by `MemoryAccount` instead of exceeding its limit. The scanner, the
+ * parser and the interpreter turn it into an `OUT_OF_MEMORY` error.
+ */
+class MemoryLimitError final : public Exception {
+public:
+  MemoryLimitError() : Exception("Memory limit exceeded.") {}
+};
+
+/**
+ * A memory resource which counts the bytes allocated through it, forwarding
+ * the allocations to `upstream`, and never lets them exceed a hard limit.
+ *
+ * One account per sandboxed evaluation bounds all of its memory: tokens,
+ * AST nodes, and the objects and ropes the script creates. Everything
+ * allocated from an account must be released before it is destroyed. The
+ * counters are atomic, a scanner allocates from several threads.
+ */
+class MemoryAccount final : public std::pmr::memory_resource {
+public:
+  static constexpr std::size_t kUnlimited =
+      std::numeric_limits<std::size_t>::max();
+
+  explicit MemoryAccount(
+      std::size_t limit = kUnlimited,
+      std::pmr::memory_resource *upstream = std::pmr::new_delete_resource())
+      : m_upstream(upstream), m_limit(limit) {}
+
+  ~MemoryAccount() noexcept override = default;
+
+  /**
+   * @brief The bytes allocated, or charged, and not released yet.
+   */
+  [[nodiscard]] std::size_t used() const noexcept {
+    return m_used.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief The high-water mark of `used()`, since the account was created or
+   *        `reset_peak()` was last called.
+   */
+  [[nodiscard]] std::size_t peak() const noexcept {
+    return m_peak.load(std::memory_order_relaxed);
+  }
+
+  void reset_peak() noexcept {
+    m_peak.store(used(), std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] std::size_t limit() const noexcept {
+    return m_limit.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Refuse the allocations beyond `limit` bytes from now on. What is
+   *        already allocated stays.
+   */
+  void set_limit(std::size_t limit) noexcept {
+    m_limit.store(limit, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Count `bytes` allocated elsewhere against the limit. Throws
+   *        `MemoryLimitError` if they do not fit.
+   */
+  void charge(std::size_t bytes);
+
+  /**
+   * @brief Give back `bytes` allocated or charged before.
+   */
+  void release(std::size_t bytes) noexcept {
+    m_used.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+private:
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+  void do_deallocate(void *pointer, std::size_t bytes,
+                     std::size_t alignment) override;
+
+  [[nodiscard]] bool
+  do_is_equal(std::pmr::memory_resource const &other) const noexcept override {
+    return this == &other;
+  }
+
+private:
+  std::pmr::memory_resource *m_upstream;
+  std::atomic<std::size_t> m_limit;
+  std::atomic<std::size_t> m_used{0};
+  std::atomic<std::size_t> m_peak{0};
+};
+
+/**
+ * Bytes charged to a `MemoryAccount` for memory which is not allocated from
+ * it, such as the nodes of an AST, and released when the charge is
+ * destroyed. Without an account, nothing is counted.
+ */
+class MemoryCharge {
+public:
+  MemoryCharge() = default;
+
+  explicit MemoryCharge(MemoryAccount *account) : m_account(account) {}
+
+  MemoryCharge(MemoryCharge const &) = delete;
+
+  MemoryCharge &operator=(MemoryCharge const &) = delete;
+
+  MemoryCharge(MemoryCharge &&other) noexcept
+      : m_account(std::exchange(other.m_account, nullptr)),
+        m_bytes(std::exchange(other.m_bytes, 0)) {}
+
+  MemoryCharge &operator=(MemoryCharge &&other) noexcept {
+    MemoryCharge tmp{std::move(other)};
+    std::swap(m_account, tmp.m_account);
+    std::swap(m_bytes, tmp.m_bytes);
+    return *this;
+  }
+
+  ~MemoryCharge() noexcept {
+    if (m_account != nullptr) {
+      m_account->release(m_bytes);
+    }
+  }
+
+  /**
+   * @brief Charge `bytes` more. Throws `MemoryLimitError` if they do not
+   *        fit.
+   */
+  void add(std::size_t bytes) {
+    if (m_account != nullptr) {
+      m_account->charge(bytes);
+      m_bytes += bytes;
+    }
+  }
+
+  /**
+   * @brief Take over the bytes of `other`, charged to the same account.
+   */
+  void merge(MemoryCharge &&other) noexcept {
+    if (m_account == nullptr) {
+      m_account = other.m_account;
+    }
+    m_bytes += std::exchange(other.m_bytes, 0);
+  }
+
+  [[nodiscard]] std::size_t bytes() const noexcept { return m_bytes; }
+
+private:
+  MemoryAccount *m_account = nullptr;
+  std::size_t m_bytes = 0;
+};
+
+} // namespace Lox
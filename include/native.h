@@ -0,0 +1,372 @@
+#pragma once
+
+#include "diagnostic.h"
+#include "expected.h"
+#include "object.h"
+#include "value.h"
+
+#include <coroutine>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Lox {
+
+/**
+ * How a C++ type is unpacked from a Lox argument, and packed into a Lox
+ * result. Specialized for the types natives may take or return.
+ */
+template <typename T> struct NativeType;
+
+template <> struct NativeType<double> {
+  static constexpr ErrorCode kError = ErrorCode::ARGUMENT_MUST_BE_NUMBER;
+
+  static bool is(Value const &value) { return value.is_number(); }
+
+  static double get(Value const &value) { return value.number(); }
+};
+
+template <> struct NativeType<bool> {
+  static constexpr ErrorCode kError = ErrorCode::ARGUMENT_MUST_BE_BOOLEAN;
+
+  static bool is(Value const &value) { return value.is_boolean(); }
+
+  static bool get(Value const &value) { return value.boolean(); }
+};
+
+template <> struct NativeType<std::string_view> {
+  static constexpr ErrorCode kError = ErrorCode::ARGUMENT_MUST_BE_STRING;
+
+  static bool is(Value const &value) { return value.is_string(); }
+
+  static std::string_view get(Value const &value) { return value.str(); }
+};
+
+template <> struct NativeType<LoxArray> {
+  static constexpr ErrorCode kError = ErrorCode::ARGUMENT_MUST_BE_ARRAY;
+
+  static bool is(Value const &value) { return as_array(value) != nullptr; }
+
+  static LoxArray const &get(Value const &value) { return *as_array(value); }
+};
+
+template <> struct NativeType<LoxMap> {
+  static constexpr ErrorCode kError = ErrorCode::ARGUMENT_MUST_BE_MAP;
+
+  static bool is(Value const &value) { return as_map(value) != nullptr; }
+
+  static LoxMap &get(Value const &value) { return *as_map(value); }
+};
+
+/**
+ * An array or a map, for natives taking either.
+ */
+struct Container {
+  [[nodiscard]] std::size_t size() const noexcept {
+    return array != nullptr ? array->size() : map->size();
+  }
+
+  LoxArray const *array;
+  LoxMap const *map;
+};
+
+template <> struct NativeType<Container> {
+  static constexpr ErrorCode kError = ErrorCode::ARGUMENT_MUST_BE_ARRAY_OR_MAP;
+
+  static bool is(Value const &value) {
+    return as_array(value) != nullptr || as_map(value) != nullptr;
+  }
+
+  static Container get(Value const &value) {
+    return {as_array(value), as_map(value)};
+  }
+};
+
+/**
+ * Any value, for natives checking their arguments themselves.
+ */
+template <> struct NativeType<Value> {
+  // Never reported, every value is accepted
+  static constexpr ErrorCode kError = ErrorCode::ARGUMENT_MUST_BE_NUMBER;
+
+  static bool is(Value const &) { return true; }
+
+  static Value const &get(Value const &value) { return value; }
+};
+
+/**
+ * The parameters and the result of a C++ callable: a function, a function
+ * pointer, or a class with a non-overloaded `operator()`.
+ */
+template <typename F>
+struct NativeSignature : NativeSignature<decltype(&F::operator())> {};
+
+template <typename R, typename... Args> struct NativeSignature<R (*)(Args...)> {
+  using Result = R;
+  using Params = std::tuple<std::remove_cvref_t<Args>...>;
+};
+
+template <typename R, typename... Args>
+struct NativeSignature<R(Args...)> : NativeSignature<R (*)(Args...)> {};
+
+template <typename C, typename R, typename... Args>
+struct NativeSignature<R (C::*)(Args...) const>
+    : NativeSignature<R (*)(Args...)> {};
+
+template <typename C, typename R, typename... Args>
+struct NativeSignature<R (C::*)(Args...)> : NativeSignature<R (*)(Args...)> {};
+
+/**
+ * The result of an asynchronous native, known after the native returned:
+ * the native returns a `Deferred` at once, keeps a copy, and settles it
+ * later, typically from the event loop of the host. Copies share the same
+ * result, which is settled once.
+ *
+ * Settling it resumes the evaluation awaiting it, if any, on the thread
+ * settling it and before `resolve()` or `reject()` returns, until the
+ * evaluation ends or awaits again. Settle it from the thread running the
+ * evaluations of the interpreter.
+ */
+class Deferred {
+  struct State {
+    std::optional<Expected<Value, ErrorCode>> outcome;
+    std::coroutine_handle<> waiter;
+  };
+
+public:
+  /**
+   * Waits for the result of a `Deferred`, in the coroutine awaiting it.
+   * Destroyed with a cancelled evaluation, it stops waiting: the result
+   * settled later resumes nothing.
+   */
+  class Awaiter {
+  public:
+    explicit Awaiter(std::shared_ptr<State> state) noexcept
+        : m_state(std::move(state)) {}
+
+    Awaiter(Awaiter const &) = delete;
+
+    Awaiter &operator=(Awaiter const &) = delete;
+
+    ~Awaiter() noexcept { m_state->waiter = nullptr; }
+
+    [[nodiscard]] bool await_ready() const noexcept {
+      return m_state->outcome.has_value();
+    }
+
+    void await_suspend(std::coroutine_handle<> waiter) noexcept {
+      m_state->waiter = waiter;
+    }
+
+    [[nodiscard]] Expected<Value, ErrorCode> await_resume() {
+      return std::move(*m_state->outcome);
+    }
+
+  private:
+    std::shared_ptr<State> m_state;
+  };
+
+  Deferred() : m_state(std::make_shared<State>()) {}
+
+  /**
+   * @brief Settle the result to `value`.
+   */
+  void resolve(Value value) const { settle(std::move(value)); }
+
+  /**
+   * @brief Settle the result to the runtime error `code`, reported at the
+   *        call of the native.
+   */
+  void reject(ErrorCode code = ErrorCode::NATIVE_FAILED) const {
+    settle(Unexpected{code});
+  }
+
+  [[nodiscard]] bool settled() const noexcept {
+    return m_state->outcome.has_value();
+  }
+
+  [[nodiscard]] Awaiter operator co_await() const noexcept {
+    return Awaiter(m_state);
+  }
+
+private:
+  void settle(Expected<Value, ErrorCode> outcome) const;
+
+private:
+  std::shared_ptr<State> m_state;
+};
+
+/**
+ * A function implemented in C++, called from Lox.
+ */
+class NativeFunction : public Object {
+public:
+  NativeFunction(std::string_view name, uint32_t arity, bool async = false)
+      : Object(Kind::NATIVE), m_name(name), m_arity(arity), m_async(async) {}
+
+  [[nodiscard]] std::string const &name() const noexcept { return m_name; }
+
+  [[nodiscard]] uint32_t arity() const noexcept { return m_arity; }
+
+  /**
+   * @brief Whether the function returns its result later, through a
+   *        `Deferred`: only `Interpreter::start()` can call it, `call()`
+   *        fails with `NATIVE_IS_ASYNC`.
+   */
+  [[nodiscard]] bool is_async() const noexcept { return m_async; }
+
+  /**
+   * @brief Call the function on the `arity()` arguments from `args`, and
+   *        store its result into `result`.
+   *
+   * @return The error of the first argument of the wrong type, if any.
+   */
+  [[nodiscard]] virtual std::optional<ErrorCode> call(Value const *args,
+                                                      Value &result) const = 0;
+
+  /**
+   * @brief Start the call of the function on the `arity()` arguments from
+   *        `args`, and store the result it settles later into `result`.
+   *        The arguments are only valid until it returns.
+   *
+   * @return The error of the first argument of the wrong type, if any.
+   */
+  [[nodiscard]] virtual std::optional<ErrorCode>
+  call_async(Value const *args, Deferred &result) const {
+    Value value;
+    if (auto const code = call(args, value)) {
+      return code;
+    }
+    result.resolve(std::move(value));
+    return std::nullopt;
+  }
+
+  void print(std::ostream &out) const override {
+    out << "<native fn " << m_name << '>';
+  }
+
+private:
+  std::string m_name;
+  uint32_t m_arity;
+  bool m_async;
+};
+
+/**
+ * A C++ callable of type `F` bound to Lox. The arguments are unpacked
+ * straight from the stack of the interpreter, by code generated for the
+ * signature of `F`. A callable returning a `Deferred` is asynchronous.
+ */
+template <typename F> class NativeBinding final : public NativeFunction {
+  using Signature = NativeSignature<F>;
+  using Params = typename Signature::Params;
+  using Result = typename Signature::Result;
+  static constexpr std::size_t kArity = std::tuple_size_v<Params>;
+  static constexpr bool kAsync = std::is_same_v<Result, Deferred>;
+
+public:
+  NativeBinding(std::string_view name, F function)
+      : NativeFunction(name, kArity, kAsync), m_function(std::move(function)) {}
+
+  [[nodiscard]] std::optional<ErrorCode> call(Value const *args,
+                                              Value &result) const override {
+    if constexpr (kAsync) {
+      return ErrorCode::NATIVE_IS_ASYNC;
+    } else {
+      return call(args, result, std::make_index_sequence<kArity>());
+    }
+  }
+
+  [[nodiscard]] std::optional<ErrorCode>
+  call_async(Value const *args, Deferred &result) const override {
+    if constexpr (kAsync) {
+      return call(args, result, std::make_index_sequence<kArity>());
+    } else {
+      return NativeFunction::call_async(args, result);
+    }
+  }
+
+private:
+  template <typename R, std::size_t... I>
+  std::optional<ErrorCode> call(Value const *args, R &result,
+                                std::index_sequence<I...>) const {
+    std::optional<ErrorCode> error;
+    // Stops at the first argument of the wrong type
+    bool const ok =
+        ((NativeType<std::tuple_element_t<I, Params>>::is(args[I]) ||
+          (error = NativeType<std::tuple_element_t<I, Params>>::kError,
+           false)) &&
+         ...);
+    if (!ok) {
+      return error;
+    }
+
+    if constexpr (std::is_void_v<Result>) {
+      m_function(NativeType<std::tuple_element_t<I, Params>>::get(args[I])...);
+      result = nullptr;
+    } else {
+      result = R(m_function(
+          NativeType<std::tuple_element_t<I, Params>>::get(args[I])...));
+    }
+    return std::nullopt;
+  }
+
+private:
+  F m_function;
+};
+
+/**
+ * The native functions of an interpreter, which are the first globals of
+ * the programs it runs, in the order they were defined. A program must be
+ * resolved against the natives of the interpreter running it, see
+ * `Resolver`.
+ */
+class NativeRegistry {
+public:
+  /**
+   * @brief A registry of the built-in natives: `clock()`, the number of
+   *        seconds since an arbitrary point, for benchmarking,
+   *        `len(container)`, the number of elements of an array or of
+   *        entries of a map, `has(map, key)`, whether a map has a key, and
+   *        `remove(map, key)`, which removes a key from a map and returns
+   *        whether it was there.
+   */
+  NativeRegistry();
+
+  NativeRegistry(NativeRegistry const &) = delete;
+
+  NativeRegistry &operator=(NativeRegistry const &) = delete;
+
+  ~NativeRegistry() noexcept = default;
+
+  /**
+   * @brief Define the native `name`, calling `function`. Its parameters and
+   *        result must be `double`, `bool`, `std::string_view` or `Value`,
+   *        it may also take a `LoxArray const &`, a `LoxMap &` or a
+   *        `Container`, and return `std::string` or `void`, or a `Deferred`
+   *        settled later, for an asynchronous native.
+   */
+  template <typename F> void define(std::string_view name, F function) {
+    m_natives.push_back(std::make_shared<NativeBinding<std::decay_t<F>>>(
+        name, std::move(function)));
+  }
+
+  [[nodiscard]] uint32_t size() const noexcept {
+    return static_cast<uint32_t>(m_natives.size());
+  }
+
+  [[nodiscard]] std::shared_ptr<NativeFunction> const &
+  operator[](uint32_t index) const noexcept {
+    return m_natives[index];
+  }
+
+private:
+  std::vector<std::shared_ptr<NativeFunction>> m_natives;
+};
+
+} // namespace Lox
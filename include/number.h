@@ -0,0 +1,25 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+namespace Lox {
+
+/**
+ * Large enough for the shortest round-trip representation of any double.
+ */
+using NumberBuffer = std::array<char, 32>;
+
+/**
+ * @brief Parse a Lox number literal, independently of the C locale.
+ */
+double parse_number(char const *first, char const *last) noexcept;
+
+/**
+ * @brief Format `number` into `buffer` with the shortest representation which
+ *        parses back to the same value, e.g. `3` for `3.0` and `0.1` for
+ *        `0.1`. The result is a view into `buffer`.
+ */
+std::string_view format_number(double number, NumberBuffer &buffer) noexcept;
+
+} // namespace Lox
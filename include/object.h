@@ -0,0 +1,534 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "value.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace Lox {
+
+/**
+ * Hash `std::string` keys so that they can be looked up by
+ * `std::string_view`, without building a string.
+ */
+struct StringHash {
+  using is_transparent = void;
+
+  std::size_t operator()(std::string_view str) const noexcept {
+    return std::hash<std::string_view>{}(str);
+  }
+};
+
+template <typename T>
+using StringMap =
+    std::unordered_map<std::string, T, StringHash, std::equal_to<>>;
+
+/**
+ * A value which lives on the heap, shared between the `Value`s referring to
+ * it.
+ */
+class Object {
+public:
+  enum class Kind : uint8_t {
+    CLASS,
+    INSTANCE,
+    FUNCTION,
+    BOUND_METHOD,
+    CELL,
+    NATIVE,
+    ARRAY,
+    MAP,
+  };
+
+  explicit Object(Kind kind) : m_kind(kind) {}
+
+  Object(Object const &) = delete;
+
+  Object &operator=(Object const &) = delete;
+
+  virtual ~Object() noexcept = default;
+
+  [[nodiscard]] Kind kind() const noexcept { return m_kind; }
+
+  virtual void print(std::ostream &out) const = 0;
+
+private:
+  Kind m_kind;
+};
+
+/**
+ * A hidden class: the layout of the fields of an instance, as the sequence of
+ * field names it got, in order.
+ *
+ * Shapes form a tree per class, rooted at the shape of fresh instances. Adding
+ * a field to an instance moves it to a child shape, which is shared by all
+ * instances given the same fields in the same order. A property access site
+ * can then cache the slot of a field per shape, see `InlineCache`.
+ */
+class Shape {
+public:
+  explicit Shape(LoxClass const &klass) : m_class(klass) {}
+
+  Shape(Shape const &parent, std::string_view name)
+      : m_class(parent.m_class), m_parent(&parent), m_name(name),
+        m_size(parent.m_size + 1) {}
+
+  Shape(Shape const &) = delete;
+
+  Shape &operator=(Shape const &) = delete;
+
+  ~Shape() noexcept = default;
+
+  [[nodiscard]] LoxClass const &klass() const noexcept { return m_class; }
+
+  /**
+   * @brief The number of fields.
+   */
+  [[nodiscard]] uint32_t size() const noexcept { return m_size; }
+
+  /**
+   * @brief The shape without the last field, `nullptr` for the root shape.
+   */
+  [[nodiscard]] Shape const *parent() const noexcept { return m_parent; }
+
+  /**
+   * @brief The name of the last field, in slot `size() - 1`.
+   */
+  [[nodiscard]] std::string const &name() const noexcept { return m_name; }
+
+  /**
+   * @brief The slot of the field `name`, or -1 if there is none.
+   */
+  [[nodiscard]] int64_t lookup(std::string_view name) const noexcept;
+
+  /**
+   * @brief The shape after adding the field `name`, created on first use.
+   */
+  [[nodiscard]] Shape const *transition(std::string_view name) const;
+
+private:
+  LoxClass const &m_class;
+  Shape const *m_parent = nullptr;
+  /**
+   * The name of the last field, in slot `m_size - 1`.
+   */
+  std::string m_name;
+  uint32_t m_size = 0;
+  mutable StringMap<std::unique_ptr<Shape>> m_transitions;
+};
+
+/**
+ * A local variable captured by a closure, moved to the heap so that it
+ * outlives the frame of its function. It is never a Lox value.
+ */
+class Cell final : public Object {
+public:
+  explicit Cell(Value value) : Object(Kind::CELL), m_value(std::move(value)) {}
+
+  [[nodiscard]] Value &value() noexcept { return m_value; }
+
+  [[nodiscard]] Value const &value() const noexcept { return m_value; }
+
+  void print(std::ostream &out) const override { out << m_value; }
+
+private:
+  Value m_value;
+};
+
+using CellPtr = std::shared_ptr<Cell>;
+
+/**
+ * The variables captured by a closure, allocated from the memory resource of
+ * the interpreter creating it.
+ */
+using Captures = std::pmr::vector<CellPtr>;
+
+/**
+ * A function or a method, which refers to its declaration: the AST must
+ * outlive it. A closure also holds the variables it captured, in the order
+ * of `Function::m_captures`.
+ */
+class LoxFunction final : public Object {
+public:
+  LoxFunction(Function const &declaration, LoxClass const *klass,
+              bool is_initializer, Captures captures = {})
+      : Object(Kind::FUNCTION), m_declaration(declaration), m_class(klass),
+        m_is_initializer(is_initializer), m_captures(std::move(captures)) {}
+
+  [[nodiscard]] Function const &declaration() const noexcept {
+    return m_declaration;
+  }
+
+  [[nodiscard]] uint32_t arity() const noexcept {
+    return static_cast<uint32_t>(m_declaration.m_params.size());
+  }
+
+  /**
+   * @brief The class declaring the method, or enclosing the function
+   *        through its methods, for `super`. `nullptr` outside of classes.
+   */
+  [[nodiscard]] LoxClass const *klass() const noexcept { return m_class; }
+
+  [[nodiscard]] bool is_initializer() const noexcept {
+    return m_is_initializer;
+  }
+
+  [[nodiscard]] Cell &capture(uint32_t index) const noexcept {
+    return *m_captures[index];
+  }
+
+  [[nodiscard]] CellPtr const &capture_ptr(uint32_t index) const noexcept {
+    return m_captures[index];
+  }
+
+  void print(std::ostream &out) const override;
+
+private:
+  Function const &m_declaration;
+  LoxClass const *m_class;
+  bool m_is_initializer;
+  Captures m_captures;
+};
+
+class LoxClass final : public Object {
+public:
+  LoxClass(std::string_view name, std::shared_ptr<LoxClass const> superclass)
+      : Object(Kind::CLASS), m_name(name), m_superclass(std::move(superclass)),
+        m_root_shape(*this) {}
+
+  [[nodiscard]] std::string const &name() const noexcept { return m_name; }
+
+  [[nodiscard]] LoxClass const *superclass() const noexcept {
+    return m_superclass.get();
+  }
+
+  /**
+   * @brief The shape of the instances without fields.
+   */
+  [[nodiscard]] Shape const *root_shape() const noexcept {
+    return &m_root_shape;
+  }
+
+  /**
+   * @brief The methods declared by the class itself, by name.
+   */
+  [[nodiscard]] StringMap<std::shared_ptr<LoxFunction>> const &
+  methods() const noexcept {
+    return m_methods;
+  }
+
+  /**
+   * @brief Find the method `name` in the class or its superclasses.
+   */
+  [[nodiscard]] LoxFunction const *find_method(std::string_view name) const;
+
+  /**
+   * @brief Define the method declared by `declaration`, with the variables
+   *        it captured. It is allocated from the memory resource of
+   *        `captures`.
+   */
+  void add_method(Function const &declaration, Captures captures);
+
+  void print(std::ostream &out) const override;
+
+private:
+  std::string m_name;
+  std::shared_ptr<LoxClass const> m_superclass;
+  StringMap<std::shared_ptr<LoxFunction>> m_methods;
+  Shape m_root_shape;
+};
+
+class LoxInstance final : public Object {
+public:
+  /**
+   * @brief The fields are allocated from `memory`.
+   */
+  explicit LoxInstance(
+      std::shared_ptr<LoxClass const> klass,
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : Object(Kind::INSTANCE), m_class(std::move(klass)),
+        m_shape(m_class->root_shape()), m_fields(memory) {}
+
+  /**
+   * @brief Release the instances referred to by the fields iteratively, so
+   *        that dropping a long linked list does not overflow the stack.
+   */
+  ~LoxInstance() noexcept override;
+
+  [[nodiscard]] std::shared_ptr<LoxClass const> const &klass() const noexcept {
+    return m_class;
+  }
+
+  [[nodiscard]] Shape const *shape() const noexcept { return m_shape; }
+
+  [[nodiscard]] Value &field(uint32_t slot) { return m_fields[slot]; }
+
+  [[nodiscard]] Value const &field(uint32_t slot) const {
+    return m_fields[slot];
+  }
+
+  /**
+   * @brief Add a field, moving the instance to the shape `target`, a child
+   *        of its current shape.
+   */
+  void add_field(Shape const *target, Value value) {
+    m_shape = target;
+    m_fields.push_back(std::move(value));
+  }
+
+  void print(std::ostream &out) const override;
+
+private:
+  std::shared_ptr<LoxClass const> m_class;
+  Shape const *m_shape;
+  std::pmr::vector<Value> m_fields;
+};
+
+/**
+ * An array of values. As long as all its elements are numbers, they are
+ * stored unboxed, as contiguous doubles, which the element-wise operators
+ * run on with SIMD instructions, see `broadcast()`. Storing anything else
+ * boxes all the elements for good.
+ */
+class LoxArray final : public Object {
+public:
+  /**
+   * @brief An empty array, whose elements are allocated from `memory`.
+   */
+  explicit LoxArray(
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : Object(Kind::ARRAY), m_numbers(memory), m_values(memory) {}
+
+  /**
+   * @brief An array of `numbers`, unboxed.
+   */
+  explicit LoxArray(std::pmr::vector<double> numbers)
+      : Object(Kind::ARRAY), m_numbers(std::move(numbers)),
+        m_values(m_numbers.get_allocator()) {}
+
+  /**
+   * @brief An array of `values`, boxed.
+   */
+  explicit LoxArray(std::pmr::vector<Value> values)
+      : Object(Kind::ARRAY), m_numbers(values.get_allocator()),
+        m_values(std::move(values)), m_boxed(true) {}
+
+  /**
+   * @brief Release the objects referred to by the elements iteratively,
+   *        see `LoxInstance`.
+   */
+  ~LoxArray() noexcept override;
+
+  [[nodiscard]] std::size_t size() const noexcept {
+    return m_boxed ? m_values.size() : m_numbers.size();
+  }
+
+  /**
+   * @brief Whether the elements are boxed `values()`, rather than unboxed
+   *        `numbers()`.
+   */
+  [[nodiscard]] bool boxed() const noexcept { return m_boxed; }
+
+  [[nodiscard]] std::pmr::vector<double> const &numbers() const noexcept {
+    return m_numbers;
+  }
+
+  [[nodiscard]] std::pmr::vector<Value> const &values() const noexcept {
+    return m_values;
+  }
+
+  [[nodiscard]] Value get(std::size_t index) const {
+    return m_boxed ? m_values[index] : Value(m_numbers[index]);
+  }
+
+  /**
+   * @brief Store `value` at `index`, or append it if `index` is `size()`.
+   */
+  void set(std::size_t index, Value value);
+
+  void print(std::ostream &out) const override;
+
+private:
+  /**
+   * @brief Move the elements from `m_numbers` to `m_values`.
+   */
+  void box();
+
+private:
+  std::pmr::vector<double> m_numbers;
+  std::pmr::vector<Value> m_values;
+  bool m_boxed = false;
+};
+
+/**
+ * @brief The array `value` refers to, `nullptr` if it is not one.
+ */
+[[nodiscard]] inline LoxArray *as_array(Value const &value) noexcept {
+  if (!value.is_object() || value.object()->kind() != Object::Kind::ARRAY) {
+    return nullptr;
+  }
+  return static_cast<LoxArray *>(value.object().get());
+}
+
+/**
+ * A map from keys to values, any value being a key, see `same_key()`.
+ *
+ * The entries are stored contiguously, the last one filling the hole left
+ * by a removed one, and indexed by a Robin Hood hash table with open
+ * addressing: an entry goes to the first free slot from the one its hash
+ * picks, taking over the slots of the entries closer to theirs on the way,
+ * so that every lookup probes a few slots. The hash of a key is computed
+ * once, when it is added: the slots keep it, with the distance to the slot
+ * it picks and the index of the entry. A lookup scans these, and compares
+ * keys on a matching hash only. Growing the table moves slots, never
+ * entries.
+ */
+class LoxMap final : public Object {
+public:
+  /**
+   * @brief An empty map, whose entries are allocated from `memory`.
+   */
+  explicit LoxMap(
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : Object(Kind::MAP), m_slots(memory), m_hashes(memory),
+        m_entries(memory) {}
+
+  /**
+   * @brief Release the objects referred to by the entries iteratively, see
+   *        `LoxInstance`.
+   */
+  ~LoxMap() noexcept override;
+
+  [[nodiscard]] std::size_t size() const noexcept { return m_hashes.size(); }
+
+  /**
+   * @brief The value of `key`, `nullptr` if it has none.
+   */
+  [[nodiscard]] Value const *find(Value const &key) const {
+    return find(key, hash_key(key));
+  }
+
+  /**
+   * @brief The value of `key`, whose `hash_key()` is `hash`, `nullptr` if it
+   *        has none.
+   */
+  [[nodiscard]] Value const *find(Value const &key, std::size_t hash) const;
+
+  /**
+   * @brief Store `value` as the value of `key`, adding it if it is missing.
+   *        A number key is stored normalized: `-0` as `0`, and all NaNs as
+   *        the same NaN.
+   */
+  void set(Value key, Value value) {
+    std::size_t const hash = hash_key(key);
+    set(std::move(key), hash, std::move(value));
+  }
+
+  /**
+   * @brief `set(key, value)`, for a `key` whose `hash_key()` is `hash`.
+   */
+  void set(Value key, std::size_t hash, Value value);
+
+  /**
+   * @brief Remove `key` and its value, if any.
+   *
+   * @return Whether it was there.
+   */
+  bool erase(Value const &key);
+
+  /**
+   * @brief Call `visit(key, value)` on each entry, in no particular order.
+   */
+  template <typename F> void for_each(F &&visit) const {
+    for (std::size_t i = 0; i < m_entries.size(); i += 2) {
+      visit(m_entries[i], m_entries[i + 1]);
+    }
+  }
+
+  void print(std::ostream &out) const override;
+
+private:
+  struct Slot {
+    /**
+     * The low bits of the hash of the key, which pick the slot.
+     */
+    uint32_t hash;
+    /**
+     * One more than the distance to the slot the hash picks, `0` for a
+     * free slot.
+     */
+    uint32_t probe;
+    uint32_t entry;
+  };
+
+  /**
+   * @brief The slot of `key`, whose hash is `hash`, or -1.
+   */
+  [[nodiscard]] int64_t lookup(Value const &key, uint32_t hash) const;
+
+  /**
+   * @brief Put `slot` in the table, assuming there is a free slot.
+   */
+  void place(Slot slot) noexcept;
+
+  /**
+   * @brief Double the number of slots, placing the entries again.
+   */
+  void grow();
+
+private:
+  std::pmr::vector<Slot> m_slots;
+  /**
+   * The low bits of the hash of the key of each entry, to find its slot.
+   */
+  std::pmr::vector<uint32_t> m_hashes;
+  /**
+   * The key of entry `i` at `2 * i`, and its value at `2 * i + 1`.
+   */
+  std::pmr::vector<Value> m_entries;
+};
+
+/**
+ * @brief The map `value` refers to, `nullptr` if it is not one.
+ */
+[[nodiscard]] inline LoxMap *as_map(Value const &value) noexcept {
+  if (!value.is_object() || value.object()->kind() != Object::Kind::MAP) {
+    return nullptr;
+  }
+  return static_cast<LoxMap *>(value.object().get());
+}
+
+/**
+ * A method read from an instance, which remembers its receiver.
+ */
+class BoundMethod final : public Object {
+public:
+  BoundMethod(ObjectPtr receiver, LoxFunction const &method)
+      : Object(Kind::BOUND_METHOD), m_receiver(std::move(receiver)),
+        m_method(method) {}
+
+  [[nodiscard]] ObjectPtr const &receiver() const noexcept {
+    return m_receiver;
+  }
+
+  /**
+   * @brief The method, kept alive by the class of the receiver.
+   */
+  [[nodiscard]] LoxFunction const &method() const noexcept { return m_method; }
+
+  void print(std::ostream &out) const override { m_method.print(out); }
+
+private:
+  ObjectPtr m_receiver;
+  LoxFunction const &m_method;
+};
+
+} // namespace Lox
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "interpreter.h"
+#include "program.h"
+#include "value.h"
+
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Lox {
+
+/**
+ * Optimize a program resolved by `Resolver`, in two passes over its AST.
+ *
+ * The first pass folds the operators whose operands are constants into
+ * `Constant` nodes, and propagates the known values of variables: a local of
+ * the frame from its declaration or assignment on, until a branch or a loop
+ * which may write it, and a global declared once by a `var` and never
+ * assigned, unless it is one of a snapshot, which its prelude may write.
+ * Captured locals may be written by any call, they are never
+ * known. Then it drops the dead code this exposes: branches never taken,
+ * loops never entered, constant expression statements, and the statements
+ * after a `return`. An operator which would raise an error is kept, so that
+ * it raises it at run time.
+ *
+ * The second pass hoists the subexpressions of every loop which are
+ * invariant in it: operators whose operands are constants, or variables the
+ * loop never writes, see `Hoisted`. A global is only invariant in a loop
+ * without calls, which may write it. A hoisted subexpression is evaluated
+ * where the loop first reaches it, not before the loop, so that the loop
+ * behaves exactly as before, errors included. An operator on arrays, whose
+ * elements the loop may write, is still evaluated every time.
+ */
+class Optimizer final : public AstNodeVisitor {
+public:
+  Optimizer() = default;
+
+  Optimizer(Optimizer const &) = delete;
+
+  Optimizer &operator=(Optimizer const &) = delete;
+
+  ~Optimizer() noexcept override = default;
+
+  void optimize(Program &program);
+
+  void visit(Literal &) override;
+
+  void visit(Binary &) override;
+
+  void visit(Unary &) override;
+
+  void visit(Grouping &) override;
+
+  void visit(Logical &) override;
+
+  void visit(Constant &) override;
+
+  void visit(Hoisted &) override;
+
+  void visit(Shared &) override;
+
+  void visit(Variable &) override;
+
+  void visit(Assign &) override;
+
+  void visit(Call &) override;
+
+  void visit(Get &) override;
+
+  void visit(Set &) override;
+
+  void visit(Invoke &) override;
+
+  void visit(Array &) override;
+
+  void visit(Map &) override;
+
+  void visit(Index &) override;
+
+  void visit(SetIndex &) override;
+
+  void visit(This &) override;
+
+  void visit(Super &) override;
+
+  void visit(Expression &) override;
+
+  void visit(Print &) override;
+
+  void visit(Var &) override;
+
+  void visit(Block &) override;
+
+  void visit(If &) override;
+
+  void visit(While &) override;
+
+  void visit(Function &) override;
+
+  void visit(Class &) override;
+
+  void visit(Return &) override;
+
+private:
+  /**
+   * The values of the variables known at the current point, keyed by their
+   * kind and their index: only the locals of the current frame and the
+   * globals are ever known.
+   */
+  using Known = std::unordered_map<uint64_t, Value>;
+
+  /**
+   * @brief Optimize `expr`, which may be replaced.
+   */
+  void optimize(ExprPtr &expr);
+
+  /**
+   * @brief Optimize `stmts`, dropping the dead ones.
+   */
+  void optimize(StmtList &stmts);
+
+  /**
+   * @brief Optimize the branch or the body `stmt`, which becomes an empty
+   *        block if it is dead.
+   */
+  void optimize_branch(StmtPtr &stmt);
+
+  /**
+   * @brief Optimize the body of a function, which starts with only the
+   *        globals known.
+   */
+  void optimize_function(Function &function);
+
+  /**
+   * @brief The value of `expr`, if it is a literal or a constant.
+   */
+  [[nodiscard]] std::optional<Value> constant_value(Expr &expr);
+
+  /**
+   * @brief Forget the variables not known with the same value in `other`.
+   */
+  void intersect(Known const &other);
+
+  /**
+   * @brief Record the value of the variable at `slot` stored by a
+   *        declaration or an assignment of `value`, if it is constant. A
+   *        declaration without `value` stores nil.
+   */
+  void store(VariableSlot slot, Expr *value, bool declared);
+
+  /**
+   * @brief Forget the value of the variable at `slot`, which is written.
+   */
+  void forget(VariableSlot slot);
+
+private:
+  /**
+   * Evaluates the folded operators, with the semantics of the run time.
+   */
+  Interpreter m_folder;
+  Known m_known;
+  /**
+   * The globals declared once by a `var`, and never assigned.
+   */
+  std::unordered_set<uint32_t> m_final_globals;
+  ExprPtr m_replacement;
+  StmtPtr m_stmt_replacement;
+  bool m_dead = false;
+};
+
+} // namespace Lox
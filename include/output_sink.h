@@ -0,0 +1,110 @@
+#pragma once
+
+#include "value.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace Lox {
+
+/**
+ * Where the `print` statements of an interpreter write, see
+ * `Interpreter::set_output()`.
+ */
+class OutputSink {
+public:
+  OutputSink() = default;
+
+  OutputSink(OutputSink const &) = delete;
+
+  OutputSink &operator=(OutputSink const &) = delete;
+
+  virtual ~OutputSink() noexcept = default;
+
+  virtual void write(std::string_view bytes) = 0;
+
+  /**
+   * @brief Hand the bytes buffered so far over to their destination.
+   */
+  virtual void flush() {}
+
+  /**
+   * @brief Write `value` as Lox prints it, and a newline.
+   */
+  void print(Value const &value);
+};
+
+/**
+ * Write to a file descriptor through a large user-space buffer, with one
+ * `write(2)` per buffer full instead of one per line. Writes larger than the
+ * buffer go straight through. What is left is flushed on destruction, where
+ * errors are ignored: call `flush()` first to report them.
+ */
+class FdSink final : public OutputSink {
+public:
+  static constexpr std::size_t kDefaultCapacity = 64 * 1024;
+
+  explicit FdSink(int fd, std::size_t capacity = kDefaultCapacity)
+      : m_fd(fd), m_buffer(std::make_unique<char[]>(capacity)),
+        m_capacity(capacity) {}
+
+  ~FdSink() noexcept override;
+
+  void write(std::string_view bytes) override;
+
+  /**
+   * @brief Write the buffer out. Throws `Exception` if `write(2)` fails.
+   */
+  void flush() override;
+
+private:
+  /**
+   * @brief Write all of `bytes` to the descriptor, whatever the number of
+   *        calls it takes.
+   */
+  void write_all(std::string_view bytes);
+
+private:
+  int m_fd;
+  std::unique_ptr<char[]> m_buffer;
+  std::size_t m_capacity;
+  std::size_t m_size = 0;
+};
+
+/**
+ * Keep the output in memory, for a host embedding the interpreter.
+ */
+class StringSink final : public OutputSink {
+public:
+  StringSink() = default;
+
+  void write(std::string_view bytes) override { m_output += bytes; }
+
+  [[nodiscard]] std::string const &str() const noexcept { return m_output; }
+
+  void clear() noexcept { m_output.clear(); }
+
+private:
+  std::string m_output;
+};
+
+/**
+ * Drop the output, to measure a script without its I/O.
+ */
+class NullSink final : public OutputSink {
+public:
+  NullSink() = default;
+
+  void write(std::string_view) override {}
+};
+
+/**
+ * @brief The buffered sink of the standard output, shared by the
+ *        interpreters which were not given another one. It is flushed at
+ *        exit.
+ */
+OutputSink &stdout_sink();
+
+} // namespace Lox
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "expected.h"
+#include "value.h"
+#include "work_stealing_pool.h"
+
+#include <cstdint>
+#include <optional>
+#include <unordered_set>
+
+namespace Lox {
+
+/**
+ * Subexpressions with fewer nodes than this are always evaluated by a single
+ * `Interpreter`, the cost of forking would dominate.
+ */
+inline constexpr uint64_t kParallelEvalMinNodes = 1 << 14;
+
+/**
+ * Evaluate a large expression on several threads.
+ *
+ * Operators have no side effects, so the operands of a node are independent.
+ * The size of every subexpression is computed once, then the right operand
+ * of every node larger than `kParallelEvalMinNodes` is forked to a
+ * `WorkStealingPool` while the left one is evaluated in place. Smaller
+ * subexpressions are evaluated by an `Interpreter` of their own.
+ *
+ * Errors are those of `Interpreter`: when both operands fail, the error of
+ * the left one is reported, as it is the one a left-to-right evaluation
+ * stops at. Shared subexpressions (see `HashConsTable`) are memoised per
+ * `Interpreter` only, so a forked task may evaluate one again.
+ */
+class ParallelEvaluator {
+public:
+  ParallelEvaluator(unsigned n_jobs) : m_n_jobs(n_jobs == 0 ? 1 : n_jobs) {}
+
+  ParallelEvaluator(ParallelEvaluator const &) = delete;
+
+  ParallelEvaluator &operator=(ParallelEvaluator const &) = delete;
+
+  ~ParallelEvaluator() noexcept = default;
+
+  /**
+   * @brief Evaluate `expr`. On a runtime error, insert it into
+   *        `runtime_errors`.
+   */
+  void interpret(Expr *expr);
+
+  [[nodiscard]] Value result() const { return m_result; }
+
+private:
+  class SubEvaluator;
+
+  /**
+   * @brief Whether `expr` is large enough to be split between threads.
+   */
+  [[nodiscard]] bool is_large(Expr const &expr) const {
+    return m_large.contains(&expr);
+  }
+
+private:
+  unsigned m_n_jobs;
+  /**
+   * The subexpressions of at least `kParallelEvalMinNodes` nodes.
+   */
+  std::unordered_set<Expr const *> m_large;
+  /**
+   * Only started for an expression large enough.
+   */
+  std::optional<WorkStealingPool> m_pool;
+  Value m_result;
+};
+
+} // namespace Lox
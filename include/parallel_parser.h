@@ -0,0 +1,65 @@
+#pragma once
+
+#include "memory_account.h"
+#include "program.h"
+#include "scanner.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace Lox {
+
+/**
+ * Parse a large program on several threads.
+ *
+ * The tokens are cut into spans of whole top-level declarations: from every
+ * split point of `ParallelScanner`, at the first `;` or `}` outside of any
+ * brackets which the next token cannot continue. Every span is parsed by its
+ * own `Parser` on a `WorkStealingPool`, and the statements are moved in order
+ * into one program.
+ *
+ * A cut is only a guess when the tokens are not a valid program: if any span
+ * fails to parse, the whole program is parsed again on the calling thread.
+ * The program and the syntax errors are always identical to those of
+ * `Parser::parse_program()`. Hash-consing shares subexpressions across the
+ * whole program, so it needs a single `Parser`.
+ */
+class ParallelParser {
+public:
+  /**
+   * @brief Parse `tokens` on `n_jobs` threads, cutting them near `splits`,
+   *        see `ParallelScanner::splits()`. The nodes are charged to `memory`
+   *        if any, see `Parser`.
+   */
+  ParallelParser(TokenList const &tokens,
+                 std::vector<std::size_t> const &splits, unsigned n_jobs,
+                 MemoryAccount *memory = nullptr)
+      : m_tokens(tokens), m_splits(splits),
+        m_n_jobs(n_jobs == 0 ? 1 : n_jobs), m_memory(memory) {}
+
+  ParallelParser(ParallelParser const &) = delete;
+
+  ParallelParser &operator=(ParallelParser const &) = delete;
+
+  ~ParallelParser() noexcept = default;
+
+  /**
+   * @brief Parse the tokens into a program. On a syntax error, insert it into
+   *        `syntax_errors` and return an empty program.
+   */
+  Program parse_program();
+
+private:
+  /**
+   * @brief The index of the first token of every span but the first.
+   */
+  std::vector<std::size_t> cut() const;
+
+private:
+  TokenList const &m_tokens;
+  std::vector<std::size_t> const &m_splits;
+  unsigned m_n_jobs;
+  MemoryAccount *m_memory;
+};
+
+} // namespace Lox
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "scanner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Lox {
+
+/**
+ * Sources smaller than this are always scanned on the calling thread, the
+ * cost of starting threads would dominate.
+ */
+inline constexpr uint64_t kParallelScanMinBytes = 1 << 20;
+
+/**
+ * Scan a source on several threads.
+ *
+ * The source is split right after newlines which are not inside a string
+ * literal (a `//` comment always ends at a newline, so it never spans two
+ * chunks), every chunk is scanned by its own `Scanner`, and the token streams
+ * are stitched in order. Tokens only carry offsets, so nothing needs fixing
+ * up. Tokens and syntax errors are identical to those of
+ * `Scanner::scan_tokens()`.
+ */
+class ParallelScanner {
+public:
+  /**
+   * @brief Scan `source` on `n_jobs` threads, allocating the tokens from
+   *        `memory`, see `Scanner`. More threads than the hardware runs at
+   *        once would only add overhead, `n_jobs` is capped to them.
+   */
+  ParallelScanner(
+      std::string const &source, unsigned n_jobs,
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : m_source(source),
+        m_n_jobs(std::max(
+            1u, std::min(n_jobs, std::thread::hardware_concurrency()))),
+        m_tokens(memory) {}
+
+  ParallelScanner(ParallelScanner const &) = delete;
+
+  ParallelScanner &operator=(ParallelScanner const &) = delete;
+
+  ~ParallelScanner() noexcept = default;
+
+  /**
+   * @brief Scan out all tokens in the source. Need to find all errors possible.
+   */
+  TokenList const &scan_tokens();
+
+  /**
+   * @brief The index of the first token of every chunk but the first, after
+   *        `scan_tokens()`. Empty if the source was scanned in one chunk.
+   */
+  [[nodiscard]] std::vector<std::size_t> const &splits() const noexcept {
+    return m_splits;
+  }
+
+private:
+  struct Chunk {
+    uint64_t begin;
+    uint64_t end;
+  };
+
+  /**
+   * @brief Find at most `m_n_jobs` chunks of roughly equal size, each of them
+   *        starting right after a newline outside of string literals.
+   */
+  std::vector<Chunk> split() const;
+
+private:
+  std::string const &m_source;
+  unsigned m_n_jobs;
+  TokenList m_tokens;
+  std::vector<std::size_t> m_splits;
+};
+
+} // namespace Lox
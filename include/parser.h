@@ -1,25 +1,38 @@
 #pragma once
 
 #include "ast_defines.inc"
+#include "expected.h"
+#include "hash_cons.h"
+#include "memory_account.h"
+#include "program.h"
 #include "scanner.h"
 
 #include <error.h>
 #include <initializer_list>
+#include <optional>
 
 namespace Lox {
 
-class ParseError : public Exception {
-public:
-  ParseError(char const *msg) : Exception(msg) {}
-
-  ParseError(std::string msg) : Exception(std::move(msg)) {}
-
-  ~ParseError() noexcept override = default;
-};
+class ParallelParser;
 
 class Parser {
+  friend class ParallelParser;
+
 public:
-  Parser(std::vector<Token> const &tokens) : m_tokens(tokens), m_current() {}
+  /**
+   * @brief With `hash_cons`, structurally identical subexpressions are
+   *        parsed into a single node shared through `Shared` nodes. With
+   *        `memory`, the nodes are charged to it, and running out of it is
+   *        an `OUT_OF_MEMORY` error.
+   */
+  Parser(TokenList const &tokens, bool hash_cons = false,
+         MemoryAccount *memory = nullptr)
+      : m_tokens(tokens), m_current(), m_end(tokens.size() - 1),
+        m_charge(memory) {
+    if (hash_cons) {
+      m_hash_cons.emplace();
+    }
+  }
 
   Parser(Parser const &) = delete;
 
@@ -27,34 +40,136 @@ public:
 
   ~Parser() noexcept = default;
 
+  /**
+   * @brief Parse the tokens into an expression. On a syntax error, insert it
+   *        into `syntax_errors` and return `nullptr`.
+   */
   ExprPtr parse();
 
+  /**
+   * @brief Parse the tokens into a program. On a syntax error, insert it into
+   *        `syntax_errors` and return an empty program.
+   */
+  Program parse_program();
+
 private:
-  ExprPtr expression();
+  /**
+   * @brief Parse only the tokens [`begin`, `end`), as if `END` followed
+   *        them.
+   */
+  Parser(TokenList const &tokens, std::size_t begin, std::size_t end,
+         MemoryAccount *memory)
+      : m_tokens(tokens), m_current(begin), m_end(end), m_charge(memory) {}
+
+  Expected<void> program(Program &program);
+
+  Expected<StmtPtr> declaration();
+
+  Expected<StmtPtr> class_declaration();
+
+  /**
+   * @brief Parse a function or a method, after its `fun` keyword if any.
+   *        `name_error` is reported if the name is missing.
+   */
+  Expected<FunctionPtr> function(ErrorCode name_error);
+
+  Expected<StmtPtr> var_declaration();
+
+  Expected<StmtPtr> statement();
+
+  Expected<StmtPtr> return_statement();
+
+  Expected<StmtPtr> print_statement();
+
+  Expected<StmtPtr> if_statement();
+
+  Expected<StmtPtr> while_statement();
+
+  /**
+   * @brief Parse a `for` loop into the equivalent `while` loop, in a block
+   *        if it declares a variable.
+   */
+  Expected<StmtPtr> for_statement();
+
+  /**
+   * @brief Parse the statements of a block, after its `{`.
+   */
+  Expected<StmtList> block();
+
+  Expected<StmtPtr> expression_statement();
+
+  Expected<ExprPtr> expression();
+
+  Expected<ExprPtr> assignment();
 
-  ExprPtr equality();
+  Expected<ExprPtr> logic_or();
 
-  ExprPtr comparison();
+  Expected<ExprPtr> logic_and();
 
-  ExprPtr term();
+  Expected<ExprPtr> equality();
+
+  Expected<ExprPtr> comparison();
+
+  Expected<ExprPtr> term();
+
+  Expected<ExprPtr> factor();
+
+  Expected<ExprPtr> unary();
+
+  Expected<ExprPtr> call();
+
+  /**
+   * @brief Parse the arguments of a call, after its `(`.
+   */
+  Expected<ExprList> arguments();
 
-  ExprPtr factor();
+  /**
+   * @brief Parse an array literal, after its `[`.
+   */
+  Expected<ExprPtr> array();
 
-  ExprPtr unary();
+  /**
+   * @brief Parse a map literal, after its `{`.
+   */
+  Expected<ExprPtr> map();
 
-  ExprPtr primary();
+  Expected<ExprPtr> primary();
 
 private:
+  /**
+   * @brief Build a node, charged to the memory account if any.
+   */
+  template <typename Node, typename... Args>
+  std::unique_ptr<Node> node(Args &&...args) {
+    m_charge.add(sizeof(Node));
+    return std::make_unique<Node>(std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Build an expression node, hash-consed if enabled.
+   */
+  template <typename Node, typename... Args> ExprPtr make(Args &&...args) {
+    auto expr = node<Node>(std::forward<Args>(args)...);
+    if (m_hash_cons) {
+      return m_hash_cons->intern(std::move(expr));
+    }
+    return expr;
+  }
+
   /**
    * @brief
    */
-  Token const &peek() noexcept { return m_tokens[m_current]; }
+  Token const &peek() noexcept {
+    return m_tokens[m_current < m_end ? m_current : m_tokens.size() - 1];
+  }
 
   /**
    * @brief
    */
   void advance() noexcept { ++m_current; }
 
+  bool check(TokenType type) noexcept { return peek().m_type == type; }
+
   /**
    * @brief
    */
@@ -68,17 +183,26 @@ private:
   /**
    * @brief
    */
-  void consume(std::initializer_list<TokenType> types,
-               std::string_view error_msg);
+  Expected<void> consume(std::initializer_list<TokenType> types,
+                         ErrorCode code);
 
   /**
-   *
+   * @brief Build the error `code` found at `token`.
    */
-  [[noreturn]] void error(Token const &token, std::string_view error_msg);
+  static Unexpected<Diagnostic> error(Token const &token, ErrorCode code) {
+    return Unexpected{Diagnostic{code, token.m_offset, &token}};
+  }
 
 private:
-  std::vector<Token> const &m_tokens;
+  TokenList const &m_tokens;
   std::size_t m_current;
+  std::size_t m_end;
+  std::optional<HashConsTable> m_hash_cons;
+  /**
+   * The nodes built so far, handed over to the program parsed. Those of a
+   * lone expression are released with the parser.
+   */
+  MemoryCharge m_charge;
 };
 
 } // namespace Lox
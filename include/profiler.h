@@ -0,0 +1,128 @@
+#pragma once
+
+#include "ast_defines.inc"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace Lox {
+
+class SourceMap;
+
+/**
+ * Attribute evaluation cost to Lox expressions instead of C++ frames.
+ *
+ * The interpreter calls `enter()` and `leave()` around every evaluation. In
+ * `EXACT` mode every evaluation is counted and timed in its calling context
+ * (the chain of expressions being evaluated). In `SAMPLING` mode evaluations
+ * only push and pop a shadow stack, and a `SIGPROF` timer marks when the
+ * current shadow stack should be recorded as a sample.
+ */
+class Profiler {
+public:
+  enum class Mode : uint8_t { EXACT, SAMPLING };
+
+  explicit Profiler(Mode mode, std::chrono::microseconds interval =
+                                   std::chrono::milliseconds(1));
+
+  Profiler(Profiler const &) = delete;
+
+  Profiler &operator=(Profiler const &) = delete;
+
+  ~Profiler() noexcept;
+
+  void enter(Expr const *expr) {
+    if (m_mode == Mode::SAMPLING) {
+      m_stack.push_back(expr);
+      if (sample_pending.load(std::memory_order_relaxed)) [[unlikely]] {
+        take_sample();
+      }
+      return;
+    }
+    auto const parent = m_active.empty() ? 0 : m_active.back().frame;
+    m_active.push_back(Active{child(parent, expr), Clock::now()});
+  }
+
+  void leave() {
+    if (m_mode == Mode::SAMPLING) {
+      m_stack.pop_back();
+      return;
+    }
+    auto const active = m_active.back();
+    m_active.pop_back();
+    auto const elapsed = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             active.start)
+            .count());
+    auto &frame = m_frames[active.frame];
+    ++frame.count;
+    frame.total += elapsed;
+    m_frames[frame.parent].children_total += elapsed;
+  }
+
+  /**
+   * @brief Write the expressions and the source lines sorted by their own
+   *        cost, at most `max_rows` of each.
+   */
+  void report(std::ostream &out, SourceMap const &source_map,
+              std::size_t max_rows = 20) const;
+
+  /**
+   * @brief Write one line per calling context, `frame;frame;frame cost`, as
+   *        consumed by flamegraph.pl and compatible tools. The cost is in
+   *        nanoseconds, or in samples in `SAMPLING` mode.
+   */
+  void write_collapsed(std::ostream &out, SourceMap const &source_map) const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * A node of the calling context tree. The root is `m_frames[0]`.
+   */
+  struct Frame {
+    Expr const *expr;
+    uint32_t parent;
+    uint64_t count = 0;
+    uint64_t total = 0;
+    uint64_t children_total = 0;
+    uint64_t samples = 0;
+    std::vector<uint32_t> children{};
+
+    [[nodiscard]] uint64_t self() const { return total - children_total; }
+  };
+
+  struct Active {
+    uint32_t frame;
+    Clock::time_point start;
+  };
+
+  /**
+   * @brief Find or create the frame of `expr` evaluated in `parent`.
+   */
+  uint32_t child(uint32_t parent, Expr const *expr);
+
+  /**
+   * @brief Record the shadow stack as a sample.
+   */
+  void take_sample();
+
+  static_assert(std::atomic<bool>::is_always_lock_free);
+
+  /**
+   * Set from the `SIGPROF` handler, so only one sampling profiler can run at
+   * a time.
+   */
+  static std::atomic<bool> sample_pending;
+
+private:
+  Mode m_mode;
+  std::vector<Frame> m_frames;
+  std::vector<Active> m_active;
+  std::vector<Expr const *> m_stack;
+};
+
+} // namespace Lox
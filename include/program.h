@@ -0,0 +1,36 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "memory_account.h"
+
+#include <cstdint>
+
+namespace Lox {
+
+/**
+ * A script: declarations, optionally followed by an expression without `;`
+ * whose value is the result of the script, as typed at the prompt.
+ */
+struct Program {
+  StmtList statements;
+  ExprPtr result;
+  /**
+   * The slots of the top-level frame, the number of globals and the number
+   * of natives among them, filled by `Resolver`.
+   */
+  uint32_t frame_size = 0;
+  uint32_t global_count = 0;
+  uint32_t native_count = 0;
+  /**
+   * The globals of the `Snapshot` the program was resolved against, natives
+   * included, which come first. 0 without a snapshot.
+   */
+  uint32_t prelude_count = 0;
+  /**
+   * The nodes of the AST charged to the memory account of the parser, if
+   * any, until the program is destroyed.
+   */
+  MemoryCharge memory;
+};
+
+} // namespace Lox
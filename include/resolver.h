@@ -0,0 +1,208 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "native.h"
+#include "program.h"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace Lox {
+
+class Snapshot;
+
+/**
+ * Find where every variable of a program lives, before it runs.
+ *
+ * Variables declared at the top level are globals, given an index in the
+ * table of globals. Every other variable is a local, given a slot in the
+ * frame of its function: slot 0 holds the receiver of a method (`this`) or
+ * the function itself, then come the parameters, then the locals of the
+ * blocks, whose slots are reused once their block ends. Only the locals
+ * captured by a closure are boxed on the heap, see `VariableSlot`. A `return`
+ * of a call is marked as a tail call.
+ *
+ * The natives are the first globals, followed by those of the `Snapshot`
+ * the program is resolved against, if any. A call of a native which neither
+ * the program nor the snapshot redefines is bound to it, and its arity
+ * checked, ahead of time.
+ *
+ * Errors, such as a `return` outside of a function, are inserted into
+ * `syntax_errors`.
+ */
+class Resolver final : public AstNodeVisitor {
+public:
+  /**
+   * @brief Resolve against `natives`, and the globals of `snapshot` if not
+   *        null, which the program then runs with, see
+   *        `Interpreter::set_snapshot()`.
+   */
+  explicit Resolver(NativeRegistry const &natives,
+                    Snapshot const *snapshot = nullptr)
+      : m_natives(natives), m_snapshot(snapshot) {}
+
+  Resolver(Resolver const &) = delete;
+
+  Resolver &operator=(Resolver const &) = delete;
+
+  ~Resolver() noexcept override = default;
+
+  void resolve(Program &program);
+
+  void visit(Literal &) override;
+
+  void visit(Binary &) override;
+
+  void visit(Unary &) override;
+
+  void visit(Grouping &) override;
+
+  void visit(Logical &) override;
+
+  void visit(Constant &) override;
+
+  void visit(Hoisted &) override;
+
+  void visit(Shared &) override;
+
+  void visit(Variable &) override;
+
+  void visit(Assign &) override;
+
+  void visit(Call &) override;
+
+  void visit(Get &) override;
+
+  void visit(Set &) override;
+
+  void visit(Invoke &) override;
+
+  void visit(Array &) override;
+
+  void visit(Map &) override;
+
+  void visit(Index &) override;
+
+  void visit(SetIndex &) override;
+
+  void visit(This &) override;
+
+  void visit(Super &) override;
+
+  void visit(Expression &) override;
+
+  void visit(Print &) override;
+
+  void visit(Var &) override;
+
+  void visit(Block &) override;
+
+  void visit(If &) override;
+
+  void visit(While &) override;
+
+  void visit(Function &) override;
+
+  void visit(Class &) override;
+
+  void visit(Return &) override;
+
+private:
+  enum class FunctionKind : uint8_t { SCRIPT, FUNCTION, METHOD, INITIALIZER };
+
+  enum class ClassKind : uint8_t { NONE, CLASS, SUBCLASS };
+
+  struct Local {
+    std::string_view name;
+    int depth;
+    bool defined;
+    bool captured = false;
+    /**
+     * The slots resolved to the local so far, made `BOXED` once it is
+     * captured.
+     */
+    std::vector<VariableSlot *> slots{};
+  };
+
+  struct FunctionScope {
+    FunctionKind kind;
+    /**
+     * The locals in scope, the index of a local is its slot.
+     */
+    std::vector<Local> locals;
+    int depth;
+    uint32_t frame_size;
+    std::vector<Capture> captures{};
+  };
+
+  void resolve(Expr *expr) { dispatch(*expr, *this); }
+
+  void resolve(StmtList &stmts) {
+    for (auto &stmt : stmts) {
+      dispatch(*stmt, *this);
+    }
+  }
+
+  /**
+   * @brief Resolve a function whose receiver, if any, is named `receiver`.
+   */
+  void resolve_function(Function &function, FunctionKind kind,
+                        std::string_view receiver);
+
+  void resolve_variable(std::string_view name, Token const &token,
+                        VariableSlot &slot);
+
+  /**
+   * @brief Capture the variable `name` of the functions enclosing
+   *        `m_functions[function]`, return its index in the captures of the
+   *        function or -1 if it is not a local of any of them.
+   */
+  int64_t resolve_upvalue(std::size_t function, std::string_view name);
+
+  /**
+   * @brief Box the local `index` of `m_functions[function]`.
+   */
+  void capture_local(std::size_t function, uint32_t index);
+
+  void begin_scope() { ++m_functions.back().depth; }
+
+  void end_scope();
+
+  /**
+   * @brief Declare the variable `name` in the current scope. `slot` is null
+   *        for a parameter.
+   */
+  void declare(Token const &name, VariableSlot *slot);
+
+  /**
+   * @brief Make the variable declared last readable.
+   */
+  void define();
+
+  void error(Token const &token, ErrorCode code);
+
+  /**
+   * @brief Bind the calls of natives which are never redefined.
+   */
+  void bind_natives();
+
+private:
+  NativeRegistry const &m_natives;
+  Snapshot const *m_snapshot;
+  std::vector<FunctionScope> m_functions;
+  ClassKind m_class = ClassKind::NONE;
+  std::unordered_map<std::string_view, uint32_t> m_globals;
+  /**
+   * The globals declared or assigned by the program.
+   */
+  std::unordered_set<uint32_t> m_redefined;
+  /**
+   * The calls whose callee is a native global.
+   */
+  std::vector<Call *> m_native_calls;
+};
+
+} // namespace Lox
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+namespace Lox {
+
+/**
+ * Concatenations of strings at least this long build a `Rope` instead of
+ * copying both operands, below it copying is cheaper.
+ */
+inline constexpr std::size_t kRopeMinBytes = 256;
+
+/**
+ * An immutable string built by concatenation, so that a chain of N `+`
+ * copies every byte once instead of O(N) times.
+ *
+ * A rope is either a leaf holding its string, or the concatenation of two
+ * ropes. It is flattened the first time its content is observed, then
+ * behaves as a leaf. Flattening mutates a rope which may be shared between
+ * values: ropes must not be observed by several threads at once. The content
+ * is allocated from the memory resource the rope is given.
+ */
+class Rope {
+public:
+  using Ptr = std::shared_ptr<Rope const>;
+
+  explicit Rope(
+      std::string_view str,
+      std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : m_size(str.size()), m_flat(str, memory) {}
+
+  Rope(Ptr left, Ptr right,
+       std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : m_size(left->size() + right->size()), m_flat(memory),
+        m_left(std::move(left)), m_right(std::move(right)) {}
+
+  Rope(Rope const &) = delete;
+
+  Rope &operator=(Rope const &) = delete;
+
+  /**
+   * @brief Release the children iteratively, a long chain of ropes would
+   *        overflow the stack if destroyed recursively. Neither allocates.
+   */
+  ~Rope() noexcept;
+
+  [[nodiscard]] std::size_t size() const noexcept { return m_size; }
+
+  /**
+   * @brief The content of the rope, flattened on the first call.
+   */
+  [[nodiscard]] std::string_view flat() const {
+    if (m_left) {
+      flatten();
+    }
+    return m_flat;
+  }
+
+  /**
+   * @brief The hash of the content, as `std::hash<std::string_view>`,
+   *        computed on the first call: a rope used as a key again and again
+   *        is hashed once.
+   */
+  [[nodiscard]] std::size_t hash() const {
+    if (!m_hashed) {
+      m_hash = std::hash<std::string_view>{}(flat());
+      m_hashed = true;
+    }
+    return m_hash;
+  }
+
+private:
+  void flatten() const;
+
+  /**
+   * @brief Whether destroying `rope` would destroy its children with it.
+   */
+  [[nodiscard]] static bool owns_children(Ptr const &rope) noexcept {
+    return rope && rope->m_left && rope.use_count() == 1;
+  }
+
+  /**
+   * @brief Destroy `rope` and the children it owns, in constant space.
+   */
+  static void dismantle(Ptr rope) noexcept;
+
+private:
+  std::size_t m_size;
+  /**
+   * The content, only valid once there are no children.
+   */
+  mutable std::pmr::string m_flat;
+  mutable Ptr m_left;
+  mutable Ptr m_right;
+  mutable std::size_t m_hash = 0;
+  mutable bool m_hashed = false;
+};
+
+} // namespace Lox
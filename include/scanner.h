@@ -5,7 +5,9 @@
 #include <cstdint>
 #include <cstring>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -17,7 +19,10 @@ enum class TokenType : uint8_t {
   RIGHT_PAREN,
   LEFT_BRACE,
   RIGHT_BRACE,
+  LEFT_BRACKET,
+  RIGHT_BRACKET,
   COMMA,
+  COLON,
   DOT,
   PLUS,
   MINUS,
@@ -71,8 +76,14 @@ inline std::string to_string(TokenType type) {
     return "LEFT_BRACE";
   case TokenType::RIGHT_BRACE:
     return "RIGHT_BRACE";
+  case TokenType::LEFT_BRACKET:
+    return "LEFT_BRACKET";
+  case TokenType::RIGHT_BRACKET:
+    return "RIGHT_BRACKET";
   case TokenType::COMMA:
     return "COMMA";
+  case TokenType::COLON:
+    return "COLON";
   case TokenType::DOT:
     return "DOT";
   case TokenType::PLUS:
@@ -147,60 +158,115 @@ inline std::string to_string(TokenType type) {
 }
 
 class Parser;
+class IncrementalScanner;
 
+/**
+ * A token only refers to its lexeme in the source, which must outlive it. Its
+ * line and column are computed from `offset()` by `SourceMap` when needed.
+ */
 class Token {
   friend std::ostream &operator<<(std::ostream &out, Token const &token);
 
   friend class Parser;
+  friend class IncrementalScanner;
 
 public:
-  Token(uint32_t lineno, TokenType type, std::string lexeme);
+  Token(uint32_t offset, TokenType type, std::string_view lexeme);
 
-  Token(Token const &other);
-
-  Token &operator=(Token const &other);
-
-  Token(Token &&) noexcept;
-
-  Token &operator=(Token &&) noexcept;
-
-  ~Token() noexcept;
-
-  void swap(Token &other) noexcept;
+  /**
+   * @brief Construct a `NUMBER` token whose literal is already parsed.
+   */
+  Token(uint32_t offset, std::string_view lexeme, double number)
+      : m_lexeme(lexeme), m_number(number), m_offset(offset),
+        m_type(TokenType::NUMBER) {}
 
-  uint32_t lineno() const { return m_lineno; }
+  /**
+   * @brief Byte offset of the first character of the token in the source.
+   */
+  uint32_t offset() const { return m_offset; }
 
   TokenType type() const { return m_type; }
 
   std::string_view lexeme() const { return m_lexeme; }
 
-  char const *str_literal() const { return m_literal.str; }
+  /**
+   * @brief The string literal, which is the lexeme without its quotes.
+   */
+  std::string_view str_literal() const {
+    return m_lexeme.substr(1, m_lexeme.size() - 2);
+  }
 
-  double number_literal() const { return m_literal.number; }
+  double number_literal() const { return m_number; }
 
 private:
-  uint32_t m_lineno;
+  std::string_view m_lexeme;
+  double m_number{};
+  uint32_t m_offset;
   TokenType m_type;
-  std::string m_lexeme;
-  union {
-    char *str;
-    double number;
-    uint64_t data;
-  } m_literal;
 };
 
-inline void swap(Token &lhs, Token &rhs) noexcept { lhs.swap(rhs); }
+/**
+ * The tokens of a source, allocated from the memory resource of their
+ * scanner.
+ */
+using TokenList = std::pmr::vector<Token>;
+
+class ParallelScanner;
+
+/**
+ * An error found by `Scanner`, reported later by `Scanner::report_errors()`.
+ */
+struct ScanError {
+  uint32_t offset;
+  ErrorCode code;
+};
 
 class Scanner {
+  friend class ParallelScanner;
+  friend class IncrementalScanner;
+
 public:
-  Scanner(std::string const &source) : m_source(source) {}
+  /**
+   * @brief Scan `source`, allocating the tokens from `memory`. If it runs
+   *        out, an `OUT_OF_MEMORY` error ends the tokens.
+   */
+  Scanner(std::string const &source,
+          std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : Scanner(source, 0, source.size(), memory) {}
+
+  /**
+   * @brief Scan only [`begin`, `end`) of `source`. `begin` must not be inside
+   *        a string literal or comment.
+   */
+  Scanner(std::string const &source, uint64_t begin, uint64_t end,
+          std::pmr::memory_resource *memory = std::pmr::get_default_resource())
+      : m_source(source), m_end(end), m_tokens(memory), m_current(begin),
+        m_start(begin) {}
 
   /**
    * @brief Scan out all tokens in the source. Need to find all errors possible.
    */
-  std::vector<Token> const &scan_tokens();
+  TokenList const &scan_tokens();
 
 private:
+  /**
+   * @brief Scan the tokens of the range without appending `END`, errors are
+   *        kept in `m_errors` until `report_errors()`.
+   */
+  void scan_range();
+
+  /**
+   * @brief Move all errors found so far into `syntax_errors`.
+   */
+  void report_errors();
+
+  /**
+   * @brief Record an error at the current token.
+   */
+  void error(ErrorCode code) {
+    m_errors.push_back(ScanError{static_cast<uint32_t>(m_start), code});
+  }
+
   /**
    * @brief Scan a token from the left characters.
    */
@@ -209,7 +275,7 @@ private:
   /**
    * @brief if no characters left, return `true`, otherwise return `false`.
    */
-  bool is_at_end() { return m_current >= m_source.size(); }
+  bool is_at_end() { return m_current >= m_end; }
 
   /**
    * @brief Consume a character and return it.
@@ -255,7 +321,7 @@ private:
    *        current character and it.
    */
   [[nodiscard]] char peek_next() noexcept {
-    if (m_current + 1 >= m_source.size()) {
+    if (m_current + 1 >= m_end) {
       return '\0';
     }
     return m_source[m_current + 1];
@@ -271,15 +337,14 @@ private:
    *        into `m_tokens`.
    */
   void add_token(TokenType type) {
-    m_tokens.emplace_back(m_lineno, type,
-                          std::string(m_source, m_start, m_current - m_start));
+    m_tokens.emplace_back(m_start, type, lexeme());
   }
 
   /**
-   * @brief Construct a token from `lexeme` and put it into `m_tokens`.
+   * @brief Returns the characters in [`m_start`, `m_current`).
    */
-  void add_token(TokenType type, std::string lexeme) {
-    m_tokens.emplace_back(m_lineno, type, std::move(lexeme));
+  [[nodiscard]] std::string_view lexeme() const noexcept {
+    return std::string_view(m_source).substr(m_start, m_current - m_start);
   }
 
   [[nodiscard]] static bool is_digit(char c) { return c >= '0' && c <= '9'; }
@@ -315,13 +380,14 @@ private:
 
 private:
   std::string const &m_source;
-  std::vector<Token> m_tokens{};
+  uint64_t m_end;
+  TokenList m_tokens;
+  std::vector<ScanError> m_errors{};
 
-  static std::unordered_map<std::string, TokenType> keywords;
+  static std::unordered_map<std::string_view, TokenType> keywords;
 
-  uint32_t m_lineno = 1;
-  uint64_t m_current{};
-  uint64_t m_start{};
+  uint64_t m_current;
+  uint64_t m_start;
 };
 
 } // namespace Lox
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "native.h"
+#include "object.h"
+#include "program.h"
+#include "source_map.h"
+#include "value.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace Lox {
+
+/**
+ * The state a prelude, such as a standard library written in Lox, leaves
+ * its globals in, to start other programs from without running it again.
+ *
+ * `write()` saves the values of the globals to a file, with the AST of the
+ * prelude, already resolved, optimized and checked, which its functions and
+ * classes refer to. A `Snapshot` maps the file back and rebuilds the AST,
+ * without scanning, parsing or running anything. The programs resolved
+ * against it see the globals of the prelude, which every run of an
+ * interpreter given the snapshot starts from, see
+ * `Interpreter::set_snapshot()`. Each run gets its own copy of the objects,
+ * so that what a run does to them never leaks into the next one.
+ *
+ * A snapshot is read back by the build which wrote it only: it is not
+ * portable across architectures or versions. Its structure is checked when
+ * it is mapped, not the code it holds, which is trusted like a script. The
+ * interpreters using it must define the same natives, in the same order.
+ */
+class Snapshot {
+public:
+  /**
+   * The values of globals, natives first, empty for those never defined.
+   */
+  using Globals = std::vector<std::optional<Value>>;
+
+  /**
+   * @brief Write to a snapshot at `pathname` the `globals` left by running
+   *        the prelude `program` with `natives`, see
+   *        `Interpreter::run_prelude()`. Their functions must all be
+   *        declared in `program`, whose source `source_map` maps.
+   */
+  static void write(char const *pathname, Program const &program,
+                    SourceMap const &source_map, Globals const &globals,
+                    NativeRegistry const &natives);
+
+  /**
+   * @brief Map the snapshot at `pathname`, and rebuild its AST.
+   */
+  explicit Snapshot(char const *pathname);
+
+  Snapshot(Snapshot const &) = delete;
+
+  Snapshot &operator=(Snapshot const &) = delete;
+
+  ~Snapshot() noexcept;
+
+  /**
+   * @brief The number of globals of the prelude, natives included.
+   */
+  [[nodiscard]] uint32_t global_count() const noexcept {
+    return static_cast<uint32_t>(m_globals.size());
+  }
+
+  [[nodiscard]] std::string_view global_name(uint32_t index) const noexcept {
+    return m_names[index];
+  }
+
+  /**
+   * @brief Whether `token` is one of the AST of the prelude, whose source
+   *        `source_map()` maps, rather than of a program run after it.
+   */
+  [[nodiscard]] bool owns(Token const *token) const noexcept {
+    std::less<Token const *> const before;
+    return !before(token, m_tokens.data()) &&
+           before(token, m_tokens.data() + m_tokens.size());
+  }
+
+  [[nodiscard]] SourceMap const &source_map() const noexcept {
+    return m_source_map;
+  }
+
+  /**
+   * @brief Whether the native global `index` still holds its native, so
+   *        that its calls can be bound ahead of time.
+   */
+  [[nodiscard]] bool holds_native(uint32_t index) const noexcept;
+
+  /**
+   * @brief Throw unless `natives` have the names and the arities of those
+   *        the snapshot was written with.
+   */
+  void check_natives(NativeRegistry const &natives) const;
+
+  /**
+   * @brief Build a copy of the globals, calling `natives`, with the objects
+   *        allocated from `memory`.
+   */
+  [[nodiscard]] Globals instantiate(NativeRegistry const &natives,
+                                    std::pmr::memory_resource *memory) const;
+
+private:
+  static constexpr uint32_t kNoObject = std::numeric_limits<uint32_t>::max();
+
+  /**
+   * A value of the snapshot: `value`, unless it refers to the object at
+   * `object`.
+   */
+  struct Slot {
+    Value value;
+    uint32_t object = kNoObject;
+  };
+
+  struct Field {
+    std::string_view name;
+    Slot value;
+  };
+
+  struct Method {
+    uint32_t declaration;
+    std::vector<uint32_t> captures;
+  };
+
+  /**
+   * An object, built after the objects it refers to, which come first. The
+   * values of cells, the fields of instances, the elements of arrays and the
+   * entries of maps are filled once all the objects are built, since they
+   * may form cycles.
+   */
+  struct Record {
+    Object::Kind kind;
+    /**
+     * The index of a native, the declaration of a function, or the class
+     * of an instance or of the method of a bound method.
+     */
+    uint32_t index = 0;
+    /**
+     * The class of a function, the superclass of a class, or the receiver
+     * of a bound method, if any.
+     */
+    uint32_t owner = kNoObject;
+    /**
+     * The name of a class, or of the method of a bound method.
+     */
+    std::string_view name{};
+    /**
+     * The cells captured by a function.
+     */
+    std::vector<uint32_t> captures{};
+    std::vector<Method> methods{};
+    /**
+     * The fields of an instance, the elements of an array or the keys and
+     * values of a map, unnamed, or the value of a cell.
+     */
+    std::vector<Field> fields{};
+  };
+
+  struct Signature {
+    std::string_view name;
+    uint32_t arity;
+  };
+
+  class Reader;
+
+  /**
+   * @brief The value of `slot`, in a copy whose objects are `objects`.
+   */
+  [[nodiscard]] static Value value(Slot const &slot,
+                                   std::vector<ObjectPtr> const &objects);
+
+private:
+  char const *m_data = nullptr;
+  std::size_t m_size = 0;
+  std::vector<Signature> m_natives;
+  /**
+   * The tokens of the AST, whose lexemes are in the mapping.
+   */
+  std::vector<Token> m_tokens;
+  SourceMap m_source_map{std::vector<uint32_t>{0}};
+  Program m_program;
+  /**
+   * The function declarations of the AST, in the order they were written.
+   */
+  std::vector<Function const *> m_functions;
+  std::vector<std::string_view> m_names;
+  std::vector<Record> m_objects;
+  std::vector<std::optional<Slot>> m_globals;
+};
+
+} // namespace Lox
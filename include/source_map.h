@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Lox {
+
+/**
+ * A position in the source, both counting from 1. The column counts bytes.
+ */
+struct SourceLocation {
+  uint32_t line;
+  uint32_t column;
+};
+
+/**
+ * Store the offset of every line start of a source once, so tokens and AST
+ * nodes only need to carry a byte offset.
+ */
+class SourceMap {
+public:
+  explicit SourceMap(std::string_view source);
+
+  /**
+   * @brief The map of a source whose line starts are `line_starts`, as
+   *        `line_starts()` returned them.
+   */
+  explicit SourceMap(std::vector<uint32_t> line_starts) noexcept
+      : m_line_starts(std::move(line_starts)) {}
+
+  /**
+   * @brief Compute the line and the column of the byte at `offset` with a
+   *        binary search over the line starts.
+   */
+  [[nodiscard]] SourceLocation locate(uint32_t offset) const noexcept;
+
+  /**
+   * @brief The offsets of the line starts, 0 first, in ascending order.
+   */
+  [[nodiscard]] std::vector<uint32_t> const &line_starts() const noexcept {
+    return m_line_starts;
+  }
+
+private:
+  std::vector<uint32_t> m_line_starts;
+};
+
+} // namespace Lox
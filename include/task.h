@@ -0,0 +1,191 @@
+#pragma once
+
+#include "error.h"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace Lox {
+
+/**
+ * A coroutine computing a `T`, started when it is awaited by another
+ * coroutine, which it resumes once done. Awaiting and completing transfer
+ * control symmetrically, so a chain of tasks, however deep, does not grow
+ * the native stack when it suspends and resumes.
+ *
+ * A task built from a value holds no coroutine: it is ready at once, for a
+ * function which only sometimes needs to suspend.
+ */
+template <typename T> class [[nodiscard]] Task {
+public:
+  class promise_type {
+  public:
+    Task get_return_object() noexcept {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    auto final_suspend() noexcept {
+      struct Resume {
+        bool await_ready() noexcept { return false; }
+
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<promise_type> done) noexcept {
+          return done.promise().m_continuation;
+        }
+
+        void await_resume() noexcept {}
+      };
+      return Resume{};
+    }
+
+    void return_value(T value) { m_value = std::move(value); }
+
+    void unhandled_exception() noexcept {
+      m_exception = std::current_exception();
+    }
+
+  private:
+    friend class Task;
+
+    std::coroutine_handle<> m_continuation = std::noop_coroutine();
+    std::optional<T> m_value;
+    std::exception_ptr m_exception;
+  };
+
+  explicit Task(T value) : m_value(std::move(value)) {}
+
+  Task(Task const &) = delete;
+
+  Task &operator=(Task const &) = delete;
+
+  Task(Task &&other) noexcept
+      : m_handle(std::exchange(other.m_handle, nullptr)),
+        m_value(std::move(other.m_value)) {}
+
+  Task &operator=(Task &&) = delete;
+
+  ~Task() noexcept {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  [[nodiscard]] bool await_ready() const noexcept { return !m_handle; }
+
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<> continuation) noexcept {
+    m_handle.promise().m_continuation = continuation;
+    return m_handle;
+  }
+
+  /**
+   * @brief The result of the task, or the exception it let escape, rethrown
+   *        into the awaiting coroutine.
+   */
+  T await_resume() {
+    if (!m_handle) {
+      return std::move(*m_value);
+    }
+    promise_type &promise = m_handle.promise();
+    if (promise.m_exception) {
+      std::rethrow_exception(promise.m_exception);
+    }
+    return std::move(*promise.m_value);
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+      : m_handle(handle) {}
+
+private:
+  std::coroutine_handle<promise_type> m_handle;
+  std::optional<T> m_value;
+};
+
+/**
+ * The root of a coroutine, owned by the host which started it. It runs at
+ * once, up to its end or its first suspension, and is resumed by whatever
+ * it awaits. Destroying it before it is done cancels it: the coroutines it
+ * awaits are destroyed too, and never resumed.
+ *
+ * An exception escaping the coroutine ends it, and is rethrown by
+ * `result()`.
+ */
+template <typename T> class [[nodiscard]] Evaluation {
+public:
+  class promise_type {
+  public:
+    Evaluation get_return_object() noexcept {
+      return Evaluation(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_never initial_suspend() noexcept { return {}; }
+
+    std::suspend_always final_suspend() noexcept { return {}; }
+
+    void return_value(T value) { m_value = std::move(value); }
+
+    void unhandled_exception() noexcept {
+      m_exception = std::current_exception();
+    }
+
+  private:
+    friend class Evaluation;
+
+    std::optional<T> m_value;
+    std::exception_ptr m_exception;
+  };
+
+  Evaluation(Evaluation const &) = delete;
+
+  Evaluation &operator=(Evaluation const &) = delete;
+
+  Evaluation(Evaluation &&other) noexcept
+      : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+  Evaluation &operator=(Evaluation &&other) noexcept {
+    Evaluation tmp{std::move(other)};
+    std::swap(m_handle, tmp.m_handle);
+    return *this;
+  }
+
+  ~Evaluation() noexcept {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  /**
+   * @brief Whether the coroutine ran to its end, rather than waiting to be
+   *        resumed.
+   */
+  [[nodiscard]] bool done() const noexcept {
+    return m_handle && m_handle.done();
+  }
+
+  /**
+   * @brief The value the coroutine returned, once it is `done()`.
+   */
+  [[nodiscard]] T &result() {
+    THROW_ASSERT(done(), "The evaluation is still in progress.");
+    promise_type &promise = m_handle.promise();
+    if (promise.m_exception) {
+      std::rethrow_exception(promise.m_exception);
+    }
+    return *promise.m_value;
+  }
+
+private:
+  explicit Evaluation(std::coroutine_handle<promise_type> handle) noexcept
+      : m_handle(handle) {}
+
+private:
+  std::coroutine_handle<promise_type> m_handle;
+};
+
+} // namespace Lox
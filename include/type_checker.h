@@ -0,0 +1,138 @@
+#pragma once
+
+#include "ast_defines.inc"
+#include "program.h"
+
+#include <cstdint>
+#include <unordered_map>
+
+namespace Lox {
+
+/**
+ * Infer the types of the expressions of a program resolved by `Resolver`,
+ * and optimized by `Optimizer` if at all, before it runs.
+ *
+ * Every expression is annotated with the set of types it may evaluate to,
+ * see `TypeSet`. The type of a local of the current frame is tracked from
+ * its declaration or assignment on, joined where branches meet, and up to a
+ * fixed point in loops. Parameters, captured variables, globals, and the
+ * results of calls, of property reads and of element reads may have any
+ * type.
+ *
+ * An operator whose operands are proven to have the types it needs is marked
+ * unchecked, for the interpreter to skip its checks. An operator whose
+ * operands can never have them is an error, inserted into `syntax_errors`
+ * before the program runs.
+ */
+class TypeChecker final : public AstNodeVisitor {
+public:
+  TypeChecker() = default;
+
+  TypeChecker(TypeChecker const &) = delete;
+
+  TypeChecker &operator=(TypeChecker const &) = delete;
+
+  ~TypeChecker() noexcept override = default;
+
+  void check(Program &program);
+
+  void visit(Literal &) override;
+
+  void visit(Binary &) override;
+
+  void visit(Unary &) override;
+
+  void visit(Grouping &) override;
+
+  void visit(Logical &) override;
+
+  void visit(Constant &) override;
+
+  void visit(Hoisted &) override;
+
+  void visit(Shared &) override;
+
+  void visit(Variable &) override;
+
+  void visit(Assign &) override;
+
+  void visit(Call &) override;
+
+  void visit(Get &) override;
+
+  void visit(Set &) override;
+
+  void visit(Invoke &) override;
+
+  void visit(Array &) override;
+
+  void visit(Map &) override;
+
+  void visit(Index &) override;
+
+  void visit(SetIndex &) override;
+
+  void visit(This &) override;
+
+  void visit(Super &) override;
+
+  void visit(Expression &) override;
+
+  void visit(Print &) override;
+
+  void visit(Var &) override;
+
+  void visit(Block &) override;
+
+  void visit(If &) override;
+
+  void visit(While &) override;
+
+  void visit(Function &) override;
+
+  void visit(Class &) override;
+
+  void visit(Return &) override;
+
+private:
+  /**
+   * The types of the locals of the current frame known at the current
+   * point, by slot. A local missing may have any type.
+   */
+  using Locals = std::unordered_map<uint32_t, TypeSet>;
+
+  /**
+   * @brief Annotate `expr` and return its type.
+   */
+  TypeSet check(Expr &expr);
+
+  void check(StmtList &stmts);
+
+  /**
+   * @brief Check the body of a function, whose locals start unknown.
+   */
+  void check_function(Function &function);
+
+  /**
+   * @brief Join the types of the locals with `other`, which was reached on
+   *        another path.
+   */
+  void join(Locals const &other);
+
+  /**
+   * @brief Record the type of the variable at `slot`, if it is tracked.
+   */
+  void store(VariableSlot slot, TypeSet type);
+
+  void error(Token const &token, ErrorCode code);
+
+private:
+  Locals m_locals;
+  /**
+   * Errors are only reported once the types are final: not while a loop is
+   * iterated to its fixed point.
+   */
+  bool m_report = true;
+};
+
+} // namespace Lox
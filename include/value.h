@@ -1,14 +1,27 @@
 #pragma once
 
+#include "rope.h"
+
 #include <iostream>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <variant>
 
 namespace Lox {
 
+class Object;
+
+using ObjectPtr = std::shared_ptr<Object>;
+
 /**
  * A static type is required to hold the result of the Lox expression
  * evaluation, which can be Number, String, Boolean.
+ *
+ * Long strings built by `+` are held as a `Rope`, flattened when `str()` is
+ * first called on them. Classes, instances and functions are `Object`s,
+ * compared by identity.
  */
 struct Value {
   friend bool operator==(Value const &lhs, Value const &rhs);
@@ -26,6 +39,10 @@ public:
 
   Value(std::nullptr_t) : m_data(nullptr) {}
 
+  Value(Rope::Ptr rope) : m_data(std::move(rope)) {}
+
+  Value(ObjectPtr object) : m_data(std::move(object)) {}
+
   Value(Value const &other) : m_data(other.m_data) {}
 
   Value(Value &&other) : m_data(std::move(other.m_data)) {}
@@ -48,12 +65,17 @@ public:
 
   bool is_number() const { return std::holds_alternative<double>(m_data); }
 
-  bool is_string() const { return std::holds_alternative<std::string>(m_data); }
+  bool is_string() const {
+    return std::holds_alternative<std::string>(m_data) ||
+           std::holds_alternative<Rope::Ptr>(m_data);
+  }
 
   bool is_boolean() const { return std::holds_alternative<bool>(m_data); }
 
   bool is_nil() const { return std::holds_alternative<std::nullptr_t>(m_data); }
 
+  bool is_object() const { return std::holds_alternative<ObjectPtr>(m_data); }
+
   /**
    * In Lox, `false` and `nil` are falsey, and everything else is truthy.
    */
@@ -61,20 +83,121 @@ public:
 
   double number() const { return std::get<double>(m_data); };
 
+  /**
+   * @brief The number, without checking that this is one: the caller proved
+   *        it ahead of time.
+   */
+  double &unchecked_number() noexcept { return *std::get_if<double>(&m_data); }
+
+  double unchecked_number() const noexcept {
+    return *std::get_if<double>(&m_data);
+  }
+
   bool boolean() const { return std::get<bool>(m_data); };
 
-  std::string const &str() const { return std::get<std::string>(m_data); };
+  ObjectPtr const &object() const { return std::get<ObjectPtr>(m_data); };
+
+  std::string_view str() const {
+    if (auto const *rope = std::get_if<Rope::Ptr>(&m_data)) {
+      return (*rope)->flat();
+    }
+    return std::get<std::string>(m_data);
+  };
+
+  /**
+   * @brief The length of a string, without flattening it.
+   */
+  std::size_t str_size() const {
+    if (auto const *rope = std::get_if<Rope::Ptr>(&m_data)) {
+      return (*rope)->size();
+    }
+    return std::get<std::string>(m_data).size();
+  }
+
+  /**
+   * @brief The hash of a string, as `std::hash<std::string_view>`, which a
+   *        rope computes once.
+   */
+  [[nodiscard]] std::size_t str_hash() const;
+
+  friend Value concat(Value const &lhs, Value const &rhs,
+                      std::pmr::memory_resource *memory);
+
+private:
+  /**
+   * @brief A string as a rope, a leaf allocated from `memory` if it is not
+   *        one already.
+   */
+  Rope::Ptr rope(std::pmr::memory_resource *memory) const;
 
 private:
-  std::variant<double, bool, std::string, std::nullptr_t> m_data;
+  std::variant<double, bool, std::string, std::nullptr_t, Rope::Ptr, ObjectPtr>
+      m_data;
 };
 
 inline void swap(Value &lhs, Value &rhs) { lhs.swap(rhs); }
 
+/**
+ * Strings are at most this long. It is far below `std::string::max_size()`,
+ * so that a rope of this size can be flattened, and the size of a rope never
+ * overflows.
+ */
+inline constexpr std::size_t kMaxStringBytes = std::size_t{1} << 30;
+
+/**
+ * Strings up to this long are stored inline in a `std::string`, longer ones
+ * allocate.
+ */
+inline constexpr std::size_t kInlineStringBytes = std::string().capacity();
+
+/**
+ * @brief Whether concatenating the strings `lhs` and `rhs` would exceed
+ *        `kMaxStringBytes`.
+ */
+inline bool concat_too_long(Value const &lhs, Value const &rhs) {
+  return lhs.str_size() > kMaxStringBytes - rhs.str_size();
+}
+
+/**
+ * @brief Concatenate two strings, into a `Rope` allocated from `memory` if
+ *        they are long. They must not be `concat_too_long()`.
+ */
+Value concat(
+    Value const &lhs, Value const &rhs,
+    std::pmr::memory_resource *memory = std::pmr::get_default_resource());
+
 bool operator==(Value const &lhs, Value const &rhs);
 
 bool operator!=(Value const &lhs, Value const &rhs);
 
+/**
+ * @brief Whether `lhs` and `rhs` are the same key of a map: equal values,
+ *        except that all NaNs are the same key. `-0` and `0` are equal.
+ */
+bool same_key(Value const &lhs, Value const &rhs);
+
+/**
+ * @brief A hash of `value` as a key, equal for the same keys: strings hash
+ *        their characters, see `Value::str_hash()`, and objects their
+ *        identity.
+ */
+std::size_t hash_key(Value const &value);
+
+/**
+ * Hash and compare `Value`s as keys, for the standard containers.
+ */
+struct KeyHash {
+  std::size_t operator()(Value const &value) const {
+    return hash_key(value);
+  }
+};
+
+struct KeyEqual {
+  bool operator()(Value const &lhs, Value const &rhs) const {
+    return same_key(lhs, rhs);
+  }
+};
+
 std::ostream &operator<<(std::ostream &out, Value const &val);
 
 } // namespace Lox
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Lox {
+
+/**
+ * A fork-join thread pool. Every worker has its own deque of tasks: it pushes
+ * and pops the tasks it forks at the back, idle workers steal from the front
+ * of the others, so the oldest, and usually largest, tasks get stolen.
+ *
+ * A worker waiting for a task to finish keeps running tasks instead of
+ * blocking, so tasks may fork and join recursively.
+ */
+class WorkStealingPool {
+public:
+  /**
+   * A unit of work. It lives in the frame which forks it, and must be joined
+   * before that frame returns.
+   */
+  struct Task {
+    explicit Task(std::function<void()> work) : fn(std::move(work)) {}
+
+    std::function<void()> fn;
+    std::atomic<bool> done{false};
+    std::exception_ptr exception{};
+  };
+
+  /**
+   * @brief Start `n_workers - 1` threads, the thread calling `run()` is the
+   *        first worker.
+   */
+  explicit WorkStealingPool(unsigned n_workers);
+
+  WorkStealingPool(WorkStealingPool const &) = delete;
+
+  WorkStealingPool &operator=(WorkStealingPool const &) = delete;
+
+  ~WorkStealingPool() noexcept;
+
+  /**
+   * @brief Run `fn` on the calling thread, which may fork tasks from it.
+   */
+  void run(std::function<void()> const &fn);
+
+  /**
+   * @brief Make `task` available to the other workers. Must be called from
+   *        a worker.
+   */
+  void fork(Task &task);
+
+  /**
+   * @brief Run tasks until `task` is done, and rethrow its exception if it
+   *        threw one.
+   */
+  void join(Task &task);
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task *> tasks;
+  };
+
+  void work(unsigned index);
+
+  /**
+   * @brief Pop a task of the worker `index`, or steal one from the others.
+   */
+  Task *take(unsigned index);
+
+  static void execute(Task &task);
+
+private:
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::vector<std::thread> m_threads;
+  std::atomic<std::size_t> m_queued{0};
+  std::mutex m_idle_mutex;
+  std::condition_variable m_idle;
+  bool m_stop = false;
+};
+
+} // namespace Lox
@@ -1,5 +1,6 @@
 #!/usr/bin/python3
 
+import re
 import sys
 import json
 
@@ -16,11 +17,15 @@ def inc_file_print(arg, indent=True, delimiter=None):
 def inc_file_println(arg = "", indent=True):
   inc_file_print(arg, indent, "\n")
 
-def gen_inc_begin():
+def gen_inc_begin(includes):
   inc_file_println("#pragma once")
   inc_file_println("#include \"scanner.h\"")
+  for include in includes:
+    inc_file_println("#include \"{}\"".format(include))
   inc_file_println()
+  inc_file_println("#include <cstdint>")
   inc_file_println("#include <memory>")
+  inc_file_println("#include <utility>")
   inc_file_println()
   inc_file_println("namespace Lox {")
 
@@ -47,6 +52,65 @@ def gen_astnode_class():
   depth -= 1
   inc_file_println("};")
 
+def kind_name(class_name):
+  """The enumerator of a node class in the kind enum of its base class."""
+  return re.sub(r"(?<!^)(?=[A-Z])", "_", class_name).upper()
+
+def child_class_names(classes, base_class_name):
+  return [child_spec.split()[0] for child_spec in classes[base_class_name]["Childs"]]
+
+def gen_kind_enum(base_class_name, child_names):
+  global depth
+
+  inc_file_println()
+  inc_file_println("/**")
+  inc_file_println(" * The concrete class of a node derived from `{}`, to dispatch on".format(base_class_name))
+  inc_file_println(" * without a virtual call.")
+  inc_file_println(" */")
+  inc_file_println("enum class {}Kind : uint8_t {{".format(base_class_name))
+  depth += 1
+  for child_name in child_names:
+    inc_file_println("{},".format(kind_name(child_name)))
+  depth -= 1
+  inc_file_println("};")
+
+def gen_dispatchers(base_class_name, child_names):
+  global depth
+
+  inc_file_println()
+  inc_file_println("/**")
+  inc_file_println(" * @brief Call `f` with `node` cast to its node class, by a switch on its")
+  inc_file_println(" *        kind: `f` is called statically, and can be inlined.")
+  inc_file_println(" */")
+  inc_file_println("template <typename F> decltype(auto) visit({} &node, F &&f) {{".format(base_class_name))
+  depth += 1
+  inc_file_println("switch (node.kind()) {")
+  for child_name in child_names[:-1]:
+    inc_file_println("case {}Kind::{}:".format(base_class_name, kind_name(child_name)))
+    depth += 1
+    inc_file_println("return std::forward<F>(f)(static_cast<{} &>(node));".format(child_name))
+    depth -= 1
+  # the last kind is the default, for every path to return
+  inc_file_println("default:")
+  depth += 1
+  inc_file_println("return std::forward<F>(f)(static_cast<{} &>(node));".format(child_names[-1]))
+  depth -= 1
+  inc_file_println("}")
+  depth -= 1
+  inc_file_println("}")
+
+  inc_file_println()
+  inc_file_println("/**")
+  inc_file_println(" * @brief Call the `visit()` overload of `visitor` for the node class of")
+  inc_file_println(" *        `node`, instead of `node.accept(visitor)`. The call is static")
+  inc_file_println(" *        if `Visitor` is `final`.")
+  inc_file_println(" */")
+  inc_file_println("template <typename Visitor> void dispatch({} &node, Visitor &visitor) {{".format(base_class_name))
+  depth += 1
+  inc_file_println("visit(node, [&visitor](auto &child) { visitor.visit(child); });")
+  depth -= 1
+  inc_file_println("}")
+
 def gen_astnode_visitor_class(node_classes):
   global depth
 
@@ -73,11 +137,27 @@ def gen_classes(classes):
 
   for base_class_name in classes.keys():
     base_class_to_childs[base_class_name] = []
+    gen_kind_enum(base_class_name, child_class_names(classes, base_class_name))
     inc_file_println()
     inc_file_println("class {} : public AstNode {{".format(base_class_name))
     inc_file_println("public:")
     depth += 1
+    inc_file_println("explicit {0}({0}Kind kind) : m_kind(kind) {{}}".format(base_class_name))
+    inc_file_println(indent=False)
     inc_file_println(" virtual ~{}() noexcept override = default;".format(base_class_name))
+    inc_file_println(indent=False)
+    inc_file_println("[[nodiscard]] {}Kind kind() const noexcept {{ return m_kind; }}".format(base_class_name))
+    # annotations shared by all the nodes of the class
+    base_fields = classes[base_class_name].get("Fields", [])
+    if base_fields:
+      inc_file_println(indent=False)
+      for field in base_fields:
+        inc_file_println(field)
+    depth -= 1
+    inc_file_println(indent=False)
+    inc_file_println("private:")
+    depth += 1
+    inc_file_println("{}Kind m_kind;".format(base_class_name))
     depth -= 1
     inc_file_println("};")
 
@@ -96,8 +176,9 @@ def gen_classes(classes):
           "name": member_name,
           "type": member_type,
         })
+      fields = classes[base_class_name]["Childs"][child_spec].get("Fields", [])
       node_classes.append(child_class_name)
-      base_class_to_childs[base_class_name].append({"name": child_class_name, "members": members})
+      base_class_to_childs[base_class_name].append({"name": child_class_name, "members": members, "fields": fields})
 
   gen_astnode_visitor_class(node_classes)
 
@@ -105,6 +186,7 @@ def gen_classes(classes):
       for child_class in base_class_to_childs[base_class_name]:
           child_class_name = child_class["name"]
           members = child_class["members"]
+          fields = child_class["fields"]
           inc_file_println(indent=False)
           inc_file_println("class {} final : public {} {{".format(child_class_name, base_class_name))
           inc_file_println("public:")
@@ -118,16 +200,13 @@ def gen_classes(classes):
             inc_file_print("{} {}".format(member["type"], member["name"]), indent=False)
             counter += 1
           inc_file_println(")", indent=False)
-          inc_file_print(":   ", indent=True)
-          counter = 0
+          inc_file_print(":   {}({}Kind::{})".format(base_class_name, base_class_name, kind_name(child_class_name)), indent=True)
           for member in members:
-            if counter > 0:
-              inc_file_print(", ", indent=False)
-            if member["type"].endswith("Ptr"):
+            inc_file_print(", ", indent=False)
+            if member["type"].endswith("Ptr") or member["type"].endswith("List"):
               inc_file_print("m_{0}(std::move({0}))".format(member["name"]), indent=False)
             else:
               inc_file_print("m_{0}({0})".format(member["name"]), indent=False)
-            counter += 1
           inc_file_println(" {}")
 
           # visit
@@ -142,11 +221,17 @@ def gen_classes(classes):
           inc_file_println(indent=False)
           for member in members:
             inc_file_println("{} m_{};".format(member["type"], member["name"]))
+          # annotations filled by later passes, not constructor arguments
+          for field in fields:
+            inc_file_println(field)
 
           depth -= 1
 
           inc_file_println("};")
 
+  for base_class_name in classes.keys():
+    gen_dispatchers(base_class_name, child_class_names(classes, base_class_name))
+
 if __name__ == "__main__":
   if len(sys.argv) != 3:
     print("Usage: {} <json_path> <inc_path>".format(sys.argv[0]))
@@ -157,11 +242,12 @@ if __name__ == "__main__":
 
   with open(json_path, "r") as json_file:
     json_data = json.load(json_file)
+    includes = json_data.get("Includes", [])
     defines = json_data["Defines"]
     classes = json_data["Classes"]
 
   with open(inc_path, "w+") as inc_file:
-    gen_inc_begin()
+    gen_inc_begin(includes)
     gen_inc_defines(defines)
     gen_classes(classes)
     gen_inc_end()
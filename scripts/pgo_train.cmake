@@ -0,0 +1,47 @@
+# Run the `lox` built with LOX_PGO=GENERATE on every program of the training
+# corpus, to record the profile the LOX_PGO=USE build is optimized with.
+#
+# cmake -DLOX=<lox> -DCORPUS_DIR=<dir> -DPROFILE_DIR=<dir>
+#       [-DLLVM_PROFDATA=<llvm-profdata>] -P pgo_train.cmake
+
+foreach(VAR LOX CORPUS_DIR PROFILE_DIR)
+  if (NOT DEFINED ${VAR})
+    message(FATAL_ERROR "${VAR} is not set")
+  endif()
+endforeach()
+
+# Only the runs of this training count, not those of earlier builds
+file(REMOVE_RECURSE "${PROFILE_DIR}")
+file(MAKE_DIRECTORY "${PROFILE_DIR}")
+
+file(GLOB PROGRAMS "${CORPUS_DIR}/*.lox")
+list(SORT PROGRAMS)
+if (NOT PROGRAMS)
+  message(FATAL_ERROR "No training program in ${CORPUS_DIR}")
+endif()
+
+foreach(PROGRAM ${PROGRAMS})
+  message(STATUS "Training on ${PROGRAM}")
+  execute_process(
+    COMMAND "${LOX}" "${PROGRAM}"
+    RESULT_VARIABLE RESULT
+    OUTPUT_QUIET
+    ERROR_VARIABLE ERRORS
+  )
+  if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${PROGRAM} failed: ${ERRORS}")
+  endif()
+endforeach()
+
+# Clang writes raw profiles, which must be merged before they can be used
+if (LLVM_PROFDATA)
+  file(GLOB RAW_PROFILES "${PROFILE_DIR}/*.profraw")
+  execute_process(
+    COMMAND "${LLVM_PROFDATA}" merge -output "${PROFILE_DIR}/default.profdata"
+            ${RAW_PROFILES}
+    RESULT_VARIABLE RESULT
+  )
+  if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "Merging the raw profiles failed")
+  endif()
+endif()
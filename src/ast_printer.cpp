@@ -1,4 +1,5 @@
 #include "ast_printer.h"
+#include "number.h"
 #include "scanner.h"
 
 namespace Lox {
@@ -6,23 +7,37 @@ namespace Lox {
 void AstPrinter::visit(Binary &node) {
   m_out << node.m_op.lexeme();
   m_out << " ";
-  node.m_left->accept(*this);
+  dispatch(*node.m_left, *this);
   m_out << " ";
-  node.m_right->accept(*this);
+  dispatch(*node.m_right, *this);
 }
 
 void AstPrinter::visit(Unary &node) {
   m_out << node.m_op.lexeme();
   m_out << " ";
-  node.m_right->accept(*this);
+  dispatch(*node.m_right, *this);
 }
 
 void AstPrinter::visit(Grouping &node) {
   m_out << "(";
-  node.m_expr->accept(*this);
+  dispatch(*node.m_expr, *this);
   m_out << ")";
 }
 
+void AstPrinter::visit(Logical &node) {
+  m_out << node.m_op.lexeme();
+  m_out << " ";
+  dispatch(*node.m_left, *this);
+  m_out << " ";
+  dispatch(*node.m_right, *this);
+}
+
+void AstPrinter::visit(Constant &node) { m_out << node.m_value; }
+
+void AstPrinter::visit(Hoisted &node) { dispatch(*node.m_expr, *this); }
+
+void AstPrinter::visit(Shared &node) { dispatch(node.m_expr, *this); }
+
 void AstPrinter::visit(Literal &node) {
   switch (node.m_token.type()) {
   case TokenType::TRUE:
@@ -34,18 +49,187 @@ void AstPrinter::visit(Literal &node) {
   case TokenType::NIL:
     m_out << "nil";
     break;
-  case TokenType::NUMBER:
-    m_out << node.m_token.number_literal();
+  case TokenType::NUMBER: {
+    NumberBuffer buffer;
+    m_out << format_number(node.m_token.number_literal(), buffer);
     break;
+  }
   case TokenType::STRING:
     m_out << node.m_token.str_literal();
     break;
   default:
-    Lox::syntax_error(
-        node.m_token.lineno(),
-        "An error occurred in Lox. A literal of invalid type was encountered.");
+    Lox::syntax_error(Diagnostic{ErrorCode::INVALID_LITERAL,
+                                 node.m_token.offset(), &node.m_token});
     break;
   }
 }
 
+void AstPrinter::visit(Variable &node) { m_out << node.m_name.lexeme(); }
+
+void AstPrinter::visit(Assign &node) {
+  m_out << "= " << node.m_name.lexeme() << " ";
+  dispatch(*node.m_value, *this);
+}
+
+void AstPrinter::visit(Call &node) {
+  m_out << "(call ";
+  dispatch(*node.m_callee, *this);
+  print_arguments(node.m_arguments);
+  m_out << ")";
+}
+
+void AstPrinter::visit(Get &node) {
+  m_out << ". ";
+  dispatch(*node.m_object, *this);
+  m_out << " " << node.m_name.lexeme();
+}
+
+void AstPrinter::visit(Set &node) {
+  m_out << ".= ";
+  dispatch(*node.m_object, *this);
+  m_out << " " << node.m_name.lexeme() << " ";
+  dispatch(*node.m_value, *this);
+}
+
+void AstPrinter::visit(Invoke &node) {
+  m_out << "(invoke ";
+  dispatch(*node.m_object, *this);
+  m_out << " " << node.m_name.lexeme();
+  print_arguments(node.m_arguments);
+  m_out << ")";
+}
+
+void AstPrinter::visit(Array &node) {
+  m_out << "(array";
+  print_arguments(node.m_elements);
+  m_out << ")";
+}
+
+void AstPrinter::visit(Map &node) {
+  m_out << "(map";
+  for (std::size_t i = 0; i < node.m_keys.size(); ++i) {
+    m_out << " ";
+    dispatch(*node.m_keys[i], *this);
+    m_out << ": ";
+    dispatch(*node.m_values[i], *this);
+  }
+  m_out << ")";
+}
+
+void AstPrinter::visit(Index &node) {
+  m_out << "[] ";
+  dispatch(*node.m_object, *this);
+  m_out << " ";
+  dispatch(*node.m_index, *this);
+}
+
+void AstPrinter::visit(SetIndex &node) {
+  m_out << "[]= ";
+  dispatch(*node.m_object, *this);
+  m_out << " ";
+  dispatch(*node.m_index, *this);
+  m_out << " ";
+  dispatch(*node.m_value, *this);
+}
+
+void AstPrinter::visit(This &) { m_out << "this"; }
+
+void AstPrinter::visit(Super &node) {
+  m_out << "super." << node.m_method.lexeme();
+}
+
+void AstPrinter::visit(Expression &node) {
+  dispatch(*node.m_expr, *this);
+  m_out << ";";
+}
+
+void AstPrinter::visit(Print &node) {
+  m_out << "print ";
+  dispatch(*node.m_expr, *this);
+  m_out << ";";
+}
+
+void AstPrinter::visit(Var &node) {
+  m_out << "var " << node.m_name.lexeme();
+  if (node.m_initializer) {
+    m_out << " = ";
+    dispatch(*node.m_initializer, *this);
+  }
+  m_out << ";";
+}
+
+void AstPrinter::visit(Block &node) {
+  m_out << "{";
+  for (auto const &stmt : node.m_statements) {
+    m_out << " ";
+    dispatch(*stmt, *this);
+  }
+  m_out << " }";
+}
+
+void AstPrinter::visit(If &node) {
+  m_out << "if ";
+  dispatch(*node.m_condition, *this);
+  m_out << " ";
+  dispatch(*node.m_then_branch, *this);
+  if (node.m_else_branch) {
+    m_out << " else ";
+    dispatch(*node.m_else_branch, *this);
+  }
+}
+
+void AstPrinter::visit(While &node) {
+  m_out << "while ";
+  if (node.m_condition) {
+    dispatch(*node.m_condition, *this);
+  } else {
+    m_out << "true";
+  }
+  m_out << " ";
+  dispatch(*node.m_body, *this);
+}
+
+void AstPrinter::visit(Function &node) {
+  m_out << node.m_name.lexeme() << "(";
+  for (std::size_t i = 0; i < node.m_params.size(); ++i) {
+    m_out << (i == 0 ? "" : ", ") << node.m_params[i]->lexeme();
+  }
+  m_out << ") {";
+  for (auto const &stmt : node.m_body) {
+    m_out << " ";
+    dispatch(*stmt, *this);
+  }
+  m_out << " }";
+}
+
+void AstPrinter::visit(Class &node) {
+  m_out << "class " << node.m_name.lexeme();
+  if (node.m_superclass) {
+    m_out << " < ";
+    dispatch(*node.m_superclass, *this);
+  }
+  m_out << " {";
+  for (auto const &method : node.m_methods) {
+    m_out << " ";
+    dispatch(*method, *this);
+  }
+  m_out << " }";
+}
+
+void AstPrinter::visit(Return &node) {
+  m_out << "return";
+  if (node.m_value) {
+    m_out << " ";
+    dispatch(*node.m_value, *this);
+  }
+  m_out << ";";
+}
+
+void AstPrinter::print_arguments(ExprList const &arguments) {
+  for (auto const &argument : arguments) {
+    m_out << " ";
+    dispatch(*argument, *this);
+  }
+}
+
 } // namespace Lox
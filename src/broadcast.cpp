@@ -0,0 +1,264 @@
+#include "broadcast.h"
+#include "object.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Resolved once, when the program is loaded, to the clone for the widest
+// instruction set the CPU runs
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__ELF__)
+#define LOX_SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define LOX_SIMD_CLONES
+#endif
+
+namespace Lox {
+
+namespace {
+
+#if defined(__GNUC__)
+/**
+ * Four doubles, operated on at once: by one AVX instruction, or by two SSE2
+ * ones on the baseline instruction set.
+ */
+using Lanes = double __attribute__((vector_size(32)));
+using LaneMask = int64_t __attribute__((vector_size(32)));
+constexpr std::size_t kLanes = 4;
+#endif
+
+/**
+ * An operand of an element-wise operator: a number, repeated for every
+ * element, or the numbers of an array.
+ */
+struct Operand {
+  [[nodiscard]] double const *data() const noexcept {
+    return scalar ? &number : numbers;
+  }
+
+  bool scalar = false;
+  double number = 0;
+  double const *numbers = nullptr;
+  /**
+   * The elements of a boxed array, unboxed.
+   */
+  std::pmr::vector<double> unboxed;
+};
+
+/**
+ * @brief The operand `value`, `array` if it is one, or an error if it is
+ *        neither a number nor an array of numbers.
+ */
+Expected<Operand, ErrorCode> operand(Value const &value,
+                                     LoxArray const *array,
+                                     std::pmr::memory_resource *memory) {
+  Operand result{false, 0, nullptr, std::pmr::vector<double>(memory)};
+  if (array == nullptr) {
+    if (!value.is_number()) {
+      return Unexpected{ErrorCode::OPERANDS_MUST_BE_NUMBERS_OR_ARRAYS};
+    }
+    result.scalar = true;
+    result.number = value.unchecked_number();
+    return result;
+  }
+  if (!array->boxed()) {
+    result.numbers = array->numbers().data();
+    return result;
+  }
+  result.unboxed.reserve(array->size());
+  for (auto const &element : array->values()) {
+    if (!element.is_number()) {
+      return Unexpected{ErrorCode::OPERANDS_MUST_BE_NUMBERS};
+    }
+    result.unboxed.push_back(element.unchecked_number());
+  }
+  result.numbers = result.unboxed.data();
+  return result;
+}
+
+/**
+ * @brief `result = x op y`, for lanes or for a single element. Vectors are
+ *        passed by reference, which keeps their ABI out of the way.
+ */
+template <TokenType kOp, typename T>
+void compute(T const &x, T const &y, T &result) noexcept {
+  if constexpr (kOp == TokenType::PLUS) {
+    result = x + y;
+  } else if constexpr (kOp == TokenType::MINUS) {
+    result = x - y;
+  } else if constexpr (kOp == TokenType::STAR) {
+    result = x * y;
+  } else {
+    result = x / y;
+  }
+}
+
+template <TokenType kOp, typename T, typename M>
+void compare(T const &x, T const &y, M &result) noexcept {
+  if constexpr (kOp == TokenType::GREATER) {
+    result = x > y;
+  } else if constexpr (kOp == TokenType::GREATER_EQUAL) {
+    result = x >= y;
+  } else if constexpr (kOp == TokenType::LESS) {
+    result = x < y;
+  } else {
+    result = x <= y;
+  }
+}
+
+/**
+ * @brief `out[i] = left[i] op right[i]` for the `size` elements, a scalar
+ *        operand being read at index 0 only.
+ */
+template <TokenType kOp, bool kLeftScalar, bool kRightScalar>
+LOX_SIMD_CLONES void arithmetic(double const *left, double const *right,
+                                double *out, std::size_t size) {
+  std::size_t i = 0;
+#if defined(__GNUC__)
+  Lanes const left_splat = Lanes{} + left[0];
+  Lanes const right_splat = Lanes{} + right[0];
+  for (; i + kLanes <= size; i += kLanes) {
+    Lanes x = left_splat;
+    Lanes y = right_splat;
+    if constexpr (!kLeftScalar) {
+      std::memcpy(&x, left + i, sizeof(x));
+    }
+    if constexpr (!kRightScalar) {
+      std::memcpy(&y, right + i, sizeof(y));
+    }
+    Lanes result;
+    compute<kOp>(x, y, result);
+    std::memcpy(out + i, &result, sizeof(result));
+  }
+#endif
+  for (; i < size; ++i) {
+    compute<kOp>(left[kLeftScalar ? 0 : i], right[kRightScalar ? 0 : i],
+                 out[i]);
+  }
+}
+
+/**
+ * @brief `out[i] = left[i] op right[i]` for the `size` elements, as 1 or
+ *        0, a scalar operand being read at index 0 only.
+ */
+template <TokenType kOp, bool kLeftScalar, bool kRightScalar>
+LOX_SIMD_CLONES void comparison(double const *left, double const *right,
+                                uint8_t *out, std::size_t size) {
+  std::size_t i = 0;
+#if defined(__GNUC__)
+  Lanes const left_splat = Lanes{} + left[0];
+  Lanes const right_splat = Lanes{} + right[0];
+  for (; i + kLanes <= size; i += kLanes) {
+    Lanes x = left_splat;
+    Lanes y = right_splat;
+    if constexpr (!kLeftScalar) {
+      std::memcpy(&x, left + i, sizeof(x));
+    }
+    if constexpr (!kRightScalar) {
+      std::memcpy(&y, right + i, sizeof(y));
+    }
+    LaneMask mask;
+    compare<kOp>(x, y, mask);
+    for (std::size_t lane = 0; lane < kLanes; ++lane) {
+      out[i + lane] = mask[lane] != 0;
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    compare<kOp>(left[kLeftScalar ? 0 : i], right[kRightScalar ? 0 : i],
+                 out[i]);
+  }
+}
+
+/**
+ * @brief Run the kernel of `op` on `left` and `right`, of which at most one
+ *        is scalar, into a new array.
+ */
+template <TokenType kOp>
+Value apply(Operand const &left, Operand const &right, std::size_t size,
+            std::pmr::memory_resource *memory) {
+  std::pmr::polymorphic_allocator<> const allocator(memory);
+  double const *const x = left.data();
+  double const *const y = right.data();
+  if constexpr (kOp == TokenType::PLUS || kOp == TokenType::MINUS ||
+                kOp == TokenType::STAR || kOp == TokenType::SLASH) {
+    std::pmr::vector<double> numbers(size, memory);
+    if (left.scalar) {
+      arithmetic<kOp, true, false>(x, y, numbers.data(), size);
+    } else if (right.scalar) {
+      arithmetic<kOp, false, true>(x, y, numbers.data(), size);
+    } else {
+      arithmetic<kOp, false, false>(x, y, numbers.data(), size);
+    }
+    return ObjectPtr(
+        std::allocate_shared<LoxArray>(allocator, std::move(numbers)));
+  } else {
+    std::pmr::vector<uint8_t> mask(size, memory);
+    if (left.scalar) {
+      comparison<kOp, true, false>(x, y, mask.data(), size);
+    } else if (right.scalar) {
+      comparison<kOp, false, true>(x, y, mask.data(), size);
+    } else {
+      comparison<kOp, false, false>(x, y, mask.data(), size);
+    }
+    std::pmr::vector<Value> values(memory);
+    values.reserve(size);
+    for (uint8_t const element : mask) {
+      values.emplace_back(element != 0);
+    }
+    return ObjectPtr(
+        std::allocate_shared<LoxArray>(allocator, std::move(values)));
+  }
+}
+
+} // namespace
+
+Expected<Value, ErrorCode> broadcast(TokenType op, Value const &left,
+                                     Value const &right,
+                                     std::pmr::memory_resource *memory) {
+  LoxArray const *const left_array = as_array(left);
+  LoxArray const *const right_array = as_array(right);
+  std::size_t const size =
+      left_array != nullptr ? left_array->size() : right_array->size();
+  if (left_array != nullptr && right_array != nullptr &&
+      right_array->size() != size) {
+    return Unexpected{ErrorCode::ARRAY_LENGTHS_DIFFER};
+  }
+  auto left_operand = operand(left, left_array, memory);
+  if (!left_operand) {
+    return Unexpected{left_operand.error()};
+  }
+  auto right_operand = operand(right, right_array, memory);
+  if (!right_operand) {
+    return Unexpected{right_operand.error()};
+  }
+  if (size == 0) {
+    // Nothing to read, the kernels would read the first elements
+    return ObjectPtr(std::allocate_shared<LoxArray>(
+        std::pmr::polymorphic_allocator<>(memory), memory));
+  }
+
+  auto const &l = left_operand.value();
+  auto const &r = right_operand.value();
+  switch (op) {
+  case TokenType::PLUS:
+    return apply<TokenType::PLUS>(l, r, size, memory);
+  case TokenType::MINUS:
+    return apply<TokenType::MINUS>(l, r, size, memory);
+  case TokenType::STAR:
+    return apply<TokenType::STAR>(l, r, size, memory);
+  case TokenType::SLASH:
+    return apply<TokenType::SLASH>(l, r, size, memory);
+  case TokenType::GREATER:
+    return apply<TokenType::GREATER>(l, r, size, memory);
+  case TokenType::GREATER_EQUAL:
+    return apply<TokenType::GREATER_EQUAL>(l, r, size, memory);
+  case TokenType::LESS:
+    return apply<TokenType::LESS>(l, r, size, memory);
+  default:
+    return apply<TokenType::LESS_EQUAL>(l, r, size, memory);
+  }
+}
+
+} // namespace Lox
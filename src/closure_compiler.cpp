@@ -0,0 +1,290 @@
+#include "closure_compiler.h"
+#include "error.h"
+
+#include <functional>
+
+namespace Lox {
+
+namespace {
+
+bool fail(Thunk const &self, Diagnostic &error, ErrorCode code) {
+  error = Diagnostic{code, self.token->offset(), self.token};
+  return false;
+}
+
+bool eval_constant(Thunk const &self, Value &out, Diagnostic &) {
+  out = self.constant;
+  return true;
+}
+
+bool eval_number(Thunk const &self, Value &out, Diagnostic &) {
+  out = self.number;
+  return true;
+}
+
+bool eval_negate(Thunk const &self, Value &out, Diagnostic &error) {
+  if (!(*self.right)(out, error)) {
+    return false;
+  }
+  if (!out.is_number()) {
+    return fail(self, error, ErrorCode::OPERAND_MUST_BE_NUMBER);
+  }
+  out = -out.number();
+  return true;
+}
+
+bool eval_not(Thunk const &self, Value &out, Diagnostic &error) {
+  if (!(*self.right)(out, error)) {
+    return false;
+  }
+  out = !out.is_truthy();
+  return true;
+}
+
+bool eval_add(Thunk const &self, Value &out, Diagnostic &error) {
+  Value left;
+  if (!(*self.left)(left, error) || !(*self.right)(out, error)) {
+    return false;
+  }
+  if (left.is_number() && out.is_number()) {
+    out = left.number() + out.number();
+  } else if (left.is_string() && out.is_string()) {
+    if (concat_too_long(left, out)) {
+      return fail(self, error, ErrorCode::STRING_TOO_LONG);
+    }
+    out = concat(left, out);
+  } else {
+    return fail(self, error, ErrorCode::OPERANDS_MUST_BE_NUMBERS_OR_STRINGS);
+  }
+  return true;
+}
+
+/**
+ * Arithmetic and comparison operators, which only accept numbers.
+ */
+template <typename Op>
+bool eval_numeric(Thunk const &self, Value &out, Diagnostic &error) {
+  Value left;
+  if (!(*self.left)(left, error) || !(*self.right)(out, error)) {
+    return false;
+  }
+  if (!left.is_number() || !out.is_number()) {
+    return fail(self, error, ErrorCode::OPERANDS_MUST_BE_NUMBERS);
+  }
+  out = Op{}(left.number(), out.number());
+  return true;
+}
+
+template <bool Equal>
+bool eval_equality(Thunk const &self, Value &out, Diagnostic &error) {
+  Value left;
+  if (!(*self.left)(left, error) || !(*self.right)(out, error)) {
+    return false;
+  }
+  out = (left == out) == Equal;
+  return true;
+}
+
+/**
+ * `and` if `Or` is false: the right operand is evaluated only if the left
+ * one does not decide the value.
+ */
+template <bool Or>
+bool eval_logical(Thunk const &self, Value &out, Diagnostic &error) {
+  if (!(*self.left)(out, error)) {
+    return false;
+  }
+  if (out.is_truthy() == Or) {
+    return true;
+  }
+  return (*self.right)(out, error);
+}
+
+} // namespace
+
+CompiledExpr ClosureCompiler::compile(Expr &expr) {
+  m_compiled = CompiledExpr{};
+  m_shared_thunks.clear();
+  m_compiled.m_root = compile_child(expr);
+  return std::move(m_compiled);
+}
+
+void ClosureCompiler::visit(Literal &expr) {
+  Thunk thunk{eval_constant};
+  thunk.token = &expr.m_token;
+  switch (expr.m_token.type()) {
+  case TokenType::NUMBER:
+    // Assigning a double is much cheaper than copying a `Value`
+    thunk.fn = eval_number;
+    thunk.number = expr.m_token.number_literal();
+    break;
+  case TokenType::STRING:
+    thunk.constant = std::string(expr.m_token.str_literal());
+    break;
+  case TokenType::TRUE:
+    thunk.constant = true;
+    break;
+  case TokenType::FALSE:
+    thunk.constant = false;
+    break;
+  case TokenType::NIL:
+    thunk.constant = nullptr;
+    break;
+  default:
+    THROW_ASSERT(false, "Literal must be number, string, boolean or nil.");
+    break;
+  }
+  m_thunk = emit(std::move(thunk));
+}
+
+void ClosureCompiler::visit(Unary &expr) {
+  Thunk thunk{nullptr};
+  thunk.token = &expr.m_op;
+  thunk.right = compile_child(*expr.m_right);
+
+  switch (expr.m_op.type()) {
+  case TokenType::MINUS:
+    thunk.fn = eval_negate;
+    break;
+  case TokenType::BANG:
+    thunk.fn = eval_not;
+    break;
+  default:
+    THROW_ASSERT(false, "Unimplemented unary operator: " +
+                            std::string(expr.m_op.lexeme()));
+    break;
+  }
+  m_thunk = emit(std::move(thunk));
+}
+
+void ClosureCompiler::visit(Binary &expr) {
+  Thunk thunk{nullptr};
+  thunk.token = &expr.m_op;
+  thunk.left = compile_child(*expr.m_left);
+  thunk.right = compile_child(*expr.m_right);
+
+  switch (expr.m_op.type()) {
+  case TokenType::PLUS:
+    thunk.fn = eval_add;
+    break;
+  case TokenType::MINUS:
+    thunk.fn = eval_numeric<std::minus<double>>;
+    break;
+  case TokenType::STAR:
+    thunk.fn = eval_numeric<std::multiplies<double>>;
+    break;
+  case TokenType::SLASH:
+    thunk.fn = eval_numeric<std::divides<double>>;
+    break;
+  case TokenType::GREATER:
+    thunk.fn = eval_numeric<std::greater<double>>;
+    break;
+  case TokenType::GREATER_EQUAL:
+    thunk.fn = eval_numeric<std::greater_equal<double>>;
+    break;
+  case TokenType::LESS:
+    thunk.fn = eval_numeric<std::less<double>>;
+    break;
+  case TokenType::LESS_EQUAL:
+    thunk.fn = eval_numeric<std::less_equal<double>>;
+    break;
+  case TokenType::EQUAL_EQUAL:
+    thunk.fn = eval_equality<true>;
+    break;
+  case TokenType::BANG_EQUAL:
+    thunk.fn = eval_equality<false>;
+    break;
+  default:
+    THROW_ASSERT(false, "Unimplemented binary operator: " +
+                            std::string(expr.m_op.lexeme()));
+    break;
+  }
+  m_thunk = emit(std::move(thunk));
+}
+
+void ClosureCompiler::visit(Grouping &expr) {
+  // Parentheses only shape the tree, they need no thunk of their own
+  m_thunk = compile_child(*expr.m_expr);
+}
+
+void ClosureCompiler::visit(Logical &expr) {
+  Thunk thunk{expr.m_op.type() == TokenType::OR ? eval_logical<true>
+                                                : eval_logical<false>};
+  thunk.token = &expr.m_op;
+  thunk.left = compile_child(*expr.m_left);
+  thunk.right = compile_child(*expr.m_right);
+  m_thunk = emit(std::move(thunk));
+}
+
+void ClosureCompiler::visit(Constant &expr) {
+  Thunk thunk{eval_constant};
+  thunk.token = &expr.m_token;
+  thunk.constant = expr.m_value;
+  m_thunk = emit(std::move(thunk));
+}
+
+void ClosureCompiler::visit(Hoisted &expr) {
+  // Only loops hoist, and a lone expression has none
+  m_thunk = compile_child(*expr.m_expr);
+}
+
+void ClosureCompiler::visit(Shared &expr) {
+  auto [it, inserted] = m_shared_thunks.try_emplace(&expr.m_expr, nullptr);
+  if (inserted) {
+    it->second = compile_child(expr.m_expr);
+  }
+  m_thunk = it->second;
+}
+
+void ClosureCompiler::unsupported(Token const &token) {
+  throw Exception("The closure backend does not compile '" +
+                  std::string(token.lexeme()) + "'.");
+}
+
+void ClosureCompiler::unsupported() {
+  throw Exception("The closure backend only compiles expressions.");
+}
+
+void ClosureCompiler::visit(Variable &expr) { unsupported(expr.m_name); }
+
+void ClosureCompiler::visit(Assign &expr) { unsupported(expr.m_name); }
+
+void ClosureCompiler::visit(Call &expr) { unsupported(expr.m_paren); }
+
+void ClosureCompiler::visit(Get &expr) { unsupported(expr.m_name); }
+
+void ClosureCompiler::visit(Set &expr) { unsupported(expr.m_name); }
+
+void ClosureCompiler::visit(Invoke &expr) { unsupported(expr.m_name); }
+
+void ClosureCompiler::visit(Array &expr) { unsupported(expr.m_bracket); }
+
+void ClosureCompiler::visit(Map &expr) { unsupported(expr.m_brace); }
+
+void ClosureCompiler::visit(Index &expr) { unsupported(expr.m_bracket); }
+
+void ClosureCompiler::visit(SetIndex &expr) { unsupported(expr.m_bracket); }
+
+void ClosureCompiler::visit(This &expr) { unsupported(expr.m_keyword); }
+
+void ClosureCompiler::visit(Super &expr) { unsupported(expr.m_keyword); }
+
+void ClosureCompiler::visit(Expression &) { unsupported(); }
+
+void ClosureCompiler::visit(Print &) { unsupported(); }
+
+void ClosureCompiler::visit(Var &) { unsupported(); }
+
+void ClosureCompiler::visit(Block &) { unsupported(); }
+
+void ClosureCompiler::visit(If &) { unsupported(); }
+
+void ClosureCompiler::visit(While &) { unsupported(); }
+
+void ClosureCompiler::visit(Function &) { unsupported(); }
+
+void ClosureCompiler::visit(Class &) { unsupported(); }
+
+void ClosureCompiler::visit(Return &) { unsupported(); }
+
+} // namespace Lox
@@ -1,7 +1,209 @@
 #include "error.h"
+#include "scanner.h"
+#include "snapshot.h"
+#include "source_map.h"
 
 namespace Lox {
 
-std::vector<std::string> syntax_error_msgs;
+std::vector<Diagnostic> syntax_errors;
+
+char const *to_message(ErrorCode code) {
+  switch (code) {
+  case ErrorCode::INVALID_CHARACTER:
+    return "Invalid character";
+  case ErrorCode::UNTERMINATED_STRING:
+    return "Unterminated string literal";
+  case ErrorCode::INVALID_LITERAL:
+    return "An error occurred in Lox. A literal of invalid type was "
+           "encountered.";
+  case ErrorCode::EXPECT_EXPRESSION:
+    return "Expect expression.";
+  case ErrorCode::EXPECT_RIGHT_PAREN:
+    return "Expect ')' after expression.";
+  case ErrorCode::EXPECT_SEMICOLON:
+    return "Expect ';' after statement.";
+  case ErrorCode::EXPECT_VARIABLE_NAME:
+    return "Expect variable name.";
+  case ErrorCode::EXPECT_CLASS_NAME:
+    return "Expect class name.";
+  case ErrorCode::EXPECT_SUPERCLASS_NAME:
+    return "Expect superclass name.";
+  case ErrorCode::EXPECT_LEFT_BRACE_BEFORE_CLASS_BODY:
+    return "Expect '{' before class body.";
+  case ErrorCode::EXPECT_RIGHT_BRACE_AFTER_CLASS_BODY:
+    return "Expect '}' after class body.";
+  case ErrorCode::EXPECT_FUNCTION_NAME:
+    return "Expect function name.";
+  case ErrorCode::EXPECT_METHOD_NAME:
+    return "Expect method name.";
+  case ErrorCode::EXPECT_LEFT_PAREN_AFTER_NAME:
+    return "Expect '(' after name.";
+  case ErrorCode::EXPECT_PARAMETER_NAME:
+    return "Expect parameter name.";
+  case ErrorCode::EXPECT_RIGHT_PAREN_AFTER_PARAMETERS:
+    return "Expect ')' after parameters.";
+  case ErrorCode::EXPECT_LEFT_BRACE_BEFORE_BODY:
+    return "Expect '{' before body.";
+  case ErrorCode::EXPECT_RIGHT_BRACE_AFTER_BLOCK:
+    return "Expect '}' after block.";
+  case ErrorCode::EXPECT_RIGHT_PAREN_AFTER_ARGUMENTS:
+    return "Expect ')' after arguments.";
+  case ErrorCode::EXPECT_PROPERTY_NAME:
+    return "Expect property name after '.'.";
+  case ErrorCode::EXPECT_DOT_AFTER_SUPER:
+    return "Expect '.' after 'super'.";
+  case ErrorCode::EXPECT_LEFT_PAREN_AFTER_IF:
+    return "Expect '(' after 'if'.";
+  case ErrorCode::EXPECT_LEFT_PAREN_AFTER_WHILE:
+    return "Expect '(' after 'while'.";
+  case ErrorCode::EXPECT_LEFT_PAREN_AFTER_FOR:
+    return "Expect '(' after 'for'.";
+  case ErrorCode::EXPECT_RIGHT_PAREN_AFTER_CONDITION:
+    return "Expect ')' after condition.";
+  case ErrorCode::EXPECT_SEMICOLON_AFTER_LOOP_CONDITION:
+    return "Expect ';' after loop condition.";
+  case ErrorCode::EXPECT_RIGHT_PAREN_AFTER_FOR_CLAUSES:
+    return "Expect ')' after for clauses.";
+  case ErrorCode::EXPECT_RIGHT_BRACKET_AFTER_ELEMENTS:
+    return "Expect ']' after elements.";
+  case ErrorCode::EXPECT_RIGHT_BRACKET_AFTER_INDEX:
+    return "Expect ']' after index.";
+  case ErrorCode::EXPECT_COLON_AFTER_KEY:
+    return "Expect ':' after key.";
+  case ErrorCode::EXPECT_RIGHT_BRACE_AFTER_ENTRIES:
+    return "Expect '}' after entries.";
+  case ErrorCode::INVALID_ASSIGNMENT_TARGET:
+    return "Invalid assignment target.";
+  case ErrorCode::ALREADY_DECLARED:
+    return "Already a variable with this name in this scope.";
+  case ErrorCode::READ_IN_OWN_INITIALIZER:
+    return "Can't read local variable in its own initializer.";
+  case ErrorCode::RETURN_FROM_TOP_LEVEL:
+    return "Can't return from top-level code.";
+  case ErrorCode::RETURN_VALUE_FROM_INITIALIZER:
+    return "Can't return a value from an initializer.";
+  case ErrorCode::THIS_OUTSIDE_CLASS:
+    return "Can't use 'this' outside of a class.";
+  case ErrorCode::SUPER_OUTSIDE_CLASS:
+    return "Can't use 'super' outside of a class.";
+  case ErrorCode::SUPER_WITHOUT_SUPERCLASS:
+    return "Can't use 'super' in a class with no superclass.";
+  case ErrorCode::INHERIT_FROM_ITSELF:
+    return "A class can't inherit from itself.";
+  case ErrorCode::NATIVE_WRONG_ARITY:
+    return "Wrong number of arguments to a native function.";
+  case ErrorCode::TYPE_OPERAND_MUST_BE_NUMBER:
+    return "Operand is never a number.";
+  case ErrorCode::TYPE_OPERANDS_MUST_BE_NUMBERS:
+    return "Operands are never both numbers.";
+  case ErrorCode::TYPE_OPERANDS_MUST_BE_NUMBERS_OR_STRINGS:
+    return "Operands are never 2 numbers or strings.";
+  case ErrorCode::OPERAND_MUST_BE_NUMBER:
+    return "Operand must be a number.";
+  case ErrorCode::OPERANDS_MUST_BE_NUMBERS:
+    return "Operands must be numbers.";
+  case ErrorCode::OPERANDS_MUST_BE_NUMBERS_OR_STRINGS:
+    return "Operands must be 2 numbers or strings.";
+  case ErrorCode::STRING_TOO_LONG:
+    return "String too long.";
+  case ErrorCode::OPERANDS_MUST_BE_NUMBERS_OR_ARRAYS:
+    return "Operands must be numbers or arrays.";
+  case ErrorCode::ARRAY_LENGTHS_DIFFER:
+    return "Arrays must have the same length.";
+  case ErrorCode::UNDEFINED_VARIABLE:
+    return "Undefined variable.";
+  case ErrorCode::UNDEFINED_PROPERTY:
+    return "Undefined property.";
+  case ErrorCode::ONLY_INSTANCES_HAVE_PROPERTIES:
+    return "Only instances have properties.";
+  case ErrorCode::ONLY_INSTANCES_HAVE_FIELDS:
+    return "Only instances have fields.";
+  case ErrorCode::ONLY_ARRAYS_AND_MAPS_HAVE_ELEMENTS:
+    return "Only arrays and maps have elements.";
+  case ErrorCode::INDEX_MUST_BE_INTEGER:
+    return "Index must be a non-negative integer.";
+  case ErrorCode::INDEX_OUT_OF_RANGE:
+    return "Index out of range.";
+  case ErrorCode::UNDEFINED_KEY:
+    return "Undefined key.";
+  case ErrorCode::NOT_CALLABLE:
+    return "Can only call functions and classes.";
+  case ErrorCode::WRONG_ARITY:
+    return "Wrong number of arguments.";
+  case ErrorCode::SUPERCLASS_MUST_BE_CLASS:
+    return "Superclass must be a class.";
+  case ErrorCode::STACK_OVERFLOW:
+    return "Stack overflow.";
+  case ErrorCode::ARGUMENT_MUST_BE_NUMBER:
+    return "Argument must be a number.";
+  case ErrorCode::ARGUMENT_MUST_BE_STRING:
+    return "Argument must be a string.";
+  case ErrorCode::ARGUMENT_MUST_BE_BOOLEAN:
+    return "Argument must be a boolean.";
+  case ErrorCode::ARGUMENT_MUST_BE_ARRAY:
+    return "Argument must be an array.";
+  case ErrorCode::ARGUMENT_MUST_BE_MAP:
+    return "Argument must be a map.";
+  case ErrorCode::ARGUMENT_MUST_BE_ARRAY_OR_MAP:
+    return "Argument must be an array or a map.";
+  case ErrorCode::OUT_OF_MEMORY:
+    return "Out of memory.";
+  case ErrorCode::STEP_BUDGET_EXHAUSTED:
+    return "Step budget exhausted.";
+  case ErrorCode::INTERRUPTED:
+    return "Interrupted.";
+  case ErrorCode::NATIVE_IS_ASYNC:
+    return "Asynchronous native called outside of an asynchronous run.";
+  case ErrorCode::NATIVE_FAILED:
+    return "Native call failed.";
+  default:
+    return "???";
+  }
+}
+
+std::string to_string(Diagnostic const &diagnostic,
+                      SourceMap const &source_map, Snapshot const *prelude) {
+  bool const in_prelude =
+      prelude != nullptr && prelude->owns(diagnostic.token);
+  auto const [line, column] =
+      (in_prelude ? prelude->source_map() : source_map)
+          .locate(diagnostic.offset);
+  std::string msg = "error: ";
+  if (is_runtime_error(diagnostic.code)) {
+    msg += in_prelude ? "prelude line " : "line ";
+    msg += std::to_string(line);
+    msg += ":";
+    msg += std::to_string(column);
+    msg += " : ";
+  } else {
+    msg += std::to_string(line);
+    msg += ":";
+    msg += std::to_string(column);
+    msg += ": ";
+    if (diagnostic.token == nullptr) {
+      // nop
+    } else if (diagnostic.token->type() == TokenType::END) {
+      msg += "at end: ";
+    } else {
+      msg += diagnostic.token->lexeme();
+      msg += ": ";
+    }
+  }
+  msg += to_message(diagnostic.code);
+  return msg;
+}
+
+std::string dump_errors(std::vector<Diagnostic> &errors,
+                        SourceMap const &source_map, Snapshot const *prelude) {
+  std::string msgs;
+  for (auto const &error : errors) {
+    if (!msgs.empty()) {
+      msgs += '\n';
+    }
+    msgs += to_string(error, source_map, prelude);
+  }
+  errors.clear();
+  return msgs;
+}
 
 } // namespace Lox
@@ -0,0 +1,237 @@
+#include "hash_cons.h"
+
+#include <bit>
+#include <functional>
+
+namespace Lox {
+
+namespace {
+
+/**
+ * Replace every child which is a canonical node referred to elsewhere by an
+ * owning `Shared` node.
+ */
+class SharedWrapper final : public AstNodeVisitor {
+public:
+  explicit SharedWrapper(std::unordered_set<Expr const *> const &targets)
+      : m_targets(targets) {}
+
+  void wrap(ExprPtr &slot) {
+    dispatch(*slot, *this);
+    if (m_targets.contains(slot.get())) {
+      auto &target = *slot;
+      slot = std::make_unique<Shared>(std::move(slot), target);
+    }
+  }
+
+  void visit(Literal &) override {}
+
+  void visit(Binary &node) override {
+    wrap(node.m_left);
+    wrap(node.m_right);
+  }
+
+  void visit(Unary &node) override { wrap(node.m_right); }
+
+  void visit(Grouping &node) override { wrap(node.m_expr); }
+
+  void visit(Logical &node) override {
+    wrap(node.m_left);
+    wrap(node.m_right);
+  }
+
+  void visit(Constant &) override {}
+
+  void visit(Hoisted &node) override { wrap(node.m_expr); }
+
+  void visit(Shared &node) override {
+    // References are wrapped through the occurrence which owns their target
+    if (node.m_owner) {
+      dispatch(*node.m_owner, *this);
+    }
+  }
+
+  void visit(Variable &) override {}
+
+  void visit(Assign &node) override { wrap(node.m_value); }
+
+  void visit(Call &node) override {
+    wrap(node.m_callee);
+    wrap_all(node.m_arguments);
+  }
+
+  void visit(Get &node) override { wrap(node.m_object); }
+
+  void visit(Set &node) override {
+    wrap(node.m_object);
+    wrap(node.m_value);
+  }
+
+  void visit(Invoke &node) override {
+    wrap(node.m_object);
+    wrap_all(node.m_arguments);
+  }
+
+  void visit(Array &node) override { wrap_all(node.m_elements); }
+
+  void visit(Map &node) override {
+    wrap_all(node.m_keys);
+    wrap_all(node.m_values);
+  }
+
+  void visit(Index &node) override {
+    wrap(node.m_object);
+    wrap(node.m_index);
+  }
+
+  void visit(SetIndex &node) override {
+    wrap(node.m_object);
+    wrap(node.m_index);
+    wrap(node.m_value);
+  }
+
+  void visit(This &) override {}
+
+  void visit(Super &) override {}
+
+  void visit(Expression &node) override { wrap(node.m_expr); }
+
+  void visit(Print &node) override { wrap(node.m_expr); }
+
+  void visit(Var &node) override {
+    if (node.m_initializer) {
+      wrap(node.m_initializer);
+    }
+  }
+
+  void visit(Block &node) override { wrap_all(node.m_statements); }
+
+  void visit(If &node) override {
+    wrap(node.m_condition);
+    dispatch(*node.m_then_branch, *this);
+    if (node.m_else_branch) {
+      dispatch(*node.m_else_branch, *this);
+    }
+  }
+
+  void visit(While &node) override {
+    if (node.m_condition) {
+      wrap(node.m_condition);
+    }
+    dispatch(*node.m_body, *this);
+  }
+
+  void visit(Function &node) override { wrap_all(node.m_body); }
+
+  void visit(Class &node) override {
+    for (auto &method : node.m_methods) {
+      dispatch(*method, *this);
+    }
+  }
+
+  void visit(Return &node) override {
+    if (node.m_value) {
+      wrap(node.m_value);
+    }
+  }
+
+  void wrap_all(ExprList &exprs) {
+    for (auto &expr : exprs) {
+      wrap(expr);
+    }
+  }
+
+  void wrap_all(StmtList &stmts) {
+    for (auto &stmt : stmts) {
+      dispatch(*stmt, *this);
+    }
+  }
+
+private:
+  std::unordered_set<Expr const *> const &m_targets;
+};
+
+} // namespace
+
+std::size_t HashConsTable::KeyHash::operator()(Key const &key) const noexcept {
+  std::size_t hash = std::hash<std::string_view>{}(key.text);
+  auto const mix = [&hash](uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+  };
+  mix(static_cast<uint64_t>(key.kind) << 8 | static_cast<uint64_t>(key.type));
+  mix(std::bit_cast<uint64_t>(key.number));
+  mix(static_cast<uint64_t>(key.left) << 32 | key.right);
+  return hash;
+}
+
+ExprPtr HashConsTable::intern(std::unique_ptr<Literal> expr) {
+  Key key{Kind::LITERAL, expr->m_token.type(), {}, 0, 0, 0};
+  if (key.type == TokenType::NUMBER) {
+    key.number = expr->m_token.number_literal();
+  } else if (key.type == TokenType::STRING) {
+    key.text = expr->m_token.str_literal();
+  }
+
+  auto const [it, inserted] =
+      m_entries.try_emplace(key, Entry{m_next_id, expr.get()});
+  m_next_id += inserted;
+  m_ids[expr.get()] = it->second.id;
+  return expr;
+}
+
+ExprPtr HashConsTable::intern(std::unique_ptr<Unary> expr) {
+  Key const key{Kind::UNARY, expr->m_op.type(), {}, 0, 0,
+                id_of(expr->m_right)};
+  return intern(std::move(expr), key);
+}
+
+ExprPtr HashConsTable::intern(std::unique_ptr<Binary> expr) {
+  Key const key{Kind::BINARY,         expr->m_op.type(),     {}, 0,
+                id_of(expr->m_left), id_of(expr->m_right)};
+  return intern(std::move(expr), key);
+}
+
+ExprPtr HashConsTable::intern(std::unique_ptr<Grouping> expr) {
+  Key const key{Kind::GROUPING, TokenType::LEFT_PAREN, {}, 0, 0,
+                id_of(expr->m_expr)};
+  return intern(std::move(expr), key);
+}
+
+ExprPtr HashConsTable::intern(ExprPtr expr, Key const &key) {
+  auto const [it, inserted] =
+      m_entries.try_emplace(key, Entry{m_next_id, expr.get()});
+  m_next_id += inserted;
+  auto const [id, canonical] = it->second;
+  if (!inserted) {
+    // The children of `expr` are all shared or literals, since its key
+    // contains their ids: no canonical node is dropped with it
+    m_targets.insert(canonical);
+    expr = std::make_unique<Shared>(nullptr, *canonical);
+  }
+  m_ids[expr.get()] = id;
+  return expr;
+}
+
+ExprPtr HashConsTable::intern(ExprPtr expr) {
+  m_ids[expr.get()] = m_next_id++;
+  return expr;
+}
+
+void HashConsTable::wrap_shared(ExprPtr &root) {
+  if (!m_targets.empty()) {
+    SharedWrapper(m_targets).wrap(root);
+  }
+}
+
+void HashConsTable::wrap_shared(Program &program) {
+  if (m_targets.empty()) {
+    return;
+  }
+  SharedWrapper wrapper(m_targets);
+  wrapper.wrap_all(program.statements);
+  if (program.result) {
+    wrapper.wrap(program.result);
+  }
+}
+
+} // namespace Lox
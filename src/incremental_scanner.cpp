@@ -0,0 +1,251 @@
+#include "incremental_scanner.h"
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+
+namespace Lox {
+
+IncrementalScanner::IncrementalScanner(std::string const &source)
+    : m_size(source.size()) {
+  Scanner scanner(source);
+  scanner.scan_range();
+  m_chunks = split(source, std::move(scanner.m_tokens),
+                   std::move(scanner.m_errors));
+  build_tree();
+}
+
+std::string const &IncrementalScanner::source() const {
+  join();
+  return m_source;
+}
+
+TokenList const &IncrementalScanner::tokens() const {
+  join();
+  return m_tokens;
+}
+
+std::size_t IncrementalScanner::edit(uint64_t offset, uint64_t removed,
+                                     std::string_view inserted) {
+  THROW_ASSERT(offset + removed <= m_size, "Edit out of range.");
+  m_joined = false;
+
+  // A token may look at the two characters after its start ("1." followed by
+  // a digit), so the first token which can change holds at most the byte two
+  // before the edit. Scanning restarts at the start of its chunk, where the
+  // scanner is never inside a string literal or a comment.
+  auto const first = chunk_at(offset < 2 ? 0 : offset - 2);
+  auto last = chunk_at(offset + removed);
+  uint64_t const begin = chunk_start(first);
+  uint64_t const edit_end = offset - begin + inserted.size();
+  int64_t const delta =
+      static_cast<int64_t>(inserted.size()) - static_cast<int64_t>(removed);
+
+  for (;;) {
+    std::string text;
+    for (auto index = first; index <= last; ++index) {
+      text += m_chunks[index]->text;
+    }
+    text.replace(offset - begin, removed, inserted);
+    bool const whole = last + 1 == m_chunks.size();
+
+    // The old tokens, at their offsets from `begin` before the edit
+    std::size_t old_chunk = first;
+    std::size_t old_token = 0;
+    uint64_t old_base = 0;
+    auto const old_start = [&]() -> uint64_t {
+      while (old_chunk <= last &&
+             old_token == m_chunks[old_chunk]->tokens.size()) {
+        old_base += m_chunks[old_chunk]->text.size();
+        ++old_chunk;
+        old_token = 0;
+      }
+      return old_chunk <= last
+                 ? old_base + m_chunks[old_chunk]->tokens[old_token].offset()
+                 : UINT64_MAX;
+    };
+
+    // Re-scan until the scanner stands, between two tokens, at the start of
+    // an old token behind the edit. Everything after that point scans the
+    // same, as long as the characters the token before it looks at are in
+    // the text.
+    Scanner scanner(text, 0, text.size());
+    bool synced = false;
+    while (!scanner.is_at_end()) {
+      scanner.m_start = scanner.m_current;
+      if (scanner.m_current >= edit_end &&
+          (whole || scanner.m_current + 1 < text.size())) {
+        uint64_t const old_pos = scanner.m_current - delta;
+        while (old_start() < old_pos) {
+          ++old_token;
+        }
+        if (old_start() == old_pos) {
+          synced = true;
+          break;
+        }
+      }
+      scanner.scan_token();
+    }
+    if (!synced && !whole) {
+      // The edit reaches past the chunks, such as an unclosed string literal
+      last = std::min(m_chunks.size() - 1, last + (last - first + 1));
+      continue;
+    }
+
+    std::size_t const rescanned = scanner.m_tokens.size();
+    auto tokens = std::move(scanner.m_tokens);
+    auto errors = std::move(scanner.m_errors);
+    if (synced) {
+      uint64_t const old_stop = scanner.m_current - delta;
+      for (; old_start() != UINT64_MAX; ++old_token) {
+        auto &token = tokens.emplace_back(m_chunks[old_chunk]->tokens[old_token]);
+        token.m_offset = static_cast<uint32_t>(old_base + token.m_offset + delta);
+      }
+      uint64_t base = 0;
+      for (auto index = first; index <= last; ++index) {
+        for (auto const &error : m_chunks[index]->errors) {
+          if (base + error.offset >= old_stop) {
+            errors.push_back(ScanError{
+                static_cast<uint32_t>(base + error.offset + delta),
+                error.code});
+          }
+        }
+        base += m_chunks[index]->text.size();
+      }
+    }
+
+    auto chunks = split(std::move(text), std::move(tokens), std::move(errors));
+    std::size_t const n_old = last - first + 1;
+    if (chunks.front()->text.empty() && m_chunks.size() > n_old) {
+      chunks.clear();
+    }
+    if (chunks.size() == n_old) {
+      for (std::size_t index = 0; index < n_old; ++index) {
+        auto &chunk = m_chunks[first + index];
+        uint64_t const grown = chunks[index]->text.size() - chunk->text.size();
+        for (auto node = first + index + 1; node < m_tree.size();
+             node += node & -node) {
+          m_tree[node] += grown;
+        }
+        chunk = std::move(chunks[index]);
+      }
+    } else {
+      auto const at = m_chunks.begin() + static_cast<std::ptrdiff_t>(first);
+      m_chunks.erase(at, at + static_cast<std::ptrdiff_t>(n_old));
+      m_chunks.insert(m_chunks.begin() + static_cast<std::ptrdiff_t>(first),
+                      std::make_move_iterator(chunks.begin()),
+                      std::make_move_iterator(chunks.end()));
+      build_tree();
+    }
+    m_size += delta;
+    return rescanned;
+  }
+}
+
+void IncrementalScanner::report_errors() const {
+  uint64_t base = 0;
+  for (auto const &chunk : m_chunks) {
+    for (auto const &error : chunk->errors) {
+      Lox::syntax_error(Diagnostic{
+          error.code, static_cast<uint32_t>(base + error.offset), nullptr});
+    }
+    base += chunk->text.size();
+  }
+}
+
+std::vector<std::unique_ptr<IncrementalScanner::Chunk>>
+IncrementalScanner::split(std::string text, TokenList tokens,
+                          std::vector<ScanError> errors) {
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  std::size_t token = 0;
+  std::size_t error = 0;
+  uint64_t begin = 0;
+  do {
+    // The chunk ends at the first token starting `kChunkSize` bytes in
+    auto end_token = token;
+    while (end_token < tokens.size() &&
+           tokens[end_token].offset() < begin + kChunkSize) {
+      ++end_token;
+    }
+    uint64_t const end =
+        end_token < tokens.size() ? tokens[end_token].offset() : text.size();
+
+    auto &chunk = *chunks.emplace_back(std::make_unique<Chunk>());
+    chunk.text = text.substr(begin, end - begin);
+    chunk.tokens.reserve(end_token - token);
+    for (; token < end_token; ++token) {
+      auto &copy = chunk.tokens.emplace_back(tokens[token]);
+      copy.m_offset = static_cast<uint32_t>(copy.m_offset - begin);
+      copy.m_lexeme = std::string_view(chunk.text).substr(
+          copy.m_offset, copy.m_lexeme.size());
+    }
+    for (; error < errors.size() &&
+           (errors[error].offset < end || end == text.size());
+         ++error) {
+      chunk.errors.push_back(ScanError{
+          static_cast<uint32_t>(errors[error].offset - begin),
+          errors[error].code});
+    }
+    begin = end;
+  } while (begin < text.size());
+  return chunks;
+}
+
+uint64_t IncrementalScanner::chunk_start(std::size_t index) const noexcept {
+  uint64_t start = 0;
+  for (; index > 0; index -= index & -index) {
+    start += m_tree[index];
+  }
+  return start;
+}
+
+std::size_t IncrementalScanner::chunk_at(uint64_t offset) const noexcept {
+  // Count the chunks ending at or before `offset`, descending the tree
+  std::size_t index = 0;
+  for (auto step = std::bit_floor(m_chunks.size()); step > 0; step >>= 1) {
+    if (index + step <= m_chunks.size() && m_tree[index + step] <= offset) {
+      index += step;
+      offset -= m_tree[index];
+    }
+  }
+  return std::min(index, m_chunks.size() - 1);
+}
+
+void IncrementalScanner::build_tree() {
+  m_tree.assign(m_chunks.size() + 1, 0);
+  for (std::size_t node = 1; node < m_tree.size(); ++node) {
+    m_tree[node] += m_chunks[node - 1]->text.size();
+    if (auto const parent = node + (node & -node); parent < m_tree.size()) {
+      m_tree[parent] += m_tree[node];
+    }
+  }
+}
+
+void IncrementalScanner::join() const {
+  if (m_joined) {
+    return;
+  }
+  m_source.clear();
+  m_source.reserve(m_size);
+  for (auto const &chunk : m_chunks) {
+    m_source += chunk->text;
+  }
+
+  // Lexemes refer to the joined source, which may have been reallocated
+  m_tokens.clear();
+  uint64_t base = 0;
+  for (auto const &chunk : m_chunks) {
+    for (auto const &token : chunk->tokens) {
+      auto &copy = m_tokens.emplace_back(token);
+      copy.m_offset = static_cast<uint32_t>(base + copy.m_offset);
+      copy.m_lexeme = std::string_view(m_source).substr(copy.m_offset,
+                                                        copy.m_lexeme.size());
+    }
+    base += chunk->text.size();
+  }
+  m_tokens.emplace_back(static_cast<uint32_t>(m_size), TokenType::END,
+                        std::string_view(m_source).substr(m_size));
+  m_joined = true;
+}
+
+} // namespace Lox
@@ -1,17 +1,145 @@
 #include "interpreter.h"
 #include "ast_defines.inc"
+#include "broadcast.h"
 #include "error.h"
 #include "runtime_error.h"
 #include "scanner.h"
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <sys/resource.h>
+
 namespace Lox {
 
-void Interpreter::interpret(Expr *expr) {
+uintptr_t Interpreter::native_stack_budget() {
+  constexpr uintptr_t kDefaultLimit = 8 << 20;
+  rlimit limit{};
+  if (getrlimit(RLIMIT_STACK, &limit) != 0 ||
+      limit.rlim_cur == RLIM_INFINITY) {
+    return kDefaultLimit / 2;
+  }
+  return static_cast<uintptr_t>(limit.rlim_cur) / 2;
+}
+
+void Interpreter::interpret(Program &program) {
+  if (!run_program(program)) {
+    runtime_error(*m_error);
+  }
+  end();
+}
+
+std::optional<Snapshot::Globals> Interpreter::run_prelude(Program &program) {
+  std::optional<Snapshot::Globals> globals;
+  if (run_program(program)) {
+    globals.emplace();
+    globals->reserve(m_globals.size());
+    for (auto const &global : m_globals) {
+      globals->push_back(global.defined ? std::optional(global.value)
+                                        : std::nullopt);
+    }
+  } else {
+    runtime_error(*m_error);
+  }
+  end();
+  return globals;
+}
+
+bool Interpreter::run_program(Program &program) {
+  mark_native_stack();
+  m_native_stack_budget = native_stack_budget();
+  return begin(program) && out_of_memory_guard([&] {
+           bool const executed = execute(program.statements);
+           m_returning = false;
+           return executed &&
+                  (!program.result || evaluate(program.result.get()));
+         });
+}
+
+bool Interpreter::begin(Program &program) {
+  m_error.reset();
+  start_run();
+  if (m_stack.empty()) {
+    m_stack.resize(m_stack_size);
+  }
+  THROW_ASSERT(program.native_count == m_natives.size(),
+               "The program was resolved against other natives.");
+  uint32_t const prelude_count =
+      m_snapshot != nullptr ? m_snapshot->global_count() : 0;
+  THROW_ASSERT(program.prelude_count == prelude_count,
+               "The program was resolved against another snapshot.");
+  m_globals.assign(program.global_count, Global{});
+  m_frame_base = 0;
+  m_frame_top = std::min(program.frame_size, m_stack_size);
+  m_depth = 0;
+  m_function = nullptr;
+  m_result = nullptr;
+  m_returning = false;
+  if (m_snapshot == nullptr) {
+    for (uint32_t i = 0; i < program.native_count; ++i) {
+      m_globals[i] = Global{ObjectPtr(m_natives[i]), true};
+    }
+    return true;
+  }
   try {
-    evaluate(expr);
-  } catch (RuntimeError const &e) {
-    runtime_error(e);
+    auto globals = m_snapshot->instantiate(m_natives, m_memory);
+    for (uint32_t i = 0; i < prelude_count; ++i) {
+      if (globals[i]) {
+        m_globals[i] = Global{std::move(*globals[i]), true};
+      }
+    }
+  } catch (MemoryLimitError const &) {
+    out_of_memory();
+    return false;
   }
+  return true;
+}
+
+void Interpreter::end() noexcept {
+  unwind(0);
+  m_native_stack_base = 0;
+  m_globals.clear();
+  m_shared_values.clear();
+}
+
+void Interpreter::interpret(Expr *expr) {
+  m_error.reset();
+  start_run();
+  if (!out_of_memory_guard([&] { return evaluate(expr); })) {
+    runtime_error(*m_error);
+  }
+  m_shared_values.clear();
+}
+
+Expected<Value> Interpreter::try_interpret(Expr *expr) {
+  m_error.reset();
+  start_run();
+  bool const ok = out_of_memory_guard([&] { return evaluate(expr); });
+  m_shared_values.clear();
+  if (!ok) {
+    return Unexpected{*m_error};
+  }
+  return std::move(m_result);
+}
+
+Expected<Value> Interpreter::apply(Unary &expr, Value operand) {
+  m_error.reset();
+  m_result = std::move(operand);
+  apply_unary(expr.m_op);
+  if (m_error) {
+    return Unexpected{*m_error};
+  }
+  return std::move(m_result);
+}
+
+Expected<Value> Interpreter::apply(Binary &expr, Value left, Value right) {
+  m_error.reset();
+  m_result = std::move(right);
+  apply_binary(expr.m_op, left);
+  if (m_error) {
+    return Unexpected{*m_error};
+  }
+  return std::move(m_result);
 }
 
 void Interpreter::visit(Literal &expr) {
@@ -20,7 +148,7 @@ void Interpreter::visit(Literal &expr) {
     m_result = expr.m_token.number_literal();
     break;
   case TokenType::STRING:
-    m_result = std::string(expr.m_token.str_literal());
+    m_result = make_string(expr.m_token, expr.m_token.str_literal());
     break;
   case TokenType::TRUE:
     m_result = true;
@@ -38,11 +166,27 @@ void Interpreter::visit(Literal &expr) {
 }
 
 void Interpreter::visit(Unary &expr) {
-  evaluate(expr.m_right.get());
+  if (evaluate(expr.m_right.get())) {
+    apply_unary(expr);
+  }
+}
 
-  switch (expr.m_op.type()) {
+void Interpreter::apply_unary(Unary &expr) {
+  if (expr.m_unchecked) {
+    // Only a `-` is checked, of a number
+    double &operand = m_result.unchecked_number();
+    operand = -operand;
+    return;
+  }
+  apply_unary(expr.m_op);
+}
+
+void Interpreter::apply_unary(Token const &op) {
+  switch (op.type()) {
   case TokenType::MINUS:
-    check_number_operands(expr.m_op, m_result);
+    if (!check_number_operands(op, m_result)) {
+      return;
+    }
     m_result = -m_result.number();
     break;
   case TokenType::BANG:
@@ -50,52 +194,83 @@ void Interpreter::visit(Unary &expr) {
     break;
   default:
     THROW_ASSERT(false, "Unimplemented unary operator: " +
-                            std::string(expr.m_op.lexeme()));
+                            std::string(op.lexeme()));
     break;
   }
 }
 
 void Interpreter::visit(Binary &expr) {
-  evaluate(expr.m_left.get());
+  if (!evaluate(expr.m_left.get())) {
+    return;
+  }
   Value left = std::move(m_result);
-  evaluate(expr.m_right.get());
+  if (!evaluate(expr.m_right.get())) {
+    return;
+  }
+  apply_binary(expr, left);
+}
+
+void Interpreter::apply_binary(Binary &expr, Value const &left) {
+  if (expr.m_unchecked) {
+    apply_unchecked(expr.m_op, left);
+    return;
+  }
+  apply_binary(expr.m_op, left);
+}
 
-  switch (expr.m_op.type()) {
+void Interpreter::apply_binary(Token const &op, Value const &left) {
+  switch (op.type()) {
   case TokenType::PLUS:
     if (left.is_number() && m_result.is_number()) {
       m_result = left.number() + m_result.number();
       break;
     } else if (left.is_string() && m_result.is_string()) {
-      m_result = left.str() + m_result.str();
+      concat(op, left);
       break;
     }
-    throw RuntimeError(expr.m_op, "Operands must be 2 numbers or strings.");
+    apply_element_wise(op, left,
+                       ErrorCode::OPERANDS_MUST_BE_NUMBERS_OR_STRINGS);
+    break;
   case TokenType::MINUS:
-    check_number_operands(expr.m_op, left, m_result);
+    if (!number_operands(op, left)) {
+      return;
+    }
     m_result = left.number() - m_result.number();
     break;
   case TokenType::STAR:
-    check_number_operands(expr.m_op, left, m_result);
+    if (!number_operands(op, left)) {
+      return;
+    }
     m_result = left.number() * m_result.number();
     break;
   case TokenType::SLASH:
-    check_number_operands(expr.m_op, left, m_result);
+    if (!number_operands(op, left)) {
+      return;
+    }
     m_result = left.number() / m_result.number();
     break;
   case TokenType::GREATER:
-    check_number_operands(expr.m_op, left, m_result);
+    if (!number_operands(op, left)) {
+      return;
+    }
     m_result = left.number() > m_result.number();
     break;
   case TokenType::GREATER_EQUAL:
-    check_number_operands(expr.m_op, left, m_result);
+    if (!number_operands(op, left)) {
+      return;
+    }
     m_result = left.number() >= m_result.number();
     break;
   case TokenType::LESS:
-    check_number_operands(expr.m_op, left, m_result);
+    if (!number_operands(op, left)) {
+      return;
+    }
     m_result = left.number() < m_result.number();
     break;
   case TokenType::LESS_EQUAL:
-    check_number_operands(expr.m_op, left, m_result);
+    if (!number_operands(op, left)) {
+      return;
+    }
     m_result = left.number() <= m_result.number();
     break;
   case TokenType::EQUAL_EQUAL:
@@ -106,11 +281,843 @@ void Interpreter::visit(Binary &expr) {
     break;
   default:
     THROW_ASSERT(false, "Unimplemented binary operator: " +
-                            std::string(expr.m_op.lexeme()));
+                            std::string(op.lexeme()));
     break;
   }
 }
 
-void Interpreter::visit(Grouping &expr) { evaluate(expr.m_expr.get()); }
+void Interpreter::apply_element_wise(Token const &op, Value const &left,
+                                     ErrorCode code) {
+  if (as_array(left) == nullptr && as_array(m_result) == nullptr) {
+    error(op, code);
+    return;
+  }
+  m_allocating = &op;
+  auto result = broadcast(op.type(), left, m_result, m_memory);
+  if (!result) {
+    error(op, result.error());
+    return;
+  }
+  m_result = std::move(result).value();
+}
+
+void Interpreter::apply_unchecked(Token const &op, Value const &left) {
+  // An arithmetic result overwrites the right operand in place
+  switch (op.type()) {
+  case TokenType::PLUS:
+    if (left.is_number()) {
+      double &right = m_result.unchecked_number();
+      right = left.unchecked_number() + right;
+    } else {
+      concat(op, left);
+    }
+    break;
+  case TokenType::MINUS: {
+    double &right = m_result.unchecked_number();
+    right = left.unchecked_number() - right;
+    break;
+  }
+  case TokenType::STAR: {
+    double &right = m_result.unchecked_number();
+    right = left.unchecked_number() * right;
+    break;
+  }
+  case TokenType::SLASH: {
+    double &right = m_result.unchecked_number();
+    right = left.unchecked_number() / right;
+    break;
+  }
+  case TokenType::GREATER:
+    m_result = left.unchecked_number() > m_result.unchecked_number();
+    break;
+  case TokenType::GREATER_EQUAL:
+    m_result = left.unchecked_number() >= m_result.unchecked_number();
+    break;
+  case TokenType::LESS:
+    m_result = left.unchecked_number() < m_result.unchecked_number();
+    break;
+  case TokenType::LESS_EQUAL:
+    m_result = left.unchecked_number() <= m_result.unchecked_number();
+    break;
+  default:
+    apply_binary(op, left);
+    break;
+  }
+}
+
+void Interpreter::visit(Grouping &expr) {
+  // The error, if any, is already in `m_error`
+  (void)evaluate(expr.m_expr.get());
+}
+
+void Interpreter::visit(Logical &expr) {
+  if (!evaluate(expr.m_left.get())) {
+    return;
+  }
+  bool const is_or = expr.m_op.type() == TokenType::OR;
+  if (m_result.is_truthy() != is_or) {
+    // The error, if any, is already in `m_error`
+    (void)evaluate(expr.m_right.get());
+  }
+}
+
+void Interpreter::visit(Constant &expr) {
+  if (m_string_memory && expr.m_value.is_string() &&
+      expr.m_value.str_size() < kRopeMinBytes) {
+    m_result = make_string(expr.m_token, expr.m_value.str());
+    return;
+  }
+  m_result = expr.m_value;
+}
+
+void Interpreter::visit(Hoisted &expr) {
+  Value &slot = m_stack[m_frame_base + expr.m_slot];
+  if (!slot.is_nil()) {
+    m_result = slot;
+    return;
+  }
+  // An array is mutable, and its elements may be written by the loop: an
+  // operator on arrays builds a new one every time
+  if (evaluate(expr.m_expr.get()) && as_array(m_result) == nullptr) {
+    slot = m_result;
+  }
+}
+
+void Interpreter::visit(Shared &expr) {
+  if (auto it = m_shared_values.find(&expr.m_expr);
+      it != m_shared_values.end()) {
+    m_result = it->second;
+    return;
+  }
+  if (!evaluate(&expr.m_expr)) {
+    return;
+  }
+  m_shared_values.emplace(&expr.m_expr, m_result);
+}
+
+void Interpreter::visit(Variable &expr) { load(expr.m_name, expr.m_slot); }
+
+void Interpreter::visit(Assign &expr) {
+  if (!evaluate(expr.m_value.get())) {
+    return;
+  }
+  store(expr.m_name, expr.m_slot, false);
+}
+
+void Interpreter::visit(Call &expr) {
+  uint32_t const base = m_frame_top;
+  uint32_t argc = 0;
+  if (expr.m_native >= 0) {
+    // Bound by `Resolver`, which checked the arity: no callee to load
+    if (push_arguments(expr.m_paren, expr.m_arguments, argc)) {
+      call_native(expr.m_paren, *m_natives[expr.m_native], base);
+    }
+  } else if (push_call(expr, argc)) {
+    call_value(expr.m_paren, base, argc);
+  }
+  unwind(base);
+}
+
+void Interpreter::visit(Get &expr) {
+  if (evaluate(expr.m_object.get())) {
+    get_property(expr);
+  }
+}
+
+void Interpreter::get_property(Get &expr) {
+  if (!m_result.is_object() ||
+      m_result.object()->kind() != Object::Kind::INSTANCE) {
+    error(expr.m_name, ErrorCode::ONLY_INSTANCES_HAVE_PROPERTIES);
+    return;
+  }
+  auto &instance = static_cast<LoxInstance &>(*m_result.object());
+  auto const property =
+      find_property(expr.m_cache, instance, expr.m_name.lexeme());
+  if (!property) {
+    error(expr.m_name, ErrorCode::UNDEFINED_PROPERTY);
+  } else if (property->method != nullptr) {
+    m_result = ObjectPtr(make<BoundMethod>(expr.m_name, m_result.object(),
+                                           *property->method));
+  } else {
+    m_result = instance.field(property->slot);
+  }
+}
+
+void Interpreter::visit(Set &expr) {
+  if (!evaluate(expr.m_object.get())) {
+    return;
+  }
+  if (!m_result.is_object() ||
+      m_result.object()->kind() != Object::Kind::INSTANCE) {
+    error(expr.m_name, ErrorCode::ONLY_INSTANCES_HAVE_FIELDS);
+    return;
+  }
+  ObjectPtr const object = m_result.object();
+  if (evaluate(expr.m_value.get())) {
+    set_field(expr, static_cast<LoxInstance &>(*object));
+  }
+}
+
+void Interpreter::set_field(Set &expr, LoxInstance &instance) {
+  Shape const *shape = instance.shape();
+  auto const *entry = expr.m_cache.find(shape);
+  TransitionCacheEntry miss;
+  if (entry == nullptr) {
+    miss.shape = shape;
+    if (auto const slot = shape->lookup(expr.m_name.lexeme()); slot >= 0) {
+      miss.target = shape;
+      miss.slot = static_cast<uint32_t>(slot);
+    } else {
+      miss.target = shape->transition(expr.m_name.lexeme());
+      miss.slot = shape->size();
+    }
+    if (!expr.m_cache.full()) {
+      miss.owner = instance.klass();
+      expr.m_cache.insert(miss);
+    }
+    entry = &miss;
+  }
+
+  if (entry->target == shape) {
+    instance.field(entry->slot) = m_result;
+  } else {
+    m_allocating = &expr.m_name;
+    instance.add_field(entry->target, m_result);
+  }
+}
+
+void Interpreter::visit(Invoke &expr) {
+  uint32_t const base = m_frame_top;
+  LoxFunction const *method = nullptr;
+  uint32_t argc = 0;
+  if (push_invoke(expr, method, argc)) {
+    if (method != nullptr) {
+      call_function(expr.m_paren, *method, base, argc);
+    } else {
+      call_value(expr.m_paren, base, argc);
+    }
+  }
+  unwind(base);
+}
+
+void Interpreter::visit(Array &expr) {
+  auto array = make<LoxArray>(expr.m_bracket, m_memory);
+  for (auto &element : expr.m_elements) {
+    if (!evaluate(element.get())) {
+      return;
+    }
+    m_allocating = &expr.m_bracket;
+    array->set(array->size(), std::move(m_result));
+  }
+  m_result = ObjectPtr(std::move(array));
+}
+
+void Interpreter::visit(Map &expr) {
+  auto map = make<LoxMap>(expr.m_brace, m_memory);
+  for (std::size_t i = 0; i < expr.m_keys.size(); ++i) {
+    if (!evaluate(expr.m_keys[i].get())) {
+      return;
+    }
+    Value key = std::move(m_result);
+    if (!evaluate(expr.m_values[i].get())) {
+      return;
+    }
+    m_allocating = &expr.m_brace;
+    map->set(std::move(key), std::move(m_result));
+  }
+  m_result = ObjectPtr(std::move(map));
+}
+
+void Interpreter::visit(Index &expr) {
+  if (!evaluate(expr.m_object.get()) || !check_container(expr.m_bracket)) {
+    return;
+  }
+  Value const container = std::move(m_result);
+  if (!evaluate(expr.m_index.get())) {
+    return;
+  }
+  if (auto const *array = as_array(container)) {
+    get_element(expr, *array);
+  } else {
+    get_entry(expr, *as_map(container));
+  }
+}
+
+void Interpreter::get_element(Index &expr, LoxArray const &array) {
+  if (auto const index =
+          element_index(expr.m_bracket, m_result, array.size())) {
+    m_result = array.get(*index);
+  }
+}
+
+void Interpreter::get_entry(Index &expr, LoxMap const &map) {
+  // Hashing a rope flattens it
+  m_allocating = &expr.m_bracket;
+  std::size_t const hash =
+      key_hash(expr.m_key_hash, *expr.m_index, m_result);
+  if (Value const *value = map.find(m_result, hash)) {
+    m_result = *value;
+  } else {
+    error(expr.m_bracket, ErrorCode::UNDEFINED_KEY);
+  }
+}
+
+void Interpreter::visit(SetIndex &expr) {
+  if (!evaluate(expr.m_object.get()) || !check_container(expr.m_bracket)) {
+    return;
+  }
+  Value const container = std::move(m_result);
+  if (!evaluate(expr.m_index.get())) {
+    return;
+  }
+  Value index = std::move(m_result);
+  if (!evaluate(expr.m_value.get())) {
+    return;
+  }
+  if (auto *array = as_array(container)) {
+    set_element(expr, *array, index);
+  } else {
+    set_entry(expr, *as_map(container), std::move(index));
+  }
+}
+
+void Interpreter::set_element(SetIndex &expr, LoxArray &array,
+                              Value const &index) {
+  // The value may have resized the array, the index is checked last
+  if (auto const i =
+          element_index(expr.m_bracket, index, array.size() + 1)) {
+    m_allocating = &expr.m_bracket;
+    array.set(*i, m_result);
+  }
+}
+
+void Interpreter::set_entry(SetIndex &expr, LoxMap &map, Value key) {
+  m_allocating = &expr.m_bracket;
+  std::size_t const hash = key_hash(expr.m_key_hash, *expr.m_index, key);
+  map.set(std::move(key), hash, m_result);
+}
+
+std::size_t Interpreter::key_hash(KeyHashCache &cache, Expr const &index,
+                                  Value const &key) {
+  if (cache.state == KeyHashCache::State::CONSTANT) {
+    return cache.hash;
+  }
+  std::size_t const hash = hash_key(key);
+  if (cache.state == KeyHashCache::State::UNKNOWN) {
+    bool const constant = index.kind() == ExprKind::LITERAL ||
+                          index.kind() == ExprKind::CONSTANT;
+    cache = {constant ? KeyHashCache::State::CONSTANT
+                      : KeyHashCache::State::VARIABLE,
+             hash};
+  }
+  return hash;
+}
+
+bool Interpreter::check_container(Token const &bracket) {
+  if (as_array(m_result) == nullptr && as_map(m_result) == nullptr) {
+    error(bracket, ErrorCode::ONLY_ARRAYS_AND_MAPS_HAVE_ELEMENTS);
+    return false;
+  }
+  return true;
+}
+
+std::optional<std::size_t> Interpreter::element_index(Token const &bracket,
+                                                      Value const &index,
+                                                      std::size_t limit) {
+  double const number = index.is_number() ? index.unchecked_number() : -1;
+  // NaN is no integer either
+  if (!(number >= 0) || number != std::floor(number)) {
+    error(bracket, ErrorCode::INDEX_MUST_BE_INTEGER);
+    return std::nullopt;
+  }
+  if (number >= static_cast<double>(limit)) {
+    error(bracket, ErrorCode::INDEX_OUT_OF_RANGE);
+    return std::nullopt;
+  }
+  return static_cast<std::size_t>(number);
+}
+
+void Interpreter::visit(This &expr) { load(expr.m_keyword, expr.m_slot); }
+
+void Interpreter::visit(Super &expr) {
+  LoxClass const *superclass = m_function->klass()->superclass();
+  LoxFunction const *method = superclass->find_method(expr.m_method.lexeme());
+  if (method == nullptr) {
+    error(expr.m_method, ErrorCode::UNDEFINED_PROPERTY);
+    return;
+  }
+  load(expr.m_keyword, expr.m_slot);
+  m_result = ObjectPtr(
+      make<BoundMethod>(expr.m_method, m_result.object(), *method));
+}
+
+void Interpreter::visit(Expression &stmt) {
+  // The error, if any, is already in `m_error`
+  (void)evaluate(stmt.m_expr.get());
+}
+
+void Interpreter::visit(Print &stmt) {
+  if (evaluate(stmt.m_expr.get())) {
+    m_output->print(m_result);
+  }
+}
+
+void Interpreter::visit(Var &stmt) {
+  if (stmt.m_initializer) {
+    if (!evaluate(stmt.m_initializer.get())) {
+      return;
+    }
+  } else {
+    m_result = nullptr;
+  }
+  store(stmt.m_name, stmt.m_slot, true);
+}
+
+void Interpreter::visit(Block &stmt) {
+  // The error, if any, is already in `m_error`
+  (void)execute(stmt.m_statements);
+}
+
+void Interpreter::visit(If &stmt) {
+  if (!evaluate(stmt.m_condition.get())) {
+    return;
+  }
+  if (m_result.is_truthy()) {
+    dispatch(*stmt.m_then_branch, *this);
+  } else if (stmt.m_else_branch) {
+    dispatch(*stmt.m_else_branch, *this);
+  }
+}
+
+void Interpreter::visit(While &stmt) {
+  // The hoisted subexpressions are evaluated again by every run of the loop
+  for (uint32_t const slot : stmt.m_hoisted) {
+    m_stack[m_frame_base + slot] = nullptr;
+  }
+  while (!stmt.m_condition || (evaluate(stmt.m_condition.get()) &&
+                               m_result.is_truthy())) {
+    if (!step(stmt.m_keyword)) {
+      return;
+    }
+    dispatch(*stmt.m_body, *this);
+    if (m_error || m_returning) {
+      return;
+    }
+  }
+}
+
+void Interpreter::visit(Function &stmt) {
+  // A function capturing itself captures its cell, which must exist first
+  bool const boxed = stmt.m_slot.kind == VariableSlot::Kind::BOXED;
+  if (boxed) {
+    m_result = nullptr;
+    store(stmt.m_name, stmt.m_slot, true);
+  }
+  LoxClass const *klass = m_function != nullptr ? m_function->klass() : nullptr;
+  m_result = ObjectPtr(
+      make<LoxFunction>(stmt.m_name, stmt, klass, false, capture(stmt)));
+  store(stmt.m_name, stmt.m_slot, !boxed);
+}
+
+void Interpreter::visit(Class &stmt) {
+  std::shared_ptr<LoxClass const> superclass;
+  if (stmt.m_superclass) {
+    if (!evaluate(stmt.m_superclass.get())) {
+      return;
+    }
+    if (!m_result.is_object() ||
+        m_result.object()->kind() != Object::Kind::CLASS) {
+      error(static_cast<Variable &>(*stmt.m_superclass).m_name,
+            ErrorCode::SUPERCLASS_MUST_BE_CLASS);
+      return;
+    }
+    superclass = std::static_pointer_cast<LoxClass const>(m_result.object());
+  }
+
+  // A method capturing its class captures its cell, which must exist first
+  bool const boxed = stmt.m_slot.kind == VariableSlot::Kind::BOXED;
+  if (boxed) {
+    m_result = nullptr;
+    store(stmt.m_name, stmt.m_slot, true);
+  }
+  auto klass =
+      make<LoxClass>(stmt.m_name, stmt.m_name.lexeme(), std::move(superclass));
+  for (auto const &method : stmt.m_methods) {
+    klass->add_method(*method, capture(*method));
+  }
+  m_result = ObjectPtr(std::move(klass));
+  store(stmt.m_name, stmt.m_slot, !boxed);
+}
+
+void Interpreter::visit(Return &stmt) {
+  if (stmt.m_tail_call) {
+    tail_call(*stmt.m_value);
+    return;
+  }
+  if (stmt.m_value) {
+    if (!evaluate(stmt.m_value.get())) {
+      return;
+    }
+  } else {
+    m_result = nullptr;
+  }
+  m_returning = true;
+}
+
+void Interpreter::load(Token const &name, VariableSlot slot) {
+  switch (slot.kind) {
+  case VariableSlot::Kind::LOCAL:
+    m_result = local(slot);
+    return;
+  case VariableSlot::Kind::BOXED:
+    m_result = cell(local(slot)).value();
+    return;
+  case VariableSlot::Kind::UPVALUE:
+    m_result = m_function->capture(slot.index).value();
+    return;
+  case VariableSlot::Kind::GLOBAL:
+    if (slot.index < m_globals.size() && m_globals[slot.index].defined) {
+      m_result = m_globals[slot.index].value;
+      return;
+    }
+    // A lone expression runs without globals, but still sees the natives
+    if (m_globals.empty() && slot.index < m_natives.size()) {
+      m_result = ObjectPtr(m_natives[slot.index]);
+      return;
+    }
+    break;
+  case VariableSlot::Kind::UNRESOLVED:
+    break;
+  }
+  error(name, ErrorCode::UNDEFINED_VARIABLE);
+}
+
+void Interpreter::store(Token const &name, VariableSlot slot, bool declared) {
+  switch (slot.kind) {
+  case VariableSlot::Kind::LOCAL:
+    local(slot) = m_result;
+    return;
+  case VariableSlot::Kind::BOXED:
+    if (declared) {
+      local(slot) = ObjectPtr(make<Cell>(name, m_result));
+    } else {
+      cell(local(slot)).value() = m_result;
+    }
+    return;
+  case VariableSlot::Kind::UPVALUE:
+    m_function->capture(slot.index).value() = m_result;
+    return;
+  case VariableSlot::Kind::GLOBAL:
+    if (slot.index < m_globals.size() &&
+        (declared || m_globals[slot.index].defined)) {
+      m_globals[slot.index] = Global{m_result, true};
+      return;
+    }
+    break;
+  case VariableSlot::Kind::UNRESOLVED:
+    break;
+  }
+  error(name, ErrorCode::UNDEFINED_VARIABLE);
+}
+
+Captures Interpreter::capture(Function const &declaration) {
+  m_allocating = &declaration.m_name;
+  Captures captures(m_memory);
+  captures.reserve(declaration.m_captures.size());
+  for (auto const capture : declaration.m_captures) {
+    Value &slot = m_stack[m_frame_base + capture.index];
+    switch (capture.kind) {
+    case Capture::Kind::CELL:
+      captures.push_back(std::static_pointer_cast<Cell>(slot.object()));
+      break;
+    case Capture::Kind::VALUE:
+      captures.push_back(make<Cell>(declaration.m_name, slot));
+      break;
+    case Capture::Kind::UPVALUE:
+      captures.push_back(m_function->capture_ptr(capture.index));
+      break;
+    }
+  }
+  return captures;
+}
+
+bool Interpreter::push(Token const &token) {
+  if (m_stack.empty()) [[unlikely]] {
+    m_stack.resize(m_stack_size);
+  } else if (m_frame_top == m_stack_size) {
+    error(token, ErrorCode::STACK_OVERFLOW);
+    return false;
+  }
+  m_stack[m_frame_top++] = std::move(m_result);
+  return true;
+}
+
+bool Interpreter::stop(Token const &where) {
+  // An interrupt stops only one run
+  if (m_interrupt.exchange(false, std::memory_order_relaxed)) {
+    error(where, ErrorCode::INTERRUPTED);
+  } else {
+    error(where, ErrorCode::STEP_BUDGET_EXHAUSTED);
+  }
+  m_stopped_depth = m_depth;
+  return false;
+}
+
+void Interpreter::unwind(uint32_t base) {
+  // Release the objects referred to by the popped slots
+  std::fill(m_stack.begin() + base, m_stack.begin() + m_frame_top, nullptr);
+  m_frame_top = base;
+}
+
+bool Interpreter::push_call(Call &expr, uint32_t &argc) {
+  return evaluate(expr.m_callee.get()) && push(expr.m_paren) &&
+         push_arguments(expr.m_paren, expr.m_arguments, argc);
+}
+
+bool Interpreter::push_invoke(Invoke &expr, LoxFunction const *&method,
+                              uint32_t &argc) {
+  return evaluate(expr.m_object.get()) && push_receiver(expr, method) &&
+         push_arguments(expr.m_paren, expr.m_arguments, argc);
+}
+
+bool Interpreter::push_receiver(Invoke &expr, LoxFunction const *&method) {
+  if (!m_result.is_object() ||
+      m_result.object()->kind() != Object::Kind::INSTANCE) {
+    error(expr.m_name, ErrorCode::ONLY_INSTANCES_HAVE_PROPERTIES);
+    return false;
+  }
+  auto &instance = static_cast<LoxInstance &>(*m_result.object());
+  auto const property =
+      find_property(expr.m_cache, instance, expr.m_name.lexeme());
+  if (!property) {
+    error(expr.m_name, ErrorCode::UNDEFINED_PROPERTY);
+    return false;
+  }
+  method = property->method;
+  if (method == nullptr) {
+    // A field holding the callee
+    m_result = instance.field(property->slot);
+  }
+  // Otherwise the receiver keeps its class, thus the method, alive
+  return push(expr.m_paren);
+}
+
+bool Interpreter::push_arguments(Token const &paren, ExprList const &arguments,
+                                 uint32_t &argc) {
+  for (auto const &argument : arguments) {
+    if (!evaluate(argument.get()) || !push(paren)) {
+      return false;
+    }
+    ++argc;
+  }
+  return true;
+}
+
+void Interpreter::tail_call(Expr &expr) {
+  uint32_t const base = m_frame_top;
+  Token const *paren = nullptr;
+  LoxFunction const *method = nullptr;
+  uint32_t argc = 0;
+  bool ok = false;
+  if (expr.kind() == ExprKind::CALL) {
+    auto &call = static_cast<Call &>(expr);
+    paren = &call.m_paren;
+    ok = push_call(call, argc);
+  } else {
+    auto &invoke = static_cast<Invoke &>(expr);
+    paren = &invoke.m_paren;
+    ok = push_invoke(invoke, method, argc);
+  }
+  if (!ok) {
+    unwind(base);
+    return;
+  }
+  replace_frame(*paren, method, base, argc);
+}
+
+void Interpreter::replace_frame(Token const &paren, LoxFunction const *method,
+                                uint32_t base, uint32_t argc) {
+  // The callee and its arguments replace the frame of the current call
+  std::move(m_stack.begin() + base, m_stack.begin() + m_frame_top,
+            m_stack.begin() + m_frame_base);
+  unwind(m_frame_base + 1 + argc);
+  m_tail_call = TailCall{&paren, method, argc};
+  m_returning = true;
+}
+
+void Interpreter::call_value(Token const &paren, uint32_t base,
+                             uint32_t argc) {
+  auto const callee = prepare_call(paren, base, argc);
+  if (callee.function != nullptr) {
+    call_function(paren, *callee.function, base, argc);
+  } else if (callee.native != nullptr) {
+    call_native(paren, *callee.native, base + 1);
+  }
+}
+
+Interpreter::Callee Interpreter::prepare_call(Token const &paren,
+                                              uint32_t base, uint32_t argc) {
+  Value &callee = m_stack[base];
+  if (!callee.is_object()) {
+    error(paren, ErrorCode::NOT_CALLABLE);
+    return {};
+  }
+  switch (callee.object()->kind()) {
+  case Object::Kind::CLASS: {
+    auto klass = std::static_pointer_cast<LoxClass const>(callee.object());
+    LoxFunction const *initializer = klass->find_method("init");
+    callee = ObjectPtr(make<LoxInstance>(paren, std::move(klass), m_memory));
+    if (initializer != nullptr) {
+      return {initializer, nullptr};
+    } else if (argc != 0) {
+      error(paren, ErrorCode::WRONG_ARITY);
+    } else {
+      m_result = callee;
+    }
+    return {};
+  }
+  case Object::Kind::BOUND_METHOD: {
+    auto const &bound = static_cast<BoundMethod const &>(*callee.object());
+    LoxFunction const &method = bound.method();
+    // The receiver keeps its class, thus the method, alive
+    callee = bound.receiver();
+    return {&method, nullptr};
+  }
+  case Object::Kind::FUNCTION:
+    // The function stays alive in slot `base`
+    return {&static_cast<LoxFunction const &>(*callee.object()), nullptr};
+  case Object::Kind::NATIVE: {
+    auto const &native = static_cast<NativeFunction const &>(*callee.object());
+    if (argc != native.arity()) {
+      error(paren, ErrorCode::WRONG_ARITY);
+      return {};
+    }
+    return {nullptr, &native};
+  }
+  case Object::Kind::INSTANCE:
+  case Object::Kind::CELL:
+  case Object::Kind::ARRAY:
+  case Object::Kind::MAP:
+    break;
+  }
+  error(paren, ErrorCode::NOT_CALLABLE);
+  return {};
+}
+
+void Interpreter::call_native(Token const &paren, NativeFunction const &native,
+                              uint32_t base) {
+  // The arguments were pushed, so they are all on the stack
+  if (auto const code = native.call(m_stack.data() + base, m_result)) {
+    error(paren, *code);
+  }
+}
+
+void Interpreter::call_function(Token const &paren, LoxFunction const &function,
+                                uint32_t base, uint32_t argc) {
+  if (m_depth == m_max_call_depth || native_stack_exhausted()) {
+    error(paren, ErrorCode::STACK_OVERFLOW);
+    return;
+  }
+
+  uint32_t const frame_base = m_frame_base;
+  LoxFunction const *const caller = m_function;
+  m_frame_base = base;
+  ++m_depth;
+
+  // Tail calls run in the same frame, one after the other
+  Token const *site = &paren;
+  for (LoxFunction const *callee = &function; callee != nullptr;) {
+    if (!run(*site, *callee, base, argc) || !m_tail_call) {
+      break;
+    }
+    site = m_tail_call->paren;
+    argc = m_tail_call->argc;
+    auto const next = next_tail_call(base);
+    if (next.native != nullptr) {
+      call_native(*site, *next.native, base + 1);
+    }
+    callee = next.function;
+  }
+  m_tail_call.reset();
+
+  --m_depth;
+  m_function = caller;
+  m_frame_base = frame_base;
+}
+
+bool Interpreter::run(Token const &paren, LoxFunction const &function,
+                      uint32_t base, uint32_t argc) {
+  if (!enter(paren, function, base, argc)) {
+    return false;
+  }
+  bool const ok = execute(function.declaration().m_body);
+  leave(function, base, ok);
+  return ok;
+}
+
+bool Interpreter::enter(Token const &paren, LoxFunction const &function,
+                        uint32_t base, uint32_t argc) {
+  if (!step(paren)) {
+    return false;
+  }
+  if (argc != function.arity()) {
+    error(paren, ErrorCode::WRONG_ARITY);
+    return false;
+  }
+  uint32_t const frame_size = function.declaration().m_frame_size;
+  if (frame_size > m_stack_size - base) {
+    error(paren, ErrorCode::STACK_OVERFLOW);
+    return false;
+  }
+  m_frame_top = base + frame_size;
+  m_function = &function;
+  for (uint32_t const slot : function.declaration().m_boxed_params) {
+    m_stack[base + slot] =
+        ObjectPtr(make<Cell>(paren, std::move(m_stack[base + slot])));
+  }
+  return true;
+}
+
+void Interpreter::leave(LoxFunction const &function, uint32_t base, bool ok) {
+  if (ok && function.is_initializer()) {
+    m_result = m_stack[base];
+  } else if (ok && !m_returning) {
+    m_result = nullptr;
+  }
+  m_returning = false;
+}
+
+Interpreter::Callee Interpreter::next_tail_call(uint32_t base) {
+  TailCall const tail = *m_tail_call;
+  m_tail_call.reset();
+  if (tail.method != nullptr) {
+    // The receiver is in slot `base` already
+    return {tail.method, nullptr};
+  }
+  return prepare_call(*tail.paren, base, tail.argc);
+}
+
+std::optional<Interpreter::Property>
+Interpreter::find_property(PropertyCache &cache, LoxInstance const &instance,
+                           std::string_view name) {
+  Shape const *shape = instance.shape();
+  if (auto const *entry = cache.find(shape)) [[likely]] {
+    return Property{entry->method, entry->slot};
+  }
+
+  Property property{nullptr, 0};
+  if (auto const slot = shape->lookup(name); slot >= 0) {
+    property.slot = static_cast<uint32_t>(slot);
+  } else if (auto const *method = shape->klass().find_method(name)) {
+    property.method = method;
+  } else {
+    return std::nullopt;
+  }
+  // A megamorphic site does not pay for holding the class
+  if (!cache.full()) {
+    cache.insert({shape, property.method, property.slot, instance.klass()});
+  }
+  return property;
+}
 
 } // namespace Lox
@@ -0,0 +1,670 @@
+#include "interpreter.h"
+#include "ast_defines.inc"
+#include "error.h"
+
+#include <algorithm>
+
+namespace Lox {
+
+// The result of a `co_await` is stored before it is tested: GCC 12
+// miscompiles a `co_await` in the condition of an `if`
+
+Evaluation<Expected<Value>> Interpreter::start(Program &program) {
+  THROW_ASSERT(!m_started, "The interpreter is running another program.");
+  bool const begun = begin(program);
+  m_started = true;
+  mark_native_stack();
+  m_native_stack_budget = native_stack_budget();
+  return run_async(program, begun);
+}
+
+Evaluation<Expected<Value>> Interpreter::run_async(Program &program,
+                                                   bool begun) {
+  // Also run if the evaluation is destroyed before its end
+  struct Ending {
+    Interpreter *interpreter;
+
+    ~Ending() noexcept {
+      interpreter->end();
+      interpreter->m_suspends.clear();
+      interpreter->m_started = false;
+    }
+  } const ending{this};
+
+  bool ok = false;
+  try {
+    if (begun) {
+      ok = co_await execute_async(program.statements);
+      m_returning = false;
+    }
+    if (ok && program.result) {
+      ok = co_await evaluate_async(*program.result);
+    }
+  } catch (MemoryLimitError const &) {
+    out_of_memory();
+  }
+  if (!ok) {
+    co_return Unexpected{*m_error};
+  }
+  co_return program.result ? m_result : Value(nullptr);
+}
+
+bool Interpreter::may_suspend(Expr &expr) {
+  if (auto const it = m_suspends.find(&expr); it != m_suspends.end()) {
+    return it->second;
+  }
+  bool suspends = false;
+  switch (expr.kind()) {
+  case ExprKind::BINARY: {
+    auto &binary = static_cast<Binary &>(expr);
+    suspends = may_suspend(*binary.m_left) || may_suspend(*binary.m_right);
+    break;
+  }
+  case ExprKind::UNARY:
+    suspends = may_suspend(*static_cast<Unary &>(expr).m_right);
+    break;
+  case ExprKind::GROUPING:
+    suspends = may_suspend(*static_cast<Grouping &>(expr).m_expr);
+    break;
+  case ExprKind::LOGICAL: {
+    auto &logical = static_cast<Logical &>(expr);
+    suspends = may_suspend(*logical.m_left) || may_suspend(*logical.m_right);
+    break;
+  }
+  case ExprKind::ASSIGN:
+    suspends = may_suspend(*static_cast<Assign &>(expr).m_value);
+    break;
+  case ExprKind::CALL: {
+    auto &call = static_cast<Call &>(expr);
+    suspends = call.m_native < 0 || m_natives[call.m_native]->is_async() ||
+               std::ranges::any_of(call.m_arguments, [this](auto &argument) {
+                 return may_suspend(*argument);
+               });
+    break;
+  }
+  case ExprKind::GET:
+    suspends = may_suspend(*static_cast<Get &>(expr).m_object);
+    break;
+  case ExprKind::SET: {
+    auto &set = static_cast<Set &>(expr);
+    suspends = may_suspend(*set.m_object) || may_suspend(*set.m_value);
+    break;
+  }
+  case ExprKind::INVOKE:
+    suspends = true;
+    break;
+  case ExprKind::ARRAY:
+    suspends = std::ranges::any_of(
+        static_cast<Array &>(expr).m_elements,
+        [this](auto &element) { return may_suspend(*element); });
+    break;
+  case ExprKind::MAP: {
+    auto &map = static_cast<Map &>(expr);
+    auto const suspends_in = [this](auto &exprs) {
+      return std::ranges::any_of(
+          exprs, [this](auto &entry) { return may_suspend(*entry); });
+    };
+    suspends = suspends_in(map.m_keys) || suspends_in(map.m_values);
+    break;
+  }
+  case ExprKind::INDEX: {
+    auto &index = static_cast<Index &>(expr);
+    suspends = may_suspend(*index.m_object) || may_suspend(*index.m_index);
+    break;
+  }
+  case ExprKind::SET_INDEX: {
+    auto &set = static_cast<SetIndex &>(expr);
+    suspends = may_suspend(*set.m_object) || may_suspend(*set.m_index) ||
+               may_suspend(*set.m_value);
+    break;
+  }
+  case ExprKind::LITERAL:
+  case ExprKind::CONSTANT:
+  case ExprKind::VARIABLE:
+  case ExprKind::THIS:
+  case ExprKind::SUPER:
+  // Hoisted and shared subexpressions have no side effects, so no calls
+  case ExprKind::HOISTED:
+  case ExprKind::SHARED:
+    break;
+  }
+  m_suspends.emplace(&expr, suspends);
+  return suspends;
+}
+
+bool Interpreter::may_suspend(Stmt &stmt) {
+  if (auto const it = m_suspends.find(&stmt); it != m_suspends.end()) {
+    return it->second;
+  }
+  bool suspends = false;
+  switch (stmt.kind()) {
+  case StmtKind::EXPRESSION:
+    suspends = may_suspend(*static_cast<Expression &>(stmt).m_expr);
+    break;
+  case StmtKind::PRINT:
+    suspends = may_suspend(*static_cast<Print &>(stmt).m_expr);
+    break;
+  case StmtKind::VAR: {
+    auto &var = static_cast<Var &>(stmt);
+    suspends = var.m_initializer && may_suspend(*var.m_initializer);
+    break;
+  }
+  case StmtKind::BLOCK:
+    suspends = may_suspend(static_cast<Block &>(stmt).m_statements);
+    break;
+  case StmtKind::IF: {
+    auto &branch = static_cast<If &>(stmt);
+    suspends = may_suspend(*branch.m_condition) ||
+               may_suspend(*branch.m_then_branch) ||
+               (branch.m_else_branch && may_suspend(*branch.m_else_branch));
+    break;
+  }
+  case StmtKind::WHILE: {
+    auto &loop = static_cast<While &>(stmt);
+    suspends = (loop.m_condition && may_suspend(*loop.m_condition)) ||
+               may_suspend(*loop.m_body);
+    break;
+  }
+  case StmtKind::RETURN: {
+    auto &ret = static_cast<Return &>(stmt);
+    suspends = ret.m_value && may_suspend(*ret.m_value);
+    break;
+  }
+  // Declaring runs no code, but a superclass, which is a variable
+  case StmtKind::FUNCTION:
+  case StmtKind::CLASS:
+    break;
+  }
+  m_suspends.emplace(&stmt, suspends);
+  return suspends;
+}
+
+bool Interpreter::may_suspend(StmtList const &stmts) {
+  return std::ranges::any_of(
+      stmts, [this](auto const &stmt) { return may_suspend(*stmt); });
+}
+
+Task<bool> Interpreter::evaluate_async(Expr &expr) {
+  if (!may_suspend(expr)) {
+    return Task<bool>(evaluate(&expr));
+  }
+  switch (expr.kind()) {
+  case ExprKind::BINARY:
+    return evaluate_async(static_cast<Binary &>(expr));
+  case ExprKind::UNARY:
+    return evaluate_async(static_cast<Unary &>(expr));
+  case ExprKind::GROUPING:
+    return evaluate_async(static_cast<Grouping &>(expr));
+  case ExprKind::LOGICAL:
+    return evaluate_async(static_cast<Logical &>(expr));
+  case ExprKind::ASSIGN:
+    return evaluate_async(static_cast<Assign &>(expr));
+  case ExprKind::CALL:
+    return evaluate_async(static_cast<Call &>(expr));
+  case ExprKind::GET:
+    return evaluate_async(static_cast<Get &>(expr));
+  case ExprKind::SET:
+    return evaluate_async(static_cast<Set &>(expr));
+  case ExprKind::INVOKE:
+    return evaluate_async(static_cast<Invoke &>(expr));
+  case ExprKind::ARRAY:
+    return evaluate_async(static_cast<Array &>(expr));
+  case ExprKind::MAP:
+    return evaluate_async(static_cast<Map &>(expr));
+  case ExprKind::INDEX:
+    return evaluate_async(static_cast<Index &>(expr));
+  case ExprKind::SET_INDEX:
+    return evaluate_async(static_cast<SetIndex &>(expr));
+  default:
+    THROW_ASSERT(false, "Only calls and their parents suspend.");
+    return Task<bool>(false);
+  }
+}
+
+Task<bool> Interpreter::evaluate_async(Binary &expr) {
+  bool ok = co_await evaluate_async(*expr.m_left);
+  if (!ok) {
+    co_return false;
+  }
+  Value left = std::move(m_result);
+  ok = co_await evaluate_async(*expr.m_right);
+  if (!ok) {
+    co_return false;
+  }
+  apply_binary(expr, left);
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::evaluate_async(Unary &expr) {
+  bool const ok = co_await evaluate_async(*expr.m_right);
+  if (!ok) {
+    co_return false;
+  }
+  apply_unary(expr);
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::evaluate_async(Grouping &expr) {
+  co_return co_await evaluate_async(*expr.m_expr);
+}
+
+Task<bool> Interpreter::evaluate_async(Logical &expr) {
+  bool const ok = co_await evaluate_async(*expr.m_left);
+  if (!ok) {
+    co_return false;
+  }
+  bool const is_or = expr.m_op.type() == TokenType::OR;
+  if (m_result.is_truthy() != is_or) {
+    co_return co_await evaluate_async(*expr.m_right);
+  }
+  co_return true;
+}
+
+Task<bool> Interpreter::evaluate_async(Assign &expr) {
+  bool const ok = co_await evaluate_async(*expr.m_value);
+  if (!ok) {
+    co_return false;
+  }
+  store(expr.m_name, expr.m_slot, false);
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::evaluate_async(Call &expr) {
+  uint32_t const base = m_frame_top;
+  uint32_t argc = 0;
+  if (expr.m_native >= 0) {
+    bool const pushed =
+        co_await push_arguments_async(expr.m_paren, expr.m_arguments, argc);
+    if (pushed) {
+      co_await call_native_async(expr.m_paren, *m_natives[expr.m_native],
+                                 base);
+    }
+  } else {
+    bool const pushed = co_await push_call_async(expr, argc);
+    if (pushed) {
+      co_await call_value_async(expr.m_paren, base, argc);
+    }
+  }
+  unwind(base);
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::evaluate_async(Get &expr) {
+  bool const ok = co_await evaluate_async(*expr.m_object);
+  if (!ok) {
+    co_return false;
+  }
+  get_property(expr);
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::evaluate_async(Set &expr) {
+  bool ok = co_await evaluate_async(*expr.m_object);
+  if (!ok) {
+    co_return false;
+  }
+  if (!m_result.is_object() ||
+      m_result.object()->kind() != Object::Kind::INSTANCE) {
+    error(expr.m_name, ErrorCode::ONLY_INSTANCES_HAVE_FIELDS);
+    co_return false;
+  }
+  ObjectPtr const object = m_result.object();
+  ok = co_await evaluate_async(*expr.m_value);
+  if (!ok) {
+    co_return false;
+  }
+  set_field(expr, static_cast<LoxInstance &>(*object));
+  co_return true;
+}
+
+Task<bool> Interpreter::evaluate_async(Invoke &expr) {
+  uint32_t const base = m_frame_top;
+  LoxFunction const *method = nullptr;
+  uint32_t argc = 0;
+  bool const pushed = co_await push_invoke_async(expr, method, argc);
+  if (pushed && method != nullptr) {
+    co_await call_function_async(expr.m_paren, *method, base, argc);
+  } else if (pushed) {
+    co_await call_value_async(expr.m_paren, base, argc);
+  }
+  unwind(base);
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::evaluate_async(Array &expr) {
+  auto array = make<LoxArray>(expr.m_bracket, m_memory);
+  for (auto &element : expr.m_elements) {
+    bool const ok = co_await evaluate_async(*element);
+    if (!ok) {
+      co_return false;
+    }
+    m_allocating = &expr.m_bracket;
+    array->set(array->size(), std::move(m_result));
+  }
+  m_result = ObjectPtr(std::move(array));
+  co_return true;
+}
+
+Task<bool> Interpreter::evaluate_async(Map &expr) {
+  auto map = make<LoxMap>(expr.m_brace, m_memory);
+  for (std::size_t i = 0; i < expr.m_keys.size(); ++i) {
+    bool ok = co_await evaluate_async(*expr.m_keys[i]);
+    if (!ok) {
+      co_return false;
+    }
+    Value key = std::move(m_result);
+    ok = co_await evaluate_async(*expr.m_values[i]);
+    if (!ok) {
+      co_return false;
+    }
+    m_allocating = &expr.m_brace;
+    map->set(std::move(key), std::move(m_result));
+  }
+  m_result = ObjectPtr(std::move(map));
+  co_return true;
+}
+
+Task<bool> Interpreter::evaluate_async(Index &expr) {
+  bool ok = co_await evaluate_async(*expr.m_object);
+  if (!ok) {
+    co_return false;
+  }
+  if (!check_container(expr.m_bracket)) {
+    co_return false;
+  }
+  Value const container = std::move(m_result);
+  ok = co_await evaluate_async(*expr.m_index);
+  if (!ok) {
+    co_return false;
+  }
+  if (auto const *array = as_array(container)) {
+    get_element(expr, *array);
+  } else {
+    get_entry(expr, *as_map(container));
+  }
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::evaluate_async(SetIndex &expr) {
+  bool ok = co_await evaluate_async(*expr.m_object);
+  if (!ok) {
+    co_return false;
+  }
+  if (!check_container(expr.m_bracket)) {
+    co_return false;
+  }
+  Value const container = std::move(m_result);
+  ok = co_await evaluate_async(*expr.m_index);
+  if (!ok) {
+    co_return false;
+  }
+  Value index = std::move(m_result);
+  ok = co_await evaluate_async(*expr.m_value);
+  if (!ok) {
+    co_return false;
+  }
+  if (auto *array = as_array(container)) {
+    set_element(expr, *array, index);
+  } else {
+    set_entry(expr, *as_map(container), std::move(index));
+  }
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::execute_async(StmtList const &stmts) {
+  for (auto const &stmt : stmts) {
+    bool const ok = co_await execute_async(*stmt);
+    if (!ok) {
+      co_return false;
+    } else if (m_returning) {
+      break;
+    }
+  }
+  co_return true;
+}
+
+Task<bool> Interpreter::execute_async(Stmt &stmt) {
+  if (!may_suspend(stmt)) {
+    dispatch(stmt, *this);
+    return Task<bool>(!m_error);
+  }
+  switch (stmt.kind()) {
+  case StmtKind::EXPRESSION:
+    return execute_async(static_cast<Expression &>(stmt));
+  case StmtKind::PRINT:
+    return execute_async(static_cast<Print &>(stmt));
+  case StmtKind::VAR:
+    return execute_async(static_cast<Var &>(stmt));
+  case StmtKind::BLOCK:
+    return execute_async(static_cast<Block &>(stmt).m_statements);
+  case StmtKind::IF:
+    return execute_async(static_cast<If &>(stmt));
+  case StmtKind::WHILE:
+    return execute_async(static_cast<While &>(stmt));
+  case StmtKind::RETURN:
+    return execute_async(static_cast<Return &>(stmt));
+  default:
+    THROW_ASSERT(false, "Declarations never suspend.");
+    return Task<bool>(false);
+  }
+}
+
+Task<bool> Interpreter::execute_async(Expression &stmt) {
+  co_return co_await evaluate_async(*stmt.m_expr);
+}
+
+Task<bool> Interpreter::execute_async(Print &stmt) {
+  bool const ok = co_await evaluate_async(*stmt.m_expr);
+  if (!ok) {
+    co_return false;
+  }
+  m_output->print(m_result);
+  co_return true;
+}
+
+Task<bool> Interpreter::execute_async(Var &stmt) {
+  bool const ok = co_await evaluate_async(*stmt.m_initializer);
+  if (!ok) {
+    co_return false;
+  }
+  store(stmt.m_name, stmt.m_slot, true);
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::execute_async(If &stmt) {
+  bool const ok = co_await evaluate_async(*stmt.m_condition);
+  if (!ok) {
+    co_return false;
+  }
+  if (m_result.is_truthy()) {
+    co_return co_await execute_async(*stmt.m_then_branch);
+  } else if (stmt.m_else_branch) {
+    co_return co_await execute_async(*stmt.m_else_branch);
+  }
+  co_return true;
+}
+
+Task<bool> Interpreter::execute_async(While &stmt) {
+  // The hoisted subexpressions are evaluated again by every run of the loop
+  for (uint32_t const slot : stmt.m_hoisted) {
+    m_stack[m_frame_base + slot] = nullptr;
+  }
+  while (true) {
+    if (stmt.m_condition) {
+      bool const ok = co_await evaluate_async(*stmt.m_condition);
+      if (!ok) {
+        co_return false;
+      } else if (!m_result.is_truthy()) {
+        break;
+      }
+    }
+    if (!step(stmt.m_keyword)) {
+      co_return false;
+    }
+    bool const ok = co_await execute_async(*stmt.m_body);
+    if (!ok) {
+      co_return false;
+    } else if (m_returning) {
+      break;
+    }
+  }
+  co_return true;
+}
+
+Task<bool> Interpreter::execute_async(Return &stmt) {
+  if (stmt.m_tail_call) {
+    co_return co_await tail_call_async(*stmt.m_value);
+  }
+  // Only a return of a value may suspend
+  bool const ok = co_await evaluate_async(*stmt.m_value);
+  if (!ok) {
+    co_return false;
+  }
+  m_returning = true;
+  co_return true;
+}
+
+Task<bool> Interpreter::push_call_async(Call &expr, uint32_t &argc) {
+  bool const ok = co_await evaluate_async(*expr.m_callee);
+  if (!ok || !push(expr.m_paren)) {
+    co_return false;
+  }
+  co_return co_await push_arguments_async(expr.m_paren, expr.m_arguments,
+                                          argc);
+}
+
+Task<bool> Interpreter::push_invoke_async(Invoke &expr,
+                                          LoxFunction const *&method,
+                                          uint32_t &argc) {
+  bool const ok = co_await evaluate_async(*expr.m_object);
+  if (!ok || !push_receiver(expr, method)) {
+    co_return false;
+  }
+  co_return co_await push_arguments_async(expr.m_paren, expr.m_arguments,
+                                          argc);
+}
+
+Task<bool> Interpreter::push_arguments_async(Token const &paren,
+                                             ExprList const &arguments,
+                                             uint32_t &argc) {
+  for (auto const &argument : arguments) {
+    bool const ok = co_await evaluate_async(*argument);
+    if (!ok || !push(paren)) {
+      co_return false;
+    }
+    ++argc;
+  }
+  co_return true;
+}
+
+Task<bool> Interpreter::tail_call_async(Expr &expr) {
+  uint32_t const base = m_frame_top;
+  Token const *paren = nullptr;
+  LoxFunction const *method = nullptr;
+  uint32_t argc = 0;
+  bool ok = false;
+  if (expr.kind() == ExprKind::CALL) {
+    auto &call = static_cast<Call &>(expr);
+    paren = &call.m_paren;
+    ok = co_await push_call_async(call, argc);
+  } else {
+    auto &invoke = static_cast<Invoke &>(expr);
+    paren = &invoke.m_paren;
+    ok = co_await push_invoke_async(invoke, method, argc);
+  }
+  if (!ok) {
+    unwind(base);
+    co_return false;
+  }
+  replace_frame(*paren, method, base, argc);
+  co_return true;
+}
+
+Task<bool> Interpreter::call_value_async(Token const &paren, uint32_t base,
+                                         uint32_t argc) {
+  auto const callee = prepare_call(paren, base, argc);
+  if (callee.function != nullptr) {
+    co_return co_await call_function_async(paren, *callee.function, base,
+                                           argc);
+  } else if (callee.native != nullptr) {
+    co_return co_await call_native_async(paren, *callee.native, base + 1);
+  }
+  co_return !m_error;
+}
+
+Task<bool> Interpreter::call_native_async(Token const &paren,
+                                          NativeFunction const &native,
+                                          uint32_t base) {
+  if (!native.is_async()) {
+    call_native(paren, native, base);
+    return Task<bool>(!m_error);
+  }
+  return await_native(paren, native, base);
+}
+
+Task<bool> Interpreter::await_native(Token const &paren,
+                                     NativeFunction const &native,
+                                     uint32_t base) {
+  Deferred deferred;
+  if (auto const code = native.call_async(m_stack.data() + base, deferred)) {
+    error(paren, *code);
+    co_return false;
+  }
+  auto result = co_await deferred;
+  // The program goes on on the stack of whoever resolved `deferred`
+  mark_native_stack();
+  if (!result) {
+    error(paren, result.error());
+    co_return false;
+  }
+  m_result = std::move(result).value();
+  co_return true;
+}
+
+Task<bool> Interpreter::call_function_async(Token const &paren,
+                                            LoxFunction const &function,
+                                            uint32_t base, uint32_t argc) {
+  if (m_depth == m_max_call_depth || native_stack_exhausted()) {
+    error(paren, ErrorCode::STACK_OVERFLOW);
+    co_return false;
+  }
+
+  uint32_t const frame_base = m_frame_base;
+  LoxFunction const *const caller = m_function;
+  m_frame_base = base;
+  ++m_depth;
+
+  // Tail calls run in the same frame, one after the other
+  Token const *site = &paren;
+  for (LoxFunction const *callee = &function; callee != nullptr;) {
+    if (!enter(*site, *callee, base, argc)) {
+      break;
+    }
+    StmtList const &body = callee->declaration().m_body;
+    bool ok = false;
+    if (may_suspend(body)) {
+      ok = co_await execute_async(body);
+    } else {
+      ok = execute(body);
+    }
+    leave(*callee, base, ok);
+    if (!ok || !m_tail_call) {
+      break;
+    }
+    site = m_tail_call->paren;
+    argc = m_tail_call->argc;
+    auto const next = next_tail_call(base);
+    if (next.native != nullptr) {
+      co_await call_native_async(*site, *next.native, base + 1);
+    }
+    callee = next.function;
+  }
+  m_tail_call.reset();
+
+  --m_depth;
+  m_function = caller;
+  m_frame_base = frame_base;
+  co_return !m_error;
+}
+
+} // namespace Lox
@@ -1,24 +1,180 @@
 #include "ast_printer.h"
+#include "closure_compiler.h"
 #include "file.h"
 #include "interpreter.h"
+#include "memory_account.h"
+#include "optimizer.h"
+#include "parallel_evaluator.h"
+#include "parallel_parser.h"
+#include "parallel_scanner.h"
 #include "parser.h"
+#include "profiler.h"
+#include "resolver.h"
 #include "runtime_error.h"
 #include "scanner.h"
+#include "snapshot.h"
+#include "source_map.h"
+#include "type_checker.h"
 
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <error.h>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string_view>
+#include <thread>
 #include <vector>
 
-static void run(std::string const &source) {
-  Lox::Scanner scanner(source);
+struct Options {
+  std::optional<Lox::Profiler::Mode> profile;
+  bool closure_backend = false;
+  bool hash_cons = false;
+  bool optimize = true;
+  bool memory_stats = false;
+  char const *profile_collapsed_path = nullptr;
+  char const *snapshot_path = nullptr;
+  char const *write_snapshot_path = nullptr;
+  uint32_t max_call_depth = Lox::Interpreter::kMaxCallDepth;
+  std::size_t max_memory = Lox::MemoryAccount::kUnlimited;
+  uint64_t max_steps = Lox::Interpreter::kUnlimitedSteps;
+  std::optional<uint64_t> timeout_ms;
+  char const *script = nullptr;
+};
+
+static Options options;
+
+/**
+ * The snapshot of `--snapshot`, which every script starts from.
+ */
+static std::optional<Lox::Snapshot> prelude;
+
+/**
+ * Interrupt an interpreter once `timeout` elapsed, unless destroyed before.
+ */
+class Watchdog {
+public:
+  Watchdog(Lox::Interpreter &interpreter, std::chrono::milliseconds timeout)
+      : m_thread([this, &interpreter, timeout](std::stop_token stop) {
+          std::unique_lock lock(m_mutex);
+          m_wakeup.wait_for(lock, stop, timeout, [] { return false; });
+          if (!stop.stop_requested()) {
+            interpreter.interrupt();
+          }
+        }) {}
+
+  Watchdog(Watchdog const &) = delete;
+
+  Watchdog &operator=(Watchdog const &) = delete;
+
+  ~Watchdog() noexcept = default;
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable_any m_wakeup;
+  std::jthread m_thread;
+};
+
+/**
+ * @brief Run `program`, scanned from `source`, on `interpreter` as
+ *        configured by `options`.
+ */
+static void interpret(Lox::Interpreter &interpreter, Lox::Program &program,
+                      std::string const &source, Lox::MemoryAccount *memory) {
+  interpreter.set_snapshot(prelude ? &*prelude : nullptr);
+  interpreter.set_max_call_depth(options.max_call_depth);
+  interpreter.set_step_budget(options.max_steps);
+  if (memory != nullptr) {
+    interpreter.set_memory(*memory);
+  }
+  std::optional<Watchdog> watchdog;
+  if (options.timeout_ms) {
+    watchdog.emplace(interpreter,
+                     std::chrono::milliseconds(*options.timeout_ms));
+  }
+  if (options.write_snapshot_path != nullptr) {
+    // The script is a prelude, whose globals are saved
+    if (auto const globals = interpreter.run_prelude(program)) {
+      Lox::Snapshot::write(options.write_snapshot_path, program,
+                           Lox::SourceMap(source), *globals,
+                           interpreter.natives());
+    }
+  } else {
+    interpreter.interpret(program);
+  }
+  watchdog.reset();
+
+  if (!Lox::runtime_errors.empty() &&
+      (Lox::runtime_errors.back().code ==
+           Lox::ErrorCode::STEP_BUDGET_EXHAUSTED ||
+       Lox::runtime_errors.back().code == Lox::ErrorCode::INTERRUPTED)) {
+    auto const report = interpreter.report();
+    std::cerr << "Stopped after " << report.steps << " steps, "
+              << report.depth << " calls deep.\n";
+  }
+}
+
+static void report_profile(Lox::Profiler const &profiler,
+                           std::string const &source) {
+  Lox::SourceMap const source_map(source);
+  profiler.report(std::cerr, source_map);
+  if (options.profile_collapsed_path != nullptr) {
+    std::ofstream out(options.profile_collapsed_path);
+    if (!out) {
+      CHECK_ERRNO(-1, "open collapsed stacks");
+    }
+    profiler.write_collapsed(out, source_map);
+  }
+}
+
+/**
+ * @brief Run `source`, and return the messages of the errors found. They are
+ *        formatted here, while the tokens they refer to are still alive.
+ */
+static std::string run(std::string const &source) {
+  // Declared first, to outlive everything allocated from it
+  std::optional<Lox::MemoryAccount> memory;
+  if (options.max_memory != Lox::MemoryAccount::kUnlimited ||
+      options.memory_stats) {
+    memory.emplace(options.max_memory);
+  }
+  struct MemoryStats {
+    Lox::MemoryAccount const *memory;
+    ~MemoryStats() {
+      if (memory != nullptr && options.memory_stats) {
+        std::cerr << "Peak memory: " << memory->peak() << " bytes\n";
+      }
+    }
+  } const stats{memory ? &*memory : nullptr};
+
+  Lox::ParallelScanner scanner(
+      source, std::thread::hardware_concurrency(),
+      memory ? &*memory : std::pmr::get_default_resource());
   auto const &tokens = scanner.scan_tokens();
 
-  Lox::Parser parser(tokens);
-  Lox::ExprPtr expr = parser.parse();
+  Lox::Program program =
+      options.hash_cons
+          ? Lox::Parser(tokens, true, memory ? &*memory : nullptr)
+                .parse_program()
+          : Lox::ParallelParser(tokens, scanner.splits(),
+                                std::thread::hardware_concurrency(),
+                                memory ? &*memory : nullptr)
+                .parse_program();
+  if (Lox::syntax_errors.empty()) {
+    // Every interpreter starts with the same built-in natives
+    Lox::Resolver(Lox::NativeRegistry(), prelude ? &*prelude : nullptr)
+        .resolve(program);
+  }
 
-  if (!Lox::syntax_error_msgs.empty()) {
-    return;
+  if (!Lox::syntax_errors.empty()) {
+    return Lox::dump_errors(Lox::syntax_errors, Lox::SourceMap(source));
   }
 
   for (auto const &token : tokens) {
@@ -26,27 +182,80 @@ static void run(std::string const &source) {
   }
 
   Lox::AstPrinter ast_printer(std::cout);
-  expr->accept(ast_printer);
-  std::cout << '\n';
+  for (auto const &stmt : program.statements) {
+    dispatch(*stmt, ast_printer);
+    std::cout << '\n';
+  }
+  if (program.result) {
+    dispatch(*program.result, ast_printer);
+    std::cout << '\n';
+  }
+
+  // A lone expression may run on any backend, statements need the
+  // tree-walking interpreter
+  bool const expression_only =
+      program.statements.empty() && program.result != nullptr;
+  // A lone expression is left as written, for the backends to evaluate
+  if (options.optimize && !expression_only) {
+    Lox::Optimizer().optimize(program);
+  }
+  Lox::TypeChecker().check(program);
+  if (!Lox::syntax_errors.empty()) {
+    return Lox::dump_errors(Lox::syntax_errors, Lox::SourceMap(source));
+  }
+
+  if (options.closure_backend) {
+    if (!expression_only) {
+      throw Lox::Exception("The closure backend only runs expressions.");
+    }
+    auto result = Lox::ClosureCompiler().compile(*program.result).evaluate();
+    if (!result) {
+      Lox::runtime_error(result.error());
+      return Lox::dump_errors(Lox::runtime_errors, Lox::SourceMap(source));
+    }
+    std::cout << result.value() << '\n';
+    return {};
+  }
 
-  Lox::Interpreter interpreter;
-  interpreter.interpret(expr.get());
+  // The output of `print` bypasses `std::cout`, which must be written first
+  std::cout.flush();
+  Lox::Value result;
+  if (options.profile) {
+    Lox::Interpreter interpreter;
+    Lox::Profiler profiler(*options.profile);
+    interpreter.set_profiler(&profiler);
+    interpret(interpreter, program, source, memory ? &*memory : nullptr);
+    interpreter.set_profiler(nullptr);
+    report_profile(profiler, source);
+    result = interpreter.result();
+  } else if (expression_only && !memory && !prelude &&
+             options.write_snapshot_path == nullptr) {
+    // The forked interpreters would not be accounted, and run without
+    // globals
+    Lox::ParallelEvaluator evaluator(std::thread::hardware_concurrency());
+    evaluator.interpret(program.result.get());
+    result = evaluator.result();
+  } else {
+    Lox::Interpreter interpreter;
+    interpret(interpreter, program, source, memory ? &*memory : nullptr);
+    result = interpreter.result();
+  }
+  Lox::stdout_sink().flush();
 
-  if (!Lox::runtime_error_msgs.empty()) {
-    return;
+  if (!Lox::runtime_errors.empty()) {
+    return Lox::dump_errors(Lox::runtime_errors, Lox::SourceMap(source),
+                            prelude ? &*prelude : nullptr);
   }
 
-  std::cout << interpreter.result() << '\n';
+  if (program.result) {
+    std::cout << result << '\n';
+  }
+  return {};
 }
 
 static void run_file(char const *pathname) {
   auto const bytes = Lox::read_file(pathname);
-  run(bytes);
-  auto error_msg = Lox::dump_error_msgs(Lox::syntax_error_msgs);
-  if (!error_msg.empty()) {
-    throw Lox::Exception(std::move(error_msg));
-  }
-  error_msg = Lox::dump_error_msgs(Lox::runtime_error_msgs);
+  auto error_msg = run(bytes);
   if (!error_msg.empty()) {
     throw Lox::Exception(std::move(error_msg));
   }
@@ -59,25 +268,113 @@ static void run_prompt() {
     if (!std::getline(std::cin, line_str)) {
       break;
     }
-    run(line_str);
-    auto error_msg = Lox::dump_error_msgs(Lox::syntax_error_msgs);
+    auto const error_msg = run(line_str);
     if (!error_msg.empty()) {
       std::cerr << error_msg << std::endl;
     }
-    error_msg = Lox::dump_error_msgs(Lox::runtime_error_msgs);
-    if (!error_msg.empty()) {
-      std::cerr << error_msg << std::endl;
+  }
+}
+
+/**
+ * @brief Parse all of `digits` into `number`, return `false` if they are not
+ *        a number.
+ */
+template <typename T>
+static bool parse_number(std::string_view digits, T &number) {
+  auto const [end, ec] =
+      std::from_chars(digits.data(), digits.data() + digits.size(), number);
+  return ec == std::errc() && end == digits.data() + digits.size() &&
+         !digits.empty();
+}
+
+/**
+ * @brief Fill `options` from the command line, return `false` if it is
+ *        invalid.
+ */
+static bool parse_options(int argc, char *argv[]) {
+  constexpr std::string_view collapsed = "--profile-collapsed=";
+  constexpr std::string_view max_depth = "--max-call-depth=";
+  constexpr std::string_view max_memory = "--max-memory=";
+  constexpr std::string_view max_steps = "--max-steps=";
+  constexpr std::string_view timeout = "--timeout=";
+  constexpr std::string_view snapshot = "--snapshot=";
+  constexpr std::string_view write_snapshot = "--write-snapshot=";
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg = argv[i];
+    if (arg == "--profile") {
+      options.profile = Lox::Profiler::Mode::EXACT;
+    } else if (arg == "--profile=sample") {
+      options.profile = Lox::Profiler::Mode::SAMPLING;
+    } else if (arg == "--backend=closure") {
+      options.closure_backend = true;
+    } else if (arg == "--backend=tree") {
+      options.closure_backend = false;
+    } else if (arg == "--hash-cons") {
+      options.hash_cons = true;
+    } else if (arg == "--no-optimize") {
+      options.optimize = false;
+    } else if (arg.starts_with(collapsed) && arg.size() > collapsed.size()) {
+      options.profile_collapsed_path = argv[i] + collapsed.size();
+    } else if (arg.starts_with(max_depth)) {
+      if (!parse_number(arg.substr(max_depth.size()), options.max_call_depth)) {
+        return false;
+      }
+    } else if (arg.starts_with(max_memory)) {
+      if (!parse_number(arg.substr(max_memory.size()), options.max_memory)) {
+        return false;
+      }
+    } else if (arg.starts_with(max_steps)) {
+      if (!parse_number(arg.substr(max_steps.size()), options.max_steps)) {
+        return false;
+      }
+    } else if (arg.starts_with(timeout)) {
+      if (!parse_number(arg.substr(timeout.size()),
+                        options.timeout_ms.emplace())) {
+        return false;
+      }
+    } else if (arg.starts_with(snapshot) && arg.size() > snapshot.size()) {
+      options.snapshot_path = argv[i] + snapshot.size();
+    } else if (arg.starts_with(write_snapshot) &&
+               arg.size() > write_snapshot.size()) {
+      options.write_snapshot_path = argv[i] + write_snapshot.size();
+    } else if (arg == "--memory-stats") {
+      options.memory_stats = true;
+    } else if (!arg.starts_with("--") && options.script == nullptr) {
+      options.script = argv[i];
+    } else {
+      return false;
     }
   }
+  if (options.profile_collapsed_path != nullptr && !options.profile) {
+    options.profile = Lox::Profiler::Mode::EXACT;
+  }
+  // The profiler hooks into the tree-walking interpreter only, and a
+  // snapshot only holds the functions of its own prelude
+  return !(options.profile && options.closure_backend) &&
+         !(options.snapshot_path != nullptr &&
+           options.write_snapshot_path != nullptr);
 }
 
 int main(int argc, char *argv[]) {
+  // Only the tokens and the AST go through `std::cout`, never through stdio
+  std::ios::sync_with_stdio(false);
   try {
-    if (argc > 2) {
-      std::cout << "Usage: " << argv[0] << " [*.lox]" << std::endl;
+    if (!parse_options(argc, argv)) {
+      std::cout << "Usage: " << argv[0]
+                << " [--backend=tree|closure] [--hash-cons] [--no-optimize]"
+                   " [--profile[=sample]] [--profile-collapsed=<path>]"
+                   " [--max-call-depth=<n>] [--max-memory=<bytes>]"
+                   " [--memory-stats] [--max-steps=<n>] [--timeout=<ms>]"
+                   " [--snapshot=<path>] [--write-snapshot=<path>]"
+                   " [*.lox]"
+                << std::endl;
       return 1;
-    } else if (argc == 2) {
-      run_file(argv[1]);
+    }
+    if (options.snapshot_path != nullptr) {
+      prelude.emplace(options.snapshot_path);
+    }
+    if (options.script != nullptr) {
+      run_file(options.script);
     } else {
       run_prompt();
     }
@@ -0,0 +1,39 @@
+#include "memory_account.h"
+
+namespace Lox {
+
+void MemoryAccount::charge(std::size_t bytes) {
+  std::size_t used = m_used.load(std::memory_order_relaxed);
+  do {
+    std::size_t const limit = m_limit.load(std::memory_order_relaxed);
+    if (used > limit || bytes > limit - used) {
+      throw MemoryLimitError();
+    }
+  } while (!m_used.compare_exchange_weak(used, used + bytes,
+                                         std::memory_order_relaxed));
+
+  std::size_t peak = m_peak.load(std::memory_order_relaxed);
+  while (used + bytes > peak &&
+         !m_peak.compare_exchange_weak(peak, used + bytes,
+                                       std::memory_order_relaxed)) {
+    // `peak` was reloaded, try again
+  }
+}
+
+void *MemoryAccount::do_allocate(std::size_t bytes, std::size_t alignment) {
+  charge(bytes);
+  try {
+    return m_upstream->allocate(bytes, alignment);
+  } catch (...) {
+    release(bytes);
+    throw;
+  }
+}
+
+void MemoryAccount::do_deallocate(void *pointer, std::size_t bytes,
+                                  std::size_t alignment) {
+  m_upstream->deallocate(pointer, bytes, alignment);
+  release(bytes);
+}
+
+} // namespace Lox
@@ -0,0 +1,33 @@
+#include "native.h"
+#include "error.h"
+
+#include <chrono>
+
+namespace Lox {
+
+void Deferred::settle(Expected<Value, ErrorCode> outcome) const {
+  THROW_ASSERT(!settled(), "A deferred result is settled once.");
+  m_state->outcome.emplace(std::move(outcome));
+  // The waiter may run to the end of its evaluation, and destroy it
+  if (auto const waiter = std::exchange(m_state->waiter, nullptr)) {
+    waiter.resume();
+  }
+}
+
+NativeRegistry::NativeRegistry() {
+  define("clock", [] {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  });
+  define("len", [](Container const &container) {
+    return static_cast<double>(container.size());
+  });
+  define("has", [](LoxMap const &map, Value const &key) {
+    return map.find(key) != nullptr;
+  });
+  define("remove",
+         [](LoxMap &map, Value const &key) { return map.erase(key); });
+}
+
+} // namespace Lox
@@ -0,0 +1,30 @@
+#include "number.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+
+namespace Lox {
+
+double parse_number(char const *first, char const *last) noexcept {
+  double number = 0;
+  auto const [end, ec] = std::from_chars(first, last, number);
+  if (ec == std::errc::result_out_of_range) {
+    // A literal has no sign nor exponent: it overflows if it has a non-zero
+    // digit before the point, and underflows otherwise.
+    char const *point = std::find(first, last, '.');
+    bool const integral = std::any_of(first, point, [](char digit) {
+      return digit != '0';
+    });
+    return integral ? HUGE_VAL : 0.0;
+  }
+  return number;
+}
+
+std::string_view format_number(double number, NumberBuffer &buffer) noexcept {
+  auto const [end, ec] =
+      std::to_chars(buffer.data(), buffer.data() + buffer.size(), number);
+  return {buffer.data(), static_cast<std::size_t>(end - buffer.data())};
+}
+
+} // namespace Lox
@@ -0,0 +1,313 @@
+#include "object.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <span>
+
+namespace Lox {
+
+int64_t Shape::lookup(std::string_view name) const noexcept {
+  for (auto const *shape = this; shape->m_parent != nullptr;
+       shape = shape->m_parent) {
+    if (shape->m_name == name) {
+      return shape->m_size - 1;
+    }
+  }
+  return -1;
+}
+
+Shape const *Shape::transition(std::string_view name) const {
+  auto it = m_transitions.find(name);
+  if (it == m_transitions.end()) {
+    it = m_transitions
+             .emplace(std::string(name), std::make_unique<Shape>(*this, name))
+             .first;
+  }
+  return it->second.get();
+}
+
+void LoxFunction::print(std::ostream &out) const {
+  out << "<fn " << m_declaration.m_name.lexeme() << '>';
+}
+
+LoxFunction const *LoxClass::find_method(std::string_view name) const {
+  for (auto const *klass = this; klass != nullptr;
+       klass = klass->m_superclass.get()) {
+    if (auto it = klass->m_methods.find(name); it != klass->m_methods.end()) {
+      return it->second.get();
+    }
+  }
+  return nullptr;
+}
+
+void LoxClass::add_method(Function const &declaration, Captures captures) {
+  auto const name = declaration.m_name.lexeme();
+  auto const allocator = captures.get_allocator();
+  m_methods[std::string(name)] = std::allocate_shared<LoxFunction>(
+      allocator, declaration, this, name == "init", std::move(captures));
+}
+
+void LoxClass::print(std::ostream &out) const { out << m_name; }
+
+namespace {
+
+/**
+ * @brief Release the objects referred to by `values`, from the destructor of
+ *        the object holding them, without recursing into the destructors of
+ *        the objects they hold in turn.
+ */
+void release(std::span<Value> values) noexcept {
+  // The objects whose last reference was in an instance, an array or a map
+  // being destroyed, drained by the outermost destructor only
+  thread_local std::vector<ObjectPtr> pending;
+  thread_local bool draining = false;
+
+  for (auto &value : values) {
+    if (value.is_object() && value.object().use_count() == 1) {
+      pending.push_back(value.object());
+      value = nullptr;
+    }
+  }
+  if (draining) {
+    return;
+  }
+  draining = true;
+  while (!pending.empty()) {
+    // May push the fields of the object being destroyed
+    ObjectPtr const object = std::move(pending.back());
+    pending.pop_back();
+  }
+  draining = false;
+}
+
+} // namespace
+
+LoxInstance::~LoxInstance() noexcept { release(m_fields); }
+
+void LoxInstance::print(std::ostream &out) const {
+  out << m_class->name() << " instance";
+}
+
+LoxArray::~LoxArray() noexcept { release(m_values); }
+
+void LoxArray::set(std::size_t index, Value value) {
+  if (!m_boxed && !value.is_number()) {
+    box();
+  }
+  if (m_boxed) {
+    if (index == m_values.size()) {
+      m_values.push_back(std::move(value));
+    } else {
+      m_values[index] = std::move(value);
+    }
+  } else if (index == m_numbers.size()) {
+    m_numbers.push_back(value.unchecked_number());
+  } else {
+    m_numbers[index] = value.unchecked_number();
+  }
+}
+
+void LoxArray::box() {
+  m_values.reserve(m_numbers.size() + 1);
+  m_values.assign(m_numbers.begin(), m_numbers.end());
+  m_numbers.clear();
+  m_numbers.shrink_to_fit();
+  m_boxed = true;
+}
+
+namespace {
+
+/**
+ * Marks an array or a map as being printed, for the time it is in scope,
+ * so that one containing itself prints once. Deeper nesting prints the
+ * same, rather than overflowing the stack.
+ */
+class Printing {
+public:
+  explicit Printing(Object const *container) {
+    constexpr std::size_t kMaxDepth = 256;
+    m_entered =
+        s_printing.size() < kMaxDepth &&
+        std::find(s_printing.begin(), s_printing.end(), container) ==
+            s_printing.end();
+    if (m_entered) {
+      s_printing.push_back(container);
+    }
+  }
+
+  Printing(Printing const &) = delete;
+
+  Printing &operator=(Printing const &) = delete;
+
+  ~Printing() noexcept {
+    if (m_entered) {
+      s_printing.pop_back();
+    }
+  }
+
+  /**
+   * @brief Whether the container is printed, rather than elided.
+   */
+  [[nodiscard]] bool entered() const noexcept { return m_entered; }
+
+private:
+  static thread_local std::vector<Object const *> s_printing;
+  bool m_entered;
+};
+
+thread_local std::vector<Object const *> Printing::s_printing;
+
+} // namespace
+
+void LoxArray::print(std::ostream &out) const {
+  Printing const printing(this);
+  if (!printing.entered()) {
+    out << "[...]";
+    return;
+  }
+  out << '[';
+  for (std::size_t i = 0; i < size(); ++i) {
+    out << (i == 0 ? "" : ", ") << get(i);
+  }
+  out << ']';
+}
+
+LoxMap::~LoxMap() noexcept { release(m_entries); }
+
+Value const *LoxMap::find(Value const &key, std::size_t hash) const {
+  if (m_hashes.empty()) {
+    return nullptr;
+  }
+  int64_t const slot = lookup(key, static_cast<uint32_t>(hash));
+  return slot < 0 ? nullptr : &m_entries[2 * m_slots[slot].entry + 1];
+}
+
+void LoxMap::set(Value key, std::size_t full_hash, Value value) {
+  auto const hash = static_cast<uint32_t>(full_hash);
+  if (!m_hashes.empty()) {
+    if (int64_t const slot = lookup(key, hash); slot >= 0) {
+      m_entries[2 * m_slots[slot].entry + 1] = std::move(value);
+      return;
+    }
+  }
+  // Everything is allocated before anything changes, so that running out
+  // of memory leaves the map as it was
+  std::size_t const size = m_hashes.size();
+  // At most 7/8 of the slots are taken, which keeps probes short
+  if (8 * (size + 1) > 7 * m_slots.size()) {
+    grow();
+  }
+  if (size == m_hashes.capacity()) {
+    std::size_t const capacity = std::max<std::size_t>(4, 2 * size);
+    m_hashes.reserve(capacity);
+    m_entries.reserve(2 * capacity);
+  }
+  if (key.is_number()) {
+    double const number = key.unchecked_number();
+    if (number == 0) {
+      key = 0.0;
+    } else if (std::isnan(number)) {
+      key = std::numeric_limits<double>::quiet_NaN();
+    }
+  }
+  m_hashes.push_back(hash);
+  m_entries.push_back(std::move(key));
+  m_entries.push_back(std::move(value));
+  place({hash, 1, static_cast<uint32_t>(size)});
+}
+
+bool LoxMap::erase(Value const &key) {
+  if (m_hashes.empty()) {
+    return false;
+  }
+  int64_t const found = lookup(key, static_cast<uint32_t>(hash_key(key)));
+  if (found < 0) {
+    return false;
+  }
+  uint32_t const entry = m_slots[found].entry;
+  // Shift back the slots after it, up to one in its own place or a free
+  // one, which leaves no tombstone
+  std::size_t const mask = m_slots.size() - 1;
+  auto slot = static_cast<std::size_t>(found);
+  for (std::size_t next = (slot + 1) & mask; m_slots[next].probe > 1;
+       slot = next, next = (next + 1) & mask) {
+    m_slots[slot] = m_slots[next];
+    --m_slots[slot].probe;
+  }
+  m_slots[slot].probe = 0;
+
+  // The last entry fills the hole
+  auto const last = static_cast<uint32_t>(m_hashes.size() - 1);
+  Value const erased = std::move(m_entries[2 * entry + 1]);
+  if (entry != last) {
+    slot = m_hashes[last] & mask;
+    while (m_slots[slot].entry != last || m_slots[slot].probe == 0) {
+      slot = (slot + 1) & mask;
+    }
+    m_slots[slot].entry = entry;
+    m_hashes[entry] = m_hashes[last];
+    m_entries[2 * entry] = std::move(m_entries[2 * last]);
+    m_entries[2 * entry + 1] = std::move(m_entries[2 * last + 1]);
+  }
+  m_hashes.pop_back();
+  m_entries.pop_back();
+  m_entries.pop_back();
+  return true;
+}
+
+int64_t LoxMap::lookup(Value const &key, uint32_t hash) const {
+  std::size_t const mask = m_slots.size() - 1;
+  std::size_t slot = hash & mask;
+  // An entry further from its place than the key would be from its own
+  // would have been displaced by it
+  for (uint32_t probe = 1; m_slots[slot].probe >= probe; ++probe) {
+    if (m_slots[slot].hash == hash &&
+        same_key(m_entries[2 * m_slots[slot].entry], key)) {
+      return static_cast<int64_t>(slot);
+    }
+    slot = (slot + 1) & mask;
+  }
+  return -1;
+}
+
+void LoxMap::place(Slot carried) noexcept {
+  std::size_t const mask = m_slots.size() - 1;
+  std::size_t slot = carried.hash & mask;
+  while (m_slots[slot].probe != 0) {
+    // Robin Hood: the entry closer to its place moves on instead
+    if (m_slots[slot].probe < carried.probe) {
+      std::swap(m_slots[slot], carried);
+    }
+    slot = (slot + 1) & mask;
+    ++carried.probe;
+  }
+  m_slots[slot] = carried;
+}
+
+void LoxMap::grow() {
+  constexpr std::size_t kMinSlots = 8;
+  std::pmr::vector<Slot> slots(std::max(kMinSlots, 2 * m_slots.size()),
+                               Slot{0, 0, 0}, m_slots.get_allocator());
+  m_slots.swap(slots);
+  for (uint32_t entry = 0; entry < m_hashes.size(); ++entry) {
+    place({m_hashes[entry], 1, entry});
+  }
+}
+
+void LoxMap::print(std::ostream &out) const {
+  Printing const printing(this);
+  if (!printing.entered()) {
+    out << "{...}";
+    return;
+  }
+  out << '{';
+  char const *separator = "";
+  for_each([&](Value const &key, Value const &value) {
+    out << separator << key << ": " << value;
+    separator = ", ";
+  });
+  out << '}';
+}
+
+} // namespace Lox
@@ -0,0 +1,762 @@
+#include "optimizer.h"
+
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Lox {
+
+namespace {
+
+constexpr uint64_t kLocalKey = uint64_t{1} << 32;
+
+/**
+ * @brief The key of a local of the current frame or of a global, or nothing
+ *        for a captured variable.
+ */
+std::optional<uint64_t> key_of(VariableSlot slot) {
+  switch (slot.kind) {
+  case VariableSlot::Kind::LOCAL:
+    return kLocalKey | slot.index;
+  case VariableSlot::Kind::GLOBAL:
+    return slot.index;
+  default:
+    return std::nullopt;
+  }
+}
+
+/**
+ * Collect the variables some code writes, and whether it calls a function,
+ * which may write any global. Nested functions are only entered if `nested`
+ * is set, their locals are then mixed with the others.
+ */
+class WriteCollector final : public AstNodeVisitor {
+public:
+  explicit WriteCollector(bool nested) : m_nested(nested) {}
+
+  void collect(Expr *expr) {
+    if (expr != nullptr) {
+      dispatch(*expr, *this);
+    }
+  }
+
+  void collect(StmtList &stmts) {
+    for (auto &stmt : stmts) {
+      dispatch(*stmt, *this);
+    }
+  }
+
+  void visit(Literal &) override {}
+
+  void visit(Binary &node) override {
+    collect(node.m_left.get());
+    collect(node.m_right.get());
+  }
+
+  void visit(Unary &node) override { collect(node.m_right.get()); }
+
+  void visit(Grouping &node) override { collect(node.m_expr.get()); }
+
+  void visit(Logical &node) override {
+    collect(node.m_left.get());
+    collect(node.m_right.get());
+  }
+
+  void visit(Constant &) override {}
+
+  void visit(Hoisted &node) override { collect(node.m_expr.get()); }
+
+  // Shared subexpressions are only made of literals and operators
+  void visit(Shared &) override {}
+
+  void visit(Variable &) override {}
+
+  void visit(Assign &node) override {
+    collect(node.m_value.get());
+    write(node.m_slot);
+  }
+
+  void visit(Call &node) override {
+    collect(node.m_callee.get());
+    for (auto &argument : node.m_arguments) {
+      collect(argument.get());
+    }
+    // A native only sees its arguments
+    calls |= node.m_native < 0;
+  }
+
+  void visit(Get &node) override { collect(node.m_object.get()); }
+
+  void visit(Set &node) override {
+    collect(node.m_object.get());
+    collect(node.m_value.get());
+  }
+
+  void visit(Invoke &node) override {
+    collect(node.m_object.get());
+    for (auto &argument : node.m_arguments) {
+      collect(argument.get());
+    }
+    calls = true;
+  }
+
+  void visit(Array &node) override {
+    for (auto &element : node.m_elements) {
+      collect(element.get());
+    }
+  }
+
+  void visit(Map &node) override {
+    for (std::size_t i = 0; i < node.m_keys.size(); ++i) {
+      collect(node.m_keys[i].get());
+      collect(node.m_values[i].get());
+    }
+  }
+
+  void visit(Index &node) override {
+    collect(node.m_object.get());
+    collect(node.m_index.get());
+  }
+
+  void visit(SetIndex &node) override {
+    collect(node.m_object.get());
+    collect(node.m_index.get());
+    collect(node.m_value.get());
+  }
+
+  void visit(This &) override {}
+
+  void visit(Super &) override {}
+
+  void visit(Expression &node) override { collect(node.m_expr.get()); }
+
+  void visit(Print &node) override { collect(node.m_expr.get()); }
+
+  void visit(Var &node) override {
+    collect(node.m_initializer.get());
+    write(node.m_slot);
+    if (node.m_slot.kind == VariableSlot::Kind::GLOBAL) {
+      var_globals.insert(node.m_slot.index);
+    }
+  }
+
+  void visit(Block &node) override { collect(node.m_statements); }
+
+  void visit(If &node) override {
+    collect(node.m_condition.get());
+    dispatch(*node.m_then_branch, *this);
+    if (node.m_else_branch) {
+      dispatch(*node.m_else_branch, *this);
+    }
+  }
+
+  void visit(While &node) override {
+    collect(node.m_condition.get());
+    dispatch(*node.m_body, *this);
+  }
+
+  void visit(Function &node) override {
+    write(node.m_slot);
+    if (m_nested) {
+      collect(node.m_body);
+    }
+  }
+
+  void visit(Class &node) override {
+    write(node.m_slot);
+    if (m_nested) {
+      for (auto &method : node.m_methods) {
+        collect(method->m_body);
+      }
+    }
+  }
+
+  void visit(Return &node) override { collect(node.m_value.get()); }
+
+  /**
+   * The number of writes of every variable, by key.
+   */
+  std::unordered_map<uint64_t, uint32_t> writes;
+  /**
+   * The globals declared by a `var`.
+   */
+  std::unordered_set<uint32_t> var_globals;
+  bool calls = false;
+
+private:
+  void write(VariableSlot slot) {
+    if (auto const key = key_of(slot)) {
+      ++writes[*key];
+    }
+  }
+
+  bool m_nested;
+};
+
+/**
+ * Hoist the invariant subexpressions of every loop into `Hoisted` nodes,
+ * whose slots are added to the frame of their function. Loops are handled
+ * from the outermost one, so that a subexpression is hoisted out of all the
+ * loops it is invariant in.
+ */
+class LoopHoister final : public AstNodeVisitor {
+public:
+  explicit LoopHoister(uint32_t &frame_size) : m_frame_size(&frame_size) {}
+
+  void hoist(StmtList &stmts) {
+    for (auto &stmt : stmts) {
+      dispatch(*stmt, *this);
+    }
+  }
+
+  void visit(Literal &) override { m_invariant = true; }
+
+  void visit(Binary &node) override {
+    bool const left = rewrite(node.m_left);
+    bool const right = rewrite(node.m_right);
+    m_invariant = left && right;
+    if (!m_invariant) {
+      hoist_if(left, node.m_left);
+      hoist_if(right, node.m_right);
+    }
+  }
+
+  void visit(Unary &node) override { m_invariant = rewrite(node.m_right); }
+
+  void visit(Grouping &node) override { m_invariant = rewrite(node.m_expr); }
+
+  void visit(Logical &node) override {
+    // The value of an `and` or an `or` may be nil, which means not yet
+    // evaluated to `Hoisted`: only its operands are hoisted
+    hoist_root(node.m_left);
+    hoist_root(node.m_right);
+    m_invariant = false;
+  }
+
+  void visit(Constant &) override { m_invariant = true; }
+
+  // Hoisted out of an enclosing loop, whose slot this loop never writes
+  void visit(Hoisted &) override { m_invariant = true; }
+
+  void visit(Shared &) override { m_invariant = true; }
+
+  void visit(Variable &node) override {
+    auto const key = key_of(node.m_slot);
+    m_invariant =
+        key && !m_writes->contains(*key) &&
+        (node.m_slot.kind == VariableSlot::Kind::LOCAL || !m_loop_calls);
+  }
+
+  void visit(Assign &node) override {
+    hoist_root(node.m_value);
+    m_invariant = false;
+  }
+
+  void visit(Call &node) override {
+    hoist_root(node.m_callee);
+    hoist_all(node.m_arguments);
+    m_invariant = false;
+  }
+
+  void visit(Get &node) override {
+    hoist_root(node.m_object);
+    m_invariant = false;
+  }
+
+  void visit(Set &node) override {
+    hoist_root(node.m_object);
+    hoist_root(node.m_value);
+    m_invariant = false;
+  }
+
+  void visit(Invoke &node) override {
+    hoist_root(node.m_object);
+    hoist_all(node.m_arguments);
+    m_invariant = false;
+  }
+
+  // Each evaluation builds a new array
+  void visit(Array &node) override {
+    hoist_all(node.m_elements);
+    m_invariant = false;
+  }
+
+  // Each evaluation builds a new map
+  void visit(Map &node) override {
+    hoist_all(node.m_keys);
+    hoist_all(node.m_values);
+    m_invariant = false;
+  }
+
+  void visit(Index &node) override {
+    hoist_root(node.m_object);
+    hoist_root(node.m_index);
+    m_invariant = false;
+  }
+
+  void visit(SetIndex &node) override {
+    hoist_root(node.m_object);
+    hoist_root(node.m_index);
+    hoist_root(node.m_value);
+    m_invariant = false;
+  }
+
+  void visit(This &) override { m_invariant = false; }
+
+  void visit(Super &) override { m_invariant = false; }
+
+  void visit(Expression &node) override { hoist_root(node.m_expr); }
+
+  void visit(Print &node) override { hoist_root(node.m_expr); }
+
+  void visit(Var &node) override {
+    if (node.m_initializer) {
+      hoist_root(node.m_initializer);
+    }
+  }
+
+  void visit(Block &node) override { hoist(node.m_statements); }
+
+  void visit(If &node) override {
+    hoist_root(node.m_condition);
+    dispatch(*node.m_then_branch, *this);
+    if (node.m_else_branch) {
+      dispatch(*node.m_else_branch, *this);
+    }
+  }
+
+  void visit(While &node) override {
+    if (m_loop != nullptr) {
+      // Part of the body of the loop being hoisted from
+      if (node.m_condition) {
+        hoist_root(node.m_condition);
+      }
+      dispatch(*node.m_body, *this);
+      return;
+    }
+
+    WriteCollector collector(false);
+    collector.collect(node.m_condition.get());
+    dispatch(*node.m_body, collector);
+    m_writes = &collector.writes;
+    m_loop_calls = collector.calls;
+    m_loop = &node;
+    if (node.m_condition) {
+      hoist_root(node.m_condition);
+    }
+    dispatch(*node.m_body, *this);
+
+    // Then out of the loops and functions it encloses
+    m_writes = nullptr;
+    m_loop = nullptr;
+    dispatch(*node.m_body, *this);
+  }
+
+  void visit(Function &node) override {
+    if (m_loop != nullptr) {
+      // Entered once the loop is done
+      return;
+    }
+    // A function runs on its own frame
+    uint32_t *const frame_size = m_frame_size;
+    m_frame_size = &node.m_frame_size;
+    hoist(node.m_body);
+    m_frame_size = frame_size;
+  }
+
+  void visit(Class &node) override {
+    for (auto &method : node.m_methods) {
+      dispatch(*method, *this);
+    }
+  }
+
+  void visit(Return &node) override {
+    if (node.m_value) {
+      hoist_root(node.m_value);
+    }
+  }
+
+private:
+  /**
+   * @brief Hoist the invariant subexpressions of `expr`, and return whether
+   *        it is invariant itself. Outside of loops, nothing is.
+   */
+  bool rewrite(ExprPtr &expr) {
+    if (m_loop == nullptr) {
+      m_invariant = false;
+      return false;
+    }
+    dispatch(*expr, *this);
+    return m_invariant;
+  }
+
+  void hoist_root(ExprPtr &expr) { hoist_if(rewrite(expr), expr); }
+
+  void hoist_all(ExprList &exprs) {
+    for (auto &expr : exprs) {
+      hoist_root(expr);
+    }
+  }
+
+  /**
+   * @brief Hoist `expr` if it is `invariant` and worth it: an operator,
+   *        whose value is never nil.
+   */
+  void hoist_if(bool invariant, ExprPtr &expr) {
+    if (!invariant || (expr->kind() != ExprKind::BINARY &&
+                       expr->kind() != ExprKind::UNARY)) {
+      return;
+    }
+    auto hoisted = std::make_unique<Hoisted>(std::move(expr));
+    hoisted->m_slot = (*m_frame_size)++;
+    m_loop->m_hoisted.push_back(hoisted->m_slot);
+    expr = std::move(hoisted);
+  }
+
+private:
+  uint32_t *m_frame_size;
+  /**
+   * The loop being hoisted from, and what it writes, or `nullptr` while
+   * looking for loops.
+   */
+  While *m_loop = nullptr;
+  std::unordered_map<uint64_t, uint32_t> const *m_writes = nullptr;
+  bool m_loop_calls = false;
+  bool m_invariant = false;
+};
+
+} // namespace
+
+void Optimizer::optimize(Program &program) {
+  WriteCollector collector(true);
+  collector.collect(program.statements);
+  collector.collect(program.result.get());
+  for (uint32_t const global : collector.var_globals) {
+    // The functions of a prelude may write its globals, unseen
+    if (global >= program.prelude_count && collector.writes[global] == 1) {
+      m_final_globals.insert(global);
+    }
+  }
+
+  optimize(program.statements);
+  if (program.result) {
+    optimize(program.result);
+  }
+  m_known.clear();
+  m_final_globals.clear();
+
+  LoopHoister(program.frame_size).hoist(program.statements);
+}
+
+void Optimizer::optimize(ExprPtr &expr) {
+  dispatch(*expr, *this);
+  if (m_replacement) {
+    expr = std::move(m_replacement);
+  }
+}
+
+void Optimizer::optimize(StmtList &stmts) {
+  std::size_t live = 0;
+  for (auto &stmt : stmts) {
+    dispatch(*stmt, *this);
+    if (m_stmt_replacement) {
+      stmt = std::move(m_stmt_replacement);
+    }
+    if (m_dead) {
+      m_dead = false;
+      continue;
+    }
+    stmts[live++] = std::move(stmt);
+    if (stmts[live - 1]->kind() == StmtKind::RETURN) {
+      // Nothing after a `return` runs
+      break;
+    }
+  }
+  stmts.resize(live);
+}
+
+void Optimizer::optimize_branch(StmtPtr &stmt) {
+  dispatch(*stmt, *this);
+  if (m_stmt_replacement) {
+    stmt = std::move(m_stmt_replacement);
+  }
+  if (m_dead) {
+    m_dead = false;
+    stmt = std::make_unique<Block>(StmtList{});
+  }
+}
+
+void Optimizer::optimize_function(Function &function) {
+  Known known = std::move(m_known);
+  m_known.clear();
+  for (auto const &[key, value] : known) {
+    if ((key & kLocalKey) == 0) {
+      m_known.emplace(key, value);
+    }
+  }
+  optimize(function.m_body);
+  m_known = std::move(known);
+}
+
+std::optional<Value> Optimizer::constant_value(Expr &expr) {
+  if (expr.kind() == ExprKind::CONSTANT) {
+    return static_cast<Constant &>(expr).m_value;
+  }
+  if (expr.kind() == ExprKind::LITERAL) {
+    auto value = m_folder.try_interpret(&expr);
+    if (value) {
+      return std::move(value).value();
+    }
+  }
+  return std::nullopt;
+}
+
+void Optimizer::intersect(Known const &other) {
+  std::erase_if(m_known, [&other](auto const &entry) {
+    auto const it = other.find(entry.first);
+    return it == other.end() || it->second != entry.second;
+  });
+}
+
+void Optimizer::store(VariableSlot slot, Expr *value, bool declared) {
+  bool const tracked = slot.kind == VariableSlot::Kind::LOCAL ||
+                       (slot.kind == VariableSlot::Kind::GLOBAL && declared &&
+                        m_final_globals.contains(slot.index));
+  if (!tracked) {
+    forget(slot);
+    return;
+  }
+  // A declaration without initializer stores nil
+  auto constant = value != nullptr ? constant_value(*value) : Value(nullptr);
+  if (!constant) {
+    forget(slot);
+    return;
+  }
+  m_known[*key_of(slot)] = std::move(*constant);
+}
+
+void Optimizer::forget(VariableSlot slot) {
+  if (auto const key = key_of(slot)) {
+    m_known.erase(*key);
+  }
+}
+
+void Optimizer::visit(Literal &) {}
+
+void Optimizer::visit(Binary &expr) {
+  optimize(expr.m_left);
+  optimize(expr.m_right);
+  auto left = constant_value(*expr.m_left);
+  auto right = constant_value(*expr.m_right);
+  if (!left || !right) {
+    return;
+  }
+  // An error is left for the run time
+  if (auto value = m_folder.apply(expr, std::move(*left), std::move(*right))) {
+    auto constant = std::make_unique<Constant>(expr.m_op);
+    constant->m_value = std::move(value).value();
+    m_replacement = std::move(constant);
+  }
+}
+
+void Optimizer::visit(Unary &expr) {
+  optimize(expr.m_right);
+  auto operand = constant_value(*expr.m_right);
+  if (!operand) {
+    return;
+  }
+  if (auto value = m_folder.apply(expr, std::move(*operand))) {
+    auto constant = std::make_unique<Constant>(expr.m_op);
+    constant->m_value = std::move(value).value();
+    m_replacement = std::move(constant);
+  }
+}
+
+void Optimizer::visit(Grouping &expr) {
+  // Parentheses only shape the tree
+  optimize(expr.m_expr);
+  m_replacement = std::move(expr.m_expr);
+}
+
+void Optimizer::visit(Logical &expr) {
+  optimize(expr.m_left);
+  if (auto const left = constant_value(*expr.m_left)) {
+    bool const is_or = expr.m_op.type() == TokenType::OR;
+    if (left->is_truthy() == is_or) {
+      m_replacement = std::move(expr.m_left);
+    } else {
+      optimize(expr.m_right);
+      m_replacement = std::move(expr.m_right);
+    }
+    return;
+  }
+  // The right operand may not run
+  Known const known = m_known;
+  optimize(expr.m_right);
+  intersect(known);
+}
+
+void Optimizer::visit(Constant &) {}
+
+void Optimizer::visit(Hoisted &) {}
+
+// The canonical node of a shared subexpression is referred to by all its
+// occurrences, it must stay in place
+void Optimizer::visit(Shared &) {}
+
+void Optimizer::visit(Variable &expr) {
+  auto const key = key_of(expr.m_slot);
+  if (!key) {
+    return;
+  }
+  if (auto const it = m_known.find(*key); it != m_known.end()) {
+    auto constant = std::make_unique<Constant>(expr.m_name);
+    constant->m_value = it->second;
+    m_replacement = std::move(constant);
+  }
+}
+
+void Optimizer::visit(Assign &expr) {
+  optimize(expr.m_value);
+  store(expr.m_slot, expr.m_value.get(), false);
+}
+
+void Optimizer::visit(Call &expr) {
+  optimize(expr.m_callee);
+  for (auto &argument : expr.m_arguments) {
+    optimize(argument);
+  }
+}
+
+void Optimizer::visit(Get &expr) { optimize(expr.m_object); }
+
+void Optimizer::visit(Set &expr) {
+  optimize(expr.m_object);
+  optimize(expr.m_value);
+}
+
+void Optimizer::visit(Invoke &expr) {
+  optimize(expr.m_object);
+  for (auto &argument : expr.m_arguments) {
+    optimize(argument);
+  }
+}
+
+void Optimizer::visit(Array &expr) {
+  for (auto &element : expr.m_elements) {
+    optimize(element);
+  }
+}
+
+void Optimizer::visit(Map &expr) {
+  for (std::size_t i = 0; i < expr.m_keys.size(); ++i) {
+    optimize(expr.m_keys[i]);
+    optimize(expr.m_values[i]);
+  }
+}
+
+void Optimizer::visit(Index &expr) {
+  optimize(expr.m_object);
+  optimize(expr.m_index);
+}
+
+void Optimizer::visit(SetIndex &expr) {
+  optimize(expr.m_object);
+  optimize(expr.m_index);
+  optimize(expr.m_value);
+}
+
+void Optimizer::visit(This &) {}
+
+void Optimizer::visit(Super &) {}
+
+void Optimizer::visit(Expression &stmt) {
+  optimize(stmt.m_expr);
+  m_dead = constant_value(*stmt.m_expr).has_value();
+}
+
+void Optimizer::visit(Print &stmt) { optimize(stmt.m_expr); }
+
+void Optimizer::visit(Var &stmt) {
+  if (stmt.m_initializer) {
+    optimize(stmt.m_initializer);
+  }
+  store(stmt.m_slot, stmt.m_initializer.get(), true);
+}
+
+void Optimizer::visit(Block &stmt) {
+  optimize(stmt.m_statements);
+  m_dead = stmt.m_statements.empty();
+}
+
+void Optimizer::visit(If &stmt) {
+  optimize(stmt.m_condition);
+  if (auto const condition = constant_value(*stmt.m_condition)) {
+    StmtPtr &taken =
+        condition->is_truthy() ? stmt.m_then_branch : stmt.m_else_branch;
+    if (!taken) {
+      m_dead = true;
+      return;
+    }
+    dispatch(*taken, *this);
+    m_stmt_replacement = m_stmt_replacement ? std::move(m_stmt_replacement)
+                                            : std::move(taken);
+    return;
+  }
+
+  Known const known = m_known;
+  optimize_branch(stmt.m_then_branch);
+  if (stmt.m_else_branch) {
+    Known then_known = std::move(m_known);
+    m_known = known;
+    optimize_branch(stmt.m_else_branch);
+    intersect(then_known);
+  } else {
+    intersect(known);
+  }
+}
+
+void Optimizer::visit(While &stmt) {
+  // The condition and the body see the values of every iteration
+  WriteCollector collector(false);
+  collector.collect(stmt.m_condition.get());
+  dispatch(*stmt.m_body, collector);
+  std::erase_if(m_known, [&collector](auto const &entry) {
+    return collector.writes.contains(entry.first);
+  });
+
+  if (stmt.m_condition) {
+    optimize(stmt.m_condition);
+    if (auto const condition = constant_value(*stmt.m_condition)) {
+      if (!condition->is_truthy()) {
+        m_dead = true;
+        return;
+      }
+      stmt.m_condition = nullptr;
+    }
+  }
+
+  Known const known = m_known;
+  optimize_branch(stmt.m_body);
+  m_known = known;
+}
+
+void Optimizer::visit(Function &stmt) {
+  forget(stmt.m_slot);
+  optimize_function(stmt);
+}
+
+void Optimizer::visit(Class &stmt) {
+  // The superclass stays a `Variable`, which its errors refer to
+  forget(stmt.m_slot);
+  for (auto &method : stmt.m_methods) {
+    optimize_function(*method);
+  }
+}
+
+void Optimizer::visit(Return &stmt) {
+  if (stmt.m_value) {
+    optimize(stmt.m_value);
+  }
+}
+
+} // namespace Lox
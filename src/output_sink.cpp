@@ -0,0 +1,74 @@
+#include "output_sink.h"
+#include "error.h"
+#include "number.h"
+#include "object.h"
+
+#include <cerrno>
+#include <sstream>
+#include <unistd.h>
+
+namespace Lox {
+
+void OutputSink::print(Value const &value) {
+  if (value.is_number()) {
+    NumberBuffer buffer;
+    write(format_number(value.number(), buffer));
+  } else if (value.is_string()) {
+    write(value.str());
+  } else if (value.is_boolean()) {
+    write(value.boolean() ? "true" : "false");
+  } else if (value.is_nil()) {
+    write("nil");
+  } else {
+    // Objects print rarely, through their own `print()`
+    std::ostringstream out;
+    out << value;
+    write(out.view());
+  }
+  write("\n");
+}
+
+FdSink::~FdSink() noexcept {
+  try {
+    flush();
+  } catch (Exception const &) {
+    // Nowhere left to report it
+  }
+}
+
+void FdSink::write(std::string_view bytes) {
+  if (bytes.size() > m_capacity - m_size) {
+    flush();
+    if (bytes.size() >= m_capacity) {
+      write_all(bytes);
+      return;
+    }
+  }
+  bytes.copy(m_buffer.get() + m_size, bytes.size());
+  m_size += bytes.size();
+}
+
+void FdSink::flush() {
+  // The buffer is emptied even if writing fails, not to fail again
+  std::size_t const size = m_size;
+  m_size = 0;
+  write_all({m_buffer.get(), size});
+}
+
+void FdSink::write_all(std::string_view bytes) {
+  while (!bytes.empty()) {
+    ssize_t const written = ::write(m_fd, bytes.data(), bytes.size());
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_ERRNO(written, "write output");
+    bytes.remove_prefix(static_cast<std::size_t>(written));
+  }
+}
+
+OutputSink &stdout_sink() {
+  static FdSink sink(STDOUT_FILENO);
+  return sink;
+}
+
+} // namespace Lox
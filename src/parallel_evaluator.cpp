@@ -0,0 +1,264 @@
+#include "parallel_evaluator.h"
+#include "interpreter.h"
+#include "runtime_error.h"
+
+#include <algorithm>
+
+namespace Lox {
+
+namespace {
+
+/**
+ * Count the nodes of every subexpression, and collect the large ones.
+ */
+class SizeCounter final : public AstNodeVisitor {
+public:
+  explicit SizeCounter(std::unordered_set<Expr const *> &large)
+      : m_large(large) {}
+
+  uint64_t count(Expr &expr) {
+    dispatch(expr, *this);
+    if (m_size >= kParallelEvalMinNodes) {
+      m_large.insert(&expr);
+    }
+    return m_size;
+  }
+
+  void visit(Literal &) override { m_size = 1; }
+
+  void visit(Binary &node) override {
+    auto const left = count(*node.m_left);
+    m_size = 1 + left + count(*node.m_right);
+  }
+
+  void visit(Unary &node) override { m_size = 1 + count(*node.m_right); }
+
+  void visit(Grouping &node) override { m_size = 1 + count(*node.m_expr); }
+
+  void visit(Shared &node) override {
+    // A reference is evaluated once per `Interpreter`, count it as a leaf
+    m_size = node.m_owner ? 1 + count(*node.m_owner) : 1;
+  }
+
+  void visit(Constant &) override { m_size = 1; }
+
+  // Nodes with side effects, or evaluated lazily, are leaves: they are never
+  // split
+  void visit(Logical &) override { m_size = 1; }
+
+  void visit(Hoisted &) override { m_size = 1; }
+
+  void visit(Variable &) override { m_size = 1; }
+
+  void visit(Assign &) override { m_size = 1; }
+
+  void visit(Call &) override { m_size = 1; }
+
+  void visit(Get &) override { m_size = 1; }
+
+  void visit(Set &) override { m_size = 1; }
+
+  void visit(Invoke &) override { m_size = 1; }
+
+  void visit(Array &) override { m_size = 1; }
+
+  void visit(Map &) override { m_size = 1; }
+
+  void visit(Index &) override { m_size = 1; }
+
+  void visit(SetIndex &) override { m_size = 1; }
+
+  void visit(This &) override { m_size = 1; }
+
+  void visit(Super &) override { m_size = 1; }
+
+  // Only expressions are evaluated in parallel
+  void visit(Expression &) override {}
+
+  void visit(Print &) override {}
+
+  void visit(Var &) override {}
+
+  void visit(Block &) override {}
+
+  void visit(If &) override {}
+
+  void visit(While &) override {}
+
+  void visit(Function &) override {}
+
+  void visit(Class &) override {}
+
+  void visit(Return &) override {}
+
+private:
+  std::unordered_set<Expr const *> &m_large;
+  uint64_t m_size = 0;
+};
+
+} // namespace
+
+/**
+ * Evaluate one subexpression, forking the right operand of its large nodes.
+ * Every task has its own, so that no state is shared between threads.
+ */
+class ParallelEvaluator::SubEvaluator final : public AstNodeVisitor {
+public:
+  explicit SubEvaluator(ParallelEvaluator &evaluator)
+      : m_evaluator(evaluator) {}
+
+  Expected<Value> evaluate(Expr &expr) {
+    if (!m_evaluator.is_large(expr)) {
+      return m_interpreter.try_interpret(&expr);
+    }
+    dispatch(expr, *this);
+    return std::move(*m_result);
+  }
+
+  void visit(Literal &expr) override {
+    m_result.emplace(m_interpreter.try_interpret(&expr));
+  }
+
+  void visit(Binary &expr) override {
+    if (!m_evaluator.is_large(*expr.m_right)) {
+      auto left = evaluate(*expr.m_left);
+      if (!left) {
+        m_result.emplace(std::move(left));
+        return;
+      }
+      auto right = evaluate(*expr.m_right);
+      combine(expr, std::move(left), std::move(right));
+      return;
+    }
+
+    auto &pool = *m_evaluator.m_pool;
+    std::optional<Expected<Value>> right;
+    WorkStealingPool::Task fork([this, &expr, &right] {
+      right.emplace(SubEvaluator(m_evaluator).evaluate(*expr.m_right));
+    });
+    pool.fork(fork);
+    auto left = evaluate(*expr.m_left);
+    pool.join(fork);
+    combine(expr, std::move(left), std::move(*right));
+  }
+
+  void visit(Unary &expr) override {
+    auto operand = evaluate(*expr.m_right);
+    if (!operand) {
+      m_result.emplace(std::move(operand));
+      return;
+    }
+    m_result.emplace(m_interpreter.apply(expr, std::move(operand).value()));
+  }
+
+  void visit(Grouping &expr) override {
+    m_result.emplace(evaluate(*expr.m_expr));
+  }
+
+  void visit(Shared &expr) override {
+    m_result.emplace(evaluate(expr.m_expr));
+  }
+
+  void visit(Logical &expr) override { sequential(expr); }
+
+  void visit(Constant &expr) override { sequential(expr); }
+
+  void visit(Hoisted &expr) override { sequential(expr); }
+
+  void visit(Variable &expr) override { sequential(expr); }
+
+  void visit(Assign &expr) override { sequential(expr); }
+
+  void visit(Call &expr) override { sequential(expr); }
+
+  void visit(Get &expr) override { sequential(expr); }
+
+  void visit(Set &expr) override { sequential(expr); }
+
+  void visit(Invoke &expr) override { sequential(expr); }
+
+  void visit(Array &expr) override { sequential(expr); }
+
+  void visit(Map &expr) override { sequential(expr); }
+
+  void visit(Index &expr) override { sequential(expr); }
+
+  void visit(SetIndex &expr) override { sequential(expr); }
+
+  void visit(This &expr) override { sequential(expr); }
+
+  void visit(Super &expr) override { sequential(expr); }
+
+  // Only expressions are evaluated in parallel
+  void visit(Expression &) override {}
+
+  void visit(Print &) override {}
+
+  void visit(Var &) override {}
+
+  void visit(Block &) override {}
+
+  void visit(If &) override {}
+
+  void visit(While &) override {}
+
+  void visit(Function &) override {}
+
+  void visit(Class &) override {}
+
+  void visit(Return &) override {}
+
+private:
+  void sequential(Expr &expr) {
+    m_result.emplace(m_interpreter.try_interpret(&expr));
+  }
+
+  /**
+   * @brief Apply `expr` to its evaluated operands, or keep the error of the
+   *        leftmost one which failed.
+   */
+  void combine(Binary &expr, Expected<Value> left, Expected<Value> right) {
+    if (!left) {
+      m_result.emplace(std::move(left));
+    } else if (!right) {
+      m_result.emplace(std::move(right));
+    } else {
+      m_result.emplace(m_interpreter.apply(expr, std::move(left).value(),
+                                           std::move(right).value()));
+    }
+  }
+
+private:
+  ParallelEvaluator &m_evaluator;
+  Interpreter m_interpreter;
+  std::optional<Expected<Value>> m_result;
+};
+
+void ParallelEvaluator::interpret(Expr *expr) {
+  m_large.clear();
+  if (m_n_jobs > 1) {
+    SizeCounter(m_large).count(*expr);
+  }
+
+  if (!is_large(*expr)) {
+    Interpreter interpreter;
+    interpreter.interpret(expr);
+    m_result = interpreter.result();
+    return;
+  }
+
+  if (!m_pool) {
+    m_pool.emplace(m_n_jobs);
+  }
+  std::optional<Expected<Value>> result;
+  m_pool->run([this, expr, &result] {
+    result.emplace(SubEvaluator(*this).evaluate(*expr));
+  });
+  if (!*result) {
+    runtime_error(result->error());
+    return;
+  }
+  m_result = std::move(*result).value();
+}
+
+} // namespace Lox
@@ -0,0 +1,139 @@
+#include "parallel_parser.h"
+#include "parser.h"
+#include "work_stealing_pool.h"
+
+#include <algorithm>
+#include <deque>
+#include <iterator>
+
+namespace Lox {
+
+namespace {
+
+/**
+ * @brief Whether a token of type `type` starts a declaration other than an
+ *        expression statement, see `Parser::program()`.
+ */
+bool starts_declaration(TokenType type) {
+  switch (type) {
+  case TokenType::CLASS:
+  case TokenType::FUN:
+  case TokenType::VAR:
+  case TokenType::RETURN:
+  case TokenType::LEFT_BRACE:
+  case TokenType::IF:
+  case TokenType::WHILE:
+  case TokenType::FOR:
+  case TokenType::PRINT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+} // namespace
+
+std::vector<std::size_t> ParallelParser::cut() const {
+  std::vector<std::size_t> cuts;
+  auto split = m_splits.begin();
+  int depth = 0;
+  for (std::size_t i = 0; i + 1 < m_tokens.size() && split != m_splits.end();
+       ++i) {
+    auto const type = m_tokens[i].type();
+    switch (type) {
+    case TokenType::LEFT_PAREN:
+    case TokenType::LEFT_BRACE:
+    case TokenType::LEFT_BRACKET:
+      ++depth;
+      break;
+    case TokenType::RIGHT_PAREN:
+    case TokenType::RIGHT_BRACE:
+    case TokenType::RIGHT_BRACKET:
+      --depth;
+      break;
+    default:
+      break;
+    }
+    if (depth != 0 || i + 1 < *split) {
+      continue;
+    }
+
+    // Only `else` continues a statement after its `;`, and a `}` may close a
+    // map literal within an expression
+    auto const next = m_tokens[i + 1].type();
+    bool const ends = type == TokenType::SEMICOLON
+                          ? next != TokenType::ELSE
+                          : type == TokenType::RIGHT_BRACE &&
+                                starts_declaration(next);
+    if (ends && next != TokenType::END) {
+      cuts.push_back(i + 1);
+      while (split != m_splits.end() && *split <= i + 1) {
+        ++split;
+      }
+    }
+  }
+  return cuts;
+}
+
+Program ParallelParser::parse_program() {
+  auto const cuts = cut();
+  if (cuts.empty()) {
+    return Parser(m_tokens, false, m_memory).parse_program();
+  }
+
+  // Spans are parsed without reporting their errors, which are found again
+  // by the serial parse
+  std::size_t const n_spans = cuts.size() + 1;
+  std::vector<Program> programs(n_spans);
+  std::vector<char> failed(n_spans, false);
+  auto const parse_span = [&](std::size_t index) {
+    auto const begin = index == 0 ? 0 : cuts[index - 1];
+    auto const end = index < cuts.size() ? cuts[index] : m_tokens.size() - 1;
+    Parser parser(m_tokens, begin, end, m_memory);
+    auto &program = programs[index];
+    try {
+      // Only the last span may end with the final expression
+      failed[index] =
+          !parser.program(program) || (index + 1 < n_spans && program.result);
+    } catch (MemoryLimitError const &) {
+      failed[index] = true;
+    }
+    if (!failed[index]) {
+      program.memory = std::move(parser.m_charge);
+    }
+  };
+
+  WorkStealingPool pool(m_n_jobs);
+  pool.run([&] {
+    std::deque<WorkStealingPool::Task> tasks;
+    for (std::size_t index = 1; index < n_spans; ++index) {
+      pool.fork(tasks.emplace_back([&parse_span, index] { parse_span(index); }));
+    }
+    parse_span(0);
+    for (auto task = tasks.rbegin(); task != tasks.rend(); ++task) {
+      pool.join(*task);
+    }
+  });
+
+  if (std::find(failed.begin(), failed.end(), true) != failed.end()) {
+    // Release the nodes of the spans before charging them again
+    programs.clear();
+    return Parser(m_tokens, false, m_memory).parse_program();
+  }
+
+  Program program = std::move(programs.front());
+  std::size_t n_statements = 0;
+  for (auto const &span : programs) {
+    n_statements += span.statements.size();
+  }
+  program.statements.reserve(n_statements);
+  for (auto span = programs.begin() + 1; span != programs.end(); ++span) {
+    std::move(span->statements.begin(), span->statements.end(),
+              std::back_inserter(program.statements));
+    program.memory.merge(std::move(span->memory));
+  }
+  program.result = std::move(programs.back().result);
+  return program;
+}
+
+} // namespace Lox
@@ -0,0 +1,99 @@
+#include "parallel_scanner.h"
+#include "memory_account.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <thread>
+
+namespace Lox {
+
+std::vector<ParallelScanner::Chunk> ParallelScanner::split() const {
+  std::vector<Chunk> chunks;
+  char const *const src = m_source.data();
+  uint64_t const size = m_source.size();
+  unsigned const n_jobs = size < kParallelScanMinBytes ? 1 : m_n_jobs;
+  if (n_jobs == 1) {
+    return {Chunk{0, size}};
+  }
+  uint64_t const chunk_sz = size / n_jobs + 1;
+
+  Chunk chunk{0, 0};
+  bool in_string = false;
+  for (uint64_t i = 0; i < size; ++i) {
+    char const c = src[i];
+    if (c == '\n') {
+      if (!in_string && i + 1 - chunk.begin >= chunk_sz && i + 1 < size) {
+        chunk.end = i + 1;
+        chunks.push_back(chunk);
+        chunk = {i + 1, 0};
+      }
+    } else if (c == '"') {
+      in_string = !in_string;
+    } else if (!in_string && c == '/' && i + 1 < size && src[i + 1] == '/') {
+      // Skip the comment, a '"' in it does not start a string literal
+      auto const *newline =
+          static_cast<char const *>(std::memchr(src + i, '\n', size - i));
+      i = newline ? newline - src - 1 : size;
+    }
+  }
+  chunk.end = size;
+  chunks.push_back(chunk);
+
+  return chunks;
+}
+
+TokenList const &ParallelScanner::scan_tokens() {
+  auto const chunks = split();
+
+  std::vector<Scanner> scanners;
+  scanners.reserve(chunks.size());
+  for (auto const &chunk : chunks) {
+    scanners.emplace_back(m_source, chunk.begin, chunk.end,
+                          m_tokens.get_allocator().resource());
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(chunks.size() - 1);
+  for (std::size_t i = 1; i < scanners.size(); ++i) {
+    threads.emplace_back([&scanner = scanners[i]] { scanner.scan_range(); });
+  }
+  scanners.front().scan_range();
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (scanners.size() == 1) {
+    scanners.front().report_errors();
+    m_tokens = std::move(scanners.front().m_tokens);
+    m_tokens.emplace_back(m_source.size(), TokenType::END, std::string_view{});
+    return m_tokens;
+  }
+
+  std::size_t n_tokens = 1;
+  for (auto const &scanner : scanners) {
+    n_tokens += scanner.m_tokens.size();
+  }
+  for (auto &scanner : scanners) {
+    scanner.report_errors();
+  }
+  try {
+    m_tokens.reserve(n_tokens);
+  } catch (MemoryLimitError const &) {
+    // The chunks are dropped, `END` fits in their memory
+    syntax_error(Diagnostic{ErrorCode::OUT_OF_MEMORY, 0, nullptr});
+    scanners.clear();
+  }
+  for (auto &scanner : scanners) {
+    if (!m_tokens.empty()) {
+      m_splits.push_back(m_tokens.size());
+    }
+    std::move(scanner.m_tokens.begin(), scanner.m_tokens.end(),
+              std::back_inserter(m_tokens));
+  }
+  m_tokens.emplace_back(m_source.size(), TokenType::END, std::string_view{});
+
+  return m_tokens;
+}
+
+} // namespace Lox
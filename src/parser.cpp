@@ -3,85 +3,526 @@
 
 namespace Lox {
 ExprPtr Parser::parse() {
+  Expected<ExprPtr> expr = nullptr;
   try {
-    ExprPtr expr = expression();
-    return expr;
-  } catch (ParseError) {
+    expr = expression();
+  } catch (MemoryLimitError const &) {
+    expr = error(peek(), ErrorCode::OUT_OF_MEMORY);
+  }
+  if (!expr) {
+    Lox::syntax_error(expr.error());
     return nullptr;
   }
+  if (m_hash_cons) {
+    m_hash_cons->wrap_shared(expr.value());
+  }
+  return std::move(expr).value();
+}
+
+Program Parser::parse_program() {
+  Program ans;
+  Expected<void> parsed;
+  try {
+    parsed = program(ans);
+  } catch (MemoryLimitError const &) {
+    parsed = error(peek(), ErrorCode::OUT_OF_MEMORY);
+  }
+  if (!parsed) {
+    Lox::syntax_error(parsed.error());
+    return {};
+  }
+  ans.memory = std::move(m_charge);
+  if (m_hash_cons) {
+    m_hash_cons->wrap_shared(ans);
+  }
+  return ans;
+}
+
+// program = declaration* expression? END
+Expected<void> Parser::program(Program &program) {
+  while (!check(TokenType::END)) {
+    if (check(TokenType::CLASS) || check(TokenType::FUN) ||
+        check(TokenType::VAR) || check(TokenType::RETURN) ||
+        check(TokenType::LEFT_BRACE) || check(TokenType::IF) ||
+        check(TokenType::WHILE) || check(TokenType::FOR) ||
+        check(TokenType::PRINT)) {
+      TRY_ASSIGN(StmtPtr stmt, declaration());
+      program.statements.push_back(std::move(stmt));
+      continue;
+    }
+
+    // An expression statement, or the final expression
+    TRY_ASSIGN(ExprPtr expr, expression());
+    if (check(TokenType::END)) {
+      program.result = std::move(expr);
+      break;
+    }
+    TRY(consume({TokenType::SEMICOLON}, ErrorCode::EXPECT_SEMICOLON));
+    program.statements.push_back(node<Expression>(std::move(expr)));
+  }
+  return {};
+}
+
+Expected<StmtPtr> Parser::declaration() {
+  if (match({TokenType::CLASS})) {
+    return class_declaration();
+  }
+  if (match({TokenType::FUN})) {
+    TRY_ASSIGN(StmtPtr declaration,
+               function(ErrorCode::EXPECT_FUNCTION_NAME));
+    return declaration;
+  }
+  if (match({TokenType::VAR})) {
+    return var_declaration();
+  }
+  return statement();
+}
+
+// class = "class" IDENTIFIER ( "<" IDENTIFIER )? "{" function* "}"
+Expected<StmtPtr> Parser::class_declaration() {
+  TRY(consume({TokenType::IDENTIFIER}, ErrorCode::EXPECT_CLASS_NAME));
+  auto const &name = previous();
+
+  ExprPtr superclass;
+  if (match({TokenType::LESS})) {
+    TRY(consume({TokenType::IDENTIFIER}, ErrorCode::EXPECT_SUPERCLASS_NAME));
+    superclass = make<Variable>(previous());
+  }
+
+  TRY(consume({TokenType::LEFT_BRACE},
+              ErrorCode::EXPECT_LEFT_BRACE_BEFORE_CLASS_BODY));
+  FunctionList methods;
+  while (!check(TokenType::RIGHT_BRACE) && !check(TokenType::END)) {
+    TRY_ASSIGN(FunctionPtr method, function(ErrorCode::EXPECT_METHOD_NAME));
+    methods.push_back(std::move(method));
+  }
+  TRY(consume({TokenType::RIGHT_BRACE},
+              ErrorCode::EXPECT_RIGHT_BRACE_AFTER_CLASS_BODY));
+
+  return node<Class>(name, std::move(superclass),
+                                 std::move(methods));
+}
+
+// function = IDENTIFIER "(" ( IDENTIFIER ( "," IDENTIFIER )* )? ")" block
+Expected<FunctionPtr> Parser::function(ErrorCode name_error) {
+  TRY(consume({TokenType::IDENTIFIER}, name_error));
+  auto const &name = previous();
+
+  TRY(consume({TokenType::LEFT_PAREN},
+              ErrorCode::EXPECT_LEFT_PAREN_AFTER_NAME));
+  KTokenList params;
+  if (!check(TokenType::RIGHT_PAREN)) {
+    do {
+      TRY(consume({TokenType::IDENTIFIER}, ErrorCode::EXPECT_PARAMETER_NAME));
+      params.push_back(&previous());
+    } while (match({TokenType::COMMA}));
+  }
+  TRY(consume({TokenType::RIGHT_PAREN},
+              ErrorCode::EXPECT_RIGHT_PAREN_AFTER_PARAMETERS));
+
+  TRY(consume({TokenType::LEFT_BRACE},
+              ErrorCode::EXPECT_LEFT_BRACE_BEFORE_BODY));
+  TRY_ASSIGN(StmtList body, block());
+
+  return node<Function>(name, std::move(params), std::move(body));
+}
+
+// var = "var" IDENTIFIER ( "=" expression )? ";"
+Expected<StmtPtr> Parser::var_declaration() {
+  TRY(consume({TokenType::IDENTIFIER}, ErrorCode::EXPECT_VARIABLE_NAME));
+  auto const &name = previous();
+
+  ExprPtr initializer;
+  if (match({TokenType::EQUAL})) {
+    TRY_ASSIGN(initializer, expression());
+  }
+  TRY(consume({TokenType::SEMICOLON}, ErrorCode::EXPECT_SEMICOLON));
+
+  return node<Var>(name, std::move(initializer));
+}
+
+Expected<StmtPtr> Parser::statement() {
+  if (match({TokenType::RETURN})) {
+    return return_statement();
+  }
+  if (match({TokenType::PRINT})) {
+    return print_statement();
+  }
+  if (match({TokenType::IF})) {
+    return if_statement();
+  }
+  if (match({TokenType::WHILE})) {
+    return while_statement();
+  }
+  if (match({TokenType::FOR})) {
+    return for_statement();
+  }
+  if (match({TokenType::LEFT_BRACE})) {
+    TRY_ASSIGN(StmtList statements, block());
+    return node<Block>(std::move(statements));
+  }
+  return expression_statement();
+}
+
+// return = "return" expression? ";"
+Expected<StmtPtr> Parser::return_statement() {
+  auto const &keyword = previous();
+
+  ExprPtr value;
+  if (!check(TokenType::SEMICOLON)) {
+    TRY_ASSIGN(value, expression());
+  }
+  TRY(consume({TokenType::SEMICOLON}, ErrorCode::EXPECT_SEMICOLON));
+
+  return node<Return>(keyword, std::move(value));
+}
+
+// print = "print" expression ";"
+Expected<StmtPtr> Parser::print_statement() {
+  auto const &keyword = previous();
+
+  TRY_ASSIGN(ExprPtr value, expression());
+  TRY(consume({TokenType::SEMICOLON}, ErrorCode::EXPECT_SEMICOLON));
+
+  return node<Print>(keyword, std::move(value));
+}
+
+// if = "if" "(" expression ")" statement ( "else" statement )?
+Expected<StmtPtr> Parser::if_statement() {
+  auto const &keyword = previous();
+
+  TRY(consume({TokenType::LEFT_PAREN}, ErrorCode::EXPECT_LEFT_PAREN_AFTER_IF));
+  TRY_ASSIGN(ExprPtr condition, expression());
+  TRY(consume({TokenType::RIGHT_PAREN},
+              ErrorCode::EXPECT_RIGHT_PAREN_AFTER_CONDITION));
+
+  TRY_ASSIGN(StmtPtr then_branch, statement());
+  StmtPtr else_branch;
+  if (match({TokenType::ELSE})) {
+    TRY_ASSIGN(else_branch, statement());
+  }
+
+  return node<If>(keyword, std::move(condition),
+                              std::move(then_branch), std::move(else_branch));
+}
+
+// while = "while" "(" expression ")" statement
+Expected<StmtPtr> Parser::while_statement() {
+  auto const &keyword = previous();
+
+  TRY(consume({TokenType::LEFT_PAREN},
+              ErrorCode::EXPECT_LEFT_PAREN_AFTER_WHILE));
+  TRY_ASSIGN(ExprPtr condition, expression());
+  TRY(consume({TokenType::RIGHT_PAREN},
+              ErrorCode::EXPECT_RIGHT_PAREN_AFTER_CONDITION));
+
+  TRY_ASSIGN(StmtPtr body, statement());
+
+  return node<While>(keyword, std::move(condition),
+                                 std::move(body));
+}
+
+// for = "for" "(" ( var | expression ";" | ";" ) expression? ";"
+//       expression? ")" statement
+Expected<StmtPtr> Parser::for_statement() {
+  auto const &keyword = previous();
+
+  TRY(consume({TokenType::LEFT_PAREN}, ErrorCode::EXPECT_LEFT_PAREN_AFTER_FOR));
+  StmtPtr initializer;
+  if (match({TokenType::VAR})) {
+    TRY_ASSIGN(initializer, var_declaration());
+  } else if (!match({TokenType::SEMICOLON})) {
+    TRY_ASSIGN(initializer, expression_statement());
+  }
+
+  ExprPtr condition;
+  if (!check(TokenType::SEMICOLON)) {
+    TRY_ASSIGN(condition, expression());
+  }
+  TRY(consume({TokenType::SEMICOLON},
+              ErrorCode::EXPECT_SEMICOLON_AFTER_LOOP_CONDITION));
+
+  ExprPtr increment;
+  if (!check(TokenType::RIGHT_PAREN)) {
+    TRY_ASSIGN(increment, expression());
+  }
+  TRY(consume({TokenType::RIGHT_PAREN},
+              ErrorCode::EXPECT_RIGHT_PAREN_AFTER_FOR_CLAUSES));
+
+  TRY_ASSIGN(StmtPtr body, statement());
+  if (increment) {
+    StmtList statements;
+    statements.push_back(std::move(body));
+    statements.push_back(node<Expression>(std::move(increment)));
+    body = node<Block>(std::move(statements));
+  }
+  StmtPtr loop = node<While>(keyword, std::move(condition),
+                                         std::move(body));
+  if (!initializer) {
+    return loop;
+  }
+  StmtList statements;
+  statements.push_back(std::move(initializer));
+  statements.push_back(std::move(loop));
+  return node<Block>(std::move(statements));
+}
+
+// block = "{" declaration* "}"
+Expected<StmtList> Parser::block() {
+  StmtList statements;
+  while (!check(TokenType::RIGHT_BRACE) && !check(TokenType::END)) {
+    TRY_ASSIGN(StmtPtr stmt, declaration());
+    statements.push_back(std::move(stmt));
+  }
+  TRY(consume({TokenType::RIGHT_BRACE},
+              ErrorCode::EXPECT_RIGHT_BRACE_AFTER_BLOCK));
+  return statements;
+}
+
+Expected<StmtPtr> Parser::expression_statement() {
+  TRY_ASSIGN(ExprPtr expr, expression());
+  TRY(consume({TokenType::SEMICOLON}, ErrorCode::EXPECT_SEMICOLON));
+  return node<Expression>(std::move(expr));
+}
+
+Expected<ExprPtr> Parser::expression() { return assignment(); }
+
+// assignment = ( call "." )? IDENTIFIER "=" assignment
+//            | call "[" expression "]" "=" assignment | logic_or
+Expected<ExprPtr> Parser::assignment() {
+  TRY_ASSIGN(ExprPtr ans, logic_or());
+
+  if (match({TokenType::EQUAL})) {
+    auto const &equals = previous();
+    TRY_ASSIGN(ExprPtr value, assignment());
+
+    switch (ans->kind()) {
+    case ExprKind::VARIABLE: {
+      auto &variable = static_cast<Variable &>(*ans);
+      return make<Assign>(variable.m_name, std::move(value));
+    }
+    case ExprKind::GET: {
+      auto &get = static_cast<Get &>(*ans);
+      return make<Set>(std::move(get.m_object), get.m_name, std::move(value));
+    }
+    case ExprKind::INDEX: {
+      auto &index = static_cast<Index &>(*ans);
+      return make<SetIndex>(std::move(index.m_object), index.m_bracket,
+                            std::move(index.m_index), std::move(value));
+    }
+    default:
+      return error(equals, ErrorCode::INVALID_ASSIGNMENT_TARGET);
+    }
+  }
+
+  return ans;
 }
 
-ExprPtr Parser::expression() { return equality(); }
+// logic_or = logic_and ( "or" logic_and )*
+Expected<ExprPtr> Parser::logic_or() {
+  TRY_ASSIGN(ExprPtr ans, logic_and());
+
+  while (match({TokenType::OR})) {
+    auto const &op = previous();
+    TRY_ASSIGN(ExprPtr right, logic_and());
+    ans = make<Logical>(std::move(ans), op, std::move(right));
+  }
+
+  return ans;
+}
+
+// logic_and = equality ( "and" equality )*
+Expected<ExprPtr> Parser::logic_and() {
+  TRY_ASSIGN(ExprPtr ans, equality());
+
+  while (match({TokenType::AND})) {
+    auto const &op = previous();
+    TRY_ASSIGN(ExprPtr right, equality());
+    ans = make<Logical>(std::move(ans), op, std::move(right));
+  }
+
+  return ans;
+}
 
 // equality = comparison (( "==" | "!=" ) comparison )*
-ExprPtr Parser::equality() {
-  ExprPtr ans = comparison();
+Expected<ExprPtr> Parser::equality() {
+  TRY_ASSIGN(ExprPtr ans, comparison());
 
   while (match({TokenType::EQUAL_EQUAL, TokenType::BANG_EQUAL})) {
     auto const &op = previous();
-    ans = std::make_unique<Binary>(std::move(ans), op, comparison());
+    TRY_ASSIGN(ExprPtr right, comparison());
+    ans = make<Binary>(std::move(ans), op, std::move(right));
   }
 
   return ans;
 }
 
-ExprPtr Parser::comparison() {
-  ExprPtr ans = term();
+Expected<ExprPtr> Parser::comparison() {
+  TRY_ASSIGN(ExprPtr ans, term());
 
   while (match({TokenType::LESS, TokenType::LESS_EQUAL, TokenType::GREATER,
                 TokenType::GREATER_EQUAL})) {
     auto const &op = previous();
-    ans = std::make_unique<Binary>(std::move(ans), op, term());
+    TRY_ASSIGN(ExprPtr right, term());
+    ans = make<Binary>(std::move(ans), op, std::move(right));
   }
 
   return ans;
 }
 
-ExprPtr Parser::term() {
-  ExprPtr ans = factor();
+Expected<ExprPtr> Parser::term() {
+  TRY_ASSIGN(ExprPtr ans, factor());
 
   while (match({TokenType::PLUS, TokenType::MINUS})) {
     auto const &op = previous();
-    ans = std::make_unique<Binary>(std::move(ans), op, factor());
+    TRY_ASSIGN(ExprPtr right, factor());
+    ans = make<Binary>(std::move(ans), op, std::move(right));
   }
 
   return ans;
 }
 
-ExprPtr Parser::factor() {
-  ExprPtr ans = unary();
+Expected<ExprPtr> Parser::factor() {
+  TRY_ASSIGN(ExprPtr ans, unary());
 
   while (match({TokenType::STAR, TokenType::SLASH})) {
     auto const &op = previous();
-    ans = std::make_unique<Binary>(std::move(ans), op, unary());
+    TRY_ASSIGN(ExprPtr right, unary());
+    ans = make<Binary>(std::move(ans), op, std::move(right));
   }
 
   return ans;
 }
 
-ExprPtr Parser::unary() {
+Expected<ExprPtr> Parser::unary() {
   if (match({TokenType::BANG, TokenType::MINUS})) {
     auto const &op = previous();
-    return std::make_unique<Unary>(op, unary());
+    TRY_ASSIGN(ExprPtr right, unary());
+    return make<Unary>(op, std::move(right));
+  }
+
+  return call();
+}
+
+// call = primary ( "(" arguments ")" | "." IDENTIFIER | "[" expression "]" )*
+Expected<ExprPtr> Parser::call() {
+  TRY_ASSIGN(ExprPtr ans, primary());
+
+  while (true) {
+    if (match({TokenType::LEFT_PAREN})) {
+      TRY_ASSIGN(ExprList args, arguments());
+      ans = make<Call>(std::move(ans), previous(), std::move(args));
+    } else if (match({TokenType::DOT})) {
+      TRY(consume({TokenType::IDENTIFIER}, ErrorCode::EXPECT_PROPERTY_NAME));
+      auto const &name = previous();
+      if (match({TokenType::LEFT_PAREN})) {
+        TRY_ASSIGN(ExprList args, arguments());
+        ans = make<Invoke>(std::move(ans), name, previous(), std::move(args));
+      } else {
+        ans = make<Get>(std::move(ans), name);
+      }
+    } else if (match({TokenType::LEFT_BRACKET})) {
+      auto const &bracket = previous();
+      TRY_ASSIGN(ExprPtr index, expression());
+      TRY(consume({TokenType::RIGHT_BRACKET},
+                  ErrorCode::EXPECT_RIGHT_BRACKET_AFTER_INDEX));
+      ans = make<Index>(std::move(ans), bracket, std::move(index));
+    } else {
+      break;
+    }
+  }
+
+  return ans;
+}
+
+// arguments = ( expression ( "," expression )* )? ")"
+Expected<ExprList> Parser::arguments() {
+  ExprList args;
+  if (!check(TokenType::RIGHT_PAREN)) {
+    do {
+      TRY_ASSIGN(ExprPtr arg, expression());
+      args.push_back(std::move(arg));
+    } while (match({TokenType::COMMA}));
+  }
+  TRY(consume({TokenType::RIGHT_PAREN},
+              ErrorCode::EXPECT_RIGHT_PAREN_AFTER_ARGUMENTS));
+  return args;
+}
+
+// array = ( expression ( "," expression )* )? "]"
+Expected<ExprPtr> Parser::array() {
+  auto const &bracket = previous();
+  ExprList elements;
+  if (!check(TokenType::RIGHT_BRACKET)) {
+    do {
+      TRY_ASSIGN(ExprPtr element, expression());
+      elements.push_back(std::move(element));
+    } while (match({TokenType::COMMA}));
   }
+  TRY(consume({TokenType::RIGHT_BRACKET},
+              ErrorCode::EXPECT_RIGHT_BRACKET_AFTER_ELEMENTS));
+  return make<Array>(bracket, std::move(elements));
+}
 
-  return primary();
+// map = ( expression ":" expression ( "," expression ":" expression )* )?
+//       "}"
+Expected<ExprPtr> Parser::map() {
+  auto const &brace = previous();
+  ExprList keys;
+  ExprList values;
+  if (!check(TokenType::RIGHT_BRACE)) {
+    do {
+      TRY_ASSIGN(ExprPtr key, expression());
+      TRY(consume({TokenType::COLON}, ErrorCode::EXPECT_COLON_AFTER_KEY));
+      TRY_ASSIGN(ExprPtr value, expression());
+      keys.push_back(std::move(key));
+      values.push_back(std::move(value));
+    } while (match({TokenType::COMMA}));
+  }
+  TRY(consume({TokenType::RIGHT_BRACE},
+              ErrorCode::EXPECT_RIGHT_BRACE_AFTER_ENTRIES));
+  return make<Map>(brace, std::move(keys), std::move(values));
 }
 
-ExprPtr Parser::primary() {
+Expected<ExprPtr> Parser::primary() {
   if (match({TokenType::NUMBER, TokenType::STRING, TokenType::TRUE,
              TokenType::FALSE, TokenType::NIL})) {
-    return std::make_unique<Literal>(previous());
+    return make<Literal>(previous());
   }
 
   if (match({TokenType::LEFT_PAREN})) {
-    ExprPtr ans = expression();
-    consume({TokenType::RIGHT_PAREN}, "Expect ')' after expression.");
+    TRY_ASSIGN(ExprPtr ans, expression());
+    TRY(consume({TokenType::RIGHT_PAREN}, ErrorCode::EXPECT_RIGHT_PAREN));
 
-    return std::make_unique<Grouping>(std::move(ans));
+    return make<Grouping>(std::move(ans));
   }
 
-  error(peek(), "Expect expression.");
+  if (match({TokenType::IDENTIFIER})) {
+    return make<Variable>(previous());
+  }
+
+  if (match({TokenType::LEFT_BRACKET})) {
+    return array();
+  }
+
+  // A statement starting with "{" is a block, so that a map literal never
+  // starts one
+  if (match({TokenType::LEFT_BRACE})) {
+    return map();
+  }
+
+  if (match({TokenType::THIS})) {
+    return make<This>(previous());
+  }
+
+  if (match({TokenType::SUPER})) {
+    auto const &keyword = previous();
+    TRY(consume({TokenType::DOT}, ErrorCode::EXPECT_DOT_AFTER_SUPER));
+    TRY(consume({TokenType::IDENTIFIER}, ErrorCode::EXPECT_PROPERTY_NAME));
+    return make<Super>(keyword, previous());
+  }
+
+  return error(peek(), ErrorCode::EXPECT_EXPRESSION);
 }
 
 bool Parser::match(std::initializer_list<TokenType> types) noexcept {
@@ -95,28 +536,16 @@ bool Parser::match(std::initializer_list<TokenType> types) noexcept {
   return false;
 }
 
-void Parser::consume(std::initializer_list<TokenType> types,
-                     std::string_view error_msg) {
+Expected<void> Parser::consume(std::initializer_list<TokenType> types,
+                               ErrorCode code) {
   for (auto type : types) {
     if (type == peek().m_type) {
       advance();
-      return;
+      return {};
     }
   }
 
-  error(peek(), error_msg);
-}
-
-[[noreturn]] void Parser::error(Token const &token,
-                                std::string_view error_msg) {
-  std::string msg;
-  if (token.m_type == TokenType::END) {
-    msg = "at end: " + std::string(error_msg);
-  } else {
-    msg = token.m_lexeme + ": " + std::string(error_msg);
-  }
-  Lox::syntax_error(token.m_lineno, msg.c_str());
-  throw ParseError("parse error");
+  return error(peek(), code);
 }
 
 }; // namespace Lox
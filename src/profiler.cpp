@@ -0,0 +1,338 @@
+#include "profiler.h"
+#include "error.h"
+#include "source_map.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <sys/time.h>
+#include <unordered_map>
+
+namespace Lox {
+
+namespace {
+
+/**
+ * Name an expression after its kind and the token which best locates it.
+ */
+class Describer final : public AstNodeVisitor {
+public:
+  void visit(Literal &node) override {
+    m_kind = "Literal";
+    m_token = &node.m_token;
+  }
+
+  void visit(Binary &node) override {
+    m_kind = "Binary";
+    m_token = &node.m_op;
+  }
+
+  void visit(Unary &node) override {
+    m_kind = "Unary";
+    m_token = &node.m_op;
+  }
+
+  void visit(Grouping &node) override {
+    dispatch(*node.m_expr, *this);
+    m_kind = "Grouping";
+  }
+
+  void visit(Logical &node) override {
+    m_kind = "Logical";
+    m_token = &node.m_op;
+  }
+
+  void visit(Constant &node) override {
+    m_kind = "Constant";
+    m_token = &node.m_token;
+  }
+
+  void visit(Hoisted &node) override {
+    dispatch(*node.m_expr, *this);
+    m_kind = "Hoisted";
+  }
+
+  void visit(Shared &node) override {
+    dispatch(node.m_expr, *this);
+    m_kind = "Shared";
+  }
+
+  void visit(Variable &node) override {
+    m_kind = "Variable";
+    m_token = &node.m_name;
+  }
+
+  void visit(Assign &node) override {
+    m_kind = "Assign";
+    m_token = &node.m_name;
+  }
+
+  void visit(Call &node) override {
+    m_kind = "Call";
+    m_token = &node.m_paren;
+  }
+
+  void visit(Get &node) override {
+    m_kind = "Get";
+    m_token = &node.m_name;
+  }
+
+  void visit(Set &node) override {
+    m_kind = "Set";
+    m_token = &node.m_name;
+  }
+
+  void visit(Invoke &node) override {
+    m_kind = "Invoke";
+    m_token = &node.m_name;
+  }
+
+  void visit(Array &node) override {
+    m_kind = "Array";
+    m_token = &node.m_bracket;
+  }
+
+  void visit(Map &node) override {
+    m_kind = "Map";
+    m_token = &node.m_brace;
+  }
+
+  void visit(Index &node) override {
+    m_kind = "Index";
+    m_token = &node.m_bracket;
+  }
+
+  void visit(SetIndex &node) override {
+    m_kind = "SetIndex";
+    m_token = &node.m_bracket;
+  }
+
+  void visit(This &node) override {
+    m_kind = "This";
+    m_token = &node.m_keyword;
+  }
+
+  void visit(Super &node) override {
+    m_kind = "Super";
+    m_token = &node.m_method;
+  }
+
+  // Only expressions are profiled
+  void visit(Expression &) override {}
+
+  void visit(Print &) override {}
+
+  void visit(Var &) override {}
+
+  void visit(Block &) override {}
+
+  void visit(If &) override {}
+
+  void visit(While &) override {}
+
+  void visit(Function &) override {}
+
+  void visit(Class &) override {}
+
+  void visit(Return &) override {}
+
+  char const *m_kind = "";
+  Token const *m_token = nullptr;
+};
+
+Describer inspect(Expr const *expr) {
+  Describer describer;
+  // Describer does not modify the node
+  dispatch(const_cast<Expr &>(*expr), describer);
+  return describer;
+}
+
+std::string describe(Expr const *expr, SourceMap const &source_map) {
+  auto const describer = inspect(expr);
+
+  std::string label = describer.m_kind;
+  if (describer.m_kind != std::string_view("Grouping")) {
+    auto const lexeme = describer.m_token->lexeme().substr(0, 24);
+    label += ' ';
+    // ';' separates frames in collapsed stacks
+    std::replace_copy_if(
+        lexeme.begin(), lexeme.end(), std::back_inserter(label),
+        [](char c) { return c == ';' || c == '\n' || c == '\r'; }, ' ');
+  }
+  auto const [line, column] = source_map.locate(describer.m_token->offset());
+  label += " ";
+  label += std::to_string(line);
+  label += ':';
+  label += std::to_string(column);
+  return label;
+}
+
+} // namespace
+
+std::atomic<bool> Profiler::sample_pending{false};
+
+Profiler::Profiler(Mode mode, std::chrono::microseconds interval)
+    : m_mode(mode), m_frames{Frame{nullptr, 0}} {
+  if (m_mode != Mode::SAMPLING) {
+    return;
+  }
+
+  struct sigaction action {};
+  action.sa_handler = [](int) {
+    sample_pending.store(true, std::memory_order_relaxed);
+  };
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  CHECK_ERRNO(::sigaction(SIGPROF, &action, nullptr), "sigaction");
+
+  auto const us = interval.count();
+  itimerval timer{};
+  timer.it_interval.tv_sec = us / 1000000;
+  timer.it_interval.tv_usec = us % 1000000;
+  timer.it_value = timer.it_interval;
+  CHECK_ERRNO(::setitimer(ITIMER_PROF, &timer, nullptr), "setitimer");
+}
+
+Profiler::~Profiler() noexcept {
+  if (m_mode != Mode::SAMPLING) {
+    return;
+  }
+  itimerval timer{};
+  ::setitimer(ITIMER_PROF, &timer, nullptr);
+  std::signal(SIGPROF, SIG_DFL);
+  sample_pending.store(false, std::memory_order_relaxed);
+}
+
+uint32_t Profiler::child(uint32_t parent, Expr const *expr) {
+  for (auto const frame : m_frames[parent].children) {
+    if (m_frames[frame].expr == expr) {
+      return frame;
+    }
+  }
+  auto const frame = static_cast<uint32_t>(m_frames.size());
+  m_frames.push_back(Frame{expr, parent});
+  m_frames[parent].children.push_back(frame);
+  return frame;
+}
+
+void Profiler::take_sample() {
+  sample_pending.store(false, std::memory_order_relaxed);
+  uint32_t frame = 0;
+  for (auto const *expr : m_stack) {
+    frame = child(frame, expr);
+  }
+  ++m_frames[frame].samples;
+}
+
+void Profiler::report(std::ostream &out, SourceMap const &source_map,
+                      std::size_t max_rows) const {
+  struct Row {
+    Expr const *expr = nullptr;
+    uint64_t count = 0;
+    uint64_t self = 0;
+    uint64_t total = 0;
+  };
+  bool const sampling = m_mode == Mode::SAMPLING;
+
+  // In sampling mode, the total of a frame is the samples of its subtree.
+  // Children are always created after their parent.
+  std::vector<uint64_t> totals(m_frames.size());
+  for (std::size_t i = m_frames.size(); i-- > 1;) {
+    auto const &frame = m_frames[i];
+    totals[i] += sampling ? frame.samples : frame.total;
+    if (sampling) {
+      totals[frame.parent] += totals[i];
+    }
+  }
+
+  std::unordered_map<Expr const *, Row> by_expr;
+  uint64_t all_self = 0;
+  for (std::size_t i = 1; i < m_frames.size(); ++i) {
+    auto const &frame = m_frames[i];
+    uint64_t const self = sampling ? frame.samples : frame.self();
+    auto &row = by_expr[frame.expr];
+    row.expr = frame.expr;
+    row.count += frame.count;
+    row.self += self;
+    row.total += totals[i];
+    all_self += self;
+  }
+
+  std::vector<Row> rows;
+  std::unordered_map<uint32_t, Row> by_line;
+  rows.reserve(by_expr.size());
+  for (auto const &[expr, row] : by_expr) {
+    rows.push_back(row);
+    auto const offset = inspect(expr).m_token->offset();
+    auto &line = by_line[source_map.locate(offset).line];
+    line.count += row.count;
+    line.self += row.self;
+  }
+  auto const by_self = [](Row const &lhs, Row const &rhs) {
+    return lhs.self > rhs.self;
+  };
+  std::sort(rows.begin(), rows.end(), by_self);
+  std::vector<std::pair<uint32_t, Row>> lines(by_line.begin(), by_line.end());
+  std::sort(lines.begin(), lines.end(), [&](auto const &lhs, auto const &rhs) {
+    return by_self(lhs.second, rhs.second);
+  });
+
+  auto const cost = [sampling](uint64_t value) {
+    return sampling ? static_cast<double>(value) : value / 1e6;
+  };
+  // Evaluations are not counted when sampling
+  auto const count = [sampling](uint64_t value) {
+    return sampling ? std::string("-") : std::to_string(value);
+  };
+  char const *const row_format =
+      sampling ? "%12.0f %12.0f %12s  " : "%12.3f %12.3f %12s  ";
+  char const *const line_format =
+      sampling ? "%12.0f %12s %12s  " : "%12.3f %12s %12s  ";
+  char buf[128];
+
+  std::snprintf(buf, sizeof(buf),
+                sampling ? "Lox profile (sampling): %.0f samples\n"
+                         : "Lox profile (exact): %.3f ms\n",
+                cost(all_self));
+  out << buf;
+  std::snprintf(buf, sizeof(buf), "%12s %12s %12s  %s\n", "self", "total",
+                "count", "expression");
+  out << buf;
+  for (std::size_t i = 0; i < rows.size() && i < max_rows; ++i) {
+    auto const &row = rows[i];
+    std::snprintf(buf, sizeof(buf), row_format, cost(row.self),
+                  cost(row.total), count(row.count).c_str());
+    out << buf << describe(row.expr, source_map) << '\n';
+  }
+
+  std::snprintf(buf, sizeof(buf), "%12s %12s %12s  %s\n", "self", "", "count",
+                "line");
+  out << buf;
+  for (std::size_t i = 0; i < lines.size() && i < max_rows; ++i) {
+    auto const &[line, row] = lines[i];
+    std::snprintf(buf, sizeof(buf), line_format, cost(row.self), "",
+                  count(row.count).c_str());
+    out << buf << line << '\n';
+  }
+}
+
+void Profiler::write_collapsed(std::ostream &out,
+                               SourceMap const &source_map) const {
+  std::vector<std::string> labels(m_frames.size());
+  for (std::size_t i = 1; i < m_frames.size(); ++i) {
+    auto const &frame = m_frames[i];
+    labels[i] = describe(frame.expr, source_map);
+    if (frame.parent != 0) {
+      labels[i] = labels[frame.parent] + ';' + labels[i];
+    }
+    uint64_t const self =
+        m_mode == Mode::SAMPLING ? frame.samples : frame.self();
+    if (self > 0) {
+      out << labels[i] << ' ' << self << '\n';
+    }
+  }
+}
+
+} // namespace Lox
@@ -0,0 +1,414 @@
+#include "resolver.h"
+#include "error.h"
+#include "scanner.h"
+#include "snapshot.h"
+
+#include <algorithm>
+#include <optional>
+
+namespace Lox {
+
+void Resolver::resolve(Program &program) {
+  if (m_snapshot != nullptr) {
+    m_snapshot->check_natives(m_natives);
+    for (uint32_t i = 0; i < m_snapshot->global_count(); ++i) {
+      m_globals.emplace(m_snapshot->global_name(i), i);
+      // The prelude may have replaced a native
+      if (i < m_natives.size() && !m_snapshot->holds_native(i)) {
+        m_redefined.insert(i);
+      }
+    }
+  } else {
+    for (uint32_t i = 0; i < m_natives.size(); ++i) {
+      m_globals.emplace(m_natives[i]->name(), i);
+    }
+  }
+
+  // Slot 0 of the top-level frame is reserved like in any function, and
+  // nothing can refer to it
+  m_functions.push_back(FunctionScope{FunctionKind::SCRIPT,
+                                      {Local{"", 0, true}},
+                                      0,
+                                      1});
+  resolve(program.statements);
+  if (program.result) {
+    resolve(program.result.get());
+  }
+  program.frame_size = m_functions.back().frame_size;
+  program.global_count = static_cast<uint32_t>(m_globals.size());
+  program.native_count = m_natives.size();
+  program.prelude_count =
+      m_snapshot != nullptr ? m_snapshot->global_count() : 0;
+  m_functions.clear();
+  bind_natives();
+}
+
+void Resolver::visit(Literal &) {}
+
+void Resolver::visit(Binary &expr) {
+  resolve(expr.m_left.get());
+  resolve(expr.m_right.get());
+}
+
+void Resolver::visit(Unary &expr) { resolve(expr.m_right.get()); }
+
+void Resolver::visit(Grouping &expr) { resolve(expr.m_expr.get()); }
+
+void Resolver::visit(Logical &expr) {
+  resolve(expr.m_left.get());
+  resolve(expr.m_right.get());
+}
+
+void Resolver::visit(Constant &) {}
+
+void Resolver::visit(Hoisted &expr) { resolve(expr.m_expr.get()); }
+
+void Resolver::visit(Shared &expr) {
+  // A reference is resolved through its owner
+  if (expr.m_owner) {
+    resolve(expr.m_owner.get());
+  }
+}
+
+void Resolver::visit(Variable &expr) {
+  resolve_variable(expr.m_name.lexeme(), expr.m_name, expr.m_slot);
+}
+
+void Resolver::visit(Assign &expr) {
+  resolve(expr.m_value.get());
+  resolve_variable(expr.m_name.lexeme(), expr.m_name, expr.m_slot);
+  if (expr.m_slot.kind == VariableSlot::Kind::GLOBAL) {
+    m_redefined.insert(expr.m_slot.index);
+  }
+}
+
+void Resolver::visit(Call &expr) {
+  resolve(expr.m_callee.get());
+  if (expr.m_callee->kind() == ExprKind::VARIABLE) {
+    auto const &callee = static_cast<Variable const &>(*expr.m_callee);
+    if (callee.m_slot.kind == VariableSlot::Kind::GLOBAL &&
+        callee.m_slot.index < m_natives.size()) {
+      m_native_calls.push_back(&expr);
+    }
+  }
+  for (auto &argument : expr.m_arguments) {
+    resolve(argument.get());
+  }
+}
+
+void Resolver::visit(Get &expr) { resolve(expr.m_object.get()); }
+
+void Resolver::visit(Set &expr) {
+  resolve(expr.m_value.get());
+  resolve(expr.m_object.get());
+}
+
+void Resolver::visit(Invoke &expr) {
+  resolve(expr.m_object.get());
+  for (auto &argument : expr.m_arguments) {
+    resolve(argument.get());
+  }
+}
+
+void Resolver::visit(Array &expr) {
+  for (auto &element : expr.m_elements) {
+    resolve(element.get());
+  }
+}
+
+void Resolver::visit(Map &expr) {
+  for (std::size_t i = 0; i < expr.m_keys.size(); ++i) {
+    resolve(expr.m_keys[i].get());
+    resolve(expr.m_values[i].get());
+  }
+}
+
+void Resolver::visit(Index &expr) {
+  resolve(expr.m_object.get());
+  resolve(expr.m_index.get());
+}
+
+void Resolver::visit(SetIndex &expr) {
+  resolve(expr.m_object.get());
+  resolve(expr.m_index.get());
+  resolve(expr.m_value.get());
+}
+
+void Resolver::visit(This &expr) {
+  if (m_class == ClassKind::NONE) {
+    error(expr.m_keyword, ErrorCode::THIS_OUTSIDE_CLASS);
+    return;
+  }
+  resolve_variable("this", expr.m_keyword, expr.m_slot);
+}
+
+void Resolver::visit(Super &expr) {
+  if (m_class == ClassKind::NONE) {
+    error(expr.m_keyword, ErrorCode::SUPER_OUTSIDE_CLASS);
+    return;
+  } else if (m_class == ClassKind::CLASS) {
+    error(expr.m_keyword, ErrorCode::SUPER_WITHOUT_SUPERCLASS);
+    return;
+  }
+  // `super.method` is bound to the receiver
+  resolve_variable("this", expr.m_keyword, expr.m_slot);
+}
+
+void Resolver::visit(Expression &stmt) { resolve(stmt.m_expr.get()); }
+
+void Resolver::visit(Print &stmt) { resolve(stmt.m_expr.get()); }
+
+void Resolver::visit(Var &stmt) {
+  declare(stmt.m_name, &stmt.m_slot);
+  if (stmt.m_initializer) {
+    resolve(stmt.m_initializer.get());
+  }
+  define();
+}
+
+void Resolver::visit(Block &stmt) {
+  begin_scope();
+  resolve(stmt.m_statements);
+  end_scope();
+}
+
+void Resolver::visit(If &stmt) {
+  resolve(stmt.m_condition.get());
+  dispatch(*stmt.m_then_branch, *this);
+  if (stmt.m_else_branch) {
+    dispatch(*stmt.m_else_branch, *this);
+  }
+}
+
+void Resolver::visit(While &stmt) {
+  if (stmt.m_condition) {
+    resolve(stmt.m_condition.get());
+  }
+  dispatch(*stmt.m_body, *this);
+}
+
+void Resolver::visit(Function &stmt) {
+  // Defined before its body, so that it can call itself
+  declare(stmt.m_name, &stmt.m_slot);
+  define();
+  // Slot 0 holds the function itself, which nothing can refer to
+  resolve_function(stmt, FunctionKind::FUNCTION, "");
+}
+
+void Resolver::visit(Class &stmt) {
+  ClassKind const enclosing = m_class;
+  m_class = ClassKind::CLASS;
+
+  declare(stmt.m_name, &stmt.m_slot);
+  define();
+
+  if (stmt.m_superclass) {
+    auto const &superclass = static_cast<Variable &>(*stmt.m_superclass);
+    if (superclass.m_name.lexeme() == stmt.m_name.lexeme()) {
+      error(superclass.m_name, ErrorCode::INHERIT_FROM_ITSELF);
+    }
+    m_class = ClassKind::SUBCLASS;
+    resolve(stmt.m_superclass.get());
+  }
+
+  for (auto &method : stmt.m_methods) {
+    bool const is_initializer = method->m_name.lexeme() == "init";
+    resolve_function(*method,
+                     is_initializer ? FunctionKind::INITIALIZER
+                                    : FunctionKind::METHOD,
+                     "this");
+  }
+
+  m_class = enclosing;
+}
+
+void Resolver::visit(Return &stmt) {
+  FunctionKind const kind = m_functions.back().kind;
+  if (kind == FunctionKind::SCRIPT) {
+    error(stmt.m_keyword, ErrorCode::RETURN_FROM_TOP_LEVEL);
+  } else if (stmt.m_value && kind == FunctionKind::INITIALIZER) {
+    error(stmt.m_keyword, ErrorCode::RETURN_VALUE_FROM_INITIALIZER);
+  }
+  if (stmt.m_value) {
+    resolve(stmt.m_value.get());
+    // An initializer returns `this`, not the value of the call
+    stmt.m_tail_call = kind != FunctionKind::INITIALIZER &&
+                       (stmt.m_value->kind() == ExprKind::CALL ||
+                        stmt.m_value->kind() == ExprKind::INVOKE);
+  }
+}
+
+void Resolver::resolve_function(Function &function, FunctionKind kind,
+                                std::string_view receiver) {
+  m_functions.push_back(FunctionScope{kind, {Local{receiver, 0, true}}, 1, 1});
+  for (Token const *param : function.m_params) {
+    declare(*param, nullptr);
+    define();
+  }
+  resolve(function.m_body);
+
+  auto &current = m_functions.back();
+  function.m_frame_size = current.frame_size;
+  // Arguments are pushed unboxed, the captured ones are boxed on entry
+  function.m_boxed_params.clear();
+  for (uint32_t i = 1; i <= function.m_params.size(); ++i) {
+    if (current.locals[i].captured) {
+      function.m_boxed_params.push_back(i);
+    }
+  }
+  function.m_captures = std::move(current.captures);
+  m_functions.pop_back();
+}
+
+void Resolver::resolve_variable(std::string_view name, Token const &token,
+                                VariableSlot &slot) {
+  auto &current = m_functions.back();
+  for (auto i = current.locals.size(); i-- > 0;) {
+    auto &local = current.locals[i];
+    if (local.name != name) {
+      continue;
+    }
+    if (!local.defined) {
+      error(token, ErrorCode::READ_IN_OWN_INITIALIZER);
+      return;
+    }
+    auto const index = static_cast<uint32_t>(i);
+    if (local.captured) {
+      slot = VariableSlot{VariableSlot::Kind::BOXED, index};
+    } else {
+      slot = VariableSlot{VariableSlot::Kind::LOCAL, index};
+      local.slots.push_back(&slot);
+    }
+    return;
+  }
+
+  if (auto const index = resolve_upvalue(m_functions.size() - 1, name);
+      index >= 0) {
+    slot = VariableSlot{VariableSlot::Kind::UPVALUE,
+                        static_cast<uint32_t>(index)};
+    return;
+  }
+
+  // Globals may be declared after the functions using them
+  auto const [it, inserted] = m_globals.try_emplace(
+      name, static_cast<uint32_t>(m_globals.size()));
+  slot = VariableSlot{VariableSlot::Kind::GLOBAL, it->second};
+}
+
+int64_t Resolver::resolve_upvalue(std::size_t function,
+                                  std::string_view name) {
+  if (function == 0) {
+    return -1;
+  }
+
+  auto const &enclosing = m_functions[function - 1];
+  std::optional<Capture> capture;
+  for (auto i = enclosing.locals.size(); i-- > 0;) {
+    if (enclosing.locals[i].name != name) {
+      continue;
+    }
+    auto const index = static_cast<uint32_t>(i);
+    if (index == 0) {
+      // The receiver never changes, a copy is as good as a cell
+      capture = Capture{Capture::Kind::VALUE, index};
+    } else {
+      capture_local(function - 1, index);
+      capture = Capture{Capture::Kind::CELL, index};
+    }
+    break;
+  }
+  if (!capture) {
+    auto const index = resolve_upvalue(function - 1, name);
+    if (index < 0) {
+      return -1;
+    }
+    capture = Capture{Capture::Kind::UPVALUE, static_cast<uint32_t>(index)};
+  }
+
+  auto &captures = m_functions[function].captures;
+  auto const it = std::find(captures.begin(), captures.end(), *capture);
+  if (it != captures.end()) {
+    return it - captures.begin();
+  }
+  captures.push_back(*capture);
+  return static_cast<int64_t>(captures.size() - 1);
+}
+
+void Resolver::capture_local(std::size_t function, uint32_t index) {
+  auto &local = m_functions[function].locals[index];
+  if (local.captured) {
+    return;
+  }
+  local.captured = true;
+  for (VariableSlot *slot : local.slots) {
+    slot->kind = VariableSlot::Kind::BOXED;
+  }
+  local.slots.clear();
+}
+
+void Resolver::end_scope() {
+  auto &current = m_functions.back();
+  --current.depth;
+  while (current.locals.back().depth > current.depth) {
+    current.locals.pop_back();
+  }
+}
+
+void Resolver::declare(Token const &name, VariableSlot *slot) {
+  auto &current = m_functions.back();
+  if (current.kind == FunctionKind::SCRIPT && current.depth == 0) {
+    auto const [it, inserted] = m_globals.try_emplace(
+        name.lexeme(), static_cast<uint32_t>(m_globals.size()));
+    *slot = VariableSlot{VariableSlot::Kind::GLOBAL, it->second};
+    m_redefined.insert(it->second);
+    return;
+  }
+
+  for (auto it = current.locals.rbegin(); it != current.locals.rend(); ++it) {
+    if (it->depth < current.depth) {
+      break;
+    }
+    if (it->name == name.lexeme()) {
+      error(name, ErrorCode::ALREADY_DECLARED);
+      break;
+    }
+  }
+  auto const index = static_cast<uint32_t>(current.locals.size());
+  current.locals.push_back(Local{name.lexeme(), current.depth, false});
+  if (slot != nullptr) {
+    *slot = VariableSlot{VariableSlot::Kind::LOCAL, index};
+    current.locals.back().slots.push_back(slot);
+  }
+  current.frame_size = std::max(
+      current.frame_size, static_cast<uint32_t>(current.locals.size()));
+}
+
+void Resolver::define() {
+  auto &current = m_functions.back();
+  if (current.kind == FunctionKind::SCRIPT && current.depth == 0) {
+    return;
+  }
+  current.locals.back().defined = true;
+}
+
+void Resolver::bind_natives() {
+  for (Call *call : m_native_calls) {
+    auto const index =
+        static_cast<Variable const &>(*call->m_callee).m_slot.index;
+    if (m_redefined.contains(index)) {
+      continue;
+    }
+    if (call->m_arguments.size() != m_natives[index]->arity()) {
+      error(call->m_paren, ErrorCode::NATIVE_WRONG_ARITY);
+      continue;
+    }
+    call->m_native = static_cast<int32_t>(index);
+  }
+  m_native_calls.clear();
+}
+
+void Resolver::error(Token const &token, ErrorCode code) {
+  syntax_error(Diagnostic{code, token.offset(), &token});
+}
+
+} // namespace Lox
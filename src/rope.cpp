@@ -0,0 +1,52 @@
+#include "rope.h"
+
+#include <vector>
+
+namespace Lox {
+
+Rope::~Rope() noexcept {
+  // A leaf, or a rope whose children live on, is done at once
+  if (owns_children(m_left)) {
+    dismantle(std::move(m_left));
+  }
+  if (owns_children(m_right)) {
+    dismantle(std::move(m_right));
+  }
+}
+
+void Rope::dismantle(Ptr rope) noexcept {
+  // Rotate right until the left child is not one to dismantle, then destroy
+  // the rope and go on with its right child. A rope is only destroyed once
+  // it owns no children to dismantle, so this never recurses
+  while (rope) {
+    if (owns_children(rope->m_left)) {
+      Ptr left = std::move(rope->m_left);
+      rope->m_left = std::move(left->m_right);
+      left->m_right = std::move(rope);
+      rope = std::move(left);
+    } else if (owns_children(rope->m_right)) {
+      rope = Ptr(std::move(rope->m_right));
+    } else {
+      rope.reset();
+    }
+  }
+}
+
+void Rope::flatten() const {
+  m_flat.reserve(m_size);
+  std::vector<Rope const *> pending{m_right.get(), m_left.get()};
+  while (!pending.empty()) {
+    auto const *rope = pending.back();
+    pending.pop_back();
+    if (rope->m_left) {
+      pending.push_back(rope->m_right.get());
+      pending.push_back(rope->m_left.get());
+    } else {
+      m_flat += rope->m_flat;
+    }
+  }
+  m_left.reset();
+  m_right.reset();
+}
+
+} // namespace Lox
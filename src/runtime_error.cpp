@@ -2,6 +2,6 @@
 
 namespace Lox {
 
-std::vector<std::string> runtime_error_msgs;
+std::vector<Diagnostic> runtime_errors;
 
 } // namespace Lox
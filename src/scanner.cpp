@@ -1,6 +1,8 @@
 #include "scanner.h"
 
 #include "error.h"
+#include "memory_account.h"
+#include "number.h"
 #include <unordered_map>
 
 namespace Lox {
@@ -10,78 +12,22 @@ std::ostream &operator<<(std::ostream &out, Token const &token) {
       << "\"" << token.m_lexeme << "\"";
 
   if (token.m_type == TokenType::STRING) {
-    out << " \"" << token.m_literal.str << "\"";
+    out << " \"" << token.str_literal() << "\"";
   } else if (token.m_type == TokenType::NUMBER) {
-    out << std::fixed << " " << token.m_literal.number;
+    NumberBuffer buffer;
+    out << " " << format_number(token.m_number, buffer);
   }
   return out;
 }
 
-void Token::swap(Token &other) noexcept {
-  std::swap(m_lineno, other.m_lineno);
-  std::swap(m_type, other.m_type);
-  m_lexeme.swap(other.m_lexeme);
-  std::swap(m_literal, other.m_literal);
-}
-
-Token::Token(uint32_t lineno, TokenType type, std::string lexeme)
-    : m_lineno(lineno), m_type(type), m_lexeme(std::move(lexeme)) {
-  if (type == TokenType::STRING) {
-    // Initialize string literal
-    // The head and tail of m_lexeme are "
-    auto const len = m_lexeme.size() - 2;
-    m_literal.str = new char[len + 1];
-    std::memcpy(m_literal.str, m_lexeme.c_str() + 1, len);
-    m_literal.str[len] = '\0';
-  } else if (type == TokenType::NUMBER) {
-    // Initialize number literal
-    double number = std::stod(m_lexeme);
-    m_literal.number = number;
-  }
-}
-
-Token::Token(Token const &other)
-    : Token(other.m_lineno, other.m_type, other.m_lexeme) {
-  if (other.m_type == TokenType::STRING) {
-    auto const str_len = std::strlen(m_literal.str);
-    char *new_str = new char[str_len + 1];
-    std::memcpy(new_str, other.m_literal.str, str_len + 1);
-    m_literal.str = new_str;
-  } else {
-    m_literal.data = other.m_literal.data;
+Token::Token(uint32_t offset, TokenType type, std::string_view lexeme)
+    : m_lexeme(lexeme), m_offset(offset), m_type(type) {
+  if (type == TokenType::NUMBER) {
+    m_number = parse_number(lexeme.data(), lexeme.data() + lexeme.size());
   }
 }
 
-Token::Token(Token &&other) noexcept {
-  m_lineno = other.m_lineno;
-  m_type = other.m_type;
-  m_lexeme = std::move(other.m_lexeme);
-  m_literal = other.m_literal;
-
-  other.m_type = TokenType::END;
-}
-
-Token &Token::operator=(Token const &other) {
-  Token tmp{other};
-  tmp.swap(*this);
-
-  return *this;
-}
-
-Token &Token::operator=(Token &&other) noexcept {
-  Token tmp{std::move(other)};
-  tmp.swap(*this);
-
-  return *this;
-}
-
-Token::~Token() noexcept {
-  if (m_type == TokenType::STRING) {
-    delete[] m_literal.str;
-  }
-}
-
-std::unordered_map<std::string, TokenType> Scanner::keywords = {
+std::unordered_map<std::string_view, TokenType> Scanner::keywords = {
     {"var", TokenType::VAR},     {"true", TokenType::TRUE},
     {"false", TokenType::FALSE}, {"nil", TokenType::NIL},
     {"fun", TokenType::FUN},     {"return", TokenType::RETURN},
@@ -97,14 +43,12 @@ void Scanner::tokenize_string() {
     if (match('"')) {
       add_token(TokenType::STRING);
       return;
-    } else if (match('\n')) {
-      // Lox supports multi-line string literals
-      ++m_lineno;
     } else {
+      // Lox supports multi-line string literals
       skip();
     }
   }
-  Lox::syntax_error(m_lineno, "Unterminated string literal");
+  error(ErrorCode::UNTERMINATED_STRING);
 }
 
 void Scanner::tokenize_number() {
@@ -122,7 +66,9 @@ void Scanner::tokenize_number() {
     skip_digits();
   }
 
-  add_token(TokenType::NUMBER);
+  char const *const source = m_source.data();
+  m_tokens.emplace_back(m_start, lexeme(),
+                        parse_number(source + m_start, source + m_current));
 }
 
 void Scanner::tokenize_identifier() {
@@ -130,24 +76,44 @@ void Scanner::tokenize_identifier() {
     // nop
   }
 
-  std::string identifier(m_source, m_start, m_current - m_start);
-
-  auto iter = keywords.find(identifier);
+  auto iter = keywords.find(lexeme());
   if (iter != keywords.end()) {
-    add_token(iter->second, std::move(identifier));
+    add_token(iter->second);
   } else {
-    add_token(TokenType::IDENTIFIER, std::move(identifier));
+    add_token(TokenType::IDENTIFIER);
   }
 }
-std::vector<Token> const &Scanner::scan_tokens() {
-  while (!is_at_end()) {
-    m_start = m_current;
-    scan_token();
-  }
-  add_token(TokenType::END, "");
+
+TokenList const &Scanner::scan_tokens() {
+  scan_range();
+  report_errors();
+  m_start = m_current;
+  add_token(TokenType::END);
   return m_tokens;
 }
 
+void Scanner::scan_range() {
+  try {
+    while (!is_at_end()) {
+      m_start = m_current;
+      scan_token();
+    }
+  } catch (MemoryLimitError const &) {
+    // The tokens found so far are dropped, their storage is kept for `END`
+    m_errors.push_back(ScanError{static_cast<uint32_t>(m_start),
+                                 ErrorCode::OUT_OF_MEMORY});
+    m_tokens.clear();
+    m_current = m_end;
+  }
+}
+
+void Scanner::report_errors() {
+  for (auto const &error : m_errors) {
+    Lox::syntax_error(Diagnostic{error.code, error.offset, nullptr});
+  }
+  m_errors.clear();
+}
+
 void Scanner::scan_token() {
   char const c = advance();
   switch (c) {
@@ -163,9 +129,18 @@ void Scanner::scan_token() {
   case '}':
     add_token(TokenType::RIGHT_BRACE);
     break;
+  case '[':
+    add_token(TokenType::LEFT_BRACKET);
+    break;
+  case ']':
+    add_token(TokenType::RIGHT_BRACKET);
+    break;
   case ',':
     add_token(TokenType::COMMA);
     break;
+  case ':':
+    add_token(TokenType::COLON);
+    break;
   case '.':
     add_token(TokenType::DOT);
     break;
@@ -202,7 +177,7 @@ void Scanner::scan_token() {
     break;
   case '>':
     match('=') ? add_token(TokenType::GREATER_EQUAL)
-               : add_token(TokenType::GREATER_EQUAL);
+               : add_token(TokenType::GREATER);
     break;
   case '"':
     tokenize_string();
@@ -210,10 +185,8 @@ void Scanner::scan_token() {
   case ' ':
   case '\r':
   case '\t':
-    // Ignore whitespaces
-    break;
   case '\n':
-    ++m_lineno;
+    // Ignore whitespaces
     break;
   default:
     if (is_digit(c)) {
@@ -223,7 +196,7 @@ void Scanner::scan_token() {
       tokenize_identifier();
       break;
     }
-    syntax_error(m_lineno, "Invalid character");
+    error(ErrorCode::INVALID_CHARACTER);
     break;
   }
 }
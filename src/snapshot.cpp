@@ -0,0 +1,1407 @@
+#include "snapshot.h"
+#include "error.h"
+#include "scanner.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Lox {
+
+namespace {
+
+constexpr std::string_view kMagic = "LOXSNAP";
+constexpr uint32_t kVersion = 4;
+/**
+ * Written in the native byte order, like everything else, to reject the
+ * snapshots of another architecture.
+ */
+constexpr uint32_t kByteOrder = 0x01020304;
+/**
+ * The kind of a null child.
+ */
+constexpr uint8_t kNull = 0xff;
+/**
+ * The number of no object, as `Snapshot::kNoObject`.
+ */
+constexpr uint32_t kNoObject = std::numeric_limits<uint32_t>::max();
+
+enum class ValueTag : uint8_t { NIL, FALSE, TRUE, NUMBER, STRING, OBJECT };
+
+/**
+ * A section of a snapshot being written.
+ */
+class Encoder {
+public:
+  template <typename T> void put(T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    m_bytes.append(reinterpret_cast<char const *>(&value), sizeof(value));
+  }
+
+  void put_string(std::string_view str) {
+    put(static_cast<uint32_t>(str.size()));
+    m_bytes.append(str);
+  }
+
+  void append(Encoder const &other) { m_bytes += other.m_bytes; }
+
+  [[nodiscard]] std::string const &bytes() const noexcept { return m_bytes; }
+
+private:
+  std::string m_bytes;
+};
+
+/**
+ * A snapshot being read, which throws on anything out of bounds.
+ */
+class Decoder {
+public:
+  Decoder(char const *data, std::size_t size)
+      : m_data(data), m_end(data + size) {}
+
+  template <typename T> [[nodiscard]] T get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    std::memcpy(&value, take(sizeof(T)), sizeof(T));
+    return value;
+  }
+
+  [[nodiscard]] bool get_bool() { return get<uint8_t>() != 0; }
+
+  /**
+   * @brief A string, which stays in the snapshot.
+   */
+  [[nodiscard]] std::string_view get_string() {
+    auto const size = get<uint32_t>();
+    return {take(size), size};
+  }
+
+  /**
+   * @brief An index, below `count`.
+   */
+  [[nodiscard]] uint32_t get_index(std::size_t count) {
+    auto const index = get<uint32_t>();
+    if (index >= count) {
+      corrupt();
+    }
+    return index;
+  }
+
+  /**
+   * @brief The size of a list, whose items take a byte at least.
+   */
+  [[nodiscard]] uint32_t get_count() {
+    return get_index(static_cast<std::size_t>(m_end - m_data) + 1);
+  }
+
+  [[nodiscard]] bool at_end() const noexcept { return m_data == m_end; }
+
+  [[noreturn]] static void corrupt() { throw Exception("Corrupt snapshot."); }
+
+private:
+  char const *take(std::size_t size) {
+    if (size > static_cast<std::size_t>(m_end - m_data)) {
+      corrupt();
+    }
+    char const *const bytes = m_data;
+    m_data += size;
+    return bytes;
+  }
+
+private:
+  char const *m_data;
+  char const *m_end;
+};
+
+/**
+ * @brief Encode `value`, unless it is an object.
+ */
+[[nodiscard]] bool put_primitive(Encoder &out, Value const &value) {
+  if (value.is_nil()) {
+    out.put(ValueTag::NIL);
+  } else if (value.is_boolean()) {
+    out.put(value.boolean() ? ValueTag::TRUE : ValueTag::FALSE);
+  } else if (value.is_number()) {
+    out.put(ValueTag::NUMBER);
+    out.put(value.number());
+  } else if (value.is_string()) {
+    out.put(ValueTag::STRING);
+    out.put_string(value.str());
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Encode an AST, numbering the tokens, the expressions and the function
+ * declarations it refers to in the order they are written. The names of
+ * the globals are collected on the way.
+ */
+class AstWriter final : public AstNodeVisitor {
+public:
+  explicit AstWriter(std::size_t global_count) : m_names(global_count) {}
+
+  AstWriter(AstWriter const &) = delete;
+
+  AstWriter &operator=(AstWriter const &) = delete;
+
+  ~AstWriter() noexcept override = default;
+
+  void write(Program const &program) {
+    write(program.statements);
+    write(program.result.get());
+  }
+
+  [[nodiscard]] Encoder const &nodes() const noexcept { return m_nodes; }
+
+  [[nodiscard]] Encoder const &tokens() const noexcept { return m_tokens; }
+
+  [[nodiscard]] uint32_t token_count() const noexcept {
+    return static_cast<uint32_t>(m_token_ids.size());
+  }
+
+  [[nodiscard]] std::unordered_map<Function const *, uint32_t> const &
+  functions() const noexcept {
+    return m_functions;
+  }
+
+  /**
+   * @brief The name of the global `index`, empty if no node refers to it.
+   */
+  [[nodiscard]] std::string_view name(uint32_t index) const noexcept {
+    return m_names[index];
+  }
+
+  void visit(Literal &expr) override { write(expr.m_token); }
+
+  void visit(Binary &expr) override {
+    write(expr.m_left.get());
+    write(expr.m_op);
+    write(expr.m_right.get());
+    m_nodes.put(expr.m_unchecked);
+  }
+
+  void visit(Unary &expr) override {
+    write(expr.m_op);
+    write(expr.m_right.get());
+    m_nodes.put(expr.m_unchecked);
+  }
+
+  void visit(Grouping &expr) override { write(expr.m_expr.get()); }
+
+  void visit(Logical &expr) override {
+    write(expr.m_left.get());
+    write(expr.m_op);
+    write(expr.m_right.get());
+  }
+
+  void visit(Constant &expr) override {
+    write(expr.m_token);
+    if (!put_primitive(m_nodes, expr.m_value)) {
+      throw Exception("A snapshot cannot hold an object constant.");
+    }
+  }
+
+  void visit(Hoisted &expr) override {
+    write(expr.m_expr.get());
+    m_nodes.put(expr.m_slot);
+  }
+
+  void visit(Shared &expr) override {
+    m_nodes.put(expr.m_owner != nullptr);
+    if (expr.m_owner) {
+      write(expr.m_owner.get());
+      return;
+    }
+    // The reader refers to the nodes it already built only
+    auto const it = m_expr_ids.find(&expr.m_expr);
+    if (it == m_expr_ids.end()) {
+      throw Exception("A snapshot cannot hold a shared subexpression "
+                      "before its owner.");
+    }
+    m_nodes.put(it->second);
+  }
+
+  void visit(Variable &expr) override {
+    write(expr.m_name);
+    write(expr.m_name, expr.m_slot);
+  }
+
+  void visit(Assign &expr) override {
+    write(expr.m_name);
+    write(expr.m_value.get());
+    write(expr.m_name, expr.m_slot);
+  }
+
+  void visit(Call &expr) override {
+    write(expr.m_callee.get());
+    write(expr.m_paren);
+    write(expr.m_arguments);
+    m_nodes.put(expr.m_native);
+  }
+
+  void visit(Get &expr) override {
+    write(expr.m_object.get());
+    write(expr.m_name);
+  }
+
+  void visit(Set &expr) override {
+    write(expr.m_object.get());
+    write(expr.m_name);
+    write(expr.m_value.get());
+  }
+
+  void visit(Invoke &expr) override {
+    write(expr.m_object.get());
+    write(expr.m_name);
+    write(expr.m_paren);
+    write(expr.m_arguments);
+  }
+
+  void visit(Array &expr) override {
+    write(expr.m_bracket);
+    write(expr.m_elements);
+  }
+
+  void visit(Map &expr) override {
+    write(expr.m_brace);
+    write(expr.m_keys);
+    write(expr.m_values);
+  }
+
+  void visit(Index &expr) override {
+    write(expr.m_object.get());
+    write(expr.m_bracket);
+    write(expr.m_index.get());
+  }
+
+  void visit(SetIndex &expr) override {
+    write(expr.m_object.get());
+    write(expr.m_bracket);
+    write(expr.m_index.get());
+    write(expr.m_value.get());
+  }
+
+  void visit(This &expr) override {
+    write(expr.m_keyword);
+    write(expr.m_keyword, expr.m_slot);
+  }
+
+  void visit(Super &expr) override {
+    write(expr.m_keyword);
+    write(expr.m_method);
+    write(expr.m_keyword, expr.m_slot);
+  }
+
+  void visit(Expression &stmt) override { write(stmt.m_expr.get()); }
+
+  void visit(Print &stmt) override {
+    write(stmt.m_keyword);
+    write(stmt.m_expr.get());
+  }
+
+  void visit(Var &stmt) override {
+    write(stmt.m_name);
+    write(stmt.m_initializer.get());
+    write(stmt.m_name, stmt.m_slot);
+  }
+
+  void visit(Block &stmt) override { write(stmt.m_statements); }
+
+  void visit(If &stmt) override {
+    write(stmt.m_keyword);
+    write(stmt.m_condition.get());
+    write(stmt.m_then_branch.get());
+    write(stmt.m_else_branch.get());
+  }
+
+  void visit(While &stmt) override {
+    write(stmt.m_keyword);
+    write(stmt.m_condition.get());
+    write(stmt.m_body.get());
+    write(stmt.m_hoisted);
+  }
+
+  void visit(Function &stmt) override {
+    m_functions.emplace(&stmt, static_cast<uint32_t>(m_functions.size()));
+    write(stmt.m_name);
+    m_nodes.put(static_cast<uint32_t>(stmt.m_params.size()));
+    for (Token const *param : stmt.m_params) {
+      write(*param);
+    }
+    write(stmt.m_body);
+    write(stmt.m_name, stmt.m_slot);
+    m_nodes.put(stmt.m_frame_size);
+    m_nodes.put(static_cast<uint32_t>(stmt.m_captures.size()));
+    for (auto const capture : stmt.m_captures) {
+      m_nodes.put(capture.kind);
+      m_nodes.put(capture.index);
+    }
+    write(stmt.m_boxed_params);
+  }
+
+  void visit(Class &stmt) override {
+    write(stmt.m_name);
+    write(stmt.m_superclass.get());
+    m_nodes.put(static_cast<uint32_t>(stmt.m_methods.size()));
+    for (auto const &method : stmt.m_methods) {
+      visit(*method);
+    }
+    write(stmt.m_name, stmt.m_slot);
+  }
+
+  void visit(Return &stmt) override {
+    write(stmt.m_keyword);
+    write(stmt.m_value.get());
+    m_nodes.put(stmt.m_tail_call);
+  }
+
+private:
+  void write(Expr *expr) {
+    if (expr == nullptr) {
+      m_nodes.put(kNull);
+      return;
+    }
+    m_expr_ids.emplace(expr, static_cast<uint32_t>(m_expr_ids.size()));
+    m_nodes.put(expr->kind());
+    m_nodes.put(expr->m_type.bits);
+    dispatch(*expr, *this);
+  }
+
+  void write(Stmt *stmt) {
+    if (stmt == nullptr) {
+      m_nodes.put(kNull);
+      return;
+    }
+    m_nodes.put(stmt->kind());
+    dispatch(*stmt, *this);
+  }
+
+  void write(ExprList const &exprs) {
+    m_nodes.put(static_cast<uint32_t>(exprs.size()));
+    for (auto const &expr : exprs) {
+      write(expr.get());
+    }
+  }
+
+  void write(StmtList const &stmts) {
+    m_nodes.put(static_cast<uint32_t>(stmts.size()));
+    for (auto const &stmt : stmts) {
+      write(stmt.get());
+    }
+  }
+
+  void write(std::vector<uint32_t> const &indexes) {
+    m_nodes.put(static_cast<uint32_t>(indexes.size()));
+    for (uint32_t const index : indexes) {
+      m_nodes.put(index);
+    }
+  }
+
+  void write(Token const &token) {
+    auto const [it, inserted] = m_token_ids.try_emplace(
+        &token, static_cast<uint32_t>(m_token_ids.size()));
+    if (inserted) {
+      m_tokens.put(token.offset());
+      m_tokens.put(token.type());
+      m_tokens.put_string(token.lexeme());
+      if (token.type() == TokenType::NUMBER) {
+        m_tokens.put(token.number_literal());
+      }
+    }
+    m_nodes.put(it->second);
+  }
+
+  /**
+   * @brief Write `slot`, the slot of the variable `name`.
+   */
+  void write(Token const &name, VariableSlot slot) {
+    m_nodes.put(slot.kind);
+    m_nodes.put(slot.index);
+    if (slot.kind == VariableSlot::Kind::GLOBAL &&
+        slot.index < m_names.size()) {
+      m_names[slot.index] = name.lexeme();
+    }
+  }
+
+private:
+  Encoder m_nodes;
+  Encoder m_tokens;
+  std::unordered_map<Token const *, uint32_t> m_token_ids;
+  std::unordered_map<Expr const *, uint32_t> m_expr_ids;
+  std::unordered_map<Function const *, uint32_t> m_functions;
+  std::vector<std::string_view> m_names;
+};
+
+/**
+ * Encode the objects reachable from the globals of a prelude, numbered in
+ * the order they are written, each after the objects it is built from. The
+ * values of cells and the fields of instances are written apart, once every
+ * object they refer to has a number.
+ */
+class HeapWriter {
+public:
+  HeapWriter(NativeRegistry const &natives,
+             std::unordered_map<Function const *, uint32_t> const &functions)
+      : m_functions(functions) {
+    for (uint32_t i = 0; i < natives.size(); ++i) {
+      m_natives.emplace(natives[i].get(), i);
+    }
+  }
+
+  HeapWriter(HeapWriter const &) = delete;
+
+  HeapWriter &operator=(HeapWriter const &) = delete;
+
+  ~HeapWriter() noexcept = default;
+
+  void put_value(Encoder &out, Value const &value) {
+    if (!put_primitive(out, value)) {
+      uint32_t const object = id(*value.object());
+      out.put(ValueTag::OBJECT);
+      out.put(object);
+    }
+  }
+
+  /**
+   * @brief Write the contents of the cells, the instances, the arrays and
+   *        the maps written so far, and of those they refer to.
+   */
+  void fill() {
+    while (!m_unfilled.empty()) {
+      Object const &object = *m_unfilled.back();
+      m_unfilled.pop_back();
+      m_fills.put(m_ids.at(&object));
+      ++m_fill_count;
+      if (object.kind() == Object::Kind::CELL) {
+        put_value(m_fills, static_cast<Cell const &>(object).value());
+        continue;
+      }
+      if (object.kind() == Object::Kind::ARRAY) {
+        auto const &array = static_cast<LoxArray const &>(object);
+        m_fills.put(static_cast<uint32_t>(array.size()));
+        for (std::size_t i = 0; i < array.size(); ++i) {
+          put_value(m_fills, array.get(i));
+        }
+        continue;
+      }
+      if (object.kind() == Object::Kind::MAP) {
+        auto const &map = static_cast<LoxMap const &>(object);
+        m_fills.put(static_cast<uint32_t>(map.size()));
+        map.for_each([this](Value const &key, Value const &value) {
+          put_value(m_fills, key);
+          put_value(m_fills, value);
+        });
+        continue;
+      }
+      auto const &instance = static_cast<LoxInstance const &>(object);
+      uint32_t const size = instance.shape()->size();
+      std::vector<std::string_view> names(size);
+      for (auto const *shape = instance.shape(); shape->parent() != nullptr;
+           shape = shape->parent()) {
+        names[shape->size() - 1] = shape->name();
+      }
+      m_fills.put(size);
+      for (uint32_t slot = 0; slot < size; ++slot) {
+        m_fills.put_string(names[slot]);
+        put_value(m_fills, instance.field(slot));
+      }
+    }
+  }
+
+  [[nodiscard]] Encoder const &objects() const noexcept { return m_objects; }
+
+  [[nodiscard]] uint32_t object_count() const noexcept {
+    return static_cast<uint32_t>(m_ids.size());
+  }
+
+  [[nodiscard]] Encoder const &fills() const noexcept { return m_fills; }
+
+  [[nodiscard]] uint32_t fill_count() const noexcept { return m_fill_count; }
+
+private:
+  /**
+   * @brief The number of `object`, written first if it was not yet.
+   */
+  uint32_t id(Object const &object) {
+    if (auto const it = m_ids.find(&object); it != m_ids.end()) {
+      return it->second;
+    }
+    // Only cells, instances, arrays and maps, filled later, may refer to
+    // themselves
+    Encoder record;
+    record.put(object.kind());
+    switch (object.kind()) {
+    case Object::Kind::NATIVE: {
+      auto const it = m_natives.find(&object);
+      if (it == m_natives.end()) {
+        throw Exception("A snapshot cannot hold the natives of another "
+                        "interpreter.");
+      }
+      record.put(it->second);
+      break;
+    }
+    case Object::Kind::CELL:
+    case Object::Kind::ARRAY:
+    case Object::Kind::MAP:
+      m_unfilled.push_back(&object);
+      break;
+    case Object::Kind::INSTANCE:
+      record.put(id(*static_cast<LoxInstance const &>(object).klass()));
+      m_unfilled.push_back(&object);
+      break;
+    case Object::Kind::FUNCTION: {
+      auto const &function = static_cast<LoxFunction const &>(object);
+      record.put(declaration(function.declaration()));
+      record.put(function.klass() != nullptr ? id(*function.klass())
+                                             : kNoObject);
+      put_captures(record, function);
+      break;
+    }
+    case Object::Kind::CLASS: {
+      auto const &klass = static_cast<LoxClass const &>(object);
+      record.put_string(klass.name());
+      record.put(klass.superclass() != nullptr ? id(*klass.superclass())
+                                               : kNoObject);
+      record.put(static_cast<uint32_t>(klass.methods().size()));
+      for (auto const &[name, method] : klass.methods()) {
+        record.put(declaration(method->declaration()));
+        put_captures(record, *method);
+      }
+      break;
+    }
+    case Object::Kind::BOUND_METHOD: {
+      auto const &bound = static_cast<BoundMethod const &>(object);
+      record.put(id(*bound.receiver()));
+      record.put(id(*bound.method().klass()));
+      record.put_string(bound.method().declaration().m_name.lexeme());
+      break;
+    }
+    }
+    uint32_t const number = object_count();
+    m_ids.emplace(&object, number);
+    m_objects.append(record);
+    return number;
+  }
+
+  void put_captures(Encoder &record, LoxFunction const &function) {
+    auto const count =
+        static_cast<uint32_t>(function.declaration().m_captures.size());
+    record.put(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      record.put(id(function.capture(i)));
+    }
+  }
+
+  uint32_t declaration(Function const &function) const {
+    auto const it = m_functions.find(&function);
+    if (it == m_functions.end()) {
+      throw Exception("A snapshot cannot hold the functions of another "
+                      "program.");
+    }
+    return it->second;
+  }
+
+private:
+  std::unordered_map<Function const *, uint32_t> const &m_functions;
+  std::unordered_map<Object const *, uint32_t> m_natives;
+  std::unordered_map<Object const *, uint32_t> m_ids;
+  std::vector<Object const *> m_unfilled;
+  Encoder m_objects;
+  Encoder m_fills;
+  uint32_t m_fill_count = 0;
+};
+
+} // namespace
+
+/**
+ * Decode the sections of a snapshot into it, checking their structure.
+ */
+class Snapshot::Reader {
+public:
+  explicit Reader(Snapshot &snapshot)
+      : m_snapshot(snapshot), m_in(snapshot.m_data, snapshot.m_size) {}
+
+  void read() {
+    if (m_in.get_string() != kMagic) {
+      throw Exception("Not a snapshot.");
+    } else if (m_in.get<uint32_t>() != kVersion ||
+               m_in.get<uint32_t>() != kByteOrder) {
+      throw Exception("The snapshot was written by another build.");
+    }
+
+    m_snapshot.m_natives.resize(m_in.get_count());
+    for (auto &native : m_snapshot.m_natives) {
+      native.name = m_in.get_string();
+      native.arity = m_in.get<uint32_t>();
+    }
+    read_line_starts();
+
+    // The nodes refer to the tokens, which must never move
+    auto const token_count = m_in.get_count();
+    m_snapshot.m_tokens.reserve(token_count);
+    for (uint32_t i = 0; i < token_count; ++i) {
+      read_token();
+    }
+    m_snapshot.m_program.statements = stmts();
+    m_snapshot.m_program.result = expr();
+
+    read_names();
+    read_objects();
+    read_fills();
+    read_globals();
+    if (!m_in.at_end()) {
+      Decoder::corrupt();
+    }
+  }
+
+private:
+  void read_line_starts() {
+    std::vector<uint32_t> line_starts(m_in.get_count());
+    for (auto &line_start : line_starts) {
+      line_start = m_in.get<uint32_t>();
+    }
+    if (line_starts.empty() || line_starts.front() != 0 ||
+        !std::ranges::is_sorted(line_starts)) {
+      Decoder::corrupt();
+    }
+    m_snapshot.m_source_map = SourceMap(std::move(line_starts));
+  }
+
+  void read_token() {
+    auto const offset = m_in.get<uint32_t>();
+    auto const type = m_in.get<TokenType>();
+    if (type > TokenType::END) {
+      Decoder::corrupt();
+    }
+    auto const lexeme = m_in.get_string();
+    if (type == TokenType::NUMBER) {
+      m_snapshot.m_tokens.emplace_back(offset, lexeme, m_in.get<double>());
+    } else {
+      m_snapshot.m_tokens.emplace_back(offset, type, lexeme);
+    }
+  }
+
+  Token const &token() {
+    return m_snapshot.m_tokens[m_in.get_index(m_snapshot.m_tokens.size())];
+  }
+
+  VariableSlot slot() {
+    auto const kind = m_in.get<VariableSlot::Kind>();
+    if (kind > VariableSlot::Kind::UPVALUE) {
+      Decoder::corrupt();
+    }
+    return VariableSlot{kind, m_in.get<uint32_t>()};
+  }
+
+  std::vector<uint32_t> indexes() {
+    std::vector<uint32_t> result(m_in.get_count());
+    for (auto &index : result) {
+      index = m_in.get<uint32_t>();
+    }
+    return result;
+  }
+
+  ExprPtr required_expr() {
+    ExprPtr result = expr();
+    if (!result) {
+      Decoder::corrupt();
+    }
+    return result;
+  }
+
+  ExprList exprs() {
+    ExprList result(m_in.get_count());
+    for (auto &expr : result) {
+      expr = required_expr();
+    }
+    return result;
+  }
+
+  ExprPtr expr() {
+    auto const tag = m_in.get<uint8_t>();
+    if (tag == kNull) {
+      return nullptr;
+    }
+    // Numbered before the children, as written
+    auto const id = m_exprs.size();
+    m_exprs.push_back(nullptr);
+    TypeSet const type{m_in.get<uint8_t>()};
+    ExprPtr result;
+    switch (static_cast<ExprKind>(tag)) {
+    case ExprKind::LITERAL:
+      result = std::make_unique<Literal>(token());
+      break;
+    case ExprKind::BINARY: {
+      ExprPtr left = required_expr();
+      Token const &op = token();
+      ExprPtr right = required_expr();
+      auto binary =
+          std::make_unique<Binary>(std::move(left), op, std::move(right));
+      binary->m_unchecked = m_in.get_bool();
+      result = std::move(binary);
+      break;
+    }
+    case ExprKind::UNARY: {
+      Token const &op = token();
+      auto unary = std::make_unique<Unary>(op, required_expr());
+      unary->m_unchecked = m_in.get_bool();
+      result = std::move(unary);
+      break;
+    }
+    case ExprKind::GROUPING:
+      result = std::make_unique<Grouping>(required_expr());
+      break;
+    case ExprKind::LOGICAL: {
+      ExprPtr left = required_expr();
+      Token const &op = token();
+      result =
+          std::make_unique<Logical>(std::move(left), op, required_expr());
+      break;
+    }
+    case ExprKind::CONSTANT: {
+      auto constant = std::make_unique<Constant>(token());
+      Slot const value = this->value(0);
+      constant->m_value = value.value;
+      result = std::move(constant);
+      break;
+    }
+    case ExprKind::HOISTED: {
+      auto hoisted = std::make_unique<Hoisted>(required_expr());
+      hoisted->m_slot = m_in.get<uint32_t>();
+      result = std::move(hoisted);
+      break;
+    }
+    case ExprKind::SHARED:
+      if (m_in.get_bool()) {
+        ExprPtr owner = required_expr();
+        Expr &target = *owner;
+        result = std::make_unique<Shared>(std::move(owner), target);
+      } else {
+        Expr *const target = m_exprs[m_in.get_index(id)];
+        if (target == nullptr) {
+          Decoder::corrupt();
+        }
+        result = std::make_unique<Shared>(nullptr, *target);
+      }
+      break;
+    case ExprKind::VARIABLE: {
+      auto variable = std::make_unique<Variable>(token());
+      variable->m_slot = slot();
+      result = std::move(variable);
+      break;
+    }
+    case ExprKind::ASSIGN: {
+      Token const &name = token();
+      auto assign = std::make_unique<Assign>(name, required_expr());
+      assign->m_slot = slot();
+      result = std::move(assign);
+      break;
+    }
+    case ExprKind::CALL: {
+      ExprPtr callee = required_expr();
+      Token const &paren = token();
+      auto call = std::make_unique<Call>(std::move(callee), paren, exprs());
+      call->m_native = m_in.get<int32_t>();
+      if (call->m_native >= static_cast<int64_t>(
+                                m_snapshot.m_natives.size())) {
+        Decoder::corrupt();
+      }
+      result = std::move(call);
+      break;
+    }
+    case ExprKind::GET: {
+      ExprPtr object = required_expr();
+      result = std::make_unique<Get>(std::move(object), token());
+      break;
+    }
+    case ExprKind::SET: {
+      ExprPtr object = required_expr();
+      Token const &name = token();
+      result =
+          std::make_unique<Set>(std::move(object), name, required_expr());
+      break;
+    }
+    case ExprKind::INVOKE: {
+      ExprPtr object = required_expr();
+      Token const &name = token();
+      Token const &paren = token();
+      result =
+          std::make_unique<Invoke>(std::move(object), name, paren, exprs());
+      break;
+    }
+    case ExprKind::ARRAY: {
+      Token const &bracket = token();
+      result = std::make_unique<Array>(bracket, exprs());
+      break;
+    }
+    case ExprKind::MAP: {
+      Token const &brace = token();
+      ExprList keys = exprs();
+      ExprList values = exprs();
+      if (keys.size() != values.size()) {
+        Decoder::corrupt();
+      }
+      result =
+          std::make_unique<Map>(brace, std::move(keys), std::move(values));
+      break;
+    }
+    case ExprKind::INDEX: {
+      ExprPtr object = required_expr();
+      Token const &bracket = token();
+      result = std::make_unique<Index>(std::move(object), bracket,
+                                       required_expr());
+      break;
+    }
+    case ExprKind::SET_INDEX: {
+      ExprPtr object = required_expr();
+      Token const &bracket = token();
+      ExprPtr index = required_expr();
+      result = std::make_unique<SetIndex>(std::move(object), bracket,
+                                          std::move(index), required_expr());
+      break;
+    }
+    case ExprKind::THIS: {
+      auto self = std::make_unique<This>(token());
+      self->m_slot = slot();
+      result = std::move(self);
+      break;
+    }
+    case ExprKind::SUPER: {
+      Token const &keyword = token();
+      auto super = std::make_unique<Super>(keyword, token());
+      super->m_slot = slot();
+      result = std::move(super);
+      break;
+    }
+    default:
+      Decoder::corrupt();
+    }
+    result->m_type = type;
+    m_exprs[id] = result.get();
+    return result;
+  }
+
+  StmtList stmts() {
+    StmtList result(m_in.get_count());
+    for (auto &stmt : result) {
+      stmt = required_stmt();
+    }
+    return result;
+  }
+
+  StmtPtr required_stmt() {
+    StmtPtr result = stmt();
+    if (!result) {
+      Decoder::corrupt();
+    }
+    return result;
+  }
+
+  StmtPtr stmt() {
+    auto const tag = m_in.get<uint8_t>();
+    if (tag == kNull) {
+      return nullptr;
+    }
+    switch (static_cast<StmtKind>(tag)) {
+    case StmtKind::EXPRESSION:
+      return std::make_unique<Expression>(required_expr());
+    case StmtKind::PRINT: {
+      Token const &keyword = token();
+      return std::make_unique<Print>(keyword, required_expr());
+    }
+    case StmtKind::VAR: {
+      Token const &name = token();
+      auto var = std::make_unique<Var>(name, expr());
+      var->m_slot = slot();
+      return var;
+    }
+    case StmtKind::BLOCK:
+      return std::make_unique<Block>(stmts());
+    case StmtKind::IF: {
+      Token const &keyword = token();
+      ExprPtr condition = required_expr();
+      StmtPtr then_branch = required_stmt();
+      return std::make_unique<If>(keyword, std::move(condition),
+                                  std::move(then_branch), stmt());
+    }
+    case StmtKind::WHILE: {
+      Token const &keyword = token();
+      ExprPtr condition = expr();
+      auto loop = std::make_unique<While>(keyword, std::move(condition),
+                                          required_stmt());
+      loop->m_hoisted = indexes();
+      return loop;
+    }
+    case StmtKind::FUNCTION:
+      return function();
+    case StmtKind::CLASS: {
+      Token const &name = token();
+      ExprPtr superclass = expr();
+      FunctionList methods(m_in.get_count());
+      for (auto &method : methods) {
+        method = function();
+      }
+      auto klass = std::make_unique<Class>(name, std::move(superclass),
+                                           std::move(methods));
+      klass->m_slot = slot();
+      return klass;
+    }
+    case StmtKind::RETURN: {
+      Token const &keyword = token();
+      auto result = std::make_unique<Return>(keyword, expr());
+      result->m_tail_call = m_in.get_bool();
+      return result;
+    }
+    default:
+      Decoder::corrupt();
+    }
+  }
+
+  FunctionPtr function() {
+    // Numbered before the nested functions, as written
+    auto const index = m_snapshot.m_functions.size();
+    m_snapshot.m_functions.push_back(nullptr);
+    Token const &name = token();
+    KTokenList params(m_in.get_count());
+    for (auto &param : params) {
+      param = &token();
+    }
+    auto function =
+        std::make_unique<Function>(name, std::move(params), stmts());
+    function->m_slot = slot();
+    function->m_frame_size = m_in.get<uint32_t>();
+    function->m_captures.resize(m_in.get_count());
+    for (auto &capture : function->m_captures) {
+      capture.kind = m_in.get<Capture::Kind>();
+      capture.index = m_in.get<uint32_t>();
+      if (capture.kind > Capture::Kind::UPVALUE) {
+        Decoder::corrupt();
+      }
+    }
+    function->m_boxed_params = indexes();
+    m_snapshot.m_functions[index] = function.get();
+    return function;
+  }
+
+  void read_names() {
+    std::unordered_set<std::string_view> names;
+    m_snapshot.m_names.resize(m_in.get_count());
+    for (auto &name : m_snapshot.m_names) {
+      name = m_in.get_string();
+      if (!names.insert(name).second) {
+        Decoder::corrupt();
+      }
+    }
+    if (m_snapshot.m_names.size() < m_snapshot.m_natives.size()) {
+      Decoder::corrupt();
+    }
+  }
+
+  /**
+   * @brief The number of an object written before `limit`, of `kind`.
+   */
+  uint32_t object(std::size_t limit, Object::Kind kind) {
+    uint32_t const index = m_in.get_index(limit);
+    if (m_snapshot.m_objects[index].kind != kind) {
+      Decoder::corrupt();
+    }
+    return index;
+  }
+
+  /**
+   * @brief `object()`, or `kNoObject`.
+   */
+  uint32_t optional_object(std::size_t limit, Object::Kind kind) {
+    uint32_t const index = m_in.get<uint32_t>();
+    if (index == kNoObject) {
+      return index;
+    } else if (index >= limit || m_snapshot.m_objects[index].kind != kind) {
+      Decoder::corrupt();
+    }
+    return index;
+  }
+
+  /**
+   * @brief The cells captured by `declaration`, written before `limit`.
+   */
+  std::vector<uint32_t> captures(std::size_t limit, uint32_t declaration) {
+    std::vector<uint32_t> result(m_in.get_count());
+    for (auto &capture : result) {
+      capture = object(limit, Object::Kind::CELL);
+    }
+    if (result.size() !=
+        m_snapshot.m_functions[declaration]->m_captures.size()) {
+      Decoder::corrupt();
+    }
+    return result;
+  }
+
+  void read_objects() {
+    auto &objects = m_snapshot.m_objects;
+    auto const count = m_in.get_count();
+    objects.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      std::size_t const limit = objects.size();
+      Record record{m_in.get<Object::Kind>()};
+      switch (record.kind) {
+      case Object::Kind::NATIVE:
+        record.index = m_in.get_index(m_snapshot.m_natives.size());
+        break;
+      case Object::Kind::CELL:
+      case Object::Kind::ARRAY:
+      case Object::Kind::MAP:
+        break;
+      case Object::Kind::INSTANCE:
+        record.index = object(limit, Object::Kind::CLASS);
+        break;
+      case Object::Kind::FUNCTION:
+        record.index = m_in.get_index(m_snapshot.m_functions.size());
+        record.owner = optional_object(limit, Object::Kind::CLASS);
+        record.captures = captures(limit, record.index);
+        break;
+      case Object::Kind::CLASS:
+        record.name = m_in.get_string();
+        record.owner = optional_object(limit, Object::Kind::CLASS);
+        record.methods.resize(m_in.get_count());
+        for (auto &method : record.methods) {
+          method.declaration = m_in.get_index(m_snapshot.m_functions.size());
+          method.captures = captures(limit, method.declaration);
+        }
+        break;
+      case Object::Kind::BOUND_METHOD: {
+        record.owner = m_in.get_index(limit);
+        record.index = object(limit, Object::Kind::CLASS);
+        record.name = m_in.get_string();
+        auto const &methods = objects[record.index].methods;
+        if (std::ranges::none_of(methods, [&](Method const &method) {
+              return m_snapshot.m_functions[method.declaration]
+                         ->m_name.lexeme() == record.name;
+            })) {
+          Decoder::corrupt();
+        }
+        break;
+      }
+      default:
+        Decoder::corrupt();
+      }
+      objects.push_back(std::move(record));
+    }
+  }
+
+  void read_fills() {
+    auto &objects = m_snapshot.m_objects;
+    for (auto i = m_in.get_count(); i > 0; --i) {
+      Record &record = objects[m_in.get_index(objects.size())];
+      if (!record.fields.empty()) {
+        Decoder::corrupt();
+      } else if (record.kind == Object::Kind::CELL) {
+        record.fields.push_back(Field{{}, value(objects.size())});
+      } else if (record.kind == Object::Kind::INSTANCE) {
+        record.fields.resize(m_in.get_count());
+        for (auto &field : record.fields) {
+          field.name = m_in.get_string();
+          field.value = value(objects.size());
+        }
+      } else if (record.kind == Object::Kind::ARRAY) {
+        record.fields.resize(m_in.get_count());
+        for (auto &field : record.fields) {
+          field.value = value(objects.size());
+        }
+      } else if (record.kind == Object::Kind::MAP) {
+        // Each key, then its value
+        record.fields.resize(2 * std::size_t{m_in.get_count()});
+        for (auto &field : record.fields) {
+          field.value = value(objects.size());
+        }
+      } else {
+        Decoder::corrupt();
+      }
+    }
+  }
+
+  void read_globals() {
+    auto &globals = m_snapshot.m_globals;
+    globals.resize(m_in.get_count());
+    if (globals.size() != m_snapshot.m_names.size()) {
+      Decoder::corrupt();
+    }
+    for (auto &global : globals) {
+      if (m_in.get_bool()) {
+        global = value(m_snapshot.m_objects.size());
+      }
+    }
+  }
+
+  /**
+   * @brief A value, which may refer to an object below `limit`.
+   */
+  Slot value(std::size_t limit) {
+    switch (m_in.get<ValueTag>()) {
+    case ValueTag::NIL:
+      return Slot{nullptr};
+    case ValueTag::FALSE:
+      return Slot{false};
+    case ValueTag::TRUE:
+      return Slot{true};
+    case ValueTag::NUMBER:
+      return Slot{m_in.get<double>()};
+    case ValueTag::STRING:
+      return Slot{std::string(m_in.get_string())};
+    case ValueTag::OBJECT:
+      return Slot{{}, m_in.get_index(limit)};
+    default:
+      Decoder::corrupt();
+    }
+  }
+
+private:
+  Snapshot &m_snapshot;
+  Decoder m_in;
+  /**
+   * The expressions built so far, by number, null until their children are
+   * built.
+   */
+  std::vector<Expr *> m_exprs;
+};
+
+void Snapshot::write(char const *pathname, Program const &program,
+                     SourceMap const &source_map, Globals const &globals,
+                     NativeRegistry const &natives) {
+  bool const matches = globals.size() == program.global_count &&
+                       natives.size() == program.native_count;
+  THROW_ASSERT(matches, "The globals are not those of the program.");
+
+  AstWriter ast(globals.size());
+  ast.write(program);
+  HeapWriter heap(natives, ast.functions());
+  Encoder values;
+  values.put(static_cast<uint32_t>(globals.size()));
+  for (auto const &global : globals) {
+    values.put(global.has_value());
+    if (global) {
+      heap.put_value(values, *global);
+    }
+  }
+  heap.fill();
+
+  Encoder out;
+  out.put_string(kMagic);
+  out.put(kVersion);
+  out.put(kByteOrder);
+  out.put(natives.size());
+  for (uint32_t i = 0; i < natives.size(); ++i) {
+    out.put_string(natives[i]->name());
+    out.put(natives[i]->arity());
+  }
+  auto const &line_starts = source_map.line_starts();
+  out.put(static_cast<uint32_t>(line_starts.size()));
+  for (uint32_t const line_start : line_starts) {
+    out.put(line_start);
+  }
+  out.put(ast.token_count());
+  out.append(ast.tokens());
+  out.append(ast.nodes());
+  out.put(static_cast<uint32_t>(globals.size()));
+  for (uint32_t i = 0; i < globals.size(); ++i) {
+    if (i < natives.size()) {
+      out.put_string(natives[i]->name());
+    } else if (!ast.name(i).empty()) {
+      out.put_string(ast.name(i));
+    } else {
+      // Dropped by the optimizer, and never to be referred to again
+      out.put_string('#' + std::to_string(i));
+    }
+  }
+  out.put(heap.object_count());
+  out.append(heap.objects());
+  out.put(heap.fill_count());
+  out.append(heap.fills());
+  out.append(values);
+
+  FILE *file = std::fopen(pathname, "wb");
+  if (file == nullptr) {
+    CHECK_ERRNO(-1, "open snapshot");
+  }
+  auto const &bytes = out.bytes();
+  bool const written =
+      std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  bool const closed = std::fclose(file) == 0;
+  if (!written || !closed) {
+    CHECK_ERRNO(-1, "write snapshot");
+  }
+}
+
+Snapshot::Snapshot(char const *pathname) {
+  int const fd = ::open(pathname, O_RDONLY | O_CLOEXEC);
+  CHECK_ERRNO(fd, "open snapshot");
+  struct stat status {};
+  if (::fstat(fd, &status) < 0) {
+    ::close(fd);
+    CHECK_ERRNO(-1, "stat snapshot");
+  } else if (status.st_size == 0) {
+    ::close(fd);
+    throw Exception("Not a snapshot.");
+  }
+  void *const data = ::mmap(nullptr, static_cast<std::size_t>(status.st_size),
+                            PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping outlives the descriptor
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    CHECK_ERRNO(-1, "map snapshot");
+  }
+  m_data = static_cast<char const *>(data);
+  m_size = static_cast<std::size_t>(status.st_size);
+
+  try {
+    Reader(*this).read();
+  } catch (...) {
+    ::munmap(const_cast<char *>(m_data), m_size);
+    throw;
+  }
+}
+
+Snapshot::~Snapshot() noexcept {
+  ::munmap(const_cast<char *>(m_data), m_size);
+}
+
+bool Snapshot::holds_native(uint32_t index) const noexcept {
+  auto const &global = m_globals[index];
+  return global && global->object != kNoObject &&
+         m_objects[global->object].kind == Object::Kind::NATIVE &&
+         m_objects[global->object].index == index;
+}
+
+void Snapshot::check_natives(NativeRegistry const &natives) const {
+  bool same = natives.size() == m_natives.size();
+  for (uint32_t i = 0; same && i < natives.size(); ++i) {
+    same = natives[i]->name() == m_natives[i].name &&
+           natives[i]->arity() == m_natives[i].arity;
+  }
+  THROW_ASSERT(same, "The snapshot was written with other natives.");
+}
+
+Snapshot::Globals
+Snapshot::instantiate(NativeRegistry const &natives,
+                      std::pmr::memory_resource *memory) const {
+  check_natives(natives);
+  std::pmr::polymorphic_allocator<> const allocator(memory);
+  auto const captures = [&](std::vector<uint32_t> const &cells,
+                            std::vector<ObjectPtr> const &objects) {
+    Captures result(memory);
+    result.reserve(cells.size());
+    for (uint32_t const cell : cells) {
+      result.push_back(std::static_pointer_cast<Cell>(objects[cell]));
+    }
+    return result;
+  };
+
+  // The records were checked when mapped, each comes after those it needs
+  std::vector<ObjectPtr> objects;
+  objects.reserve(m_objects.size());
+  for (auto const &record : m_objects) {
+    switch (record.kind) {
+    case Object::Kind::NATIVE:
+      objects.push_back(natives[record.index]);
+      break;
+    case Object::Kind::CELL:
+      objects.push_back(std::allocate_shared<Cell>(allocator, nullptr));
+      break;
+    case Object::Kind::ARRAY:
+      objects.push_back(std::allocate_shared<LoxArray>(allocator, memory));
+      break;
+    case Object::Kind::MAP:
+      objects.push_back(std::allocate_shared<LoxMap>(allocator, memory));
+      break;
+    case Object::Kind::INSTANCE:
+      objects.push_back(std::allocate_shared<LoxInstance>(
+          allocator, std::static_pointer_cast<LoxClass>(objects[record.index]),
+          memory));
+      break;
+    case Object::Kind::FUNCTION: {
+      auto const *klass =
+          record.owner != kNoObject
+              ? static_cast<LoxClass const *>(objects[record.owner].get())
+              : nullptr;
+      objects.push_back(std::allocate_shared<LoxFunction>(
+          allocator, *m_functions[record.index], klass, false,
+          captures(record.captures, objects)));
+      break;
+    }
+    case Object::Kind::CLASS: {
+      std::shared_ptr<LoxClass const> superclass;
+      if (record.owner != kNoObject) {
+        superclass = std::static_pointer_cast<LoxClass>(objects[record.owner]);
+      }
+      auto klass = std::allocate_shared<LoxClass>(allocator, record.name,
+                                                  std::move(superclass));
+      for (auto const &method : record.methods) {
+        klass->add_method(*m_functions[method.declaration],
+                          captures(method.captures, objects));
+      }
+      objects.push_back(std::move(klass));
+      break;
+    }
+    case Object::Kind::BOUND_METHOD: {
+      auto const &klass = static_cast<LoxClass const &>(*objects[record.index]);
+      objects.push_back(std::allocate_shared<BoundMethod>(
+          allocator, objects[record.owner],
+          *klass.methods().find(record.name)->second));
+      break;
+    }
+    }
+  }
+
+  for (std::size_t i = 0; i < m_objects.size(); ++i) {
+    auto const &record = m_objects[i];
+    if (record.kind == Object::Kind::CELL && !record.fields.empty()) {
+      static_cast<Cell &>(*objects[i]).value() =
+          value(record.fields.front().value, objects);
+    } else if (record.kind == Object::Kind::INSTANCE) {
+      auto &instance = static_cast<LoxInstance &>(*objects[i]);
+      for (auto const &field : record.fields) {
+        instance.add_field(instance.shape()->transition(field.name),
+                           value(field.value, objects));
+      }
+    } else if (record.kind == Object::Kind::ARRAY) {
+      auto &array = static_cast<LoxArray &>(*objects[i]);
+      for (auto const &field : record.fields) {
+        array.set(array.size(), value(field.value, objects));
+      }
+    } else if (record.kind == Object::Kind::MAP) {
+      auto &map = static_cast<LoxMap &>(*objects[i]);
+      for (std::size_t j = 0; j < record.fields.size(); j += 2) {
+        map.set(value(record.fields[j].value, objects),
+                value(record.fields[j + 1].value, objects));
+      }
+    }
+  }
+
+  Globals globals;
+  globals.reserve(m_globals.size());
+  for (auto const &global : m_globals) {
+    globals.push_back(global ? std::optional(value(*global, objects))
+                             : std::nullopt);
+  }
+  return globals;
+}
+
+Value Snapshot::value(Slot const &slot,
+                      std::vector<ObjectPtr> const &objects) {
+  if (slot.object != kNoObject) {
+    return objects[slot.object];
+  }
+  return slot.value;
+}
+
+} // namespace Lox
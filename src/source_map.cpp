@@ -0,0 +1,29 @@
+#include "source_map.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace Lox {
+
+SourceMap::SourceMap(std::string_view source) {
+  m_line_starts.push_back(0);
+  char const *const begin = source.data();
+  char const *const end = begin + source.size();
+  for (char const *pos = begin; pos != end; ++pos) {
+    pos = static_cast<char const *>(std::memchr(pos, '\n', end - pos));
+    if (pos == nullptr) {
+      break;
+    }
+    m_line_starts.push_back(pos + 1 - begin);
+  }
+}
+
+SourceLocation SourceMap::locate(uint32_t offset) const noexcept {
+  // The first line start after `offset` follows the line of `offset`
+  auto const iter =
+      std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset);
+  auto const line = static_cast<uint32_t>(iter - m_line_starts.begin());
+  return {line, offset - *(iter - 1) + 1};
+}
+
+} // namespace Lox
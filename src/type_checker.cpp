@@ -0,0 +1,343 @@
+#include "type_checker.h"
+
+#include "broadcast.h"
+#include "error.h"
+#include "object.h"
+
+namespace Lox {
+
+namespace {
+
+constexpr TypeSet kNumber{TypeSet::kNumber};
+constexpr TypeSet kBoolean{TypeSet::kBoolean};
+constexpr TypeSet kObject{TypeSet::kObject};
+constexpr TypeSet kAny{TypeSet::kAny};
+
+TypeSet type_of(Value const &value) {
+  if (value.is_number()) {
+    return kNumber;
+  }
+  if (value.is_string()) {
+    return {TypeSet::kString};
+  }
+  if (value.is_boolean()) {
+    return kBoolean;
+  }
+  if (value.is_nil()) {
+    return {TypeSet::kNil};
+  }
+  if (as_array(value) != nullptr) {
+    return {TypeSet::kArray};
+  }
+  return kObject;
+}
+
+} // namespace
+
+void TypeChecker::check(Program &program) {
+  check(program.statements);
+  if (program.result) {
+    check(*program.result);
+  }
+  m_locals.clear();
+}
+
+TypeSet TypeChecker::check(Expr &expr) {
+  dispatch(expr, *this);
+  return expr.m_type;
+}
+
+void TypeChecker::check(StmtList &stmts) {
+  for (auto &stmt : stmts) {
+    dispatch(*stmt, *this);
+  }
+}
+
+void TypeChecker::check_function(Function &function) {
+  Locals locals = std::move(m_locals);
+  m_locals.clear();
+  check(function.m_body);
+  m_locals = std::move(locals);
+}
+
+void TypeChecker::join(Locals const &other) {
+  for (auto it = m_locals.begin(); it != m_locals.end();) {
+    auto const found = other.find(it->first);
+    if (found == other.end()) {
+      it = m_locals.erase(it);
+      continue;
+    }
+    it->second = it->second | found->second;
+    ++it;
+  }
+}
+
+void TypeChecker::store(VariableSlot slot, TypeSet type) {
+  // Only the frame itself writes its locals, a closure writes boxed ones
+  if (slot.kind == VariableSlot::Kind::LOCAL) {
+    m_locals[slot.index] = type;
+  }
+}
+
+void TypeChecker::error(Token const &token, ErrorCode code) {
+  if (m_report) {
+    syntax_error(Diagnostic{code, token.offset(), &token});
+  }
+}
+
+void TypeChecker::visit(Literal &expr) {
+  switch (expr.m_token.type()) {
+  case TokenType::NUMBER:
+    expr.m_type = kNumber;
+    break;
+  case TokenType::STRING:
+    expr.m_type = {TypeSet::kString};
+    break;
+  case TokenType::TRUE:
+  case TokenType::FALSE:
+    expr.m_type = kBoolean;
+    break;
+  case TokenType::NIL:
+    expr.m_type = {TypeSet::kNil};
+    break;
+  default:
+    expr.m_type = kAny;
+    break;
+  }
+}
+
+void TypeChecker::visit(Binary &expr) {
+  TypeSet const left = check(*expr.m_left);
+  TypeSet const right = check(*expr.m_right);
+  expr.m_unchecked = false;
+  if (!broadcasts(expr.m_op.type())) {
+    expr.m_type = kBoolean;
+    return;
+  }
+  // An array and a number or another array, operated on element-wise
+  constexpr uint8_t kElementWise = TypeSet::kNumber | TypeSet::kArray;
+  bool const arrays =
+      (!left.never(TypeSet::kArray) && !right.never(kElementWise)) ||
+      (!right.never(TypeSet::kArray) && !left.never(kElementWise));
+  bool const numbers =
+      !left.never(TypeSet::kNumber) && !right.never(TypeSet::kNumber);
+  uint8_t const array_bits = arrays ? TypeSet::kArray : 0;
+  if (expr.m_op.type() == TokenType::PLUS) {
+    bool const strings =
+        !left.never(TypeSet::kString) && !right.never(TypeSet::kString);
+    if (!numbers && !strings && !arrays) {
+      error(expr.m_op, ErrorCode::TYPE_OPERANDS_MUST_BE_NUMBERS_OR_STRINGS);
+    }
+    expr.m_unchecked =
+        (left.only(TypeSet::kNumber) && right.only(TypeSet::kNumber)) ||
+        (left.only(TypeSet::kString) && right.only(TypeSet::kString));
+    expr.m_type = {static_cast<uint8_t>((numbers ? TypeSet::kNumber : 0) |
+                                        (strings ? TypeSet::kString : 0) |
+                                        array_bits)};
+    if (expr.m_type.bits == 0) {
+      expr.m_type = kNumber | TypeSet{TypeSet::kString};
+    }
+    return;
+  }
+  if (!numbers && !arrays) {
+    error(expr.m_op, ErrorCode::TYPE_OPERANDS_MUST_BE_NUMBERS);
+  }
+  expr.m_unchecked =
+      left.only(TypeSet::kNumber) && right.only(TypeSet::kNumber);
+  bool const comparison = expr.m_op.type() != TokenType::MINUS &&
+                          expr.m_op.type() != TokenType::STAR &&
+                          expr.m_op.type() != TokenType::SLASH;
+  TypeSet const scalar = comparison ? kBoolean : kNumber;
+  expr.m_type = {static_cast<uint8_t>((numbers ? scalar.bits : 0) |
+                                      array_bits)};
+  if (expr.m_type.bits == 0) {
+    expr.m_type = scalar;
+  }
+}
+
+void TypeChecker::visit(Unary &expr) {
+  TypeSet const operand = check(*expr.m_right);
+  expr.m_unchecked = false;
+  if (expr.m_op.type() == TokenType::BANG) {
+    expr.m_type = kBoolean;
+    return;
+  }
+  if (operand.never(TypeSet::kNumber)) {
+    error(expr.m_op, ErrorCode::TYPE_OPERAND_MUST_BE_NUMBER);
+  }
+  expr.m_unchecked = operand.only(TypeSet::kNumber);
+  expr.m_type = kNumber;
+}
+
+void TypeChecker::visit(Grouping &expr) { expr.m_type = check(*expr.m_expr); }
+
+void TypeChecker::visit(Logical &expr) {
+  TypeSet const left = check(*expr.m_left);
+  // The right operand may not run
+  Locals const locals = m_locals;
+  TypeSet const right = check(*expr.m_right);
+  join(locals);
+  expr.m_type = left | right;
+}
+
+void TypeChecker::visit(Constant &expr) { expr.m_type = type_of(expr.m_value); }
+
+void TypeChecker::visit(Hoisted &expr) { expr.m_type = check(*expr.m_expr); }
+
+void TypeChecker::visit(Shared &expr) {
+  // A reference reports nothing more than its owner: shared nodes only
+  // depend on their structure, their types too
+  bool const report = m_report;
+  m_report = report && expr.m_owner != nullptr;
+  expr.m_type = check(expr.m_expr);
+  m_report = report;
+}
+
+void TypeChecker::visit(Variable &expr) {
+  expr.m_type = kAny;
+  if (expr.m_slot.kind == VariableSlot::Kind::LOCAL) {
+    if (auto const it = m_locals.find(expr.m_slot.index);
+        it != m_locals.end()) {
+      expr.m_type = it->second;
+    }
+  }
+}
+
+void TypeChecker::visit(Assign &expr) {
+  expr.m_type = check(*expr.m_value);
+  store(expr.m_slot, expr.m_type);
+}
+
+void TypeChecker::visit(Call &expr) {
+  check(*expr.m_callee);
+  for (auto &argument : expr.m_arguments) {
+    check(*argument);
+  }
+  expr.m_type = kAny;
+}
+
+void TypeChecker::visit(Get &expr) {
+  check(*expr.m_object);
+  expr.m_type = kAny;
+}
+
+void TypeChecker::visit(Set &expr) {
+  check(*expr.m_object);
+  expr.m_type = check(*expr.m_value);
+}
+
+void TypeChecker::visit(Invoke &expr) {
+  check(*expr.m_object);
+  for (auto &argument : expr.m_arguments) {
+    check(*argument);
+  }
+  expr.m_type = kAny;
+}
+
+void TypeChecker::visit(Array &expr) {
+  for (auto &element : expr.m_elements) {
+    check(*element);
+  }
+  expr.m_type = {TypeSet::kArray};
+}
+
+void TypeChecker::visit(Map &expr) {
+  for (std::size_t i = 0; i < expr.m_keys.size(); ++i) {
+    check(*expr.m_keys[i]);
+    check(*expr.m_values[i]);
+  }
+  expr.m_type = kObject;
+}
+
+void TypeChecker::visit(Index &expr) {
+  check(*expr.m_object);
+  check(*expr.m_index);
+  expr.m_type = kAny;
+}
+
+void TypeChecker::visit(SetIndex &expr) {
+  check(*expr.m_object);
+  check(*expr.m_index);
+  expr.m_type = check(*expr.m_value);
+}
+
+void TypeChecker::visit(This &expr) { expr.m_type = kObject; }
+
+void TypeChecker::visit(Super &expr) { expr.m_type = kObject; }
+
+void TypeChecker::visit(Expression &stmt) { check(*stmt.m_expr); }
+
+void TypeChecker::visit(Print &stmt) { check(*stmt.m_expr); }
+
+void TypeChecker::visit(Var &stmt) {
+  // A declaration without initializer stores nil
+  TypeSet const type = stmt.m_initializer ? check(*stmt.m_initializer)
+                                          : TypeSet{TypeSet::kNil};
+  store(stmt.m_slot, type);
+}
+
+void TypeChecker::visit(Block &stmt) { check(stmt.m_statements); }
+
+void TypeChecker::visit(If &stmt) {
+  check(*stmt.m_condition);
+  Locals const locals = m_locals;
+  dispatch(*stmt.m_then_branch, *this);
+  if (stmt.m_else_branch) {
+    Locals then_locals = std::move(m_locals);
+    m_locals = locals;
+    dispatch(*stmt.m_else_branch, *this);
+    join(then_locals);
+  } else {
+    join(locals);
+  }
+}
+
+void TypeChecker::visit(While &stmt) {
+  // Widen the types at the head of the loop until an iteration changes none
+  // of them. Types only grow and are finite, this ends.
+  bool const report = m_report;
+  m_report = false;
+  while (true) {
+    Locals const head = m_locals;
+    if (stmt.m_condition) {
+      check(*stmt.m_condition);
+    }
+    dispatch(*stmt.m_body, *this);
+    join(head);
+    if (m_locals == head) {
+      break;
+    }
+  }
+  m_report = report;
+
+  // Then annotate the loop with the types of every iteration
+  if (stmt.m_condition) {
+    check(*stmt.m_condition);
+  }
+  Locals const exit = m_locals;
+  dispatch(*stmt.m_body, *this);
+  m_locals = exit;
+}
+
+void TypeChecker::visit(Function &stmt) {
+  store(stmt.m_slot, kObject);
+  check_function(stmt);
+}
+
+void TypeChecker::visit(Class &stmt) {
+  if (stmt.m_superclass) {
+    check(*stmt.m_superclass);
+  }
+  store(stmt.m_slot, kObject);
+  for (auto &method : stmt.m_methods) {
+    check_function(*method);
+  }
+}
+
+void TypeChecker::visit(Return &stmt) {
+  if (stmt.m_value) {
+    check(*stmt.m_value);
+  }
+}
+
+} // namespace Lox
@@ -1,25 +1,114 @@
 #include "value.h"
 #include "error.h"
+#include "number.h"
+#include "object.h"
 
+#include <cmath>
+#include <cstdint>
 #include <cstring>
+#include <functional>
+#include <limits>
 
 namespace Lox {
 
 bool operator==(Value const &lhs, Value const &rhs) {
+  if (lhs.is_string() && rhs.is_string()) {
+    return lhs.str_size() == rhs.str_size() && lhs.str() == rhs.str();
+  }
   return lhs.m_data == rhs.m_data;
 }
 
+Value concat(Value const &lhs, Value const &rhs,
+             std::pmr::memory_resource *memory) {
+  if (lhs.str_size() + rhs.str_size() < kRopeMinBytes) {
+    std::string str;
+    str.reserve(lhs.str_size() + rhs.str_size());
+    str += lhs.str();
+    str += rhs.str();
+    return str;
+  }
+  std::pmr::polymorphic_allocator<> const allocator(memory);
+  return std::allocate_shared<Rope const>(allocator, lhs.rope(memory),
+                                          rhs.rope(memory), memory);
+}
+
+Rope::Ptr Value::rope(std::pmr::memory_resource *memory) const {
+  if (auto const *rope = std::get_if<Rope::Ptr>(&m_data)) {
+    return *rope;
+  }
+  std::pmr::polymorphic_allocator<> const allocator(memory);
+  return std::allocate_shared<Rope const>(
+      allocator, std::get<std::string>(m_data), memory);
+}
+
+std::size_t Value::str_hash() const {
+  if (auto const *rope = std::get_if<Rope::Ptr>(&m_data)) {
+    return (*rope)->hash();
+  }
+  return std::hash<std::string_view>{}(std::get<std::string>(m_data));
+}
+
 bool operator!=(Value const &lhs, Value const &rhs) { return !(lhs == rhs); }
 
+bool same_key(Value const &lhs, Value const &rhs) {
+  if (lhs.is_number() && rhs.is_number()) {
+    double const x = lhs.unchecked_number();
+    double const y = rhs.unchecked_number();
+    return x == y || (std::isnan(x) && std::isnan(y));
+  }
+  return lhs == rhs;
+}
+
+namespace {
+
+/**
+ * @brief Mix the bits of `bits`, so that the low bits a table indexes by
+ *        depend on all of them (the finalizer of SplitMix64).
+ */
+constexpr uint64_t mix(uint64_t bits) noexcept {
+  bits = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  bits = (bits ^ (bits >> 27)) * 0x94d049bb133111ebULL;
+  return bits ^ (bits >> 31);
+}
+
+} // namespace
+
+std::size_t hash_key(Value const &value) {
+  if (value.is_number()) {
+    double number = value.unchecked_number();
+    if (number == 0) {
+      number = 0; // and not -0
+    } else if (std::isnan(number)) {
+      number = std::numeric_limits<double>::quiet_NaN();
+    }
+    uint64_t bits;
+    std::memcpy(&bits, &number, sizeof(bits));
+    return mix(bits);
+  }
+  if (value.is_string()) {
+    return value.str_hash();
+  }
+  if (value.is_object()) {
+    return mix(reinterpret_cast<uintptr_t>(value.object().get()));
+  }
+  if (value.is_boolean()) {
+    return mix(value.boolean() ? 2 : 1);
+  }
+  return mix(0);
+}
+
 std::ostream &operator<<(std::ostream &out, Value const &val) {
   if (val.is_nil()) {
     out << "nil";
   } else if (val.is_number()) {
-    out << val.number();
+    NumberBuffer buffer;
+    out << format_number(val.number(), buffer);
   } else if (val.is_string()) {
     out << val.str();
   } else if (val.is_boolean()) {
     out << (val.boolean() ? "true" : "false");
+  } else if (val.is_object()) {
+    val.object()->print(out);
   } else {
     out << "none";
   }
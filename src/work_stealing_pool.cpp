@@ -0,0 +1,132 @@
+#include "work_stealing_pool.h"
+#include "error.h"
+
+namespace Lox {
+
+namespace {
+
+/**
+ * The pool and the index of the worker running on this thread.
+ */
+thread_local WorkStealingPool *current_pool = nullptr;
+thread_local unsigned current_index = 0;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(unsigned n_workers) {
+  n_workers = n_workers == 0 ? 1 : n_workers;
+  for (unsigned i = 0; i < n_workers; ++i) {
+    m_workers.push_back(std::make_unique<Worker>());
+  }
+  for (unsigned i = 1; i < n_workers; ++i) {
+    m_threads.emplace_back(&WorkStealingPool::work, this, i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() noexcept {
+  {
+    std::lock_guard lock(m_idle_mutex);
+    m_stop = true;
+  }
+  m_idle.notify_all();
+  for (auto &thread : m_threads) {
+    thread.join();
+  }
+}
+
+void WorkStealingPool::run(std::function<void()> const &fn) {
+  THROW_ASSERT(current_pool == nullptr, "Nested WorkStealingPool::run().");
+  current_pool = this;
+  current_index = 0;
+  try {
+    fn();
+  } catch (...) {
+    current_pool = nullptr;
+    throw;
+  }
+  current_pool = nullptr;
+}
+
+void WorkStealingPool::fork(Task &task) {
+  THROW_ASSERT(current_pool == this, "Fork from outside of the pool.");
+  auto &worker = *m_workers[current_index];
+  {
+    std::lock_guard lock(worker.mutex);
+    worker.tasks.push_back(&task);
+  }
+  m_queued.fetch_add(1, std::memory_order_release);
+  {
+    // Taken so that the notification cannot slip in between the check of
+    // `m_queued` and the wait of an idle worker
+    std::lock_guard lock(m_idle_mutex);
+  }
+  m_idle.notify_one();
+}
+
+void WorkStealingPool::join(Task &task) {
+  while (!task.done.load(std::memory_order_acquire)) {
+    if (auto *other = take(current_index)) {
+      execute(*other);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  if (task.exception) {
+    std::rethrow_exception(task.exception);
+  }
+}
+
+void WorkStealingPool::work(unsigned index) {
+  current_pool = this;
+  current_index = index;
+  while (true) {
+    if (auto *task = take(index)) {
+      execute(*task);
+      continue;
+    }
+    std::unique_lock lock(m_idle_mutex);
+    m_idle.wait(lock, [this] {
+      return m_stop || m_queued.load(std::memory_order_acquire) > 0;
+    });
+    if (m_stop) {
+      return;
+    }
+  }
+}
+
+WorkStealingPool::Task *WorkStealingPool::take(unsigned index) {
+  if (m_queued.load(std::memory_order_acquire) == 0) {
+    return nullptr;
+  }
+
+  auto const n_workers = static_cast<unsigned>(m_workers.size());
+  for (unsigned i = 0; i < n_workers; ++i) {
+    auto &worker = *m_workers[(index + i) % n_workers];
+    std::lock_guard lock(worker.mutex);
+    if (worker.tasks.empty()) {
+      continue;
+    }
+    Task *task;
+    if (i == 0) {
+      task = worker.tasks.back();
+      worker.tasks.pop_back();
+    } else {
+      task = worker.tasks.front();
+      worker.tasks.pop_front();
+    }
+    m_queued.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+  }
+  return nullptr;
+}
+
+void WorkStealingPool::execute(Task &task) {
+  try {
+    task.fn();
+  } catch (...) {
+    task.exception = std::current_exception();
+  }
+  task.done.store(true, std::memory_order_release);
+}
+
+} // namespace Lox